@@ -0,0 +1,283 @@
+#ifndef PTK_QUADIFY_IN_MEMORY_HPP
+#define PTK_QUADIFY_IN_MEMORY_HPP
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <algorithm>
+
+// In memory quadification used by ptk_quadify_wkt and
+// shptk_quadify: every polygon is read in once and
+// clipped down the quadtree, only leaf tiles are written.
+//
+// The tools link different versions of clipper so it
+// has to be included before this header, along with
+// ClipperLib::ExPolygon(s) (clipper 5 doesn't have them,
+// see shptk_quadify.cpp). The clipper call itself is
+// passed in as a QuadClipFunc for the same reason.
+
+#define DBLMT 1E10
+
+struct BoundingBox
+{
+    double minLat;
+    double minLon;
+    double maxLat;
+    double maxLon;
+};
+
+inline bool calcAreaRectOverlap(double r1_bl_x, double r1_bl_y,
+                                double r1_tr_x, double r1_tr_y,
+                                double r2_bl_x, double r2_bl_y,
+                                double r2_tr_x, double r2_tr_y)
+{
+    // check if rectangles intersect
+    if((r1_tr_x < r2_bl_x) || (r1_bl_x > r2_tr_x) ||
+       (r1_tr_y < r2_bl_y) || (r1_bl_y > r2_tr_y))
+    {   return false;   }
+
+    return true;
+}
+
+inline BoundingBox getQuadKeyExtents(BoundingBox const &rootExtents,
+                                     std::string const &quadKey)
+{
+    BoundingBox myExtents;
+    myExtents = rootExtents;
+
+    if(quadKey.size() < 2)   {
+        return myExtents;
+    }
+
+    if(quadKey.size() % 2 != 0)   {
+        return myExtents;
+    }
+
+    for(size_t i=0; i < quadKey.size(); i+=2)
+    {
+        std::string quadrant = quadKey.substr(i,2);
+        double halfLonStep = (myExtents.maxLon-myExtents.minLon)/2;
+        double halfLatStep = (myExtents.maxLat-myExtents.minLat)/2;
+
+        // top left quadrant
+        if(quadrant.compare("00") == 0)   {
+            myExtents.maxLon -= halfLonStep;
+            myExtents.minLat += halfLatStep;
+        }
+        // top right quadrant
+        else if(quadrant.compare("01") == 0)   {
+            myExtents.minLon += halfLonStep;
+            myExtents.minLat += halfLatStep;
+        }
+        // bottom left quadrant
+        else if(quadrant.compare("10") == 0)   {
+            myExtents.maxLon -= halfLonStep;
+            myExtents.maxLat -= halfLatStep;
+        }
+        // bottom right quadrant
+        else if(quadrant.compare("11") == 0)   {
+            myExtents.minLon += halfLonStep;
+            myExtents.maxLat -= halfLatStep;
+        }
+    }
+
+    return myExtents;
+}
+
+// A polygon in clipper coords and its bounding box
+struct QuadItem
+{
+    ClipperLib::ExPolygon poly;
+    ClipperLib::long64 minX;
+    ClipperLib::long64 minY;
+    ClipperLib::long64 maxX;
+    ClipperLib::long64 maxY;
+};
+
+// Intersects the subject and clip polygons that have
+// been added to clipperObj
+typedef bool (*QuadClipFunc)(ClipperLib::Clipper &clipperObj,
+                             ClipperLib::ExPolygons &xsecPolys);
+
+// Writes the polygons of the leaf tile quadKey; called
+// from several threads at once
+typedef std::function<bool(std::string const &quadKey,
+                           std::vector<QuadItem> const &listItems)> QuadWriteFunc;
+
+inline void calcQuadItemBounds(QuadItem &item)
+{
+    // holes are within the outer ring
+    ClipperLib::Polygon const &outer = item.poly.outer;
+    item.minX = outer[0].X;   item.maxX = outer[0].X;
+    item.minY = outer[0].Y;   item.maxY = outer[0].Y;
+    for(size_t i=1; i < outer.size(); i++)   {
+        item.minX = std::min(item.minX,outer[i].X);
+        item.maxX = std::max(item.maxX,outer[i].X);
+        item.minY = std::min(item.minY,outer[i].Y);
+        item.maxY = std::max(item.maxY,outer[i].Y);
+    }
+}
+
+// Clips listItems against the given extents. Items that
+// are entirely within the extents are copied as is and
+// items that don't overlap them at all are skipped.
+inline void clipQuadItems(std::vector<QuadItem> const &listItems,
+                          BoundingBox const &extents,
+                          QuadClipFunc clipFunc,
+                          std::vector<QuadItem> &listClipped)
+{
+    ClipperLib::long64 const left = ClipperLib::long64(extents.minLon*DBLMT);
+    ClipperLib::long64 const right = ClipperLib::long64(extents.maxLon*DBLMT);
+    ClipperLib::long64 const btm = ClipperLib::long64(extents.minLat*DBLMT);
+    ClipperLib::long64 const top = ClipperLib::long64(extents.maxLat*DBLMT);
+
+    ClipperLib::Polygon gridCell;
+    gridCell.push_back(ClipperLib::IntPoint(left,top));
+    gridCell.push_back(ClipperLib::IntPoint(left,btm));
+    gridCell.push_back(ClipperLib::IntPoint(right,btm));
+    gridCell.push_back(ClipperLib::IntPoint(right,top));
+
+    for(size_t i=0; i < listItems.size(); i++)   {
+        QuadItem const &item = listItems[i];
+
+        if(!calcAreaRectOverlap(left,btm,right,top,
+                                item.minX,item.minY,
+                                item.maxX,item.maxY))
+        {   continue;   }
+
+        if(left <= item.minX && item.maxX <= right &&
+           btm <= item.minY && item.maxY <= top)
+        {
+            listClipped.push_back(item);
+            continue;
+        }
+
+        ClipperLib::Clipper clipperObj;
+        ClipperLib::ExPolygons xsecPolys;
+
+        clipperObj.AddPolygon(item.poly.outer,ClipperLib::ptSubject);
+        clipperObj.AddPolygons(item.poly.holes,ClipperLib::ptSubject);
+        clipperObj.AddPolygon(gridCell,ClipperLib::ptClip);
+
+        if(clipFunc(clipperObj,xsecPolys))   {
+            for(size_t x=0; x < xsecPolys.size(); x++)   {
+                if(xsecPolys[x].outer.empty())   {
+                    continue;
+                }
+                listClipped.push_back(QuadItem());
+                listClipped.back().poly = xsecPolys[x];
+                calcQuadItemBounds(listClipped.back());
+            }
+        }
+    }
+}
+
+// Recursively splits listItems into quadrants until
+// numLevels is reached; empty quadrants are dropped
+inline bool quadifyNode(BoundingBox const &extents,
+                        std::string const &quadKey,
+                        std::vector<QuadItem> const &listItems,
+                        size_t numLevels,
+                        QuadClipFunc clipFunc,
+                        QuadWriteFunc const &writeFunc)
+{
+    if(numLevels == 0)   {
+        return writeFunc(quadKey,listItems);
+    }
+
+    static char const * listQuadrants[4] = { "00","01","10","11" };
+    for(int q=0; q < 4; q++)   {
+        BoundingBox qExtents = getQuadKeyExtents(extents,listQuadrants[q]);
+
+        std::vector<QuadItem> listQItems;
+        clipQuadItems(listItems,qExtents,clipFunc,listQItems);
+        if(listQItems.empty())   {
+            continue;
+        }
+
+        if(!quadifyNode(qExtents,quadKey+listQuadrants[q],listQItems,
+                        numLevels-1,clipFunc,writeFunc))
+        {   return false;   }
+    }
+    return true;
+}
+
+// Splits listItems into the leaf tiles numLevels down
+// from rootExtents with numThreads threads. Progress is
+// printed as logPrefix + "Subtree ...".
+inline bool quadifyInMemory(std::vector<QuadItem> const &listItems,
+                            BoundingBox const &rootExtents,
+                            size_t numLevels,
+                            size_t numThreads,
+                            QuadClipFunc clipFunc,
+                            QuadWriteFunc const &writeFunc,
+                            std::string const &logPrefix)
+{
+    // Each thread takes a subtree rooted at taskLevel; the
+    // root polygons are clipped straight to the subtree's
+    // extents so there's no serial work at the top levels.
+    // Use enough subtrees to keep all threads busy even if
+    // the data is concentrated in a few of them.
+    size_t taskLevel = 1;
+    while(taskLevel < numLevels &&
+          (size_t(1) << (2*taskLevel)) < 4*numThreads)   {
+        taskLevel++;
+    }
+
+    std::vector<std::string> listTaskKeys(1,std::string());
+    for(size_t n=0; n < taskLevel; n++)   {
+        std::vector<std::string> listNextKeys;
+        for(size_t i=0; i < listTaskKeys.size(); i++)   {
+            listNextKeys.push_back(listTaskKeys[i]+"00");
+            listNextKeys.push_back(listTaskKeys[i]+"01");
+            listNextKeys.push_back(listTaskKeys[i]+"10");
+            listNextKeys.push_back(listTaskKeys[i]+"11");
+        }
+        listTaskKeys.swap(listNextKeys);
+    }
+
+    std::atomic<size_t> ixNextTask(0);
+    std::atomic<size_t> numTasksDone(0);
+    std::atomic<bool> failed(false);
+    std::mutex coutMutex;
+
+    std::vector<std::thread> listWorkers;
+    for(size_t t=0; t < numThreads; t++)   {
+        listWorkers.push_back(std::thread([&]() {
+            size_t ixTask;
+            while(!failed && (ixTask=ixNextTask++) < listTaskKeys.size())   {
+                std::string const &quadKey = listTaskKeys[ixTask];
+                BoundingBox tExtents = getQuadKeyExtents(rootExtents,quadKey);
+
+                std::vector<QuadItem> listTItems;
+                clipQuadItems(listItems,tExtents,clipFunc,listTItems);
+
+                bool ok = listTItems.empty() ||
+                        quadifyNode(tExtents,quadKey,listTItems,
+                                    numLevels-taskLevel,clipFunc,writeFunc);
+
+                std::lock_guard<std::mutex> lock(coutMutex);
+                if(!ok)   {
+                    failed = true;
+                }
+                else   {
+                    std::cout << logPrefix << "Subtree " << quadKey
+                              << " (" << listTItems.size() << " polygons), "
+                              << ++numTasksDone << "/" << listTaskKeys.size() << "\n";
+                }
+            }
+        }));
+    }
+
+    for(size_t t=0; t < listWorkers.size(); t++)   {
+        listWorkers[t].join();
+    }
+
+    return !failed;
+}
+
+#endif // PTK_QUADIFY_IN_MEMORY_HPP
@@ -0,0 +1,1130 @@
+#ifndef PTK_SIMPLE_POLY_TRIANGULATOR_HPP
+#define PTK_SIMPLE_POLY_TRIANGULATOR_HPP
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+// geom defs
+#include "Vec2.hpp"
+
+// mmap'd wkt/wkb reader
+#include "WktReader.hpp"
+
+// Triangulates polygons that are already valid and
+// simple by ear clipping, which is a lot faster than
+// repairing them with CGAL first.
+//
+// Ear clipping only gives the right triangles for
+// valid input, so every polygon is checked first:
+// * rings need at least three distinct points
+// * edges can't intersect or touch other than the
+//   shared point of neighbouring edges, and neighbours
+//   can't fold back onto each other
+// * holes must be inside the outer ring and can't be
+//   inside other holes
+// * polygons of a MULTIPOLYGON can't have overlapping
+//   bounding boxes
+// Anything that's close to failing a check (relative
+// to the size of the polygon) fails it, so Triangulate
+// returning false doesn't mean the polygon is invalid,
+// just that it has to go through the repair path. The
+// same goes for the rare polygon that ear clipping
+// gets stuck on because of rounding.
+//
+// Holes are bridged to the outer ring to make a single
+// ring, and once a ring is big enough the points are
+// also linked in z-order so ear tests only look at the
+// points near each ear (the same approach as mapbox's
+// earcut).
+//
+// Triangles are output with the original coordinates
+// of the polygon, three (counter clockwise) vertices
+// per triangle:
+//
+//   SimplePolyTriangulator triangulator;
+//   while(reader.ReadLine(valid))   {
+//       if(valid && triangulator.Triangulate(reader))   {
+//           std::vector<Vec2> const &listTriVx =
+//                   triangulator.GetTriangles();
+//           ...
+//       }
+//       else   {
+//           // repair with CGAL
+//       }
+//   }
+
+// points closer than this (in units of the largest
+// side of the polygon's bounding box) aren't distinct
+#define K_SPT_MIN_DIST 1E-9
+
+// orientations smaller than this are collinear
+#define K_SPT_ORIENT_EPS 1E-12
+
+// give up on polygons that need more than this many
+// edge pair tests per edge (ie. the sweep degenerates)
+#define K_SPT_MAX_TESTS_PER_EDGE 1024
+
+// rings with more points than this use z-order hashing
+#define K_SPT_MIN_HASHED_PTS 80
+
+// the triangles must add up to the area of the polygon
+// to within this fraction
+#define K_SPT_AREA_EPS 1E-6
+
+class SimplePolyTriangulator
+{
+public:
+    SimplePolyTriangulator() :
+        m_hashed(false)
+    {}
+
+    // Triangulates every polygon of the reader's current
+    // line; returns false (with no triangles) if any of
+    // them fail the checks or can't be triangulated
+    bool Triangulate(WktReader const &reader)
+    {
+        m_listTriVx.clear();
+
+        size_t const numPolys = reader.GetNumPolygons();
+        if(numPolys == 0)   {
+            return false;
+        }
+
+        if(numPolys > 1)   {
+            m_listBounds.resize(numPolys);
+            for(size_t i=0; i < numPolys; i++)   {
+                if(!calcBounds(reader.GetPolygon(i),m_listBounds[i]))   {
+                    return false;
+                }
+            }
+            if(!checkBoundsDisjoint(m_listBounds))   {
+                return false;
+            }
+        }
+
+        for(size_t i=0; i < numPolys; i++)   {
+            if(!appendTriangles(reader.GetPolygon(i)))   {
+                m_listTriVx.clear();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Triangulates a single polygon
+    bool Triangulate(WktPolygon const &poly)
+    {
+        m_listTriVx.clear();
+        if(!appendTriangles(poly))   {
+            m_listTriVx.clear();
+            return false;
+        }
+        return true;
+    }
+
+    std::vector<Vec2> const & GetTriangles() const
+    {
+        return m_listTriVx;
+    }
+
+private:
+    struct Bounds
+    {
+        double minX,minY,maxX,maxY;
+    };
+
+    struct Edge
+    {
+        size_t a,b;         // point indices
+        size_t ring;
+        double minS,maxS;   // extents on the sweep axis
+        double minT,maxT;   // extents on the other axis
+    };
+
+    static bool compareEdgeMinS(Edge const &first, Edge const &second)
+    {
+        return (first.minS < second.minS);
+    }
+
+    static bool compareBoundsMinX(Bounds const &first, Bounds const &second)
+    {
+        return (first.minX < second.minX);
+    }
+
+    static bool calcBounds(WktPolygon const &poly, Bounds &bounds)
+    {
+        // the outer ring bounds the polygon
+        if(poly.GetNumRings() == 0 || poly.GetRingSize(0) == 0)   {
+            return false;
+        }
+        double const * px = poly.GetRingX(0);
+        double const * py = poly.GetRingY(0);
+        size_t const numPts = poly.GetRingSize(0);
+
+        bounds.minX = px[0]; bounds.maxX = px[0];
+        bounds.minY = py[0]; bounds.maxY = py[0];
+        for(size_t i=1; i < numPts; i++)   {
+            bounds.minX = std::min(bounds.minX,px[i]);
+            bounds.maxX = std::max(bounds.maxX,px[i]);
+            bounds.minY = std::min(bounds.minY,py[i]);
+            bounds.maxY = std::max(bounds.maxY,py[i]);
+        }
+        return true;
+    }
+
+    static bool checkBoundsDisjoint(std::vector<Bounds> &listBounds)
+    {
+        std::sort(listBounds.begin(),listBounds.end(),compareBoundsMinX);
+        for(size_t i=0; i < listBounds.size(); i++)   {
+            Bounds const &bi = listBounds[i];
+            for(size_t j=i+1; j < listBounds.size(); j++)   {
+                Bounds const &bj = listBounds[j];
+                if(bj.minX > bi.maxX)   {
+                    break;
+                }
+                if(bj.minY <= bi.maxY && bj.maxY >= bi.minY)   {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    static double calcOrient(Vec2 const &a,
+                             Vec2 const &b,
+                             Vec2 const &c)
+    {
+        return (b.x-a.x)*(c.y-a.y) - (b.y-a.y)*(c.x-a.x);
+    }
+
+    // builds the normalized points of each ring without
+    // closing points or repeated points
+    bool buildRings(WktPolygon const &poly)
+    {
+        m_listPts.clear();
+        m_listOrigPts.clear();
+        m_listRingOffsets.clear();
+
+        size_t const numRings = poly.GetNumRings();
+        if(numRings == 0 || poly.GetRingSize(0) == 0)   {
+            return false;
+        }
+
+        // translate and scale the polygon to its bounding
+        // box so the epsilons are relative to its size
+        Bounds bounds;
+        calcBounds(poly,bounds);
+        double const extent = std::max(bounds.maxX-bounds.minX,
+                                       bounds.maxY-bounds.minY);
+        if(!(extent > 0))   {
+            return false;
+        }
+        double const scale = 1.0/extent;
+        double const minDist2 = K_SPT_MIN_DIST*K_SPT_MIN_DIST;
+
+        m_listPts.reserve(poly.listX.size());
+        m_listOrigPts.reserve(poly.listX.size());
+
+        for(size_t i=0; i < numRings; i++)   {
+            double const * px = poly.GetRingX(i);
+            double const * py = poly.GetRingY(i);
+            size_t numPts = poly.GetRingSize(i);
+
+            size_t const ringBegin = m_listPts.size();
+            m_listRingOffsets.push_back(ringBegin);
+
+            for(size_t j=0; j < numPts; j++)   {
+                if(!(std::isfinite(px[j]) && std::isfinite(py[j])))   {
+                    return false;
+                }
+                if(m_listPts.size() > ringBegin &&
+                   px[j] == m_listOrigPts.back().x &&
+                   py[j] == m_listOrigPts.back().y)   {
+                    continue;
+                }
+                m_listOrigPts.push_back(Vec2(px[j],py[j]));
+                m_listPts.push_back(Vec2((px[j]-bounds.minX)*scale,
+                                         (py[j]-bounds.minY)*scale));
+            }
+
+            // drop the closing point
+            if(m_listPts.size()-ringBegin > 1 &&
+               m_listOrigPts.back().x == m_listOrigPts[ringBegin].x &&
+               m_listOrigPts.back().y == m_listOrigPts[ringBegin].y)   {
+                m_listPts.pop_back();
+                m_listOrigPts.pop_back();
+            }
+
+            size_t const ringSize = m_listPts.size()-ringBegin;
+            if(ringSize < 3)   {
+                return false;
+            }
+
+            // points that are distinct but too close
+            for(size_t j=0; j < ringSize; j++)   {
+                Vec2 const &p = m_listPts[ringBegin+j];
+                Vec2 const &q = m_listPts[ringBegin+(j+1)%ringSize];
+                double const dx = q.x-p.x;
+                double const dy = q.y-p.y;
+                if(dx*dx+dy*dy < minDist2)   {
+                    return false;
+                }
+            }
+        }
+        m_listRingOffsets.push_back(m_listPts.size());
+        return true;
+    }
+
+    bool checkEdgePair(Edge const &e0, Edge const &e1)
+    {
+        Vec2 const &a = m_listPts[e0.a];
+        Vec2 const &b = m_listPts[e0.b];
+        Vec2 const &c = m_listPts[e1.a];
+        Vec2 const &d = m_listPts[e1.b];
+
+        // neighbouring edges share a point and are fine
+        // as long as they don't fold back onto each other
+        if(e0.b == e1.a || e1.b == e0.a)   {
+            bool const e0First = (e0.b == e1.a);
+            Vec2 const &p = e0First ? a : c;   // start
+            Vec2 const &q = e0First ? b : d;   // shared
+            Vec2 const &r = e0First ? d : b;   // end
+            if(e0First && e1.b == e0.a)   {
+                // two point ring, can't happen (rings
+                // have at least three points)
+                return false;
+            }
+            double const orient = calcOrient(p,q,r);
+            if(std::fabs(orient) < K_SPT_ORIENT_EPS)   {
+                double const dot = (p.x-q.x)*(r.x-q.x) + (p.y-q.y)*(r.y-q.y);
+                if(dot > 0)   {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // otherwise the edges must be clearly apart
+        double const o1 = calcOrient(a,b,c);
+        double const o2 = calcOrient(a,b,d);
+        if((o1 > K_SPT_ORIENT_EPS && o2 > K_SPT_ORIENT_EPS) ||
+           (o1 < -K_SPT_ORIENT_EPS && o2 < -K_SPT_ORIENT_EPS))   {
+            return true;
+        }
+        double const o3 = calcOrient(c,d,a);
+        double const o4 = calcOrient(c,d,b);
+        if((o3 > K_SPT_ORIENT_EPS && o4 > K_SPT_ORIENT_EPS) ||
+           (o3 < -K_SPT_ORIENT_EPS && o4 < -K_SPT_ORIENT_EPS))   {
+            return true;
+        }
+        return false;
+    }
+
+    // checks every pair of edges with overlapping bounds
+    // by sweeping along the longer axis of the polygon
+    bool checkEdges()
+    {
+        double minX = m_listPts[0].x, maxX = minX;
+        double minY = m_listPts[0].y, maxY = minY;
+        for(size_t i=1; i < m_listPts.size(); i++)   {
+            minX = std::min(minX,m_listPts[i].x);
+            maxX = std::max(maxX,m_listPts[i].x);
+            minY = std::min(minY,m_listPts[i].y);
+            maxY = std::max(maxY,m_listPts[i].y);
+        }
+        bool const sweepX = ((maxX-minX) >= (maxY-minY));
+
+        m_listEdges.clear();
+        m_listEdges.reserve(m_listPts.size());
+        for(size_t i=0; i+1 < m_listRingOffsets.size(); i++)   {
+            size_t const ringBegin = m_listRingOffsets[i];
+            size_t const ringEnd = m_listRingOffsets[i+1];
+            for(size_t j=ringBegin; j < ringEnd; j++)   {
+                Edge edge;
+                edge.a = j;
+                edge.b = (j+1 == ringEnd) ? ringBegin : j+1;
+                edge.ring = i;
+
+                Vec2 const &a = m_listPts[edge.a];
+                Vec2 const &b = m_listPts[edge.b];
+                double const as = sweepX ? a.x : a.y;
+                double const at = sweepX ? a.y : a.x;
+                double const bs = sweepX ? b.x : b.y;
+                double const bt = sweepX ? b.y : b.x;
+                edge.minS = std::min(as,bs) - K_SPT_MIN_DIST;
+                edge.maxS = std::max(as,bs) + K_SPT_MIN_DIST;
+                edge.minT = std::min(at,bt) - K_SPT_MIN_DIST;
+                edge.maxT = std::max(at,bt) + K_SPT_MIN_DIST;
+                m_listEdges.push_back(edge);
+            }
+        }
+        std::sort(m_listEdges.begin(),m_listEdges.end(),compareEdgeMinS);
+
+        size_t numTests = 0;
+        size_t const maxTests = m_listEdges.size()*K_SPT_MAX_TESTS_PER_EDGE;
+        for(size_t i=0; i < m_listEdges.size(); i++)   {
+            Edge const &ei = m_listEdges[i];
+            for(size_t j=i+1; j < m_listEdges.size(); j++)   {
+                Edge const &ej = m_listEdges[j];
+                if(ej.minS > ei.maxS)   {
+                    break;
+                }
+                numTests++;
+                if(numTests > maxTests)   {
+                    return false;
+                }
+                if(ej.minT > ei.maxT || ej.maxT < ei.minT)   {
+                    continue;
+                }
+                if(!checkEdgePair(ei,ej))   {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    bool calcPointInRing(Vec2 const &pt, size_t ring) const
+    {
+        // crossing number test
+        size_t const ringBegin = m_listRingOffsets[ring];
+        size_t const ringEnd = m_listRingOffsets[ring+1];
+
+        bool inside = false;
+        for(size_t i=ringBegin, j=ringEnd-1; i < ringEnd; j=i++)   {
+            Vec2 const &a = m_listPts[i];
+            Vec2 const &b = m_listPts[j];
+            if((a.y > pt.y) != (b.y > pt.y))   {
+                double const x = a.x + (pt.y-a.y)*(b.x-a.x)/(b.y-a.y);
+                if(pt.x < x)   {
+                    inside = !inside;
+                }
+            }
+        }
+        return inside;
+    }
+
+    // since no edges cross or touch a ring is inside
+    // another ring if any one of its points is
+    bool checkHoles()
+    {
+        size_t const numRings = m_listRingOffsets.size()-1;
+        if(numRings == 1)   {
+            return true;
+        }
+
+        m_listHoleBounds.clear();
+        for(size_t i=1; i < numRings; i++)   {
+            Vec2 const &pt = m_listPts[m_listRingOffsets[i]];
+            if(!calcPointInRing(pt,0))   {
+                return false;
+            }
+
+            Bounds bounds;
+            bounds.minX = pt.x; bounds.maxX = pt.x;
+            bounds.minY = pt.y; bounds.maxY = pt.y;
+            for(size_t j=m_listRingOffsets[i]; j < m_listRingOffsets[i+1]; j++)   {
+                bounds.minX = std::min(bounds.minX,m_listPts[j].x);
+                bounds.maxX = std::max(bounds.maxX,m_listPts[j].x);
+                bounds.minY = std::min(bounds.minY,m_listPts[j].y);
+                bounds.maxY = std::max(bounds.maxY,m_listPts[j].y);
+            }
+            m_listHoleBounds.push_back(std::make_pair(bounds,i));
+        }
+
+        // a hole can only be inside another hole
+        // if its bounds are inside the other's too
+        std::sort(m_listHoleBounds.begin(),m_listHoleBounds.end(),compareHoleBoundsMinX);
+        for(size_t i=0; i < m_listHoleBounds.size(); i++)   {
+            Bounds const &bi = m_listHoleBounds[i].first;
+            for(size_t j=i+1; j < m_listHoleBounds.size(); j++)   {
+                Bounds const &bj = m_listHoleBounds[j].first;
+                if(bj.minX > bi.maxX)   {
+                    break;
+                }
+                if(bj.maxX <= bi.maxX && bj.minY >= bi.minY && bj.maxY <= bi.maxY)   {
+                    size_t const ringI = m_listHoleBounds[i].second;
+                    size_t const ringJ = m_listHoleBounds[j].second;
+                    Vec2 const &pt = m_listPts[m_listRingOffsets[ringJ]];
+                    if(calcPointInRing(pt,ringI))   {
+                        return false;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    static bool compareHoleBoundsMinX(std::pair<Bounds,size_t> const &first,
+                                      std::pair<Bounds,size_t> const &second)
+    {
+        return (first.first.minX < second.first.minX);
+    }
+
+    // ear clipping; the nodes of the rings are kept in
+    // doubly linked lists stored in m_listNodes
+
+    struct EarNode
+    {
+        double x,y;
+        size_t pt;          // index into m_listPts
+        uint32_t z;         // z-order of the point
+        int prev,next;      // ring
+        int prevZ,nextZ;    // z-order (-1 at the ends)
+    };
+
+    double calcOrient(int a, int b, int c) const
+    {
+        EarNode const &na = m_listNodes[a];
+        EarNode const &nb = m_listNodes[b];
+        EarNode const &nc = m_listNodes[c];
+        return (nb.x-na.x)*(nc.y-na.y) - (nb.y-na.y)*(nc.x-na.x);
+    }
+
+    bool equalNodes(int a, int b) const
+    {
+        return (m_listNodes[a].x == m_listNodes[b].x &&
+                m_listNodes[a].y == m_listNodes[b].y);
+    }
+
+    int prev(int n) const
+    {
+        return m_listNodes[n].prev;
+    }
+
+    int next(int n) const
+    {
+        return m_listNodes[n].next;
+    }
+
+    static bool calcPointInTri(double ax, double ay,
+                               double bx, double by,
+                               double cx, double cy,
+                               double px, double py)
+    {
+        // inclusive, for counter clockwise triangles
+        return ((cx-px)*(ay-py) >= (ax-px)*(cy-py) &&
+                (ax-px)*(by-py) >= (bx-px)*(ay-py) &&
+                (bx-px)*(cy-py) >= (cx-px)*(by-py));
+    }
+
+    static uint32_t calcZOrder(double x, double y)
+    {
+        // points are normalized to [0,1]
+        uint32_t zx = static_cast<uint32_t>(x*32767.0);
+        uint32_t zy = static_cast<uint32_t>(y*32767.0);
+
+        zx = (zx | (zx << 8)) & 0x00FF00FF;
+        zx = (zx | (zx << 4)) & 0x0F0F0F0F;
+        zx = (zx | (zx << 2)) & 0x33333333;
+        zx = (zx | (zx << 1)) & 0x55555555;
+
+        zy = (zy | (zy << 8)) & 0x00FF00FF;
+        zy = (zy | (zy << 4)) & 0x0F0F0F0F;
+        zy = (zy | (zy << 2)) & 0x33333333;
+        zy = (zy | (zy << 1)) & 0x55555555;
+
+        return (zx | (zy << 1));
+    }
+
+    int insertNode(size_t pt, int last)
+    {
+        int const n = m_listNodes.size();
+
+        EarNode node;
+        node.x = m_listPts[pt].x;
+        node.y = m_listPts[pt].y;
+        node.pt = pt;
+        node.z = 0;
+        node.prevZ = -1;
+        node.nextZ = -1;
+        if(last < 0)   {
+            node.prev = n;
+            node.next = n;
+        }
+        else   {
+            node.prev = last;
+            node.next = m_listNodes[last].next;
+            m_listNodes[node.next].prev = n;
+            m_listNodes[last].next = n;
+        }
+        m_listNodes.push_back(node);
+        return n;
+    }
+
+    void removeNode(int n)
+    {
+        EarNode const &node = m_listNodes[n];
+        m_listNodes[node.next].prev = node.prev;
+        m_listNodes[node.prev].next = node.next;
+        if(node.prevZ >= 0)   {
+            m_listNodes[node.prevZ].nextZ = node.nextZ;
+        }
+        if(node.nextZ >= 0)   {
+            m_listNodes[node.nextZ].prevZ = node.prevZ;
+        }
+    }
+
+    // links a ring so it winds counter clockwise (the
+    // outer ring) or clockwise (holes)
+    int linkRing(size_t ring, bool ccw)
+    {
+        size_t const ringBegin = m_listRingOffsets[ring];
+        size_t const ringEnd = m_listRingOffsets[ring+1];
+
+        double area = 0;
+        for(size_t i=ringBegin, j=ringEnd-1; i < ringEnd; j=i++)   {
+            area += (m_listPts[j].x*m_listPts[i].y) - (m_listPts[i].x*m_listPts[j].y);
+        }
+
+        int last = -1;
+        if((area > 0) == ccw)   {
+            for(size_t i=ringBegin; i < ringEnd; i++)   {
+                last = insertNode(i,last);
+            }
+        }
+        else   {
+            for(size_t i=ringEnd; i > ringBegin; i--)   {
+                last = insertNode(i-1,last);
+            }
+        }
+        return last;
+    }
+
+    // removes repeated and collinear points
+    int filterPoints(int start, int end=-1)
+    {
+        if(start < 0)   {
+            return start;
+        }
+        if(end < 0)   {
+            end = start;
+        }
+
+        int p = start;
+        bool again;
+        do   {
+            again = false;
+            if(equalNodes(p,next(p)) || calcOrient(prev(p),p,next(p)) == 0)   {
+                removeNode(p);
+                p = end = prev(p);
+                if(p == next(p))   {
+                    break;
+                }
+                again = true;
+            }
+            else   {
+                p = next(p);
+            }
+        }
+        while(again || p != end);
+
+        return end;
+    }
+
+    // links the nodes of a ring in z-order
+    void indexCurve(int start)
+    {
+        m_listZNodes.clear();
+        int p = start;
+        do   {
+            EarNode &node = m_listNodes[p];
+            if(node.z == 0)   {
+                node.z = calcZOrder(node.x,node.y);
+            }
+            m_listZNodes.push_back(p);
+            p = node.next;
+        }
+        while(p != start);
+
+        std::vector<EarNode> const &listNodes = m_listNodes;
+        std::sort(m_listZNodes.begin(),m_listZNodes.end(),[&](int a, int b) {
+            return (listNodes[a].z < listNodes[b].z);
+        });
+
+        for(size_t i=0; i < m_listZNodes.size(); i++)   {
+            EarNode &node = m_listNodes[m_listZNodes[i]];
+            node.prevZ = (i > 0) ? m_listZNodes[i-1] : -1;
+            node.nextZ = (i+1 < m_listZNodes.size()) ? m_listZNodes[i+1] : -1;
+        }
+    }
+
+    // an ear can't contain any (reflex) points of the ring
+    bool isEarPoint(int a, int b, int c, int p,
+                    double minX, double minY,
+                    double maxX, double maxY) const
+    {
+        EarNode const &na = m_listNodes[a];
+        EarNode const &nb = m_listNodes[b];
+        EarNode const &nc = m_listNodes[c];
+        EarNode const &np = m_listNodes[p];
+        return (np.x >= minX && np.x <= maxX &&
+                np.y >= minY && np.y <= maxY &&
+                calcPointInTri(na.x,na.y,nb.x,nb.y,nc.x,nc.y,np.x,np.y) &&
+                calcOrient(np.prev,p,np.next) <= 0);
+    }
+
+    bool isEar(int ear) const
+    {
+        int const a = prev(ear);
+        int const c = next(ear);
+        if(calcOrient(a,ear,c) <= 0)   {
+            return false;   // reflex
+        }
+
+        EarNode const &na = m_listNodes[a];
+        EarNode const &nb = m_listNodes[ear];
+        EarNode const &nc = m_listNodes[c];
+        double const minX = std::min(na.x,std::min(nb.x,nc.x));
+        double const minY = std::min(na.y,std::min(nb.y,nc.y));
+        double const maxX = std::max(na.x,std::max(nb.x,nc.x));
+        double const maxY = std::max(na.y,std::max(nb.y,nc.y));
+
+        for(int p=next(c); p != a; p=next(p))   {
+            if(isEarPoint(a,ear,c,p,minX,minY,maxX,maxY))   {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool isEarHashed(int ear) const
+    {
+        int const a = prev(ear);
+        int const c = next(ear);
+        if(calcOrient(a,ear,c) <= 0)   {
+            return false;   // reflex
+        }
+
+        EarNode const &na = m_listNodes[a];
+        EarNode const &nb = m_listNodes[ear];
+        EarNode const &nc = m_listNodes[c];
+        double const minX = std::min(na.x,std::min(nb.x,nc.x));
+        double const minY = std::min(na.y,std::min(nb.y,nc.y));
+        double const maxX = std::max(na.x,std::max(nb.x,nc.x));
+        double const maxY = std::max(na.y,std::max(nb.y,nc.y));
+
+        // only points within the z-order range of the
+        // ear's bounding box need to be checked
+        uint32_t const minZ = calcZOrder(minX,minY);
+        uint32_t const maxZ = calcZOrder(maxX,maxY);
+
+        int p = nb.prevZ;
+        while(p >= 0 && m_listNodes[p].z >= minZ)   {
+            if(p != a && p != c && isEarPoint(a,ear,c,p,minX,minY,maxX,maxY))   {
+                return false;
+            }
+            p = m_listNodes[p].prevZ;
+        }
+
+        int n = nb.nextZ;
+        while(n >= 0 && m_listNodes[n].z <= maxZ)   {
+            if(n != a && n != c && isEarPoint(a,ear,c,n,minX,minY,maxX,maxY))   {
+                return false;
+            }
+            n = m_listNodes[n].nextZ;
+        }
+        return true;
+    }
+
+    static int calcSign(double v)
+    {
+        return (v > 0) - (v < 0);
+    }
+
+    bool isOnSegment(int p, int q, int r) const
+    {
+        // q is on segment pr (given they're collinear)
+        EarNode const &np = m_listNodes[p];
+        EarNode const &nq = m_listNodes[q];
+        EarNode const &nr = m_listNodes[r];
+        return (nq.x <= std::max(np.x,nr.x) && nq.x >= std::min(np.x,nr.x) &&
+                nq.y <= std::max(np.y,nr.y) && nq.y >= std::min(np.y,nr.y));
+    }
+
+    bool intersects(int p1, int q1, int p2, int q2) const
+    {
+        int const o1 = calcSign(calcOrient(p1,q1,p2));
+        int const o2 = calcSign(calcOrient(p1,q1,q2));
+        int const o3 = calcSign(calcOrient(p2,q2,p1));
+        int const o4 = calcSign(calcOrient(p2,q2,q1));
+
+        if(o1 != o2 && o3 != o4)   {
+            return true;
+        }
+        return ((o1 == 0 && isOnSegment(p1,p2,q1)) ||
+                (o2 == 0 && isOnSegment(p1,q2,q1)) ||
+                (o3 == 0 && isOnSegment(p2,p1,q2)) ||
+                (o4 == 0 && isOnSegment(p2,q1,q2)));
+    }
+
+    bool intersectsRing(int a, int b) const
+    {
+        size_t const ptA = m_listNodes[a].pt;
+        size_t const ptB = m_listNodes[b].pt;
+        int p = a;
+        do   {
+            int const pn = next(p);
+            size_t const pt = m_listNodes[p].pt;
+            size_t const ptNext = m_listNodes[pn].pt;
+            if(pt != ptA && ptNext != ptA && pt != ptB && ptNext != ptB &&
+               intersects(p,pn,a,b))   {
+                return true;
+            }
+            p = pn;
+        }
+        while(p != a);
+        return false;
+    }
+
+    // the diagonal ab is inside the ring locally at a
+    bool isLocallyInside(int a, int b) const
+    {
+        if(calcOrient(prev(a),a,next(a)) > 0)   {
+            return (calcOrient(a,b,next(a)) <= 0 && calcOrient(a,prev(a),b) <= 0);
+        }
+        return (calcOrient(a,b,prev(a)) > 0 || calcOrient(a,next(a),b) > 0);
+    }
+
+    bool isMiddleInside(int a, int b) const
+    {
+        double const px = (m_listNodes[a].x + m_listNodes[b].x)*0.5;
+        double const py = (m_listNodes[a].y + m_listNodes[b].y)*0.5;
+
+        bool inside = false;
+        int p = a;
+        do   {
+            EarNode const &np = m_listNodes[p];
+            EarNode const &nn = m_listNodes[np.next];
+            if(((np.y > py) != (nn.y > py)) && nn.y != np.y &&
+               (px < (nn.x-np.x)*(py-np.y)/(nn.y-np.y) + np.x))   {
+                inside = !inside;
+            }
+            p = np.next;
+        }
+        while(p != a);
+        return inside;
+    }
+
+    bool isValidDiagonal(int a, int b) const
+    {
+        size_t const ptB = m_listNodes[b].pt;
+        if(m_listNodes[next(a)].pt == ptB ||
+           m_listNodes[prev(a)].pt == ptB ||
+           intersectsRing(a,b))   {
+            return false;
+        }
+        if(isLocallyInside(a,b) && isLocallyInside(b,a) && isMiddleInside(a,b) &&
+           (calcOrient(prev(a),a,prev(b)) != 0 || calcOrient(a,prev(b),b) != 0))   {
+            return true;
+        }
+        return (equalNodes(a,b) &&
+                calcOrient(prev(a),a,next(a)) < 0 &&
+                calcOrient(prev(b),b,next(b)) < 0);
+    }
+
+    // links a and b with a diagonal, splitting the ring
+    // in two; returns the copy of b in the second ring
+    int splitRing(int a, int b)
+    {
+        int const a2 = insertNode(m_listNodes[a].pt,-1);
+        int const b2 = insertNode(m_listNodes[b].pt,-1);
+        int const an = next(a);
+        int const bp = prev(b);
+
+        m_listNodes[a].next = b;
+        m_listNodes[b].prev = a;
+
+        m_listNodes[a2].next = an;
+        m_listNodes[an].prev = a2;
+
+        m_listNodes[b2].next = a2;
+        m_listNodes[a2].prev = b2;
+
+        m_listNodes[bp].next = b2;
+        m_listNodes[b2].prev = bp;
+
+        return b2;
+    }
+
+    void addTriangle(int a, int b, int c)
+    {
+        m_listTriPts.push_back(m_listNodes[a].pt);
+        m_listTriPts.push_back(m_listNodes[b].pt);
+        m_listTriPts.push_back(m_listNodes[c].pt);
+    }
+
+    // clips ears from the ring; if it gets stuck the ring
+    // is filtered, then small self intersections (from
+    // rounding) are cut off and finally it's split in two
+    bool earcutLinked(int ear, int pass)
+    {
+        if(ear < 0)   {
+            return true;
+        }
+        if(pass == 0 && m_hashed)   {
+            indexCurve(ear);
+        }
+
+        int stop = ear;
+        while(prev(ear) != next(ear))   {
+            int const earPrev = prev(ear);
+            int const earNext = next(ear);
+
+            if(m_hashed ? isEarHashed(ear) : isEar(ear))   {
+                addTriangle(earPrev,ear,earNext);
+                removeNode(ear);
+                ear = next(earNext);
+                stop = ear;
+                continue;
+            }
+
+            ear = earNext;
+            if(ear == stop)   {
+                if(pass == 0)   {
+                    return earcutLinked(filterPoints(ear),1);
+                }
+                else if(pass == 1)   {
+                    ear = cureLocalIntersections(filterPoints(ear));
+                    return earcutLinked(ear,2);
+                }
+                return splitEarcut(ear);
+            }
+        }
+        return true;
+    }
+
+    int cureLocalIntersections(int start)
+    {
+        int p = start;
+        do   {
+            int const a = prev(p);
+            int const b = next(next(p));
+            if(!equalNodes(a,b) && intersects(a,p,next(p),b) &&
+               isLocallyInside(a,b) && isLocallyInside(b,a))   {
+                addTriangle(a,p,b);
+                removeNode(p);
+                removeNode(next(p));
+                p = start = b;
+            }
+            p = next(p);
+        }
+        while(p != start);
+
+        return filterPoints(p);
+    }
+
+    bool splitEarcut(int start)
+    {
+        int a = start;
+        do   {
+            int b = next(next(a));
+            while(b != prev(a))   {
+                if(m_listNodes[a].pt != m_listNodes[b].pt && isValidDiagonal(a,b))   {
+                    int c = splitRing(a,b);
+                    a = filterPoints(a,next(a));
+                    c = filterPoints(c,next(c));
+                    return (earcutLinked(a,0) && earcutLinked(c,0));
+                }
+                b = next(b);
+            }
+            a = next(a);
+        }
+        while(a != start);
+
+        return false;
+    }
+
+    int getLeftmost(int start) const
+    {
+        int p = start;
+        int leftmost = start;
+        do   {
+            EarNode const &np = m_listNodes[p];
+            EarNode const &nl = m_listNodes[leftmost];
+            if(np.x < nl.x || (np.x == nl.x && np.y < nl.y))   {
+                leftmost = p;
+            }
+            p = np.next;
+        }
+        while(p != start);
+        return leftmost;
+    }
+
+    bool sectorContainsSector(int m, int p) const
+    {
+        return (calcOrient(prev(m),m,prev(p)) > 0 &&
+                calcOrient(next(p),m,next(m)) > 0);
+    }
+
+    // finds a point of the outer ring that the leftmost
+    // point of a hole can be connected to
+    int findHoleBridge(int hole, int outer) const
+    {
+        double const hx = m_listNodes[hole].x;
+        double const hy = m_listNodes[hole].y;
+
+        // find the closest segment crossed by a
+        // ray from the hole point to the left
+        double qx = -HUGE_VAL;
+        int m = -1;
+        int p = outer;
+        do   {
+            EarNode const &np = m_listNodes[p];
+            EarNode const &nn = m_listNodes[np.next];
+            if(hy <= np.y && hy >= nn.y && nn.y != np.y)   {
+                double const x = np.x + (hy-np.y)*(nn.x-np.x)/(nn.y-np.y);
+                if(x <= hx && x > qx)   {
+                    qx = x;
+                    m = (np.x < nn.x) ? p : np.next;
+                    if(x == hx)   {
+                        return m;
+                    }
+                }
+            }
+            p = np.next;
+        }
+        while(p != outer);
+
+        if(m < 0)   {
+            return -1;
+        }
+
+        // the segment's endpoint m is visible from the hole
+        // point unless other points are inside the triangle
+        // of the hole point, the crossing and m; if so use
+        // the point with the smallest angle to the ray
+        int const stop = m;
+        double const mx = m_listNodes[m].x;
+        double const my = m_listNodes[m].y;
+        double tanMin = HUGE_VAL;
+
+        p = m;
+        do   {
+            EarNode const &np = m_listNodes[p];
+            if(hx >= np.x && np.x >= mx && hx != np.x &&
+               calcPointInTri((hy < my) ? hx : qx, hy, mx, my,
+                              (hy < my) ? qx : hx, hy, np.x, np.y))   {
+                double const tan = std::fabs(hy-np.y)/(hx-np.x);
+                if(isLocallyInside(p,hole) &&
+                   (tan < tanMin || (tan == tanMin &&
+                                     (np.x > m_listNodes[m].x ||
+                                      (np.x == m_listNodes[m].x && sectorContainsSector(m,p))))))   {
+                    m = p;
+                    tanMin = tan;
+                }
+            }
+            p = np.next;
+        }
+        while(p != stop);
+
+        return m;
+    }
+
+    // joins every hole to the outer ring, leftmost first
+    int eliminateHoles(int outer)
+    {
+        size_t const numRings = m_listRingOffsets.size()-1;
+
+        m_listHoleNodes.clear();
+        for(size_t i=1; i < numRings; i++)   {
+            m_listHoleNodes.push_back(getLeftmost(linkRing(i,false)));
+        }
+
+        std::vector<EarNode> const &listNodes = m_listNodes;
+        std::sort(m_listHoleNodes.begin(),m_listHoleNodes.end(),[&](int a, int b) {
+            return (listNodes[a].x < listNodes[b].x ||
+                    (listNodes[a].x == listNodes[b].x && listNodes[a].y < listNodes[b].y));
+        });
+
+        for(size_t i=0; i < m_listHoleNodes.size(); i++)   {
+            int const hole = m_listHoleNodes[i];
+            int const bridge = findHoleBridge(hole,outer);
+            if(bridge < 0)   {
+                return -1;
+            }
+            int const bridgeReverse = splitRing(bridge,hole);
+            filterPoints(bridgeReverse,next(bridgeReverse));
+            outer = filterPoints(bridge,next(bridge));
+        }
+        return outer;
+    }
+
+    bool appendTriangles(WktPolygon const &poly)
+    {
+        if(!buildRings(poly) || !checkEdges() || !checkHoles())   {
+            return false;
+        }
+
+        m_listNodes.clear();
+        m_listNodes.reserve(m_listPts.size() + 2*m_listRingOffsets.size());
+        m_listTriPts.clear();
+
+        int outer = linkRing(0,true);
+        if(m_listRingOffsets.size() > 2)   {
+            outer = eliminateHoles(outer);
+            if(outer < 0)   {
+                return false;
+            }
+        }
+
+        m_hashed = (m_listPts.size() > K_SPT_MIN_HASHED_PTS);
+        if(!earcutLinked(outer,0) || m_listTriPts.empty())   {
+            return false;
+        }
+
+        // every triangle should be counter clockwise and
+        // together they should cover the polygon, otherwise
+        // something went wrong and the polygon is repaired
+        double polyArea = 0;
+        for(size_t i=0; i+1 < m_listRingOffsets.size(); i++)   {
+            double ringArea = 0;
+            size_t const ringBegin = m_listRingOffsets[i];
+            size_t const ringEnd = m_listRingOffsets[i+1];
+            for(size_t j=ringBegin, k=ringEnd-1; j < ringEnd; k=j++)   {
+                ringArea += (m_listPts[k].x*m_listPts[j].y) - (m_listPts[j].x*m_listPts[k].y);
+            }
+            polyArea += (i == 0) ? std::fabs(ringArea) : -std::fabs(ringArea);
+        }
+
+        double triArea = 0;
+        for(size_t i=0; i < m_listTriPts.size(); i+=3)   {
+            Vec2 const &a = m_listPts[m_listTriPts[i]];
+            Vec2 const &b = m_listPts[m_listTriPts[i+1]];
+            Vec2 const &c = m_listPts[m_listTriPts[i+2]];
+            double const area = calcOrient(a,b,c);
+            if(!(area > 0))   {
+                return false;
+            }
+            triArea += area;
+        }
+        if(!(std::fabs(triArea-polyArea) <= K_SPT_AREA_EPS*polyArea))   {
+            return false;
+        }
+
+        // output the original (unscaled) coordinates
+        for(size_t i=0; i < m_listTriPts.size(); i++)   {
+            m_listTriVx.push_back(m_listOrigPts[m_listTriPts[i]]);
+        }
+        return true;
+    }
+
+    std::vector<Vec2> m_listPts;
+    std::vector<Vec2> m_listOrigPts;
+    std::vector<size_t> m_listRingOffsets;
+    std::vector<Edge> m_listEdges;
+    std::vector<Bounds> m_listBounds;
+    std::vector<std::pair<Bounds,size_t> > m_listHoleBounds;
+
+    std::vector<EarNode> m_listNodes;
+    std::vector<int> m_listZNodes;
+    std::vector<int> m_listHoleNodes;
+    std::vector<size_t> m_listTriPts;
+    bool m_hashed;
+
+    std::vector<Vec2> m_listTriVx;
+};
+
+#endif // PTK_SIMPLE_POLY_TRIANGULATOR_HPP
@@ -1,3 +1,6 @@
+#ifndef PTK_VEC2_HPP
+#define PTK_VEC2_HPP
+
 #include <math.h>
 
     class Vec2
@@ -56,3 +59,5 @@
         double x;
         double y;
     };
+
+#endif // PTK_VEC2_HPP
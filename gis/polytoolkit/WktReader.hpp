@@ -0,0 +1,767 @@
+#ifndef PTK_WKT_READER_HPP
+#define PTK_WKT_READER_HPP
+
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <utility>
+
+// sys
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// OGR
+#include <ogrsf_frmts.h>
+
+// A polygon with the coordinates of all of its rings
+// in flat arrays; ring 0 is the outer ring and rings
+// keep their closing point (same as the input)
+struct WktPolygon
+{
+    std::vector<double> listX;
+    std::vector<double> listY;
+
+    // index of the first point of each ring, plus
+    // one past the last point of the last ring
+    std::vector<size_t> listRingOffsets;
+
+    void Clear()
+    {
+        listX.clear();
+        listY.clear();
+        listRingOffsets.clear();
+    }
+
+    size_t GetNumRings() const
+    {
+        return listRingOffsets.empty() ? 0 : listRingOffsets.size()-1;
+    }
+
+    size_t GetRingSize(size_t ring) const
+    {
+        return listRingOffsets[ring+1]-listRingOffsets[ring];
+    }
+
+    double * GetRingX(size_t ring)
+    {
+        return &(listX[listRingOffsets[ring]]);
+    }
+
+    double * GetRingY(size_t ring)
+    {
+        return &(listY[listRingOffsets[ring]]);
+    }
+
+    double const * GetRingX(size_t ring) const
+    {
+        return &(listX[listRingOffsets[ring]]);
+    }
+
+    double const * GetRingY(size_t ring) const
+    {
+        return &(listY[listRingOffsets[ring]]);
+    }
+};
+
+// Reads polygons from a file with one POLYGON or
+// MULTIPOLYGON per line, as either WKT or hex encoded
+// (E)WKB. Quotes around a line are ignored, as are any
+// z and m coordinates.
+//
+// The file is memory mapped and coordinates are parsed
+// straight into the flat arrays of each WktPolygon, so
+// lines aren't copied and no OGR geometry is created
+// unless it's asked for. The polygons are reused from
+// line to line so their arrays only grow until they
+// fit the largest geometry in the file.
+//
+//   WktReader reader;
+//   reader.Open(filePath);
+//   bool valid;
+//   while(reader.ReadLine(valid))   {
+//       for(size_t i=0; i < reader.GetNumPolygons(); i++)   {
+//           WktPolygon const &poly = reader.GetPolygon(i);
+//           ...
+//       }
+//       // reader.GetOffset()/reader.GetFileSize() is the progress
+//   }
+class WktReader
+{
+public:
+    WktReader() :
+        m_fd(-1),
+        m_data(NULL),
+        m_size(0),
+        m_offset(0),
+        m_lineBegin(NULL),
+        m_lineEnd(NULL),
+        m_numPolygons(0),
+        m_isMulti(false)
+    {}
+
+    ~WktReader()
+    {
+        Close();
+    }
+
+    bool Open(std::string const &filePath)
+    {
+        Close();
+
+        m_fd = open(filePath.c_str(),O_RDONLY);
+        if(m_fd < 0)   {
+            return false;
+        }
+
+        struct stat fileStat;
+        if(fstat(m_fd,&fileStat) != 0)   {
+            Close();
+            return false;
+        }
+        m_size = fileStat.st_size;
+
+        // mmap doesn't work on empty files
+        if(m_size > 0)   {
+            void * data = mmap(NULL,m_size,PROT_READ,MAP_PRIVATE,m_fd,0);
+            if(data == MAP_FAILED)   {
+                Close();
+                return false;
+            }
+            m_data = static_cast<char const *>(data);
+            madvise(data,m_size,MADV_SEQUENTIAL);
+        }
+        return true;
+    }
+
+    void Close()
+    {
+        if(m_data != NULL)   {
+            munmap(const_cast<char*>(m_data),m_size);
+        }
+        if(m_fd >= 0)   {
+            close(m_fd);
+        }
+        m_fd = -1;
+        m_data = NULL;
+        m_size = 0;
+        m_offset = 0;
+        m_lineBegin = NULL;
+        m_lineEnd = NULL;
+        m_numPolygons = 0;
+    }
+
+    bool IsOpen() const
+    {
+        return (m_fd >= 0);
+    }
+
+    // Reads the next non empty line. Returns false at the
+    // end of the file. valid is set to false if the line
+    // isn't a POLYGON or MULTIPOLYGON (in which case there
+    // are no polygons for it).
+    bool ReadLine(bool &valid)
+    {
+        m_numPolygons = 0;
+        m_isMulti = false;
+        valid = false;
+
+        char const * begin;
+        char const * end;
+        while(true)   {
+            if(m_offset >= m_size)   {
+                m_lineBegin = NULL;
+                m_lineEnd = NULL;
+                return false;
+            }
+
+            begin = m_data + m_offset;
+            char const * lineEnd = static_cast<char const *>(
+                        memchr(begin,'\n',m_size-m_offset));
+            if(lineEnd == NULL)   {
+                lineEnd = m_data + m_size;
+            }
+            m_offset = (lineEnd - m_data) + 1;
+
+            // trim whitespace and quotes
+            end = lineEnd;
+            while(begin < end && isSpaceOrQuote(*begin))   {
+                begin++;
+            }
+            while(end > begin && isSpaceOrQuote(*(end-1)))   {
+                end--;
+            }
+            if(begin < end)   {
+                break;
+            }
+        }
+        m_lineBegin = begin;
+        m_lineEnd = end;
+
+        if((end-begin) >= 2 && begin[0] == '0' &&
+           (begin[1] == '0' || begin[1] == '1'))
+        {
+            valid = parseHexWkb(begin,end);
+        }
+        else   {
+            valid = parseWkt(begin,end);
+        }
+
+        if(!valid)   {
+            m_numPolygons = 0;
+            m_isMulti = false;
+        }
+        return true;
+    }
+
+    size_t GetNumPolygons() const
+    {
+        return m_numPolygons;
+    }
+
+    WktPolygon & GetPolygon(size_t i)
+    {
+        return m_listPolygons[i];
+    }
+
+    WktPolygon const & GetPolygon(size_t i) const
+    {
+        return m_listPolygons[i];
+    }
+
+    // true if the last line was a MULTIPOLYGON
+    bool IsMulti() const
+    {
+        return m_isMulti;
+    }
+
+    // the last line read (for error messages)
+    std::string GetLine() const
+    {
+        if(m_lineBegin == NULL)   {
+            return std::string();
+        }
+        return std::string(m_lineBegin,m_lineEnd);
+    }
+
+    size_t GetOffset() const
+    {
+        return (m_offset > m_size) ? m_size : m_offset;
+    }
+
+    size_t GetFileSize() const
+    {
+        return m_size;
+    }
+
+    // Creates an OGR geometry for the last line read:
+    // an OGRPolygon for a POLYGON and an OGRMultiPolygon
+    // for a MULTIPOLYGON. Returns NULL if the line wasn't
+    // valid. The caller owns the returned geometry.
+    OGRGeometry * CreateGeometry() const
+    {
+        if(m_numPolygons == 0 && !m_isMulti)   {
+            return NULL;
+        }
+
+        if(!m_isMulti)   {
+            return CreatePolygon(m_listPolygons[0]);
+        }
+
+        OGRMultiPolygon * multiPoly = new OGRMultiPolygon;
+        for(size_t i=0; i < m_numPolygons; i++)   {
+            multiPoly->addGeometryDirectly(CreatePolygon(m_listPolygons[i]));
+        }
+        return multiPoly;
+    }
+
+    static OGRPolygon * CreatePolygon(WktPolygon const &poly)
+    {
+        OGRPolygon * ogrPoly = new OGRPolygon;
+        for(size_t r=0; r < poly.GetNumRings(); r++)   {
+            OGRLinearRing * ring = new OGRLinearRing;
+            ring->setPoints(poly.GetRingSize(r),
+                            const_cast<double*>(poly.GetRingX(r)),
+                            const_cast<double*>(poly.GetRingY(r)));
+            ogrPoly->addRingDirectly(ring);
+        }
+        return ogrPoly;
+    }
+
+    // Parses a decimal number starting at ptr and sets ptr
+    // to one past its end. Numbers with at most 19
+    // significant digits and a small enough exponent are
+    // converted exactly with one multiply or divide; the
+    // rest fall back to strtod. Returns false if there's
+    // no number at ptr.
+    static bool ParseDouble(char const * &ptr,
+                            char const * end,
+                            double &value)
+    {
+        static double const listPow10[23] = {
+            1E0,  1E1,  1E2,  1E3,  1E4,  1E5,  1E6,  1E7,
+            1E8,  1E9,  1E10, 1E11, 1E12, 1E13, 1E14, 1E15,
+            1E16, 1E17, 1E18, 1E19, 1E20, 1E21, 1E22
+        };
+
+        char const * p = ptr;
+        bool negative = false;
+        if(p < end && (*p == '-' || *p == '+'))   {
+            negative = (*p == '-');
+            p++;
+        }
+
+        uint64_t mantissa = 0;
+        int numDigits = 0;      // significant digits in mantissa
+        int exp10 = 0;
+        bool anyDigits = false;
+        bool truncated = false;
+
+        // integer part
+        while(p < end && isDigit(*p))   {
+            anyDigits = true;
+            if(numDigits < 19)   {
+                if(mantissa > 0 || *p != '0')   {
+                    mantissa = mantissa*10 + (*p-'0');
+                    numDigits += (mantissa > 0);
+                }
+            }
+            else   {
+                exp10++;
+                truncated = true;
+            }
+            p++;
+        }
+
+        // fractional part
+        if(p < end && *p == '.')   {
+            p++;
+            while(p < end && isDigit(*p))   {
+                anyDigits = true;
+                if(numDigits < 19)   {
+                    mantissa = mantissa*10 + (*p-'0');
+                    numDigits += (mantissa > 0);
+                    exp10--;
+                }
+                else   {
+                    truncated = true;
+                }
+                p++;
+            }
+        }
+
+        if(!anyDigits)   {
+            return false;
+        }
+
+        // exponent
+        if(p < end && (*p == 'e' || *p == 'E'))   {
+            char const * q = p+1;
+            bool expNegative = false;
+            if(q < end && (*q == '-' || *q == '+'))   {
+                expNegative = (*q == '-');
+                q++;
+            }
+            if(q < end && isDigit(*q))   {
+                int expValue = 0;
+                while(q < end && isDigit(*q))   {
+                    if(expValue < 10000)   {
+                        expValue = expValue*10 + (*q-'0');
+                    }
+                    q++;
+                }
+                exp10 += expNegative ? -expValue : expValue;
+                p = q;
+            }
+        }
+
+        if(!truncated && mantissa < (uint64_t(1) << 53) &&
+           exp10 >= -22 && exp10 <= 22)
+        {
+            value = double(mantissa);
+            value = (exp10 < 0) ? value/listPow10[-exp10] : value*listPow10[exp10];
+        }
+        else   {
+            // slow path; numbers are short so copy
+            // to a buffer that strtod can stop at
+            char buff[128];
+            size_t len = p-ptr;
+            if(len >= sizeof(buff))   {
+                return false;
+            }
+            memcpy(buff,ptr,len);
+            buff[len] = '\0';
+            value = strtod(buff,NULL);
+            ptr = p;
+            return true;
+        }
+
+        if(negative)   {
+            value = -value;
+        }
+        ptr = p;
+        return true;
+    }
+
+private:
+    static bool isDigit(char c)
+    {
+        return (c >= '0' && c <= '9');
+    }
+
+    static bool isSpace(char c)
+    {
+        return (c == ' ' || c == '\t' || c == '\r' || c == '\n');
+    }
+
+    static bool isSpaceOrQuote(char c)
+    {
+        return isSpace(c) || c == '\"' || c == '\'';
+    }
+
+    static void skipSpace(char const * &ptr, char const * end)
+    {
+        while(ptr < end && isSpace(*ptr))   {
+            ptr++;
+        }
+    }
+
+    // case insensitive match of keyword at ptr; advances
+    // ptr past the keyword if it matches
+    static bool matchKeyword(char const * &ptr,
+                             char const * end,
+                             char const * keyword)
+    {
+        size_t len = strlen(keyword);
+        if(size_t(end-ptr) < len)   {
+            return false;
+        }
+        for(size_t i=0; i < len; i++)   {
+            char c = ptr[i];
+            if(c >= 'a' && c <= 'z')   {
+                c -= ('a'-'A');
+            }
+            if(c != keyword[i])   {
+                return false;
+            }
+        }
+        ptr += len;
+        return true;
+    }
+
+    static bool matchChar(char const * &ptr, char const * end, char c)
+    {
+        skipSpace(ptr,end);
+        if(ptr < end && *ptr == c)   {
+            ptr++;
+            return true;
+        }
+        return false;
+    }
+
+    WktPolygon & nextPolygon()
+    {
+        if(m_numPolygons == m_listPolygons.size())   {
+            m_listPolygons.push_back(WktPolygon());
+        }
+        WktPolygon &poly = m_listPolygons[m_numPolygons];
+        m_numPolygons++;
+
+        poly.Clear();
+        return poly;
+    }
+
+    // (x y, x y, ...) where each point may also have
+    // a z and/or m coordinate
+    static bool parseWktRing(char const * &ptr,
+                             char const * end,
+                             WktPolygon &poly)
+    {
+        if(!matchChar(ptr,end,'('))   {
+            return false;
+        }
+
+        poly.listRingOffsets.push_back(poly.listX.size());
+        while(true)   {
+            double x,y,z;
+            skipSpace(ptr,end);
+            if(!ParseDouble(ptr,end,x))   {
+                return false;
+            }
+            skipSpace(ptr,end);
+            if(!ParseDouble(ptr,end,y))   {
+                return false;
+            }
+            // optional z and/or m (POLYGON Z, M or ZM), ignored
+            for(int i=0; i < 2; i++)   {
+                skipSpace(ptr,end);
+                if(!ParseDouble(ptr,end,z))   {
+                    break;
+                }
+            }
+
+            poly.listX.push_back(x);
+            poly.listY.push_back(y);
+
+            if(matchChar(ptr,end,')'))   {
+                break;
+            }
+            if(!matchChar(ptr,end,','))   {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // ((ring),(ring),...)
+    bool parseWktPolygon(char const * &ptr, char const * end)
+    {
+        WktPolygon &poly = nextPolygon();
+        if(!matchChar(ptr,end,'('))   {
+            return false;
+        }
+        while(true)   {
+            if(!parseWktRing(ptr,end,poly))   {
+                return false;
+            }
+            if(matchChar(ptr,end,')'))   {
+                break;
+            }
+            if(!matchChar(ptr,end,','))   {
+                return false;
+            }
+        }
+        poly.listRingOffsets.push_back(poly.listX.size());
+        return true;
+    }
+
+    bool parseWkt(char const * ptr, char const * end)
+    {
+        bool isPolygon = matchKeyword(ptr,end,"POLYGON");
+        if(!isPolygon)   {
+            if(!matchKeyword(ptr,end,"MULTIPOLYGON"))   {
+                return false;
+            }
+            m_isMulti = true;
+        }
+
+        // dimension tags (ie POLYGON Z)
+        skipSpace(ptr,end);
+        if(!(matchKeyword(ptr,end,"ZM") || matchKeyword(ptr,end,"Z")))   {
+            matchKeyword(ptr,end,"M");
+        }
+
+        skipSpace(ptr,end);
+        if(matchKeyword(ptr,end,"EMPTY"))   {
+            return m_isMulti;
+        }
+
+        if(isPolygon)   {
+            return parseWktPolygon(ptr,end);
+        }
+
+        if(!matchChar(ptr,end,'('))   {
+            return false;
+        }
+        while(true)   {
+            if(!parseWktPolygon(ptr,end))   {
+                return false;
+            }
+            if(matchChar(ptr,end,')'))   {
+                break;
+            }
+            if(!matchChar(ptr,end,','))   {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // reads hex WKB values from m_wkb
+    struct WkbCursor
+    {
+        unsigned char const * ptr;
+        unsigned char const * end;
+        bool swap;
+
+        bool ReadUInt32(uint32_t &value)
+        {
+            if(end-ptr < 4)   {
+                return false;
+            }
+            unsigned char b[4];
+            memcpy(b,ptr,4);
+            if(swap)   {
+                std::swap(b[0],b[3]);
+                std::swap(b[1],b[2]);
+            }
+            memcpy(&value,b,4);
+            ptr += 4;
+            return true;
+        }
+
+        bool ReadDouble(double &value)
+        {
+            if(end-ptr < 8)   {
+                return false;
+            }
+            unsigned char b[8];
+            memcpy(b,ptr,8);
+            if(swap)   {
+                for(int i=0; i < 4; i++)   {
+                    std::swap(b[i],b[7-i]);
+                }
+            }
+            memcpy(&value,b,8);
+            ptr += 8;
+            return true;
+        }
+    };
+
+    // Reads the byte order and type of a geometry. Handles
+    // ISO (type+1000*dims) and EWKB (flags) dimensions.
+    static bool readWkbHeader(WkbCursor &cursor,
+                              uint32_t &type,
+                              size_t &numDims)
+    {
+        if(cursor.ptr >= cursor.end)   {
+            return false;
+        }
+        // native order is assumed to be little endian
+        cursor.swap = (*cursor.ptr == 0);
+        cursor.ptr++;
+
+        uint32_t rawType;
+        if(!cursor.ReadUInt32(rawType))   {
+            return false;
+        }
+
+        numDims = 2;
+        if(rawType & 0x80000000)   { numDims++; }  // EWKB z
+        if(rawType & 0x40000000)   { numDims++; }  // EWKB m
+        if(rawType & 0x20000000)   {               // EWKB srid
+            uint32_t srid;
+            if(!cursor.ReadUInt32(srid))   {
+                return false;
+            }
+        }
+        rawType &= 0x0FFFFFFF;
+
+        uint32_t isoDims = rawType/1000;
+        type = rawType%1000;
+        if(isoDims == 1 || isoDims == 2)   { numDims = 3; }
+        else if(isoDims == 3)   { numDims = 4; }
+
+        return true;
+    }
+
+    bool parseWkbPolygon(WkbCursor &cursor, size_t numDims)
+    {
+        WktPolygon &poly = nextPolygon();
+
+        uint32_t numRings;
+        if(!cursor.ReadUInt32(numRings))   {
+            return false;
+        }
+        for(uint32_t r=0; r < numRings; r++)   {
+            uint32_t numPts;
+            if(!cursor.ReadUInt32(numPts) ||
+               size_t(cursor.end-cursor.ptr) < size_t(numPts)*numDims*8)
+            {   return false;   }
+
+            poly.listRingOffsets.push_back(poly.listX.size());
+            for(uint32_t i=0; i < numPts; i++)   {
+                double x,y,extra;
+                cursor.ReadDouble(x);
+                cursor.ReadDouble(y);
+                for(size_t d=2; d < numDims; d++)   {
+                    cursor.ReadDouble(extra);
+                }
+                poly.listX.push_back(x);
+                poly.listY.push_back(y);
+            }
+        }
+        poly.listRingOffsets.push_back(poly.listX.size());
+        return true;
+    }
+
+    bool parseHexWkb(char const * begin, char const * end)
+    {
+        size_t len = end-begin;
+        if(len % 2 != 0)   {
+            return false;
+        }
+
+        m_wkb.resize(len/2);
+        for(size_t i=0; i < m_wkb.size(); i++)   {
+            int hi = hexValue(begin[2*i]);
+            int lo = hexValue(begin[2*i+1]);
+            if(hi < 0 || lo < 0)   {
+                return false;
+            }
+            m_wkb[i] = (unsigned char)((hi << 4) | lo);
+        }
+
+        WkbCursor cursor;
+        cursor.ptr = &(m_wkb[0]);
+        cursor.end = cursor.ptr + m_wkb.size();
+
+        uint32_t type;
+        size_t numDims;
+        if(!readWkbHeader(cursor,type,numDims))   {
+            return false;
+        }
+
+        if(type == 3)   {      // polygon
+            return parseWkbPolygon(cursor,numDims);
+        }
+        if(type != 6)   {      // multipolygon
+            return false;
+        }
+
+        m_isMulti = true;
+        uint32_t numPolys;
+        if(!cursor.ReadUInt32(numPolys))   {
+            return false;
+        }
+        for(uint32_t i=0; i < numPolys; i++)   {
+            uint32_t polyType;
+            size_t polyDims;
+            if(!readWkbHeader(cursor,polyType,polyDims) || polyType != 3)   {
+                return false;
+            }
+            if(!parseWkbPolygon(cursor,polyDims))   {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static int hexValue(char c)
+    {
+        if(c >= '0' && c <= '9')   { return c-'0'; }
+        if(c >= 'a' && c <= 'f')   { return c-'a'+10; }
+        if(c >= 'A' && c <= 'F')   { return c-'A'+10; }
+        return -1;
+    }
+
+    int m_fd;
+    char const * m_data;
+    size_t m_size;
+    size_t m_offset;
+
+    char const * m_lineBegin;
+    char const * m_lineEnd;
+
+    std::vector<WktPolygon> m_listPolygons;
+    size_t m_numPolygons;
+    bool m_isMulti;
+
+    std::vector<unsigned char> m_wkb;
+};
+
+#endif // PTK_WKT_READER_HPP
@@ -16,17 +16,8 @@
 // epsilon error
 #define K_EPS 1E-11
 
-// WGS84 ellipsoid parameters
-// (http://en.wikipedia.org/wiki/WGS_84)
-#define ELL_SEMI_MAJOR 6378137.0            // meters
-#define ELL_SEMI_MAJOR_EXP2 40680631590769
-
-#define ELL_SEMI_MINOR 6356752.3142         // meters
-#define ELL_SEMI_MINOR_EXP2 40408299984087.1
-
-#define ELL_F 1/298.257223563
-#define ELL_ECC_EXP2 6.69437999014e-3
-#define ELL_ECC2_EXP2 6.73949674228e-3
+// WGS84 ellipsoid and LLA <-> ECEF conversions
+#include <geodesy.hpp>
 
 // longitude, latitude, altitude point class
 class PointLLA
@@ -56,18 +47,12 @@ struct Vx
 Vx ConvLLAToECEF(const PointLLA &pointLLA)
 {
     Vx pointECEF;
-
-    // remember to convert deg->rad
-    double sinLat = sin(pointLLA.lat * K_PI/180.0f);
-    double sinLon = sin(pointLLA.lon * K_PI/180.0f);
-    double cosLat = cos(pointLLA.lat * K_PI/180.0f);
-    double cosLon = cos(pointLLA.lon * K_PI/180.0f);
-
-    // v = radius of curvature (meters)
-    double v = ELL_SEMI_MAJOR / (sqrt(1-(ELL_ECC_EXP2*sinLat*sinLat)));
-    pointECEF.x = (v + pointLLA.alt) * cosLat * cosLon;
-    pointECEF.y = (v + pointLLA.alt) * cosLat * sinLon;
-    pointECEF.z = ((1-ELL_ECC_EXP2)*v + pointLLA.alt)*sinLat;
+    geodesy::ConvLLAToECEF(pointLLA.lon,
+                           pointLLA.lat,
+                           pointLLA.alt,
+                           pointECEF.x,
+                           pointECEF.y,
+                           pointECEF.z);
 
     return pointECEF;
 }
@@ -33,3 +33,8 @@ SOURCES += pcl_wkt_to_ctm.cpp
 
 # we need gdal's ogr tools
 LIBS += -lgdal
+
+# geodesy (needs c++11)
+QMAKE_CXXFLAGS += -std=c++11
+INCLUDEPATH += $${PWD}/../../utils/geodesy
+HEADERS += $${PWD}/../../utils/geodesy/geodesy.hpp
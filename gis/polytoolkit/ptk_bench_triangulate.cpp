@@ -0,0 +1,246 @@
+// STL
+#include <iostream>
+#include <cstdlib>
+#include <cmath>
+#include <random>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <sys/time.h>
+
+// OGR
+#include <ogrsf_frmts.h>
+
+// mmap'd wkt/wkb reader
+#include "WktReader.hpp"
+
+// fast path for valid polygons
+#include "SimplePolyTriangulator.hpp"
+
+// CGAL
+#include <CGAL/Exact_predicates_inexact_constructions_kernel.h>
+#include <CGAL/Triangulation_face_base_with_info_2.h>
+#include <CGAL/Constrained_Delaunay_triangulation_2.h>
+#include <CGAL/Constrained_triangulation_plus_2.h>
+
+#define K_PI 3.14159265358979323846
+
+// same triangulation as ptk_wkt_to_ctm/ply
+typedef CGAL::Exact_predicates_inexact_constructions_kernel K;
+typedef CGAL::Triangulation_vertex_base_2<K> VB;
+typedef CGAL::Constrained_triangulation_face_base_2<K> FB;
+typedef CGAL::Triangulation_face_base_with_info_2<void *, K, FB> FBWI;
+typedef CGAL::Triangulation_data_structure_2<VB, FBWI> TDS;
+typedef CGAL::Exact_predicates_tag PT;
+typedef CGAL::Constrained_Delaunay_triangulation_2<K, TDS, PT> CDT;
+
+typedef CGAL::Constrained_triangulation_plus_2<CDT> Triangulation;
+typedef Triangulation::Point Point;
+
+// Compares SimplePolyTriangulator against the CGAL
+// triangulation that ptk_wkt_to_ctm and ptk_wkt_to_ply
+// use for every polygon. Only the constraint insertion
+// done by repair() is timed for CGAL; tagging and the
+// crossing number filtering that follow it are left out,
+// so the CGAL times are a lower bound.
+//
+// Without an input file the polygons are generated: one
+// for each of the meshes in thirdparty/models (using the
+// same number of points as the mesh has triangles) and
+// a set of small polygons like building footprints.
+
+double GetTimeMs()
+{
+    timeval t;
+    gettimeofday(&t,NULL);
+    return (t.tv_sec*1000.0) + (t.tv_usec/1000.0);
+}
+
+void AddRing(WktPolygon &poly, std::vector<Vec2> const &listPts)
+{
+    if(poly.listRingOffsets.empty())   {
+        poly.listRingOffsets.push_back(0);
+    }
+    for(size_t i=0; i <= listPts.size(); i++)   {
+        // close the ring
+        Vec2 const &pt = listPts[i%listPts.size()];
+        poly.listX.push_back(pt.x);
+        poly.listY.push_back(pt.y);
+    }
+    poly.listRingOffsets.push_back(poly.listX.size());
+}
+
+// A star shaped ring (so it's always simple) with
+// some noise in the radius
+std::vector<Vec2> BuildRing(Vec2 const &center,
+                            double radius,
+                            double noise,
+                            size_t numPts,
+                            std::mt19937 &rng)
+{
+    std::uniform_real_distribution<double> dist(1.0-noise,1.0);
+    std::vector<Vec2> listPts(numPts);
+    for(size_t i=0; i < numPts; i++)   {
+        double const angle = (2.0*K_PI*i)/numPts;
+        double const r = radius*dist(rng);
+        listPts[i] = Vec2(center.x + r*cos(angle),
+                          center.y + r*sin(angle));
+    }
+    return listPts;
+}
+
+// A polygon with numPts points, about a tenth of them in
+// holes, spanning a tenth of a degree
+WktPolygon BuildPolygon(size_t numPts, std::mt19937 &rng)
+{
+    Vec2 const center(-79.38,43.65);
+    double const radius = 0.05;
+
+    size_t const numHoles = std::min(size_t(64),numPts/1000);
+    size_t const numHolePts = (numHoles > 0) ? (numPts/10)/numHoles : 0;
+
+    WktPolygon poly;
+    AddRing(poly,BuildRing(center,radius,0.001,numPts-numHoles*numHolePts,rng));
+    for(size_t i=0; i < numHoles; i++)   {
+        double const angle = (2.0*K_PI*i)/numHoles;
+        Vec2 const holeCenter(center.x + 0.6*radius*cos(angle),
+                              center.y + 0.6*radius*sin(angle));
+        AddRing(poly,BuildRing(holeCenter,0.02*radius,0.1,numHolePts,rng));
+    }
+    return poly;
+}
+
+size_t TriangulateCGAL(WktPolygon const &poly)
+{
+    Triangulation triangulation;
+    for(size_t i=0; i < poly.GetNumRings(); i++)   {
+        double const * px = poly.GetRingX(i);
+        double const * py = poly.GetRingY(i);
+        size_t const numPts = poly.GetRingSize(i);
+        for(size_t j=0; j < numPts; j++)   {
+            size_t const k = (j+1)%numPts;
+            triangulation.insert_constraint(Point(px[j],py[j]),Point(px[k],py[k]));
+        }
+    }
+    return triangulation.number_of_faces();
+}
+
+struct BenchResult
+{
+    BenchResult() :
+        numPolys(0),numFast(0),msFast(0),msCGAL(0) {}
+
+    size_t numPolys;
+    size_t numFast;     // polys that took the fast path
+    double msFast;
+    double msCGAL;
+};
+
+void Bench(WktPolygon const &poly,
+           SimplePolyTriangulator &triangulator,
+           bool runCGAL,
+           BenchResult &result)
+{
+    double t0 = GetTimeMs();
+    bool const fast = triangulator.Triangulate(poly);
+    result.msFast += GetTimeMs()-t0;
+
+    result.numPolys++;
+    result.numFast += (fast) ? 1 : 0;
+
+    if(runCGAL)   {
+        t0 = GetTimeMs();
+        TriangulateCGAL(poly);
+        result.msCGAL += GetTimeMs()-t0;
+    }
+}
+
+void PrintResult(std::string const &desc,
+                 BenchResult const &result,
+                 bool runCGAL)
+{
+    std::cout << "INFO: " << desc << ": " << result.numPolys << " polys, "
+              << result.numFast << " fast path: \t"
+              << result.msFast << " ms";
+    if(runCGAL)   {
+        std::cout << " vs CGAL " << result.msCGAL << " ms ("
+                  << result.msCGAL/std::max(result.msFast,1E-3) << "x)";
+    }
+    std::cout << std::endl;
+}
+
+int main(int argc, const char *argv[])
+{
+    if(argc > 3) {
+        std::cout << "Usage: #> ./ptk_bench_triangulate [inputfile] [nocgal]\n";
+        std::cout << "* Times triangulating valid polygons directly against\n";
+        std::cout << "  triangulating them with CGAL like ptk_wkt_to_ctm/ply\n";
+        std::cout << "* Expect each line of the input file to contain a single WKT POLYGON() def,\n";
+        std::cout << "  polygons are generated if there's no input file\n";
+        std::cout << "* Pass nocgal to only time the fast path\n";
+        return 0;
+    }
+
+    std::string inputFile;
+    bool runCGAL = true;
+    for(int i=1; i < argc; i++)   {
+        if(std::string(argv[i]) == "nocgal")   {
+            runCGAL = false;
+        }
+        else   {
+            inputFile = argv[i];
+        }
+    }
+
+    SimplePolyTriangulator triangulator;
+
+    if(!inputFile.empty())   {
+        WktReader reader;
+        reader.Open(inputFile.c_str());
+        if(!reader.IsOpen())   {
+            std::cout << "Error: Could not open " << inputFile << std::endl;
+            return -1;
+        }
+
+        BenchResult result;
+        bool valid;
+        while(reader.ReadLine(valid))   {
+            if(!valid || reader.IsMulti())   {
+                continue;
+            }
+            Bench(reader.GetPolygon(0),triangulator,runCGAL,result);
+        }
+        reader.Close();
+
+        PrintResult(inputFile,result,runCGAL);
+        return 0;
+    }
+
+    std::mt19937 rng(1);
+
+    // thirdparty/models scale
+    char const * listModels[] = {
+        "bunny_70k","dragon_100k","heptoroid_140k","lucy_260k","thai_statuette_300k"
+    };
+    size_t const listModelPts[] = {
+        70000,100000,140000,260000,300000
+    };
+    for(size_t i=0; i < 5; i++)   {
+        WktPolygon poly = BuildPolygon(listModelPts[i],rng);
+        BenchResult result;
+        Bench(poly,triangulator,runCGAL,result);
+        PrintResult(listModels[i],result,runCGAL);
+    }
+
+    // building footprints
+    std::uniform_int_distribution<size_t> distPts(4,64);
+    BenchResult result;
+    for(size_t i=0; i < 100000; i++)   {
+        WktPolygon poly;
+        AddRing(poly,BuildRing(Vec2(0,0),0.0002,0.3,distPts(rng),rng));
+        Bench(poly,triangulator,runCGAL,result);
+    }
+    PrintResult("footprints",result,runCGAL);
+
+    return 0;
+}
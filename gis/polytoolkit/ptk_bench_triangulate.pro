@@ -0,0 +1,19 @@
+TEMPLATE = app
+CONFIG += console release
+CONFIG -= qt
+TARGET = ptk_bench_triangulate
+
+# ptk_bench_triangulate
+SOURCES += ptk_bench_triangulate.cpp
+
+# required libs
+LIBS += -lgdal -lCGAL_Core -lCGAL -lmpfr -lgmp -lboost_thread
+
+# c++0x
+QMAKE_CXXFLAGS += -std=c++0x
+
+# wkt reader
+HEADERS += WktReader.hpp
+
+# fast path for valid polygons
+HEADERS += SimplePolyTriangulator.hpp
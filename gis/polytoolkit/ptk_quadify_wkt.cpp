@@ -2,12 +2,17 @@
 #include <iostream>
 #include <iomanip>
 #include <cstring>
+#include <cerrno>
 #include <sstream>
 #include <fstream>
 #include <stack>
 #include <set>
+#include <vector>
+#include <thread>
+#include <algorithm>
 #include <dirent.h>
 #include <sys/time.h>
+#include <sys/stat.h>
 
 // OGR
 #include <ogrsf_frmts.h>
@@ -15,13 +20,15 @@
 // clipper
 #include "clipper/clipper.hpp"
 
+// in memory quadtree split
+#include "QuadifyInMemory.hpp"
+
 #define MINLON -180
 #define MAXLON -20
 #define MINLAT -58
 #define MAXLAT 86
 #define LONSTEP 20
 #define LATSTEP 18
-#define DBLMT 1E10
 
 // timing vars
 timeval t1,t2;
@@ -58,85 +65,165 @@ double StringToNumber ( const std::string &Text )
     return ss >> result ? result : 0;
 }
 
-struct BoundingBox
-{
-    double minLat;
-    double minLon;
-    double maxLat;
-    double maxLon;
-};
-
+// ========================================================================== //
+// ========================================================================== //
 
-bool calcAreaRectOverlap(double r1_bl_x, double r1_bl_y,
-                         double r1_tr_x, double r1_tr_y,
-                         double r2_bl_x, double r2_bl_y,
-                         double r2_tr_x, double r2_tr_y)
+// Clipper call used by quadifyInMemory
+bool clipQuadIntersection(ClipperLib::Clipper &clipperObj,
+                          ClipperLib::ExPolygons &xsecPolys)
 {
-    // check if rectangles intersect
-    if((r1_tr_x < r2_bl_x) || (r1_bl_x > r2_tr_x) ||
-            (r1_tr_y < r2_bl_y) || (r1_bl_y > r2_tr_y))
-    {   return false;   }
-
-    return true;
+    return clipperObj.Execute(ClipperLib::ctIntersection,xsecPolys);
 }
 
-BoundingBox getQuadKeyExtents(BoundingBox const &rootExtents,
-                              std::string const &quadKey)
+bool writeQuadItems(std::string const &filePath,
+                    std::vector<QuadItem> const &listItems)
 {
-    BoundingBox myExtents;
-    myExtents = rootExtents;
+    std::ofstream tileFile(filePath.c_str());
+    if(!tileFile.is_open())   {
+        return false;
+    }
 
-    if(quadKey.size() < 2)   {
-        return myExtents;
+    for(size_t x=0; x < listItems.size(); x++)   {
+        OGRPolygon savePolygon;
+        ClipperLib::ExPolygon const &xsecPoly = listItems[x].poly;
+
+        OGRLinearRing outerRing;
+        for(size_t y=0; y < xsecPoly.outer.size(); y++)
+        {    outerRing.addPoint(double(xsecPoly.outer[y].X)/DBLMT,double(xsecPoly.outer[y].Y)/DBLMT);   }
+        outerRing.addPoint(double(xsecPoly.outer[0].X)/DBLMT,double(xsecPoly.outer[0].Y)/DBLMT);
+        savePolygon.addRing(&outerRing);
+
+        for(size_t y=0; y < xsecPoly.holes.size(); y++)   {
+            OGRLinearRing innerRing;
+            for(size_t z=0; z < xsecPoly.holes[y].size(); z++)
+            {   innerRing.addPoint(double(xsecPoly.holes[y][z].X)/DBLMT,double(xsecPoly.holes[y][z].Y)/DBLMT);   }
+            innerRing.addPoint(double(xsecPoly.holes[y][0].X)/DBLMT,double(xsecPoly.holes[y][0].Y)/DBLMT);
+            savePolygon.addRing(&innerRing);
+        }
+        // save as wkt
+        char *outputWKT;
+        savePolygon.exportToWkt(&outputWKT);
+        tileFile << outputWKT << std::endl;
+        CPLFree(outputWKT);
     }
 
-    if(quadKey.size() % 2 != 0)   {
-        return myExtents;
+    return tileFile.good();
+}
+
+bool quadifyWktInMemory(std::string const &inputFile,
+                        BoundingBox const &rootExtents,
+                        unsigned int numLevels,
+                        size_t numThreads,
+                        std::string const &outputPrefix)
+{
+    // read in all the polygons
+    std::vector<QuadItem> listItems;
+    std::ifstream inputWktFile(inputFile.c_str());
+    if(!inputWktFile.is_open())   {
+        std::cout << "ptk_quadify_wkt: ERROR: Could not open "
+                  << inputFile << "\n";
+        return false;
     }
 
-    for(int i=0; i < quadKey.size(); i+=2)
+    std::string wktLine;
+    while(std::getline(inputWktFile,wktLine))
     {
-        std::string quadrant = quadKey.substr(i,2);
-        double halfLonStep = (myExtents.maxLon-myExtents.minLon)/2;
-        double halfLatStep = (myExtents.maxLat-myExtents.minLat)/2;
-
-        // top left quadrant
-        if(quadrant.compare("00") == 0)   {
-            myExtents.maxLon -= halfLonStep;
-            myExtents.minLat += halfLatStep;
+        if(wktLine.empty())   {
+            continue;
         }
-        // top right quadrant
-        else if(quadrant.compare("01") == 0)   {
-            myExtents.minLon += halfLonStep;
-            myExtents.minLat += halfLatStep;
+
+        // remove any quotes around wktLine
+        if(wktLine[0] == '\"' || wktLine[0] == '\'')
+        {   wktLine.erase(0,1);   }
+
+        if(!wktLine.empty() &&
+           (wktLine[wktLine.size()-1] == '\"' || wktLine[wktLine.size()-1] == '\''))
+        {   wktLine.erase(wktLine.size()-1,1);   }
+
+        // create geometry from wkt
+        std::vector<char> wktBuff(wktLine.begin(),wktLine.end());
+        wktBuff.push_back('\0');
+        char *inputWKT = &(wktBuff[0]);
+
+        OGRGeometry *inputGeometry = NULL;
+        OGRGeometryFactory::createFromWkt(&inputWKT, NULL, &inputGeometry);
+        if(inputGeometry == NULL)   {
+            continue;
         }
-        // bottom left quadrant
-        else if(quadrant.compare("10") == 0)   {
-            myExtents.maxLon -= halfLonStep;
-            myExtents.maxLat -= halfLatStep;
+
+        if(inputGeometry->getGeometryType() != wkbPolygon)   {
+            delete inputGeometry;
+            continue;
         }
-        // bottom right quadrant
-        else if(quadrant.compare("11") == 0)   {
-            myExtents.minLon += halfLonStep;
-            myExtents.maxLat -= halfLatStep;
+
+        OGRPolygon *singlePoly = (OGRPolygon*)inputGeometry;
+        OGRLinearRing *outerRing = singlePoly->getExteriorRing();
+        if(outerRing == NULL || outerRing->getNumPoints() < 4)   {
+            delete inputGeometry;
+            continue;
         }
-    }
 
-//    // debug
-//    std::cout << "New Extents: "
-//              << myExtents.minLon << "," << myExtents.maxLon << "|"
-//              << myExtents.minLat << "," << myExtents.maxLat
-//              << std::endl;
+        QuadItem item;
 
-    return myExtents;
+        // outer ring
+        for(int j=0; j < outerRing->getNumPoints()-1; j++)   {
+            ClipperLib::IntPoint intPt;
+            intPt.X = ClipperLib::long64(outerRing->getX(j)*DBLMT);
+            intPt.Y = ClipperLib::long64(outerRing->getY(j)*DBLMT);
+            item.poly.outer.push_back(intPt);
+        }
+
+        // inner rings
+        for(int j=0; j < singlePoly->getNumInteriorRings(); j++)   {
+            OGRLinearRing *innerRing = singlePoly->getInteriorRing(j);
+            ClipperLib::Polygon innerPoly;
+            for(int k=0; k < innerRing->getNumPoints()-1; k++)   {
+                ClipperLib::IntPoint intPt;
+                intPt.X = ClipperLib::long64(innerRing->getX(k)*DBLMT);
+                intPt.Y = ClipperLib::long64(innerRing->getY(k)*DBLMT);
+                innerPoly.push_back(intPt);
+            }
+            item.poly.holes.push_back(innerPoly);
+        }
+        delete inputGeometry;
+
+        calcQuadItemBounds(item);
+        listItems.push_back(item);
+    }
+    inputWktFile.close();
+
+    std::cout << "ptk_quadify_wkt: Read " << listItems.size()
+              << " polygons\n";
+
+    QuadWriteFunc writeFunc =
+            [&outputPrefix](std::string const &quadKey,
+                            std::vector<QuadItem> const &listQItems) {
+        if(!writeQuadItems(outputPrefix+quadKey,listQItems))   {
+            std::cout << "ptk_quadify_wkt: ERROR: Could not write tiles for "
+                      << quadKey << "\n";
+            return false;
+        }
+        return true;
+    };
+
+    return quadifyInMemory(listItems,rootExtents,numLevels,numThreads,
+                           clipQuadIntersection,writeFunc,"ptk_quadify_wkt: ");
 }
 
+// ========================================================================== //
+// ========================================================================== //
+
 int main(int argc, const char *argv[])
 {
-    if(argc != 8) {
-        std::cout << "Usage: #> ./ptk_quadify_wkt MINLON MAXLON MINLAT MAXLAT LEVELS inputfile.dat outputdir\n";
+    if(argc < 8 || argc > 9) {
+        std::cout << "Usage: #> ./ptk_quadify_wkt MINLON MAXLON MINLAT MAXLAT LEVELS inputfile.dat outputdir [numthreads]\n";
         std::cout << "* Expect each line of the input file to contain a single WKT def\n";
         std::cout << "* The output file is in the same format as the input file\n";
+        std::cout << "* The input is read into memory once and split with numthreads\n";
+        std::cout << "  threads (defaults to the number of cores); only leaf tiles\n";
+        std::cout << "  that have polygons are written\n";
+        std::cout << "* Set numthreads to 0 to split the input level by level on\n";
+        std::cout << "  disk instead (for inputs that don't fit in memory)\n";
         return 0;
     }
 
@@ -170,16 +257,34 @@ int main(int argc, const char *argv[])
     inputStr = std::string(argv[5]);
     unsigned int numLevels = StringToNumber(inputStr);
 
+    size_t numThreads = std::thread::hardware_concurrency();
+    if(argc == 9)   {
+        numThreads = atoi(argv[8]);
+    }
+    else   {
+        numThreads = std::max(numThreads,size_t(1));
+    }
+
     // create output dir
-    std::string makeDir("mkdir ");
-    makeDir.append(argv[7]);
-    system(makeDir.c_str());
+    if(mkdir(argv[7],0755) != 0 && errno != EEXIST)   {
+        std::cout << "ptk_quadify_wkt: ERROR: Could not create "
+                  << argv[7] << "\n";
+        return -1;
+    }
 
     // create output prefix
     std::string outputDir = std::string(argv[7]) + std::string("/");
     std::string outputPrefix = std::string(argv[7]);
     outputPrefix.append("/TILE_");
 
+    if(numThreads > 0)   {
+        bool ok = (numLevels == 0) ||
+                quadifyWktInMemory(argv[6],rootExtents,numLevels,
+                                   numThreads,outputPrefix);
+        EndTiming();
+        return ok ? 0 : -1;
+    }
+
     std::string str00("00");
     std::string str01("01");
     std::string str10("10");
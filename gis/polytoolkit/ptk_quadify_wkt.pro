@@ -1,12 +1,13 @@
 TEMPLATE = app
 CONFIG += console debug
 CONFIG -= qt
-HEADERS += clipper/clipper.hpp
+HEADERS += clipper/clipper.hpp \
+           QuadifyInMemory.hpp
 SOURCES += ptk_quadify_wkt.cpp \
            clipper/clipper.cpp
 TARGET = ptk_quadify_wkt
 
 # required libs
-LIBS += -lgdal -lCGAL_Core -lCGAL -lmpfr -lgmp -lboost_thread
+LIBS += -lgdal -lCGAL_Core -lCGAL -lmpfr -lgmp -lboost_thread -lpthread
 
 QMAKE_CXXFLAGS += -std=c++0x
@@ -50,6 +50,9 @@
 // OGR
 #include <ogrsf_frmts.h>
 
+// mmap'd wkt/wkb reader
+#include "WktReader.hpp"
+
 // CGAL
 #include <CGAL/Exact_predicates_inexact_constructions_kernel.h>
 #include <CGAL/Triangulation_face_base_with_info_2.h>
@@ -106,58 +109,29 @@ int main(int argc, const char *argv[])
 
     StartTiming("[Repair Polygons]");
 
-    std::ifstream inputWktFile;
-    inputWktFile.open(argv[1]);
+    WktReader reader;
+    reader.Open(argv[1]);
 
     std::ofstream outputWktFile;
     outputWktFile.open(argv[2]);
 
-    // get number of input lines
-    unsigned int numInputLines=0;
-    if(inputWktFile.is_open())   {
-        while(!inputWktFile.eof())   {
-            std::string wktLine;
-            std::getline(inputWktFile,wktLine);
-            numInputLines++;
-        }
-    }
-    inputWktFile.close();
-    inputWktFile.open(argv[1]);
-
-    if(inputWktFile.is_open() && outputWktFile.is_open())
+    if(reader.IsOpen() && outputWktFile.is_open())
     {
         int linesProcessed = 0;
+        size_t lastPercent = 0;
         outputWktFile << "WKT\n";
 
-        while(!inputWktFile.eof())
+        bool valid;
+        while(reader.ReadLine(valid))
         {
-            std::string wktLine;
-            std::getline(inputWktFile,wktLine);
-
-            // remove any quotes around wktLine
-            if(wktLine[0] == '\"' || wktLine[0] == '\'')
-            {   wktLine.erase(0,1);   }
-
-            if(wktLine[wktLine.size()-1] == '\"' || wktLine[wktLine.size()-1] == '\'')
-            {   wktLine.erase(wktLine.size()-1,1);   }
-
-            // create geometry from wkt
-            char *inputWKT = new char[wktLine.size()+1];
-            char *inputWKTRef = inputWKT;
-            strcpy(inputWKT,wktLine.c_str());
-
-            OGRGeometry *inputGeometry;
-            OGRGeometryFactory::createFromWkt(&inputWKT, NULL, &inputGeometry);
-
-            if (inputGeometry == NULL)   {
+            if(!valid)   {
                 std::cout << "Error: WKT is not valid (ignoring)" << std::endl;
-                std::cout << "-> WKT: " << wktLine << std::endl;
-                delete[] inputWKTRef;
+                std::cout << "-> WKT: " << reader.GetLine() << std::endl;
                 continue;
             }
-            delete[] inputWKTRef;
 
-            if(inputGeometry->getGeometryType() == wkbPolygon)   {
+            if(!reader.IsMulti())   {
+                OGRGeometry *inputGeometry = reader.CreateGeometry();
                 Triangulation cTri;
                 OGRMultiPolygon* outputPolygons = repair(inputGeometry,cTri);
 
@@ -167,30 +141,34 @@ int main(int argc, const char *argv[])
                         char *outputWKT;
                         outputPolygons->getGeometryRef(i)->exportToWkt(&outputWKT);
                         outputWktFile << outputWKT << std::endl;
-                        delete[] outputWKT;
+                        CPLFree(outputWKT);
                     }
+                    delete outputPolygons;
                 }
                 else   {
                     std::cout << "Error: Could not repair geometry,: "
                                  "input points are collinear (no area)\n ";
-                    std::cout << "-> WKT: " << wktLine << "\n";
+                    std::cout << "-> WKT: " << reader.GetLine() << "\n";
                 }
+
+                // clean up
+                delete inputGeometry;
             }
             else   {
                 std::cout << "Error: Could not repair geometry, "
                              "WKT type is not a POLYGON()\n";
-                std::cout << "-> WKT: " << wktLine << "\n";
+                std::cout << "-> WKT: " << reader.GetLine() << "\n";
             }
 
             linesProcessed++;
-            std::cout << "Lines Processed: "
-                      << linesProcessed << "/"
-                      << numInputLines << std::endl;
-
-            // clean up
-            delete inputGeometry;
+            size_t percent = (100*reader.GetOffset())/reader.GetFileSize();
+            if(percent != lastPercent)   {
+                lastPercent = percent;
+                std::cout << "Lines Processed: "
+                          << linesProcessed << " (" << percent << "%)" << std::endl;
+            }
         }
-        inputWktFile.close();
+        reader.Close();
         outputWktFile.close();
     }
     EndTiming();
@@ -8,3 +8,6 @@ TARGET = ptk_repair_wkt
 LIBS += -lgdal -lCGAL_Core -lCGAL -lmpfr -lgmp -lboost_thread
 
 QMAKE_CXXFLAGS += -std=c++0x
+
+# wkt reader
+HEADERS += WktReader.hpp
@@ -9,6 +9,10 @@
 #include <set>
 #include <map>
 #include <algorithm>
+#include <atomic>
+#include <thread>
+#include <cfloat>
+#include <cmath>
 #include <sys/time.h>
 
 // OGR
@@ -75,216 +79,317 @@ bool calcAreaRectOverlap(double r1_bl_x, double r1_bl_y,
     return true;
 }
 
-void simplifyWithVW(OGRLinearRing *polyLine)
+// Binary min heap of ring points ordered by area that
+// tracks where each point is in the heap so a point's
+// area can be updated in place. The areas are stored in
+// the heap itself to avoid chasing indices while sifting.
+class VWHeap
 {
-    // * compute the effective area of each point and store
-    //   it in a list with the corresponding points
-    //   (note, first last pts don't have an eff. area)
-    std::multimap<double,unsigned int> pointsByArea;
-    std::map<unsigned int,double> areasByPoint;
-
-    unsigned int numPts = polyLine->getNumPoints()-1;   // ignore the last point since
-                                                        // the last point == first point
-    for(unsigned int i=1; i < numPts-1; i++)   {
-        double triArea = calcAreaTriangle(polyLine->getX(i-1),polyLine->getY(i-1),
-                                          polyLine->getX(i+0),polyLine->getY(i+0),
-                                          polyLine->getX(i+1),polyLine->getY(i+1));
-
-        // * delete all the points that have an effective
-        //   area of zero (this indicates a colinear set of pts)
-        if(triArea > 0)   {
-            std::pair<double,unsigned int> insArea(triArea,i);
-            pointsByArea.insert(insArea);
-
-            std::pair<unsigned int,double> insPt(i,triArea);
-            areasByPoint.insert(insPt);
+public:
+    VWHeap(size_t numPts) :
+        m_listHeapPos(numPts,0)
+    {
+        m_heap.reserve(numPts);
+    }
+
+    bool Empty() const
+    {
+        return m_heap.empty();
+    }
+
+    void Push(unsigned int idx, double area)
+    {
+        m_listHeapPos[idx] = m_heap.size();
+        m_heap.push_back(Entry(area,idx));
+        siftUp(m_heap.size()-1);
+    }
+
+    // removes the point with the least area
+    unsigned int Pop(double &area)
+    {
+        unsigned int idx = m_heap[0].idx;
+        area = m_heap[0].area;
+
+        m_heap[0] = m_heap.back();
+        m_heap.pop_back();
+        if(!m_heap.empty())   {
+            m_listHeapPos[m_heap[0].idx] = 0;
+            siftDown(0);
         }
+        return idx;
     }
 
-    // * expect pointsByArea and areasByPoint to be in sync
-    unsigned int sIdx = 0;
-    unsigned int eIdx = numPts-1;
+    void Update(unsigned int idx, double area)
+    {
+        size_t pos = m_listHeapPos[idx];
+        m_heap[pos].area = area;
+        siftUp(pos);
+        siftDown(m_listHeapPos[idx]);
+    }
 
-    std::multimap<double,unsigned int>::iterator aListIt;
-    std::map<unsigned int,double>::iterator pListIt,tempIt,lastIt;
-    std::pair<std::multimap<double,unsigned int>::iterator,
-              std::multimap<double,unsigned int>::iterator> itRange;
+private:
+    struct Entry
+    {
+        Entry(double area, unsigned int idx) :
+            area(area),idx(idx) {}
 
-//    for(pListIt = areasByPoint.begin();
-//        pListIt != areasByPoint.end(); ++pListIt)   {
-////        std::cout << "PIdx: " << pListIt->first << ", " << pListIt->second << "\n";
-//    }
+        double area;
+        unsigned int idx;
 
-//    for(aListIt = pointsByArea.begin();
-//        aListIt != pointsByArea.end(); ++aListIt)   {
-////        std::cout << "Area: " << aListIt->first << " " << aListIt->second << "\n";
-//    }
+        // ties are broken by index so the order of
+        // removal doesn't depend on the heap layout
+        bool operator < (Entry const &other) const
+        {
+            if(area == other.area)   {
+                return (idx < other.idx);
+            }
+            return (area < other.area);
+        }
+    };
 
-    while(1) {
+    void swap(size_t posA, size_t posB)
+    {
+        std::swap(m_heap[posA],m_heap[posB]);
+        m_listHeapPos[m_heap[posA].idx] = posA;
+        m_listHeapPos[m_heap[posB].idx] = posB;
+    }
 
-        if(pointsByArea.size() < 3)   {
-            break;
+    void siftUp(size_t pos)
+    {
+        while(pos > 0)   {
+            size_t parent = (pos-1)/2;
+            if(!(m_heap[pos] < m_heap[parent]))   {
+                break;
+            }
+            swap(pos,parent);
+            pos = parent;
         }
+    }
 
-        // find the point with the least effective area
-        // and call it the current point
-        aListIt = pointsByArea.begin();
-        pListIt = areasByPoint.find(aListIt->second);
-        lastIt = areasByPoint.end(); --lastIt;
+    void siftDown(size_t pos)
+    {
+        while(true)   {
+            size_t child = 2*pos+1;
+            if(child >= m_heap.size())   {
+                break;
+            }
+            if(child+1 < m_heap.size() &&
+               m_heap[child+1] < m_heap[child])   {
+                child++;
+            }
+            if(!(m_heap[child] < m_heap[pos]))   {
+                break;
+            }
+            swap(pos,child);
+            pos = child;
+        }
+    }
 
-        unsigned int cIdx = pListIt->first; // current point
-        unsigned int pIdx,pIdx_prev,nIdx,nIdx_next;
+    std::vector<size_t> m_listHeapPos;
+    std::vector<Entry> m_heap;
+};
 
-        // indicates if the current point is at either end;
-        // note that a point cant be first AND last because
-        // we have a minimum of four points per poly
-        bool isFirst,isLast;
+// Calculates the Visvalingam-Whyatt effective area of
+// every point in a ring; simplifying the ring to any
+// area threshold is then just a matter of keeping the
+// points whose effective area is at least the threshold.
+//
+// listRingPts shouldn't repeat the first point at the
+// end. The first and last points (and the last two
+// points between them to be removed) are never removed
+// and get an area of DBL_MAX, so a simplified ring always
+// has at least four points.
+//
+// Effective areas are kept monotonic: if removing a point
+// shrinks the area of its neighbour below the area of
+// the removed point, the neighbour's effective area is
+// clamped to the removed point's area so it's removed
+// at the same threshold.
+void calcVWEffectiveAreas(std::vector<Vec2> const &listRingPts,
+                          std::vector<double> &listEffAreas)
+{
+    size_t numPts = listRingPts.size();
+    listEffAreas.assign(numPts,DBL_MAX);
+    if(numPts < 5)   {
+        return;
+    }
 
-        if(pListIt == areasByPoint.begin())   {             // is first
-            isFirst = true;
-            tempIt = pListIt;
-                                    pIdx = sIdx;
-            std::advance(tempIt,1); nIdx = tempIt->first;
-            std::advance(tempIt,1); nIdx_next = tempIt->first;
+    // the points are kept in a doubly linked list so
+    // the neighbours of a point can be found after
+    // points have been removed
+    std::vector<unsigned int> listPrev(numPts);
+    std::vector<unsigned int> listNext(numPts);
 
-//            std::cout << "First Tri: " << pIdx <<","<<cIdx<<","<<nIdx<<","<<aListIt->first<<"\n";
-        }
-        else if(pListIt == lastIt)   {        // is last
-            isLast = true;
-            tempIt = pListIt;
-
-            std::advance(tempIt,-2); pIdx_prev = tempIt->first;
-            std::advance(tempIt,1);  pIdx = tempIt->first;
-                                     nIdx = eIdx;
-//            std::cout << "Last Tri: " << pIdx <<","<<cIdx<<","<<nIdx<<","<<aListIt->first<<"\n";
+    VWHeap heap(numPts);
+    for(unsigned int i=1; i < numPts-1; i++)   {
+        listPrev[i] = i-1;
+        listNext[i] = i+1;
+        heap.Push(i,calcAreaTriangle(listRingPts[i-1].x,listRingPts[i-1].y,
+                                     listRingPts[i+0].x,listRingPts[i+0].y,
+                                     listRingPts[i+1].x,listRingPts[i+1].y));
+    }
+    listNext[0] = 1;
+    listPrev[numPts-1] = numPts-2;
+
+    unsigned int const sIdx = 0;
+    unsigned int const eIdx = numPts-1;
+    size_t numInBetween = numPts-2;
+    double maxEffArea = 0;
+
+    while(numInBetween > 2)   {
+        // remove the point with the least area
+        double cArea;
+        unsigned int cIdx = heap.Pop(cArea);
+        maxEffArea = std::max(maxEffArea,cArea);
+        listEffAreas[cIdx] = maxEffArea;
+        numInBetween--;
+
+        unsigned int pIdx = listPrev[cIdx];
+        unsigned int nIdx = listNext[cIdx];
+        listNext[pIdx] = nIdx;
+        listPrev[nIdx] = pIdx;
+
+        // recalculate the areas of its neighbours
+        if(pIdx != sIdx)   {
+            unsigned int ppIdx = listPrev[pIdx];
+            heap.Update(pIdx,calcAreaTriangle(listRingPts[ppIdx].x,listRingPts[ppIdx].y,
+                                              listRingPts[pIdx].x,listRingPts[pIdx].y,
+                                              listRingPts[nIdx].x,listRingPts[nIdx].y));
         }
-        else   {                                            // is inbetween
-            isFirst = false;
-            isLast = false;
-
-            // set pIdx and pIdx_prev
-            tempIt = pListIt;
-            std::advance(tempIt,-1); pIdx=tempIt->first;
-            if(tempIt == areasByPoint.begin())
-            {   pIdx_prev=sIdx;   }
-            else
-            {   std::advance(tempIt,-1); pIdx_prev=tempIt->first;   }
-
-            // set nIdx and nIdx_next
-            tempIt = pListIt;
-            std::advance(tempIt,1);  nIdx = tempIt->first;
-            if(tempIt == lastIt)
-            {   nIdx_next=eIdx;   }
-            else
-            {   std::advance(tempIt,1);  nIdx_next=tempIt->first;   }
-
-//            std::cout << "Middle Tri: "
-//                      << pIdx <<","<<cIdx<<","<<nIdx<<","<<aListIt->first
-//                      << " | ";
-//            std::cout << "\n";
+        if(nIdx != eIdx)   {
+            unsigned int nnIdx = listNext[nIdx];
+            heap.Update(nIdx,calcAreaTriangle(listRingPts[pIdx].x,listRingPts[pIdx].y,
+                                              listRingPts[nIdx].x,listRingPts[nIdx].y,
+                                              listRingPts[nnIdx].x,listRingPts[nnIdx].y));
         }
+    }
+}
 
-        // if the area of the current point is below the
-        // threshold, delete it from the polyline
-        if(aListIt->first < VW_AREA)   {
-            // delete the point from our maps
-            pointsByArea.erase(aListIt);
-            areasByPoint.erase(pListIt);
-
-            if(!isLast)   {
-                // recalculate the adjacent triangle
-                // area for the next index (pIdx,nIdx,nIdx_next)
-
-                // * find the elements we have to update in each map
-                pListIt = areasByPoint.find(nIdx);
-                itRange = pointsByArea.equal_range(pListIt->second);
-                for(aListIt = itRange.first; aListIt != itRange.second; ++aListIt)   {
-                    if(aListIt->second == nIdx)   {
-                        break;
-                    }
-                }
-                // * recalculate area
-                double nIdxArea = calcAreaTriangle(polyLine->getX(pIdx),
-                                                   polyLine->getY(pIdx),
-                                                   polyLine->getX(nIdx),
-                                                   polyLine->getY(nIdx),
-                                                   polyLine->getX(nIdx_next),
-                                                   polyLine->getY(nIdx_next));
-
-                // * replace old entries in both maps for nIdx
-                pointsByArea.erase(aListIt);
-                areasByPoint.erase(pListIt);
-
-                std::pair<double,unsigned int> insArea(nIdxArea,nIdx);
-                pointsByArea.insert(insArea);
-
-                std::pair<unsigned int,double> insPt(nIdx,nIdxArea);
-                areasByPoint.insert(insPt);
-            }
-
-            if(!isFirst)   {
-                // recalculate the adjacent triangle
-                // area for the prev index (nIdx,pIdx,pIdx_prev)
+// Replaces the points in polyLine with the points in
+// listRingPts whose effective area is at least minArea
+void setVWRingPoints(OGRLinearRing *polyLine,
+                     std::vector<Vec2> const &listRingPts,
+                     std::vector<double> const &listEffAreas,
+                     double minArea)
+{
+    polyLine->empty();
+    for(size_t i=0; i < listRingPts.size(); i++)   {
+        if(listEffAreas[i] >= minArea)   {
+            polyLine->addPoint(listRingPts[i].x,listRingPts[i].y,0);
+        }
+    }
+    if(!listRingPts.empty())   {
+        polyLine->addPoint(listRingPts[0].x,listRingPts[0].y,0);   // wrap == first
+    }
+}
 
-                // * find the elements we have to update in each map
-                pListIt = areasByPoint.find(pIdx);
-                itRange = pointsByArea.equal_range(pListIt->second);
-                for(aListIt = itRange.first; aListIt != itRange.second; ++aListIt)   {
-                    if(aListIt->second == pIdx)   {
-                        break;
-                    }
-                }
-                // * recalculate area
-                double pIdxArea = calcAreaTriangle(polyLine->getX(nIdx),
-                                                   polyLine->getY(nIdx),
-                                                   polyLine->getX(pIdx),
-                                                   polyLine->getY(pIdx),
-                                                   polyLine->getX(pIdx_prev),
-                                                   polyLine->getY(pIdx_prev));
-
-                // * replace old entries in both maps for pIdx
-                pointsByArea.erase(aListIt);
-                areasByPoint.erase(pListIt);
-
-                std::pair<double,unsigned int> insArea(pIdxArea,pIdx);
-                pointsByArea.insert(insArea);
-
-                std::pair<unsigned int,double> insPt(pIdx,pIdxArea);
-                areasByPoint.insert(insPt);
+// Calls fn(i) for every i in [0,count) on numThreads threads
+template <typename Fn>
+void runParallel(size_t count, size_t numThreads, Fn fn)
+{
+    std::atomic<size_t> ixNext(0);
+    std::vector<std::thread> listWorkers;
+    for(size_t t=0; t < std::min(numThreads,count); t++)   {
+        listWorkers.push_back(std::thread([&]() {
+            size_t i;
+            while((i=ixNext++) < count)   {
+                fn(i);
             }
-        }
-        else   {
-            // since point areas are ordered by increasing area,
-            // if the current point area is greater than the threshold,
-            // all other points are as well, and we're done
-            break;
-        }
+        }));
     }
+    for(size_t t=0; t < listWorkers.size(); t++)   {
+        listWorkers[t].join();
+    }
+}
 
-    // save
+// A line of the input file
+struct SimplifyLine
+{
+    SimplifyLine() :
+        geometry(NULL),
+        ixFirstRing(0),
+        numRings(0)
+    {}
+
+    std::string wktLine;
+    std::string error;
+    OGRGeometry * geometry;
+
+    // rings of this line's geometry in the batch's ring list
+    size_t ixFirstRing;
+    size_t numRings;
+
+    // simplified wkt for each tolerance
+    std::vector<std::string> listOutputWkt;
+};
+
+struct SimplifyRing
+{
+    OGRLinearRing * ring;
     std::vector<Vec2> listRingPts;
-    listRingPts.push_back(Vec2(polyLine->getX(sIdx),polyLine->getY(sIdx)));               // first
+    std::vector<double> listEffAreas;
+};
+
+void parseLine(SimplifyLine &line)
+{
+    std::string &wktLine = line.wktLine;
+
+    // remove any quotes around wktLine
+    if(wktLine[0] == '\"' || wktLine[0] == '\'')
+    {   wktLine.erase(0,1);   }
+
+    if(!wktLine.empty() &&
+       (wktLine[wktLine.size()-1] == '\"' || wktLine[wktLine.size()-1] == '\''))
+    {   wktLine.erase(wktLine.size()-1,1);   }
 
-    for(pListIt = areasByPoint.begin();                                                   // in betweens
-        pListIt != areasByPoint.end(); ++pListIt)   {
-        listRingPts.push_back(Vec2(polyLine->getX(pListIt->first),
-                                   polyLine->getY(pListIt->first)));
+    // create geometry from wkt
+    std::vector<char> wktBuff(wktLine.begin(),wktLine.end());
+    wktBuff.push_back('\0');
+    char *inputWKT = &(wktBuff[0]);
+
+    OGRGeometry *inputGeometry = NULL;
+    OGRGeometryFactory::createFromWkt(&inputWKT, NULL, &inputGeometry);
+
+    if (inputGeometry == NULL)   {
+        line.error = "Error: WKT is not valid (ignoring)";
+        return;
     }
-    listRingPts.push_back(Vec2(polyLine->getX(eIdx),polyLine->getY(eIdx)));               // last
-    listRingPts.push_back(listRingPts[0]);       // wrap == first
 
-    polyLine->empty();
-    for(unsigned int i=0; i < listRingPts.size(); i++)   {
-        polyLine->addPoint(listRingPts[i].x,listRingPts[i].y,0);
+    if(!(inputGeometry->getGeometryType() == wkbMultiPolygon ||
+         inputGeometry->getGeometryType() == wkbPolygon))   {
+        line.error = "Error: WKT is not POLYGON/MULTIPOLYGON (ignoring)";
+        delete inputGeometry;
+        return;
+    }
+
+    line.geometry = inputGeometry;
+}
+
+void collectRings(OGRPolygon *singlePoly,
+                  std::vector<SimplifyRing> &listRings)
+{
+    listRings.push_back(SimplifyRing());
+    listRings.back().ring = singlePoly->getExteriorRing();
+
+    for(int j=0; j < singlePoly->getNumInteriorRings(); j++)   {
+        listRings.push_back(SimplifyRing());
+        listRings.back().ring = singlePoly->getInteriorRing(j);
     }
 }
 
 int main(int argc, const char *argv[])
 {
-    if(argc != 3) {
-        std::cout << "Usage: #> ./ptk_simplify_wkt myinputfile.dat myoutputfile.ply\n";
+    if(argc < 3 || argc > 5) {
+        std::cout << "Usage: #> ./ptk_simplify_wkt myinputfile.dat myoutputfile.dat [tolerances] [numthreads]\n";
         std::cout << "* Expect each line of the input file to contain a single WKT def\n";
         std::cout << "* The output file is in the same format as the input file\n";
+        std::cout << "* tolerances is a comma separated list of areas (Visvalingam-Whyatt)\n";
+        std::cout << "  or distances (Douglas-Peucker) to simplify with; if there's more\n";
+        std::cout << "  than one, an output file is written for each as myoutputfile.dat.N\n";
+        std::cout << "  where N is the tolerance. Visvalingam-Whyatt areas are calculated\n";
+        std::cout << "  once per ring no matter how many tolerances there are\n";
+        std::cout << "* Polygons are simplified with numthreads threads (defaults to\n";
+        std::cout << "  the number of cores)\n";
         return 0;
     }
 
@@ -298,13 +403,56 @@ int main(int argc, const char *argv[])
         return -1;
     }
 
+    // tolerances
+    std::vector<std::string> listTolStrs;
+    if(argc > 3)   {
+        std::stringstream ss(argv[3]);
+        std::string tolStr;
+        while(std::getline(ss,tolStr,','))   {
+            if(!tolStr.empty())   {
+                listTolStrs.push_back(tolStr);
+            }
+        }
+    }
+    if(listTolStrs.empty())   {
+        if(SIMPLIFY_MODE == DOUGLAS_PEUCKER)   {
+            listTolStrs.push_back(NumberToString(DP_DIST));
+        }
+        else   {
+            listTolStrs.push_back(NumberToString(VW_AREA));
+        }
+    }
+
+    std::vector<double> listTols;
+    for(size_t t=0; t < listTolStrs.size(); t++)   {
+        std::stringstream ss(listTolStrs[t]);
+        double tol = 0;
+        ss >> tol;
+        listTols.push_back(tol);
+    }
+
+    size_t numThreads = std::thread::hardware_concurrency();
+    if(argc > 4)   {
+        numThreads = atoi(argv[4]);
+    }
+    numThreads = std::max(numThreads,size_t(1));
+
     StartTiming("[Simplification]");
 
     std::ifstream inputWktFile;
     inputWktFile.open(argv[1]);
 
-    std::ofstream outputWktFile;
-    outputWktFile.open(argv[2]);
+    // one output file per tolerance
+    std::vector<std::ofstream*> listOutputWktFiles;
+    bool outputsOpen = true;
+    for(size_t t=0; t < listTols.size(); t++)   {
+        std::string outputPath(argv[2]);
+        if(listTols.size() > 1)   {
+            outputPath += "." + listTolStrs[t];
+        }
+        listOutputWktFiles.push_back(new std::ofstream(outputPath.c_str()));
+        outputsOpen = outputsOpen && listOutputWktFiles.back()->is_open();
+    }
 
     // get number of input lines
     unsigned int numInputLines=0;
@@ -319,108 +467,152 @@ int main(int argc, const char *argv[])
     inputWktFile.open(argv[1]);
 
     // do stuff
-    if(inputWktFile.is_open() && outputWktFile.is_open())
+    if(inputWktFile.is_open() && outputsOpen)
     {
-        int linesProcessed = 0;
-        outputWktFile << "WKT\n";
-        while(!inputWktFile.eof())
-        {
-            std::string wktLine;
-            std::getline(inputWktFile,wktLine);
-
-            // remove any quotes around wktLine
-            if(wktLine[0] == '\"' || wktLine[0] == '\'')
-            {   wktLine.erase(0,1);   }
-
-            if(wktLine[wktLine.size()-1] == '\"' || wktLine[wktLine.size()-1] == '\'')
-            {   wktLine.erase(wktLine.size()-1,1);   }
+        for(size_t t=0; t < listOutputWktFiles.size(); t++)   {
+            (*listOutputWktFiles[t]) << "WKT\n";
+        }
 
-            // create geometry from wkt
-            char *inputWKT = new char[wktLine.size()+1];
-            char *inputWKTRef = inputWKT;
-            strcpy(inputWKT,wktLine.c_str());
+        // lines are read and written in batches; each
+        // batch is parsed and simplified in parallel
+        size_t const batchSize = 4096;
+        int linesProcessed = 0;
 
-            OGRGeometry *inputGeometry;
-            OGRGeometryFactory::createFromWkt(&inputWKT, NULL, &inputGeometry);
+        std::vector<SimplifyLine> listLines;
+        std::vector<SimplifyRing> listRings;
 
-            if (inputGeometry == NULL)   {
-                std::cout << "Error: WKT is not valid (ignoring)" << std::endl;
-                std::cout << "-> " << wktLine << std::endl;
-                delete[] inputWKTRef;
-                continue;
-            }
-            delete[] inputWKTRef;
+        while(!inputWktFile.eof())
+        {
+            listLines.clear();
+            listRings.clear();
 
-            if(!(inputGeometry->getGeometryType() == wkbMultiPolygon ||
-                 inputGeometry->getGeometryType() == wkbPolygon))   {
-                std::cout << "Error: WKT is not POLYGON/MULTIPOLYGON (ignoring)" << std::endl;
-                std::cout << "-> " << wktLine << std::endl;
-                continue;
+            std::string wktLine;
+            while(listLines.size() < batchSize &&
+                  std::getline(inputWktFile,wktLine))   {
+                if(wktLine.empty())   {
+                    continue;
+                }
+                listLines.push_back(SimplifyLine());
+                listLines.back().wktLine.swap(wktLine);
             }
 
-            OGRGeometry *simplerGeometry;
+            // parse
+            runParallel(listLines.size(),numThreads,[&](size_t i) {
+                parseLine(listLines[i]);
+            });
 
             if(SIMPLIFY_MODE == DOUGLAS_PEUCKER)   {
-                simplerGeometry = inputGeometry->SimplifyPreserveTopology(DP_DIST);
-
-                if(!(simplerGeometry == NULL))   {
-                    char *outputWKT;
-                    simplerGeometry->exportToWkt(&outputWKT);
-                    outputWktFile << outputWKT << std::endl;
-                    delete[] outputWKT;
-                    delete simplerGeometry;
-                }
-                else   {
-                    std::cout << "Simplified Geom was NULL\n" << std::endl;
-                }
-            }
+                runParallel(listLines.size(),numThreads,[&](size_t i) {
+                    SimplifyLine &line = listLines[i];
+                    if(line.geometry == NULL)   {
+                        return;
+                    }
+
+                    for(size_t t=0; t < listTols.size(); t++)   {
+                        OGRGeometry *simplerGeometry =
+                                line.geometry->SimplifyPreserveTopology(listTols[t]);
 
+                        if(!(simplerGeometry == NULL))   {
+                            char *outputWKT;
+                            simplerGeometry->exportToWkt(&outputWKT);
+                            line.listOutputWkt.push_back(outputWKT);
+                            CPLFree(outputWKT);
+                            delete simplerGeometry;
+                        }
+                        else   {
+                            line.listOutputWkt.push_back(std::string());
+                            line.error = "Simplified Geom was NULL\n";
+                        }
+                    }
+                });
+            }
             else if (SIMPLIFY_MODE == VISVALINGAM_WHYATT)   {
                 // http://www2.dcs.hull.ac.uk/CISRG/publications/DPs/DP10/DP10.html
                 // this algorithm works on polylines -- so we operate
                 // on the constituent rings of the polygons
-                if(inputGeometry->getGeometryType() == wkbMultiPolygon)   {
-                    OGRMultiPolygon *multiPoly = (OGRMultiPolygon*)inputGeometry;
-                    for(int i=0; i < multiPoly->getNumGeometries(); i++)   {
-                        // outer ring
-                        OGRPolygon *singlePoly = (OGRPolygon*)(multiPoly->getGeometryRef(i));
-                        OGRLinearRing* outerRing = singlePoly->getExteriorRing();
-                        simplifyWithVW(outerRing);
-
-                        // inner rings
-                        for(int j=0; j < singlePoly->getNumInteriorRings(); j++)   {
-                            OGRLinearRing *innerRing = singlePoly->getInteriorRing(j);
-                            simplifyWithVW(innerRing);
+                for(size_t i=0; i < listLines.size(); i++)   {
+                    SimplifyLine &line = listLines[i];
+                    if(line.geometry == NULL)   {
+                        continue;
+                    }
+
+                    line.ixFirstRing = listRings.size();
+                    if(line.geometry->getGeometryType() == wkbMultiPolygon)   {
+                        OGRMultiPolygon *multiPoly = (OGRMultiPolygon*)line.geometry;
+                        for(int j=0; j < multiPoly->getNumGeometries(); j++)   {
+                            OGRPolygon *singlePoly = (OGRPolygon*)(multiPoly->getGeometryRef(j));
+                            collectRings(singlePoly,listRings);
                         }
                     }
-                }
-                else if(inputGeometry->getGeometryType() == wkbPolygon)   {
-                    // outer ring
-                    OGRPolygon *singlePoly = (OGRPolygon*)inputGeometry;
-                    OGRLinearRing* outerRing = singlePoly->getExteriorRing();
-                    simplifyWithVW(outerRing);
-
-                    // inner rings
-                    for(int j=0; j < singlePoly->getNumInteriorRings(); j++)   {
-                        OGRLinearRing *innerRing = singlePoly->getInteriorRing(j);
-                        simplifyWithVW(innerRing);
+                    else if(line.geometry->getGeometryType() == wkbPolygon)   {
+                        collectRings((OGRPolygon*)line.geometry,listRings);
                     }
+                    line.numRings = listRings.size()-line.ixFirstRing;
                 }
 
-                char *outputWKT;
-                inputGeometry->exportToWkt(&outputWKT);
-                outputWktFile << outputWKT << std::endl;
-                delete[] outputWKT;
+                // effective areas for each ring
+                runParallel(listRings.size(),numThreads,[&](size_t i) {
+                    SimplifyRing &ring = listRings[i];
+
+                    // ignore the last point since
+                    // the last point == first point
+                    int numPts = ring.ring->getNumPoints()-1;
+                    for(int j=0; j < numPts; j++)   {
+                        ring.listRingPts.push_back(Vec2(ring.ring->getX(j),
+                                                        ring.ring->getY(j)));
+                    }
+                    calcVWEffectiveAreas(ring.listRingPts,ring.listEffAreas);
+                });
+
+                // simplified geometry for each tolerance
+                runParallel(listLines.size(),numThreads,[&](size_t i) {
+                    SimplifyLine &line = listLines[i];
+                    if(line.geometry == NULL)   {
+                        return;
+                    }
+
+                    for(size_t t=0; t < listTols.size(); t++)   {
+                        for(size_t r=0; r < line.numRings; r++)   {
+                            SimplifyRing &ring = listRings[line.ixFirstRing+r];
+                            setVWRingPoints(ring.ring,ring.listRingPts,
+                                            ring.listEffAreas,listTols[t]);
+                        }
+
+                        char *outputWKT;
+                        line.geometry->exportToWkt(&outputWKT);
+                        line.listOutputWkt.push_back(outputWKT);
+                        CPLFree(outputWKT);
+                    }
+                });
             }
 
-            delete inputGeometry;
+            // write out this batch in order
+            for(size_t i=0; i < listLines.size(); i++)   {
+                SimplifyLine &line = listLines[i];
+                if(!line.error.empty())   {
+                    std::cout << line.error << std::endl;
+                    if(line.geometry == NULL)   {
+                        std::cout << "-> " << line.wktLine << std::endl;
+                    }
+                }
+                for(size_t t=0; t < line.listOutputWkt.size(); t++)   {
+                    if(!line.listOutputWkt[t].empty())   {
+                        (*listOutputWktFiles[t]) << line.listOutputWkt[t] << std::endl;
+                    }
+                }
+                delete line.geometry;
+            }
 
-            linesProcessed++;
+            linesProcessed += listLines.size();
             std::cout << "Lines Processed: "
                       << linesProcessed << "/" << numInputLines <<std::endl;
         }
         inputWktFile.close();
-        outputWktFile.close();
+    }
+
+    for(size_t t=0; t < listOutputWktFiles.size(); t++)   {
+        listOutputWktFiles[t]->close();
+        delete listOutputWktFiles[t];
     }
     EndTiming();
 
@@ -5,6 +5,6 @@ SOURCES += ptk_simplify_wkt.cpp
 TARGET = ptk_simplify_wkt
 
 # required libs
-LIBS += -lgdal -lCGAL_Core -lCGAL -lmpfr -lgmp -lboost_thread
+LIBS += -lgdal -lCGAL_Core -lCGAL -lmpfr -lgmp -lboost_thread -lpthread
 
 QMAKE_CXXFLAGS += -std=c++0x
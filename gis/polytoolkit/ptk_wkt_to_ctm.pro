@@ -37,3 +37,17 @@ LIBS += -lgdal -lCGAL_Core -lCGAL -lmpfr -lgmp -lboost_thread
 
 # c++0x
 QMAKE_CXXFLAGS += -std=c++0x
+
+# geodesy
+INCLUDEPATH += $${PWD}/../../utils/geodesy
+HEADERS += $${PWD}/../../utils/geodesy/geodesy.hpp
+
+# vxweld
+INCLUDEPATH += $${PWD}/../../utils/vxweld
+HEADERS += $${PWD}/../../utils/vxweld/vxweld.hpp
+
+# wkt reader
+HEADERS += WktReader.hpp
+
+# fast path for valid polygons
+HEADERS += SimplePolyTriangulator.hpp
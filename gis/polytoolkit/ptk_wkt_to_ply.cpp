@@ -50,6 +50,12 @@
 // OGR
 #include <ogrsf_frmts.h>
 
+// mmap'd wkt/wkb reader
+#include "WktReader.hpp"
+
+// fast path for valid polygons
+#include "SimplePolyTriangulator.hpp"
+
 // CGAL
 #include <CGAL/Exact_predicates_inexact_constructions_kernel.h>
 #include <CGAL/Triangulation_face_base_with_info_2.h>
@@ -70,17 +76,14 @@
 // epsilon
 #define K_EPS 1E-11
 
-// WGS84 ellipsoid parameters
-// (http://en.wikipedia.org/wiki/WGS_84)
-#define ELL_SEMI_MAJOR 6378137.0            // meters
-#define ELL_SEMI_MAJOR_EXP2 40680631590769
+// vertices closer than this (in degrees) are welded
+#define K_WELD_EPS 1E-9
 
-#define ELL_SEMI_MINOR 6356752.3142         // meters
-#define ELL_SEMI_MINOR_EXP2 40408299984087.1
+// WGS84 ellipsoid and LLA <-> ECEF conversions
+#include <geodesy.hpp>
 
-#define ELL_F 1/298.257223563
-#define ELL_ECC_EXP2 6.69437999014e-3
-#define ELL_ECC2_EXP2 6.73949674228e-3
+// vertex welding
+#include <vxweld.hpp>
 
 #define USE_ECEF false
 
@@ -136,35 +139,6 @@ bool compareVec3(Vec3 const &first, Vec3 const &second)
     return false;
 }
 
-std::string Vec3ToString (Vec3 const &myVec)
-{
-    std::stringstream ss;
-    ss.precision(12);
-    ss << myVec.x << "," << myVec.y << "," << myVec.z << std::endl;
-    return ss.str();
-}
-
-Vec3 StringToVec3(const std::string &myText)
-{
-    unsigned int xEnd = myText.find(",");
-    unsigned int yEnd = myText.find_last_of(",");
-    std::string xStr = myText.substr(0,xEnd);
-    std::string yStr = myText.substr(xEnd+1,yEnd-xEnd-1);
-    std::string zStr = myText.substr(yEnd+1);
-
-    Vec3 myVec;
-    std::stringstream ssX(xStr);
-    ssX >> myVec.x;
-
-    std::stringstream ssY(yStr);
-    ssY >> myVec.y;
-
-    std::stringstream ssZ(zStr);
-    ssZ >> myVec.z;
-
-    return myVec;
-}
-
 class PointLLA
 {
 public:
@@ -185,18 +159,12 @@ public:
 Vec3 convLLAToECEF(const PointLLA &pointLLA)
 {
     Vec3 pointECEF;
-
-    // remember to convert deg->rad
-    double sinLat = sin(pointLLA.lat * K_PI/180.0f);
-    double sinLon = sin(pointLLA.lon * K_PI/180.0f);
-    double cosLat = cos(pointLLA.lat * K_PI/180.0f);
-    double cosLon = cos(pointLLA.lon * K_PI/180.0f);
-
-    // v = radius of curvature (meters)
-    double v = ELL_SEMI_MAJOR / (sqrt(1-(ELL_ECC_EXP2*sinLat*sinLat)));
-    pointECEF.x = (v + pointLLA.alt) * cosLat * cosLon;
-    pointECEF.y = (v + pointLLA.alt) * cosLat * sinLon;
-    pointECEF.z = ((1-ELL_ECC_EXP2)*v + pointLLA.alt)*sinLat;
+    geodesy::ConvLLAToECEF(pointLLA.lon,
+                           pointLLA.lat,
+                           pointLLA.alt,
+                           pointECEF.x,
+                           pointECEF.y,
+                           pointECEF.z);
 
     return pointECEF;
 }
@@ -337,116 +305,93 @@ void EndTiming()
 }
 
 
-int main(int argc, const char *argv[])
+// Repairs the geometry with CGAL (see repair() below)
+// and adds the triangles of the repaired polygons to
+// the mesh
+void repairAndTriangulate(OGRGeometry *inputGeometry, TriangleMesh &triMesh)
 {
-    if(argc != 3) {
-        std::cout << "Usage: #> ./ptk_wkt_to_ply inputfile myoutputfile\n";
-        std::cout << "* Expect each line of the input file to contain a single WKT POLYGON() def\n";
-        std::cout << "* The output file is a mesh in PLY format\n";
-        return 0;
-    }
-
-    StartTiming("[Covert WKT to PLY]");
-
-    std::ifstream wktFile;
-    wktFile.open(argv[1]);
-
-    // get number of input lines
-    unsigned int numInputLines=0;
-    if(wktFile.is_open())   {
-        while(!wktFile.eof())   {
-            std::string wktLine;
-            std::getline(wktFile,wktLine);
-            numInputLines++;
-        }
-    }
-    wktFile.close();
-    wktFile.open(argv[1]);
-
-    if(wktFile.is_open())
+    // process / fix geometry
+    Triangulation myTriangulation;
+    OGRMultiPolygon* outputPolygons = repair(inputGeometry,myTriangulation);
+
+    // get list of cdt triangles
+    std::vector<Tri> listCDTTriangles;
+    std::vector<bool> listTrisToKeep;
+    Triangulation::Finite_faces_iterator fIt;
+    for(fIt = myTriangulation.finite_faces_begin();
+        fIt != myTriangulation.finite_faces_end(); ++fIt)
     {
-        TriangleMesh triMesh;
-        int linesProcessed = 0;
+        Triangulation::Triangle cdtTri = myTriangulation.triangle(fIt);
 
-        while(!wktFile.eof())
-        {
-            std::string wktLine;
-            std::getline(wktFile,wktLine);
+        Tri myTri;
+        myTri.A.x = cdtTri[0].x();
+        myTri.A.y = cdtTri[0].y();
 
-            // remove any quotes around wktLine
-            if(wktLine[0] == '\"' || wktLine[0] == '\'')
-            {   wktLine.erase(0,1);   }
+        myTri.B.x = cdtTri[1].x();
+        myTri.B.y = cdtTri[1].y();
 
-            if(wktLine[wktLine.size()-1] == '\"' || wktLine[wktLine.size()-1] == '\'')
-            {   wktLine.erase(wktLine.size()-1,1);   }
+        myTri.C.x = cdtTri[2].x();
+        myTri.C.y = cdtTri[2].y();
 
-            // create geometry from wkt
-            char *inputWKT = new char[wktLine.size()+1];
-            char *inputWKTRef = inputWKT;
-            strcpy(inputWKT,wktLine.c_str());
+        myTri.len_a = sqrt( pow(myTri.C.x-myTri.B.x,2) + pow(myTri.C.y-myTri.B.y,2));
+        myTri.len_b = sqrt( pow(myTri.C.x-myTri.A.x,2) + pow(myTri.C.y-myTri.A.y,2));
+        myTri.len_c = sqrt( pow(myTri.A.x-myTri.B.x,2) + pow(myTri.A.y-myTri.B.y,2));
 
-            OGRGeometry *inputGeometry;
-            OGRGeometryFactory::createFromWkt(&inputWKT, NULL, &inputGeometry);
+        listCDTTriangles.push_back(myTri);
+        listTrisToKeep.push_back(false);
+    }
 
-            if (inputGeometry == NULL)   {
-                std::cout << "Error: WKT is not valid (ignoring)" << std::endl;
-                std::cout << "-> " << wktLine << std::endl;
-                delete[] inputWKTRef;
-                continue;
+    if(!(outputPolygons == NULL))
+    {
+        // discard triangles using the repaired multipolygon as a ref
+        for(int i=0; i < outputPolygons->getNumGeometries(); i++)
+        {
+            OGRGeometry *polyGeometry = outputPolygons->getGeometryRef(i);
+            OGRPolygon *singlePoly = (OGRPolygon*)polyGeometry;
+
+            // filter triangles outside of outer ring
+            OGRLinearRing* outerRing = singlePoly->getExteriorRing();
+            std::vector<Vec2> listOuterRingPts(outerRing->getNumPoints());
+            for(int j=0; j < listOuterRingPts.size(); j++)   {
+                OGRPoint *myPt = new OGRPoint; outerRing->getPoint(j,myPt);
+                listOuterRingPts[j] = Vec2(myPt->getX(),myPt->getY());
+                delete myPt;
             }
-            delete[] inputWKTRef;
-
-            // process / fix geometry
-            Triangulation myTriangulation;
-            OGRMultiPolygon* outputPolygons = repair(inputGeometry,myTriangulation);
-
-            // get list of cdt triangles
-            std::vector<Tri> listCDTTriangles;
-            std::vector<bool> listTrisToKeep;
-            Triangulation::Finite_faces_iterator fIt;
-            for(fIt = myTriangulation.finite_faces_begin();
-                fIt != myTriangulation.finite_faces_end(); ++fIt)
-            {
-                Triangulation::Triangle cdtTri = myTriangulation.triangle(fIt);
 
-                Tri myTri;
-                myTri.A.x = cdtTri[0].x();
-                myTri.A.y = cdtTri[0].y();
-
-                myTri.B.x = cdtTri[1].x();
-                myTri.B.y = cdtTri[1].y();
+            std::vector<Tri>::iterator triIt;
+            for(triIt = listCDTTriangles.begin();
+                triIt != listCDTTriangles.end(); ++triIt)
+            {
+                // create triangle incenter
+                Vec2 inCenter;
+                inCenter.x = ((triIt->len_a*triIt->A.x + triIt->len_b*triIt->B.x + triIt->len_c*triIt->C.x) /
+                              (triIt->len_a+triIt->len_b+triIt->len_c));
 
-                myTri.C.x = cdtTri[2].x();
-                myTri.C.y = cdtTri[2].y();
+                inCenter.y = ((triIt->len_a*triIt->A.y + triIt->len_b*triIt->B.y + triIt->len_c*triIt->C.y) /
+                              (triIt->len_a+triIt->len_b+triIt->len_c));
 
-                myTri.len_a = sqrt( pow(myTri.C.x-myTri.B.x,2) + pow(myTri.C.y-myTri.B.y,2));
-                myTri.len_b = sqrt( pow(myTri.C.x-myTri.A.x,2) + pow(myTri.C.y-myTri.A.y,2));
-                myTri.len_c = sqrt( pow(myTri.A.x-myTri.B.x,2) + pow(myTri.A.y-myTri.B.y,2));
+                int crossingNum = calcCrossingNumber(inCenter,listOuterRingPts);
 
-                listCDTTriangles.push_back(myTri);
-                listTrisToKeep.push_back(false);
+                // we want to keep all triangles within outer rings
+                if(crossingNum != 0)    // if cross num != 0, point is in poly
+                {   listTrisToKeep[triIt-listCDTTriangles.begin()] = true;   }
             }
 
-            if(!(outputPolygons == NULL))
+            // filter triangles inside inner rings
+            for(int j=0; j < singlePoly->getNumInteriorRings(); j++)
             {
-                // discard triangles using the repaired multipolygon as a ref
-                for(int i=0; i < outputPolygons->getNumGeometries(); i++)
-                {
-                    OGRGeometry *polyGeometry = outputPolygons->getGeometryRef(i);
-                    OGRPolygon *singlePoly = (OGRPolygon*)polyGeometry;
-
-                    // filter triangles outside of outer ring
-                    OGRLinearRing* outerRing = singlePoly->getExteriorRing();
-                    std::vector<Vec2> listOuterRingPts(outerRing->getNumPoints());
-                    for(int j=0; j < listOuterRingPts.size(); j++)   {
-                        OGRPoint *myPt = new OGRPoint; outerRing->getPoint(j,myPt);
-                        listOuterRingPts[j] = Vec2(myPt->getX(),myPt->getY());
-                        delete myPt;
-                    }
+                OGRLinearRing* innerRing = singlePoly->getInteriorRing(j);
+                std::vector<Vec2> listInnerRingPts(innerRing->getNumPoints());
+                for(int k=0; k < listInnerRingPts.size(); k++)   {
+                    OGRPoint *myPt = new OGRPoint; innerRing->getPoint(k,myPt);
+                    listInnerRingPts[k] = Vec2(myPt->getX(),myPt->getY());
+                    delete myPt;
+                }
 
-                    std::vector<Tri>::iterator triIt;
-                    for(triIt = listCDTTriangles.begin();
-                        triIt != listCDTTriangles.end(); ++triIt)
+                for(triIt = listCDTTriangles.begin();
+                    triIt != listCDTTriangles.end(); ++triIt)
+                {
+                    if(listTrisToKeep[triIt-listCDTTriangles.begin()] == true)
                     {
                         // create triangle incenter
                         Vec2 inCenter;
@@ -456,111 +401,122 @@ int main(int argc, const char *argv[])
                         inCenter.y = ((triIt->len_a*triIt->A.y + triIt->len_b*triIt->B.y + triIt->len_c*triIt->C.y) /
                                       (triIt->len_a+triIt->len_b+triIt->len_c));
 
-                        int crossingNum = calcCrossingNumber(inCenter,listOuterRingPts);
+                        int crossingNum = calcCrossingNumber(inCenter,listInnerRingPts);
 
-                        // we want to keep all triangles within outer rings
+                        // we want to remove all triangles within inner rings
                         if(crossingNum != 0)    // if cross num != 0, point is in poly
-                        {   listTrisToKeep[triIt-listCDTTriangles.begin()] = true;   }
-                    }
-
-                    // filter triangles inside inner rings
-                    for(int j=0; j < singlePoly->getNumInteriorRings(); j++)
-                    {
-                        OGRLinearRing* innerRing = singlePoly->getInteriorRing(j);
-                        std::vector<Vec2> listInnerRingPts(innerRing->getNumPoints());
-                        for(int k=0; k < listInnerRingPts.size(); k++)   {
-                            OGRPoint *myPt = new OGRPoint; innerRing->getPoint(k,myPt);
-                            listInnerRingPts[k] = Vec2(myPt->getX(),myPt->getY());
-                            delete myPt;
-                        }
-
-                        for(triIt = listCDTTriangles.begin();
-                            triIt != listCDTTriangles.end(); ++triIt)
-                        {
-                            if(listTrisToKeep[triIt-listCDTTriangles.begin()] == true)
-                            {
-                                // create triangle incenter
-                                Vec2 inCenter;
-                                inCenter.x = ((triIt->len_a*triIt->A.x + triIt->len_b*triIt->B.x + triIt->len_c*triIt->C.x) /
-                                              (triIt->len_a+triIt->len_b+triIt->len_c));
-
-                                inCenter.y = ((triIt->len_a*triIt->A.y + triIt->len_b*triIt->B.y + triIt->len_c*triIt->C.y) /
-                                              (triIt->len_a+triIt->len_b+triIt->len_c));
-
-                                int crossingNum = calcCrossingNumber(inCenter,listInnerRingPts);
-
-                                // we want to remove all triangles within inner rings
-                                if(crossingNum != 0)    // if cross num != 0, point is in poly
-                                {   listTrisToKeep[triIt-listCDTTriangles.begin()] = false;   }
-                            }
-                        }
+                        {   listTrisToKeep[triIt-listCDTTriangles.begin()] = false;   }
                     }
+                }
+            }
 
-                    // save triangles
-                    for(triIt = listCDTTriangles.begin();
-                        triIt != listCDTTriangles.end(); ++triIt)
-                    {
-                        if(listTrisToKeep[triIt-listCDTTriangles.begin()])
-                        {
-//                            Vec3 pt0 = convLLAToECEF(PointLLA(triIt->A.y,triIt->A.x));
-//                            Vec3 pt1 = convLLAToECEF(PointLLA(triIt->B.y,triIt->B.x));
-//                            Vec3 pt2 = convLLAToECEF(PointLLA(triIt->C.y,triIt->C.x));
+            // save triangles
+            for(triIt = listCDTTriangles.begin();
+                triIt != listCDTTriangles.end(); ++triIt)
+            {
+                if(listTrisToKeep[triIt-listCDTTriangles.begin()])
+                {
+//                    Vec3 pt0 = convLLAToECEF(PointLLA(triIt->A.y,triIt->A.x));
+//                    Vec3 pt1 = convLLAToECEF(PointLLA(triIt->B.y,triIt->B.x));
+//                    Vec3 pt2 = convLLAToECEF(PointLLA(triIt->C.y,triIt->C.x));
 
-                            Vec3 pt0(triIt->A.x,triIt->A.y,0);
-                            Vec3 pt1(triIt->B.x,triIt->B.y,0);
-                            Vec3 pt2(triIt->C.x,triIt->C.y,0);
+                    Vec3 pt0(triIt->A.x,triIt->A.y,0);
+                    Vec3 pt1(triIt->B.x,triIt->B.y,0);
+                    Vec3 pt2(triIt->C.x,triIt->C.y,0);
 
-                            triMesh.listVertices.push_back(pt0);
-                            triMesh.listIdxs.push_back(triMesh.listVertices.size()-1);
+                    triMesh.listVertices.push_back(pt0);
+                    triMesh.listIdxs.push_back(triMesh.listVertices.size()-1);
 
-                            triMesh.listVertices.push_back(pt1);
-                            triMesh.listIdxs.push_back(triMesh.listVertices.size()-1);
+                    triMesh.listVertices.push_back(pt1);
+                    triMesh.listIdxs.push_back(triMesh.listVertices.size()-1);
 
-                            triMesh.listVertices.push_back(pt2);
-                            triMesh.listIdxs.push_back(triMesh.listVertices.size()-1);
-                        }
-                    }
+                    triMesh.listVertices.push_back(pt2);
+                    triMesh.listIdxs.push_back(triMesh.listVertices.size()-1);
                 }
+            }
+        }
+
+        delete outputPolygons;
+    }
+}
+
+int main(int argc, const char *argv[])
+{
+    if(argc != 3) {
+        std::cout << "Usage: #> ./ptk_wkt_to_ply inputfile myoutputfile\n";
+        std::cout << "* Expect each line of the input file to contain a single WKT POLYGON() def\n";
+        std::cout << "* The output file is a mesh in PLY format\n";
+        return 0;
+    }
+
+    StartTiming("[Covert WKT to PLY]");
+
+    WktReader reader;
+    reader.Open(argv[1]);
+
+    if(reader.IsOpen())
+    {
+        TriangleMesh triMesh;
+        int linesProcessed = 0;
+        int linesTriangulated = 0;
+        int linesRepaired = 0;
+        size_t lastPercent = 0;
+        SimplePolyTriangulator triangulator;
+
+        bool valid;
+        while(reader.ReadLine(valid))
+        {
+            if(!valid)   {
+                std::cout << "Error: WKT is not valid (ignoring)" << std::endl;
+                std::cout << "-> " << reader.GetLine() << std::endl;
+                continue;
+            }
 
+            // valid polygons are triangulated directly, the
+            // rest are repaired and triangulated with CGAL
+            if(triangulator.Triangulate(reader))   {
+                std::vector<Vec2> const &listTriVx = triangulator.GetTriangles();
+                for(size_t i=0; i < listTriVx.size(); i++)   {
+                    triMesh.listVertices.push_back(Vec3(listTriVx[i].x,listTriVx[i].y,0));
+                    triMesh.listIdxs.push_back(triMesh.listVertices.size()-1);
+                }
+                linesTriangulated++;
+            }
+            else   {
+                OGRGeometry *inputGeometry = reader.CreateGeometry();
+                repairAndTriangulate(inputGeometry,triMesh);
                 delete inputGeometry;
-                delete outputPolygons;
+                linesRepaired++;
+            }
 
-                linesProcessed++;
+            linesProcessed++;
+            size_t percent = (100*reader.GetOffset())/reader.GetFileSize();
+            if(percent != lastPercent)   {
+                lastPercent = percent;
                 std::cout << "Lines Processed: "
-                          << linesProcessed << "/" << numInputLines <<std::endl;
+                          << linesProcessed << " (" << percent << "%)" << std::endl;
             }
         }
-        wktFile.close();
+        reader.Close();
+        std::cout << "INFO: Triangulated " << linesTriangulated << " lines directly, "
+                  << linesRepaired << " lines with CGAL repair" << std::endl;
 
         // clean mesh to remove duplicate verts
-        std::vector<std::string>::iterator vecStrIt;
-        std::vector<std::string> listUniqueVertexStrings(triMesh.listVertices.size());
-        for(int i=0; i < triMesh.listVertices.size(); i++)   {
-            listUniqueVertexStrings[i] = Vec3ToString(triMesh.listVertices[i]);
-        }
-        std::sort(listUniqueVertexStrings.begin(),listUniqueVertexStrings.end());
-        vecStrIt = std::unique(listUniqueVertexStrings.begin(),listUniqueVertexStrings.end());
-        listUniqueVertexStrings.resize(vecStrIt-listUniqueVertexStrings.begin());
-
-        std::vector<unsigned int> idxMap;
-        for(int i=0; i < triMesh.listVertices.size(); i++)   {
-            vecStrIt = std::lower_bound(listUniqueVertexStrings.begin(),
-                                        listUniqueVertexStrings.end(),
-                                        Vec3ToString(triMesh.listVertices[i]));
-            idxMap.push_back(vecStrIt-listUniqueVertexStrings.begin());
+        vxweld::Welder<3> welder(K_WELD_EPS);
+        welder.Reserve(triMesh.listVertices.size());
+        for(int i=0; i < triMesh.listIdxs.size(); i++)   {
+            Vec3 const &vx = triMesh.listVertices[triMesh.listIdxs[i]];
+            double const vxWeld[3] = {vx.x,vx.y,vx.z};
+            triMesh.listIdxs[i] = welder.Add(vxWeld);
         }
 
         triMesh.listVertices.clear();
-        for(int i=0; i < listUniqueVertexStrings.size(); i++)   {
-            triMesh.listVertices.push_back(StringToVec3(listUniqueVertexStrings[i]));
-        }
-
-        for(int i=0; i < triMesh.listIdxs.size(); i++)   {
-            unsigned int oldIdx = triMesh.listIdxs[i];
-            triMesh.listIdxs[i] = idxMap[oldIdx];
+        for(int i=0; i < welder.GetNumVertices(); i++)   {
+            double const * vx = welder.GetVertex(i);
+            triMesh.listVertices.push_back(Vec3(vx[0],vx[1],vx[2]));
         }
 
-        std::cout << "# Num Unique Verts: " << listUniqueVertexStrings.size() << "\n";
+        std::cout << "# Num Unique Verts: " << welder.GetNumVertices() << "\n";
         EndTiming();
 //        return 0;
 
@@ -12,3 +12,17 @@ HEADERS += rply/rply.h
 SOURCES += rply/rply.c
 
 QMAKE_CXXFLAGS += -std=c++0x
+
+# geodesy
+INCLUDEPATH += $${PWD}/../../utils/geodesy
+HEADERS += $${PWD}/../../utils/geodesy/geodesy.hpp
+
+# vxweld
+INCLUDEPATH += $${PWD}/../../utils/vxweld
+HEADERS += $${PWD}/../../utils/vxweld/vxweld.hpp
+
+# wkt reader
+HEADERS += WktReader.hpp
+
+# fast path for valid polygons
+HEADERS += SimplePolyTriangulator.hpp
@@ -6,12 +6,23 @@
 #include <fstream>
 #include <stack>
 #include <set>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <cmath>
 #include <sys/time.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 // OGR
 #include <ogrsf_frmts.h>
 #include <ogr_spatialref.h>
 
+// mmap'd wkt/wkb reader
+#include "WktReader.hpp"
+
 // timing vars
 timeval t1,t2;
 std::string timingDesc;
@@ -40,15 +51,282 @@ std::string NumberToString ( T Number )
     return ss.str();
 }
 
+// ========================================================================== //
+// ========================================================================== //
+
+#define K_PI 3.14159265358979323846
+#define K_DEG2RAD (K_PI/180.0)
+#define K_RAD2DEG (180.0/K_PI)
+
+// radius of the sphere used by spherical mercator
+#define K_MERC_RAD 6378137.0
+
+bool isSphericalMercator(int epsg)
+{
+    // 900913 and 3785 are the old codes for 3857
+    return (epsg == 3857 || epsg == 3785 || epsg == 900913);
+}
+
+// latitude where spherical mercator is square (the
+// limit of EPSG 3857); lat +-90 maps to +-inf
+#define K_MERC_MAX_LAT 85.0511287798066
+
+// y/K_MERC_RAD past which 2*atan(exp(y))-pi/2 rounds
+// to +-pi/2 anyway
+#define K_MERC_MAX_Y 40.0
+
+// The spherical mercator transforms are closed form so
+// they're done here instead of going through OGR/PROJ.
+// With SSE2, y is done two points at a time using
+// exp/atan/log/tan lanes built from the Cephes
+// polynomials (within a few ulps of libm over the
+// ranges used here); the remaining point and non SSE2
+// builds use libm.
+
+#if defined(__SSE2__)
+// exp(x) for |x| <= K_MERC_MAX_Y
+inline __m128d expSSE2(__m128d x)
+{
+    // x = n*ln2 + r, |r| <= ln2/2
+    __m128i const n = _mm_cvtpd_epi32(_mm_mul_pd(x,_mm_set1_pd(1.4426950408889634073599)));
+    __m128d const fn = _mm_cvtepi32_pd(n);
+    x = _mm_sub_pd(x,_mm_mul_pd(fn,_mm_set1_pd(6.93145751953125E-1)));
+    x = _mm_sub_pd(x,_mm_mul_pd(fn,_mm_set1_pd(1.42860682030941723212E-6)));
+
+    // exp(r) = 1 + 2*r*P(r^2)/(Q(r^2)-r*P(r^2))
+    __m128d const xx = _mm_mul_pd(x,x);
+    __m128d p = _mm_set1_pd(1.26177193074810590878E-4);
+    p = _mm_add_pd(_mm_mul_pd(p,xx),_mm_set1_pd(3.02994407707441961300E-2));
+    p = _mm_add_pd(_mm_mul_pd(p,xx),_mm_set1_pd(9.99999999999999999910E-1));
+    p = _mm_mul_pd(p,x);
+    __m128d q = _mm_set1_pd(3.00198505138664455042E-6);
+    q = _mm_add_pd(_mm_mul_pd(q,xx),_mm_set1_pd(2.52448340349684104192E-3));
+    q = _mm_add_pd(_mm_mul_pd(q,xx),_mm_set1_pd(2.27265548208155028766E-1));
+    q = _mm_add_pd(_mm_mul_pd(q,xx),_mm_set1_pd(2.00000000000000000009E0));
+    x = _mm_div_pd(p,_mm_sub_pd(q,p));
+    x = _mm_add_pd(_mm_set1_pd(1.0),_mm_add_pd(x,x));
+
+    // * 2^n
+    __m128i e = _mm_add_epi32(n,_mm_set1_epi32(1023));
+    e = _mm_slli_epi64(_mm_unpacklo_epi32(e,_mm_setzero_si128()),52);
+    return _mm_mul_pd(x,_mm_castsi128_pd(e));
+}
+
+// atan(x) for any x
+inline __m128d atanSSE2(__m128d x)
+{
+    __m128d const sign_bit = _mm_set1_pd(-0.0);
+    __m128d const one = _mm_set1_pd(1.0);
+    __m128d const x_sign = _mm_and_pd(x,sign_bit);
+    x = _mm_andnot_pd(sign_bit,x);
+
+    // x > tan(3pi/8): atan(x) = pi/2 - atan(1/x)
+    // x > 0.66:       atan(x) = pi/4 + atan((x-1)/(x+1))
+    __m128d const big = _mm_cmpgt_pd(x,_mm_set1_pd(2.41421356237309504880));
+    __m128d const mid = _mm_andnot_pd(big,_mm_cmpgt_pd(x,_mm_set1_pd(0.66)));
+
+    __m128d const x_big = _mm_div_pd(_mm_set1_pd(-1.0),x);
+    __m128d const x_mid = _mm_div_pd(_mm_sub_pd(x,one),_mm_add_pd(x,one));
+    x = _mm_or_pd(_mm_and_pd(big,x_big),
+                  _mm_or_pd(_mm_and_pd(mid,x_mid),
+                            _mm_andnot_pd(_mm_or_pd(big,mid),x)));
+
+    __m128d const y = _mm_or_pd(_mm_and_pd(big,_mm_set1_pd(0.5*K_PI)),
+                                _mm_and_pd(mid,_mm_set1_pd(0.25*K_PI)));
+    __m128d const more = _mm_or_pd(_mm_and_pd(big,_mm_set1_pd(6.123233995736765886130E-17)),
+                                   _mm_and_pd(mid,_mm_set1_pd(3.061616997868382943065E-17)));
+
+    __m128d const z = _mm_mul_pd(x,x);
+    __m128d p = _mm_set1_pd(-8.750608600031904122785E-1);
+    p = _mm_add_pd(_mm_mul_pd(p,z),_mm_set1_pd(-1.615753718733365076637E1));
+    p = _mm_add_pd(_mm_mul_pd(p,z),_mm_set1_pd(-7.500855792314704667340E1));
+    p = _mm_add_pd(_mm_mul_pd(p,z),_mm_set1_pd(-1.228866684490136173410E2));
+    p = _mm_add_pd(_mm_mul_pd(p,z),_mm_set1_pd(-6.485021904942025371773E1));
+    __m128d q = _mm_add_pd(z,_mm_set1_pd(2.485846490142306297962E1));
+    q = _mm_add_pd(_mm_mul_pd(q,z),_mm_set1_pd(1.650270098316988542046E2));
+    q = _mm_add_pd(_mm_mul_pd(q,z),_mm_set1_pd(4.328810604912902668951E2));
+    q = _mm_add_pd(_mm_mul_pd(q,z),_mm_set1_pd(4.853903996359136964868E2));
+    q = _mm_add_pd(_mm_mul_pd(q,z),_mm_set1_pd(1.945506571482613964425E2));
+
+    __m128d r = _mm_div_pd(_mm_mul_pd(z,p),q);
+    r = _mm_add_pd(_mm_add_pd(_mm_mul_pd(x,r),x),more);
+    return _mm_xor_pd(_mm_add_pd(y,r),x_sign);
+}
+
+// log(x) for finite x > 0
+inline __m128d logSSE2(__m128d x)
+{
+    __m128d const one = _mm_set1_pd(1.0);
+
+    // x = m*2^e, 0.5 <= m < 1
+    __m128i const bits = _mm_castpd_si128(x);
+    __m128i const exp_bits = _mm_srli_epi64(bits,52);
+    __m128d e = _mm_cvtepi32_pd(_mm_shuffle_epi32(exp_bits,_MM_SHUFFLE(3,1,2,0)));
+    e = _mm_sub_pd(e,_mm_set1_pd(1022.0));
+    x = _mm_castsi128_pd(_mm_or_si128(
+            _mm_and_si128(bits,_mm_set1_epi64x(0x800FFFFFFFFFFFFFLL)),
+            _mm_set1_epi64x(0x3FE0000000000000LL)));
+
+    // m < sqrt(1/2): use 2m-1 and e-1, else m-1
+    __m128d const small = _mm_cmplt_pd(x,_mm_set1_pd(0.70710678118654752440));
+    e = _mm_sub_pd(e,_mm_and_pd(small,one));
+    x = _mm_sub_pd(_mm_add_pd(x,_mm_and_pd(small,x)),one);
+
+    __m128d const z = _mm_mul_pd(x,x);
+    __m128d p = _mm_set1_pd(1.01875663804580931796E-4);
+    p = _mm_add_pd(_mm_mul_pd(p,x),_mm_set1_pd(4.97494994976747001425E-1));
+    p = _mm_add_pd(_mm_mul_pd(p,x),_mm_set1_pd(4.70579119878881725854E0));
+    p = _mm_add_pd(_mm_mul_pd(p,x),_mm_set1_pd(1.44989225341610930846E1));
+    p = _mm_add_pd(_mm_mul_pd(p,x),_mm_set1_pd(1.79368678507819816313E1));
+    p = _mm_add_pd(_mm_mul_pd(p,x),_mm_set1_pd(7.70838733755885391666E0));
+    __m128d q = _mm_add_pd(x,_mm_set1_pd(1.12873587189167450590E1));
+    q = _mm_add_pd(_mm_mul_pd(q,x),_mm_set1_pd(4.52279145837532221105E1));
+    q = _mm_add_pd(_mm_mul_pd(q,x),_mm_set1_pd(8.29875266912776603211E1));
+    q = _mm_add_pd(_mm_mul_pd(q,x),_mm_set1_pd(7.11544750618563894466E1));
+    q = _mm_add_pd(_mm_mul_pd(q,x),_mm_set1_pd(2.31251620126765340583E1));
+
+    // log(1+x) = x - x^2/2 + x^3*P(x)/Q(x), plus e*ln2
+    // in two parts
+    __m128d y = _mm_mul_pd(x,_mm_div_pd(_mm_mul_pd(z,p),q));
+    y = _mm_sub_pd(y,_mm_mul_pd(e,_mm_set1_pd(2.121944400546905827679E-4)));
+    y = _mm_sub_pd(y,_mm_mul_pd(z,_mm_set1_pd(0.5)));
+    return _mm_add_pd(_mm_add_pd(x,y),_mm_mul_pd(e,_mm_set1_pd(0.693359375)));
+}
+
+// tan(x) for 0 <= x < pi/2
+inline __m128d tanSSE2(__m128d x)
+{
+    // x = j*pi/4 + z with j even, |z| <= pi/4
+    __m128i j = _mm_cvttpd_epi32(_mm_mul_pd(x,_mm_set1_pd(4.0/K_PI)));
+    j = _mm_and_si128(_mm_add_epi32(j,_mm_set1_epi32(1)),_mm_set1_epi32(~1));
+    __m128d const fj = _mm_cvtepi32_pd(j);
+    __m128d z = _mm_sub_pd(x,_mm_mul_pd(fj,_mm_set1_pd(7.853981554508209228515625E-1)));
+    z = _mm_sub_pd(z,_mm_mul_pd(fj,_mm_set1_pd(7.94662735614792836714E-9)));
+    z = _mm_sub_pd(z,_mm_mul_pd(fj,_mm_set1_pd(3.06161699786838294307E-17)));
+
+    // tan(z) = z + z^3*P(z^2)/Q(z^2)
+    __m128d const zz = _mm_mul_pd(z,z);
+    __m128d p = _mm_set1_pd(-1.30936939181383777646E4);
+    p = _mm_add_pd(_mm_mul_pd(p,zz),_mm_set1_pd(1.15351664838587416140E6));
+    p = _mm_add_pd(_mm_mul_pd(p,zz),_mm_set1_pd(-1.79565251976484877988E7));
+    __m128d q = _mm_add_pd(zz,_mm_set1_pd(1.36812963470692954678E4));
+    q = _mm_add_pd(_mm_mul_pd(q,zz),_mm_set1_pd(-1.32089234440210967447E6));
+    q = _mm_add_pd(_mm_mul_pd(q,zz),_mm_set1_pd(2.50083801823357915839E7));
+    q = _mm_add_pd(_mm_mul_pd(q,zz),_mm_set1_pd(-5.38695755929454629881E7));
+    __m128d const y = _mm_add_pd(z,_mm_mul_pd(z,_mm_div_pd(_mm_mul_pd(zz,p),q)));
+
+    // j = 2 mod 4: tan(x) = -1/tan(z)
+    __m128i const jj = _mm_shuffle_epi32(j,_MM_SHUFFLE(1,1,0,0));
+    __m128d const j_bit2 = _mm_castsi128_pd(
+                _mm_cmpeq_epi32(_mm_and_si128(jj,_mm_set1_epi32(2)),
+                                _mm_set1_epi32(2)));
+    __m128d const y_inv = _mm_div_pd(_mm_set1_pd(-1.0),y);
+    return _mm_or_pd(_mm_and_pd(j_bit2,y_inv),_mm_andnot_pd(j_bit2,y));
+}
+#endif
+
+void xformMercatorToWGS84(size_t numPts, double *listX, double *listY)
+{
+    double const lonScale = K_RAD2DEG/K_MERC_RAD;
+    double const invRad = 1.0/K_MERC_RAD;
+
+    for(size_t i=0; i < numPts; i++)   {
+        listX[i] *= lonScale;
+    }
+
+    size_t i=0;
+#if defined(__SSE2__)
+    __m128d const vInvRad = _mm_set1_pd(invRad);
+    __m128d const vMaxY = _mm_set1_pd(K_MERC_MAX_Y);
+    __m128d const vMinY = _mm_set1_pd(-K_MERC_MAX_Y);
+    __m128d const vHalfPi = _mm_set1_pd(0.5*K_PI);
+    __m128d const vRad2Deg = _mm_set1_pd(K_RAD2DEG);
+    for(; i+1 < numPts; i+=2)   {
+        // (NaN is passed through by min/max in this order)
+        __m128d y = _mm_mul_pd(_mm_loadu_pd(listY+i),vInvRad);
+        y = _mm_min_pd(vMaxY,_mm_max_pd(vMinY,y));
+        y = atanSSE2(expSSE2(y));
+        y = _mm_mul_pd(_mm_sub_pd(_mm_add_pd(y,y),vHalfPi),vRad2Deg);
+        _mm_storeu_pd(listY+i,y);
+    }
+#endif
+    for(; i < numPts; i++)   {
+        listY[i] = (2.0*atan(exp(listY[i]*invRad)) - 0.5*K_PI)*K_RAD2DEG;
+    }
+}
+
+void xformWGS84ToMercator(size_t numPts, double *listX, double *listY)
+{
+    double const xScale = K_DEG2RAD*K_MERC_RAD;
+    double const halfLatScale = 0.5*K_DEG2RAD;
+
+    for(size_t i=0; i < numPts; i++)   {
+        listX[i] *= xScale;
+    }
+
+    // clamp to the mercator limit so the poles
+    // don't become +-inf
+    size_t i=0;
+#if defined(__SSE2__)
+    __m128d const vHalfLatScale = _mm_set1_pd(halfLatScale);
+    __m128d const vMaxLat = _mm_set1_pd(K_MERC_MAX_LAT);
+    __m128d const vMinLat = _mm_set1_pd(-K_MERC_MAX_LAT);
+    __m128d const vQuarterPi = _mm_set1_pd(0.25*K_PI);
+    __m128d const vRad = _mm_set1_pd(K_MERC_RAD);
+    for(; i+1 < numPts; i+=2)   {
+        __m128d const lat = _mm_loadu_pd(listY+i);
+        __m128d y = _mm_min_pd(vMaxLat,_mm_max_pd(vMinLat,lat));
+        y = tanSSE2(_mm_add_pd(vQuarterPi,_mm_mul_pd(y,vHalfLatScale)));
+        y = _mm_mul_pd(logSSE2(y),vRad);
+
+        // logSSE2 doesn't keep NaN so put it back
+        __m128d const isNaN = _mm_cmpunord_pd(lat,lat);
+        y = _mm_or_pd(_mm_andnot_pd(isNaN,y),_mm_and_pd(isNaN,lat));
+        _mm_storeu_pd(listY+i,y);
+    }
+#endif
+    for(; i < numPts; i++)   {
+        double const lat = std::min(std::max(listY[i],-K_MERC_MAX_LAT),K_MERC_MAX_LAT);
+        listY[i] = K_MERC_RAD*log(tan(0.25*K_PI + lat*halfLatScale));
+    }
+}
+
+// A line of the input file
+struct XformLine
+{
+    WktPolygon poly;
+    std::string error;
+    std::string outputWkt;
+};
+
 int main(int argc, const char *argv[])
 {
-    if(argc != 3) {
-        std::cout << "Usage: #> ./ptk_xform_wkt myinputfile myoutputfile\n";
+    if(argc < 3 || argc > 6) {
+        std::cout << "Usage: #> ./ptk_xform_wkt myinputfile myoutputfile [source_epsg target_epsg] [numthreads]\n";
         std::cout << "* Expect each line of the input file to contain a single WKT POLYGON() def\n";
         std::cout << "* The output file is in the same format as the input file\n";
+        std::cout << "* Transforms from EPSG 3785 (Mercator) to 4326 (WGS84 Lat/Lon) by\n";
+        std::cout << "  default; spherical mercator <-> 4326 is done without OGR/PROJ\n";
+        std::cout << "* Lines are transformed with numthreads threads (defaults to\n";
+        std::cout << "  the number of cores)\n";
         return 0;
     }
 
+    int sourceEPSG = 3785;
+    int targetEPSG = 4326;
+    size_t numThreads = std::thread::hardware_concurrency();
+    if(argc == 4)   {
+        numThreads = atoi(argv[3]);
+    }
+    else if(argc >= 5)   {
+        sourceEPSG = atoi(argv[3]);
+        targetEPSG = atoi(argv[4]);
+        if(argc == 6)   {
+            numThreads = atoi(argv[5]);
+        }
+    }
+    numThreads = std::max(numThreads,size_t(1));
+
     std::cout << "Was GDAL built against GEOS?\n ";
     if(OGRGeometryFactory::haveGEOS())   {
         std::cout << "-> Yeah, WOOOOO!" << std::endl;
@@ -59,110 +337,182 @@ int main(int argc, const char *argv[])
         return -1;
     }
 
-    StartTiming("[Transform from EPSG 3785 (Mercator) to EPSG 4326 (WGS84 Lat/Lon)]");
+    // spherical mercator <-> wgs84 doesn't need OGR
+    void (*fastXform)(size_t,double*,double*) = NULL;
+    if(isSphericalMercator(sourceEPSG) && targetEPSG == 4326)   {
+        fastXform = xformMercatorToWGS84;
+    }
+    else if(sourceEPSG == 4326 && isSphericalMercator(targetEPSG))   {
+        fastXform = xformWGS84ToMercator;
+    }
+
+    // otherwise setup coordinate transform with OGR; every
+    // thread gets its own since they aren't thread safe
+    OGRSpatialReference sourceSRS, targetSRS;
+    if(fastXform == NULL)   {
+        if(sourceSRS.importFromEPSG(sourceEPSG) != OGRERR_NONE ||
+           targetSRS.importFromEPSG(targetEPSG) != OGRERR_NONE)   {
+            std::cout << "Error: Unknown EPSG code" << std::endl;
+            return -1;
+        }
+    }
 
-    std::ifstream inputWktFile;
-    inputWktFile.open(argv[1]);
+    StartTiming("[Transform from EPSG "+NumberToString(sourceEPSG)+
+                " to EPSG "+NumberToString(targetEPSG)+"]");
+
+    WktReader reader;
+    reader.Open(argv[1]);
 
     std::ofstream outputWktFile;
     outputWktFile.open(argv[2]);
 
-    // get number of input lines
-    unsigned int numInputLines=0;
-    if(inputWktFile.is_open())   {
-        while(!inputWktFile.eof())   {
-            std::string wktLine;
-            std::getline(inputWktFile,wktLine);
-            numInputLines++;
-        }
-    }
-    inputWktFile.close();
-    inputWktFile.open(argv[1]);
-
     // do stuff
-    if(inputWktFile.is_open() && outputWktFile.is_open())
+    if(reader.IsOpen() && outputWktFile.is_open())
     {
         int linesProcessed = 0;
-        outputWktFile << "WKT\n";
+        size_t lastPercent = 0;
 
-        // setup coordinate transform (from EPSG:3785
-        // [Google Mercator]) to EPSG:4326 [WGS84 lat/lon]
-        OGRSpatialReference sourceSRS, targetSRS;
-        sourceSRS.importFromEPSG(3785);
-        targetSRS.importFromEPSG(4326);
+        std::vector<OGRCoordinateTransformation*> listCoordXforms(numThreads,NULL);
+        if(fastXform == NULL)   {
+            bool xformsOk = true;
+            for(size_t t=0; t < numThreads; t++)   {
+                listCoordXforms[t] =
+                        OGRCreateCoordinateTransformation(&sourceSRS,&targetSRS);
+                xformsOk = xformsOk && (listCoordXforms[t] != NULL);
+            }
+            if(!xformsOk)   {
+                std::cout << "Error: Could not create a transform from EPSG "
+                          << sourceEPSG << " to EPSG " << targetEPSG << std::endl;
+                for(size_t t=0; t < numThreads; t++)   {
+                    if(listCoordXforms[t] != NULL)   {
+                        OCTDestroyCoordinateTransformation(listCoordXforms[t]);
+                    }
+                }
+                reader.Close();
+                outputWktFile.close();
+                return -1;
+            }
+        }
+
+        outputWktFile << "WKT\n";
 
-        OGRCoordinateTransformation * coordXform;
-        coordXform = OGRCreateCoordinateTransformation(&sourceSRS,&targetSRS);
+        // lines are read into batches which are split into
+        // one chunk per thread; polygons are swapped out of
+        // the reader so their arrays are still reused
+        size_t const batchSize = 4096;
+        std::vector<XformLine> listLines(batchSize);
 
-        while(!inputWktFile.eof())
+        bool valid;
+        bool moreLines = true;
+        while(moreLines)
         {
-            std::string wktLine;
-            std::getline(inputWktFile,wktLine);
+            size_t numLines = 0;
+            while(numLines < batchSize)   {
+                moreLines = reader.ReadLine(valid);
+                if(!moreLines)   {
+                    break;
+                }
 
-            // remove any quotes around wktLine
-            if(wktLine[0] == '\"' || wktLine[0] == '\'')
-            {   wktLine.erase(0,1);   }
+                XformLine &line = listLines[numLines];
+                line.error.clear();
+                line.outputWkt.clear();
+                if(!valid)   {
+                    line.error = "Error: WKT is not valid (ignoring)\n-> " +
+                            reader.GetLine();
+                }
+                else if(reader.IsMulti())   {
+                    line.error = "Error: Could not xform geometry, "
+                                 "WKT type is not a POLYGON()\n-> WKT: " +
+                            reader.GetLine();
+                }
+                else   {
+                    std::swap(line.poly,reader.GetPolygon(0));
+                }
+                numLines++;
+            }
 
-            if(wktLine[wktLine.size()-1] == '\"' || wktLine[wktLine.size()-1] == '\'')
-            {   wktLine.erase(wktLine.size()-1,1);   }
+            size_t const numChunks = std::min(numThreads,numLines);
+            std::vector<std::thread> listWorkers;
+            for(size_t t=0; t < numChunks; t++)   {
+                listWorkers.push_back(std::thread([&,t]() {
+                    size_t const ixBegin = (numLines*t)/numChunks;
+                    size_t const ixEnd = (numLines*(t+1))/numChunks;
 
-            // create geometry from wkt
-            char *inputWKT = new char[wktLine.size()+1];
-            char *inputWKTRef = inputWKT;
-            strcpy(inputWKT,wktLine.c_str());
+                    for(size_t i=ixBegin; i < ixEnd; i++)   {
+                        XformLine &line = listLines[i];
+                        if(!line.error.empty())   {
+                            continue;
+                        }
 
-            OGRGeometry *inputGeometry;
-            OGRGeometryFactory::createFromWkt(&inputWKT, NULL, &inputGeometry);
+                        // all rings are in one array so they
+                        // can be transformed in one call
+                        WktPolygon &poly = line.poly;
+                        if(poly.listX.empty())   {
+                            // nothing to transform
+                        }
+                        else if(fastXform)   {
+                            fastXform(poly.listX.size(),
+                                      &(poly.listX[0]),
+                                      &(poly.listY[0]));
+                        }
+                        else   {
+                            listCoordXforms[t]->Transform(poly.listX.size(),
+                                                          &(poly.listX[0]),
+                                                          &(poly.listY[0]));
+                        }
 
-            if (inputGeometry == NULL)   {
-                std::cout << "Error: WKT is not valid (ignoring)" << std::endl;
-                std::cout << "-> " << wktLine << std::endl;
-                delete[] inputWKTRef;
-                continue;
+                        OGRPolygon outputPoly;
+                        for(size_t j=0; j < poly.GetNumRings(); j++)   {
+                            double const * px = poly.GetRingX(j);
+                            double const * py = poly.GetRingY(j);
+                            int numPts = poly.GetRingSize(j);
+
+                            OGRLinearRing ring;
+                            ring.setNumPoints(numPts);
+                            for(int k=0; k < numPts; k++)   {
+                                ring.setPoint(k,px[k],py[k],0);
+                            }
+                            outputPoly.addRing(&ring);
+                        }
+
+                        char *outputWKT;
+                        outputPoly.exportToWkt(&outputWKT);
+                        line.outputWkt = outputWKT;
+                        CPLFree(outputWKT);
+                    }
+                }));
             }
-            delete[] inputWKTRef;
-
-            if(inputGeometry->getGeometryType() == wkbPolygon)   {
-                // outer ring
-                OGRPolygon *singlePoly = (OGRPolygon*)inputGeometry;
-                OGRLinearRing* outerRing = singlePoly->getExteriorRing();
-                for(int j=0; j < outerRing->getNumPoints(); j++)   {
-                    double px = outerRing->getX(j);
-                    double py = outerRing->getY(j);
-                    coordXform->Transform(1,&px,&py);
-                    outerRing->setPoint(j,px,py,0);
+            for(size_t t=0; t < listWorkers.size(); t++)   {
+                listWorkers[t].join();
+            }
+
+            // write output
+            for(size_t i=0; i < numLines; i++)   {
+                XformLine const &line = listLines[i];
+                if(!line.error.empty())   {
+                    std::cout << line.error << std::endl;
                 }
-                // inner rings
-                for(int j=0; j < singlePoly->getNumInteriorRings(); j++)   {
-                    OGRLinearRing *innerRing = singlePoly->getInteriorRing(j);
-                    for(int k=0; k < innerRing->getNumPoints(); k++)   {
-                        double px = innerRing->getX(k);
-                        double py = innerRing->getY(k);
-                        coordXform->Transform(1,&px,&py);
-                        innerRing->setPoint(k,px,py,0);
-                    }
+                else   {
+                    outputWktFile << line.outputWkt << "\n";
                 }
-
-                // write output
-                char *outputWKT;
-                inputGeometry->exportToWkt(&outputWKT);
-                outputWktFile << outputWKT << std::endl;
-                delete[] outputWKT;
-
-                // clean up
-                delete inputGeometry;
             }
-            else   {
-                std::cout << "Error: Could not xform geometry, "
-                             "WKT type is not a POLYGON()\n";
-                std::cout << "-> WKT: " << wktLine << "\n";
+
+            linesProcessed += numLines;
+            size_t percent = (reader.GetFileSize() > 0) ?
+                        (100*reader.GetOffset())/reader.GetFileSize() : 100;
+            if(percent != lastPercent)   {
+                lastPercent = percent;
+                std::cout << "ptk_xform_wkt: Lines Processed: "
+                          << linesProcessed << " (" << percent << "%)" << std::endl;
             }
+        }
 
-            linesProcessed++;
-            std::cout << "ptk_xform_wkt: Lines Processed: "
-                      << linesProcessed << "/" << numInputLines <<std::endl;
+        for(size_t t=0; t < listCoordXforms.size(); t++)   {
+            if(listCoordXforms[t] != NULL)   {
+                OCTDestroyCoordinateTransformation(listCoordXforms[t]);
+            }
         }
-        inputWktFile.close();
+        reader.Close();
         outputWktFile.close();
     }
     EndTiming();
@@ -5,6 +5,9 @@ SOURCES += ptk_xform_wkt.cpp
 TARGET = ptk_xform_wkt
 
 # required libs
-LIBS += -lgdal -lCGAL_Core -lCGAL -lmpfr -lgmp -lboost_thread
+LIBS += -lgdal -lCGAL_Core -lCGAL -lmpfr -lgmp -lboost_thread -lpthread
 
 QMAKE_CXXFLAGS += -std=c++0x
+
+# wkt reader
+HEADERS += WktReader.hpp
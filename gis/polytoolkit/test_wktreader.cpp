@@ -0,0 +1,186 @@
+// STL
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <string>
+
+// mmap'd wkt/wkb reader
+#include "WktReader.hpp"
+
+// Checks that WktReader gets the same x/y coordinates
+// out of every dimension of WKT and WKB it accepts, and
+// rejects lines it shouldn't
+
+struct TestLine
+{
+    std::string line;
+    bool valid;
+    size_t numPolygons;
+    std::vector<size_t> listRingSizes;  // over all polygons
+    std::vector<double> listXY;         // over all polygons
+};
+
+bool CheckLine(WktReader const &reader,
+               bool valid,
+               TestLine const &test)
+{
+    if(valid != test.valid)   {
+        return false;
+    }
+    if(!valid)   {
+        return true;
+    }
+    if(reader.GetNumPolygons() != test.numPolygons)   {
+        return false;
+    }
+
+    std::vector<size_t> listRingSizes;
+    std::vector<double> listXY;
+    for(size_t i=0; i < reader.GetNumPolygons(); i++)   {
+        WktPolygon const &poly = reader.GetPolygon(i);
+        for(size_t r=0; r < poly.GetNumRings(); r++)   {
+            listRingSizes.push_back(poly.GetRingSize(r));
+            for(size_t j=0; j < poly.GetRingSize(r); j++)   {
+                listXY.push_back(poly.GetRingX(r)[j]);
+                listXY.push_back(poly.GetRingY(r)[j]);
+            }
+        }
+    }
+    if(listRingSizes != test.listRingSizes ||
+       listXY.size() != test.listXY.size())   {
+        return false;
+    }
+    for(size_t i=0; i < listXY.size(); i++)   {
+        if(std::fabs(listXY[i]-test.listXY[i]) > 1E-12)   {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main()
+{
+    double const listSquare[] = { 0,0, 1,0, 1,1, 0,1, 0,0 };
+    std::vector<double> listXY(listSquare,listSquare+10);
+    std::vector<size_t> listOneRing(1,5);
+
+    std::vector<TestLine> listTests;
+    TestLine test;
+    test.valid = true;
+    test.numPolygons = 1;
+    test.listRingSizes = listOneRing;
+    test.listXY = listXY;
+
+    test.line = "POLYGON ((0 0, 1 0, 1 1, 0 1, 0 0))";
+    listTests.push_back(test);
+
+    test.line = "\"polygon((0 0,1 0,1 1,0 1,0 0))\"";
+    listTests.push_back(test);
+
+    test.line = "POLYGON ((0 0 7, 1 0 7, 1 1 7, 0 1 7, 0 0 7))";
+    listTests.push_back(test);
+
+    test.line = "POLYGON Z ((0 0 7, 1 0 7, 1 1 7, 0 1 7, 0 0 7))";
+    listTests.push_back(test);
+
+    test.line = "POLYGON M ((0 0 3, 1 0 3, 1 1 3, 0 1 3, 0 0 3))";
+    listTests.push_back(test);
+
+    test.line = "POLYGON ZM ((0 0 7 3, 1 0 7 3, 1 1 7 3, 0 1 7 3, 0 0 7 3))";
+    listTests.push_back(test);
+
+    test.line = "POLYGON ZM ((0 0 -7.5 3E2,1 0 -7.5 3E2,1 1 -7.5 3E2,"
+                "0 1 -7.5 3E2,0 0 -7.5 3E2))";
+    listTests.push_back(test);
+
+    // wkb (little endian polygon, ISO zm polygon)
+    test.line = "0103000000010000000500000000000000000000000000000000000000"
+                "000000000000F03F0000000000000000000000000000F03F0000000000"
+                "00F03F0000000000000000000000000000F03F00000000000000000000"
+                "000000000000";
+    listTests.push_back(test);
+
+    test.line = "01BB0B00000100000005000000000000000000000000000000000000"
+                "000000000000001C400000000000000840000000000000F03F000000"
+                "00000000000000000000001C400000000000000840000000000000F0"
+                "3F000000000000F03F0000000000001C400000000000000840000000"
+                "0000000000000000000000F03F0000000000001C4000000000000008"
+                "40000000000000000000000000000000000000000000001C40000000"
+                "0000000840";
+    listTests.push_back(test);
+
+    // multipolygon zm with a hole in the second polygon
+    test.line = "MULTIPOLYGON ZM (((0 0 1 2, 1 0 1 2, 1 1 1 2, 0 1 1 2, 0 0 1 2)),"
+                "((0 0 1 2, 4 0 1 2, 4 4 1 2, 0 0 1 2),"
+                "(1 1 1 2, 2 1 1 2, 2 2 1 2, 1 1 1 2)))";
+    test.numPolygons = 2;
+    test.listRingSizes.push_back(4);
+    test.listRingSizes.push_back(4);
+    double const listMulti[] = { 0,0, 4,0, 4,4, 0,0,
+                                 1,1, 2,1, 2,2, 1,1 };
+    test.listXY.insert(test.listXY.end(),listMulti,listMulti+16);
+    listTests.push_back(test);
+
+    // invalid
+    test.valid = false;
+    test.numPolygons = 0;
+    test.listRingSizes.clear();
+    test.listXY.clear();
+
+    test.line = "POLYGON ((0 0 1 2 3, 1 0 1 2 3, 1 1 1 2 3, 0 0 1 2 3))";
+    listTests.push_back(test);
+
+    test.line = "POLYGON ((0, 1 0, 1 1, 0 0))";
+    listTests.push_back(test);
+
+    test.line = "POLYGON ((0 0, 1 0, 1 1, 0 0)";
+    listTests.push_back(test);
+
+    test.line = "LINESTRING (0 0, 1 0)";
+    listTests.push_back(test);
+
+    // write the lines out and read them back
+    std::string filePath = "test_wktreader.txt";
+    std::ofstream testFile(filePath.c_str());
+    for(size_t i=0; i < listTests.size(); i++)   {
+        testFile << listTests[i].line << "\n";
+    }
+    testFile.close();
+
+    WktReader reader;
+    if(!reader.Open(filePath))   {
+        std::cout << "Error: Could not open " << filePath << std::endl;
+        return -1;
+    }
+
+    size_t numFailed = 0;
+    size_t numLines = 0;
+    bool valid;
+    while(reader.ReadLine(valid))   {
+        if(numLines >= listTests.size())   {
+            numLines++;
+            numFailed++;
+            break;
+        }
+        TestLine const &test = listTests[numLines];
+        if(!CheckLine(reader,valid,test))   {
+            std::cout << "FAIL: " << test.line << std::endl;
+            numFailed++;
+        }
+        numLines++;
+    }
+    reader.Close();
+    remove(filePath.c_str());
+
+    if(numLines != listTests.size())   {
+        std::cout << "FAIL: Read " << numLines << " lines, expected "
+                  << listTests.size() << std::endl;
+        numFailed++;
+    }
+
+    std::cout << "#: " << (numFailed == 0 ? "PASS" : "FAIL") << std::endl;
+    return (numFailed == 0) ? 0 : 1;
+}
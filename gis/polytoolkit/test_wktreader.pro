@@ -0,0 +1,16 @@
+TEMPLATE = app
+CONFIG += console debug
+CONFIG -= qt
+TARGET = test_wktreader
+
+# test_wktreader
+SOURCES += test_wktreader.cpp
+
+# required libs
+LIBS += -lgdal
+
+# c++0x
+QMAKE_CXXFLAGS += -std=c++0x
+
+# wkt reader
+HEADERS += WktReader.hpp
@@ -412,6 +412,84 @@ const char SHPAPI_CALL1(*)
 const char SHPAPI_CALL1(*)
       SHPPartTypeName( int nPartType );
 
+/* -------------------------------------------------------------------- */
+/*      Memory mapped, read only access to the .shp file (shpmap.c).    */
+/*                                                                      */
+/*      Records are returned as views onto the mapped file instead of   */
+/*      being copied into an SHPObject.  The array pointers in a view   */
+/*      point at the raw (little endian, possibly unaligned) record     */
+/*      data, so use SHPMapGetPartStart(), SHPMapGetPartType() and      */
+/*      SHPMapReadVertices() to access them.  A view remains valid      */
+/*      until SHPMapClose() is called.                                  */
+/* -------------------------------------------------------------------- */
+typedef struct
+{
+    SHPHandle   hSHP;           /* header and .shx record index */
+
+    unsigned char *pabyMap;     /* the whole .shp file */
+    SAOffset    nMapSize;
+    int         bMapped;        /* FALSE if pabyMap was read into memory */
+} SHPMapInfo;
+
+typedef SHPMapInfo * SHPMapHandle;
+
+typedef struct
+{
+    int		nSHPType;
+    int		nShapeId;
+
+    int		nParts;
+    const unsigned char *pabyPartStart;  /* nParts int32 */
+    const unsigned char *pabyPartType;   /* nParts int32, NULL unless
+                                            SHPT_MULTIPATCH */
+
+    int		nVertices;
+    const unsigned char *pabyXY;         /* nVertices x,y double pairs */
+    const unsigned char *pabyZ;          /* nVertices doubles or NULL */
+    const unsigned char *pabyM;          /* nVertices doubles or NULL */
+
+    double	dfXMin;
+    double	dfYMin;
+    double	dfZMin;
+    double	dfMMin;
+
+    double	dfXMax;
+    double	dfYMax;
+    double	dfZMax;
+    double	dfMMax;
+
+    int		bMeasureIsUsed;
+} SHPRecordView;
+
+/* Return FALSE to stop visiting the rest of the records. */
+typedef int (*SHPMapCallback)( const SHPRecordView * psView, int iThread,
+                               void * pUserData );
+
+SHPMapHandle SHPAPI_CALL
+      SHPMapOpen( const char * pszShapeFile );
+void SHPAPI_CALL
+      SHPMapClose( SHPMapHandle hMap );
+void SHPAPI_CALL
+      SHPMapGetInfo( SHPMapHandle hMap, int * pnEntities, int * pnShapeType,
+                     double * padfMinBound, double * padfMaxBound );
+
+int SHPAPI_CALL
+      SHPMapGetRecord( SHPMapHandle hMap, int iShape, SHPRecordView * psView );
+int SHPAPI_CALL
+      SHPMapGetPartStart( const SHPRecordView * psView, int iPart );
+int SHPAPI_CALL
+      SHPMapGetPartType( const SHPRecordView * psView, int iPart );
+void SHPAPI_CALL
+      SHPMapReadVertices( const SHPRecordView * psView, int iStart, int nCount,
+                          double * padfX, double * padfY,
+                          double * padfZ, double * padfM );
+SHPObject SHPAPI_CALL1(*)
+      SHPMapReadObject( SHPMapHandle hMap, int iShape );
+
+int SHPAPI_CALL
+      SHPMapForEach( SHPMapHandle hMap, int iStart, int iEnd, int nThreads,
+                     SHPMapCallback pfnCallback, void * pUserData );
+
 /* -------------------------------------------------------------------- */
 /*      Shape quadtree indexing API.                                    */
 /* -------------------------------------------------------------------- */
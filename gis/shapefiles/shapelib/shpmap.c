@@ -0,0 +1,1031 @@
+/******************************************************************************
+ * $Id$
+ *
+ * Project:  Shapelib
+ * Purpose:  Memory mapped, read only access to the .shp file with record
+ *           views and parallel iteration over ranges of records.
+ *
+ ******************************************************************************
+ *
+ * This software is available under the following "MIT Style" license,
+ * or at the option of the licensee under the LGPL (see LICENSE.LGPL).  This
+ * option is discussed in more detail in shapelib.html.
+ *
+ * --
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ ******************************************************************************
+ *
+ * The header and the .shx record index are still read by SHPOpen(), only
+ * the (much larger) .shp file is mapped.  SHPMapGetRecord() validates a
+ * record the same way SHPReadObject() does, but it doesn't allocate or
+ * copy anything, so reading a file is bound by how fast the mapped pages
+ * can be touched.
+ *
+ */
+
+#include "shapefil.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#if defined(_WIN32) || defined(WIN32)
+#  define SHPMAP_NO_MMAP
+#  define SHPMAP_NO_THREADS
+#  ifndef snprintf
+#     define snprintf _snprintf
+#  endif
+#else
+#  include <sys/types.h>
+#  include <sys/stat.h>
+#  include <sys/mman.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#  include <pthread.h>
+#endif
+
+SHP_CVSID("$Id$")
+
+typedef unsigned char uchar;
+
+#if UINT_MAX == 65535
+typedef long	      int32;
+#else
+typedef int	      int32;
+#endif
+
+#ifndef FALSE
+#  define FALSE		0
+#  define TRUE		1
+#endif
+
+/* Records handed to a thread at a time by SHPMapForEach(); a block ends */
+/* at whichever limit is reached first.                                   */
+#define SHPMAP_BLOCK_RECORDS    256
+#define SHPMAP_BLOCK_BYTES      (256*1024)
+
+static int 	bBigEndian;
+
+/************************************************************************/
+/*                              SwapWord()                              */
+/*                                                                      */
+/*      Swap a 2, 4 or 8 byte word.                                     */
+/************************************************************************/
+
+static void	SwapWord( int length, void * wordP )
+
+{
+    int		i;
+    uchar	temp;
+
+    for( i=0; i < length/2; i++ )
+    {
+	temp = ((uchar *) wordP)[i];
+	((uchar *)wordP)[i] = ((uchar *) wordP)[length-i-1];
+	((uchar *) wordP)[length-i-1] = temp;
+    }
+}
+
+/************************************************************************/
+/*                            SwapDoubles()                             */
+/*                                                                      */
+/*      Swap an array of 8 byte words.  With gcc/clang this is a        */
+/*      straight loop over bswap that gets vectorized into byte         */
+/*      shuffles.                                                       */
+/************************************************************************/
+
+static void	SwapDoubles( double * padfValues, int nCount )
+
+{
+    int		i;
+
+#if defined(__GNUC__)
+    unsigned long long nValue;
+
+    for( i = 0; i < nCount; i++ )
+    {
+        memcpy( &nValue, padfValues + i, 8 );
+        nValue = __builtin_bswap64( nValue );
+        memcpy( padfValues + i, &nValue, 8 );
+    }
+#else
+    for( i = 0; i < nCount; i++ )
+        SwapWord( 8, padfValues + i );
+#endif
+}
+
+/************************************************************************/
+/*                         GetInt32() / GetDouble()                     */
+/*                                                                      */
+/*      Fetch a little endian value from a possibly unaligned           */
+/*      address in the mapped file.                                     */
+/************************************************************************/
+
+static int GetInt32( const uchar * pabyData )
+
+{
+    int32	nValue;
+
+    memcpy( &nValue, pabyData, 4 );
+    if( bBigEndian ) SwapWord( 4, &nValue );
+
+    return nValue;
+}
+
+static double GetDouble( const uchar * pabyData )
+
+{
+    double	dfValue;
+
+    memcpy( &dfValue, pabyData, 8 );
+    if( bBigEndian ) SwapWord( 8, &dfValue );
+
+    return dfValue;
+}
+
+/************************************************************************/
+/*                             SHPMapFile()                             */
+/*                                                                      */
+/*      Map (or read) the whole of the named file.                      */
+/************************************************************************/
+
+static int SHPMapFile( SHPMapHandle psMap, const char * pszFilename )
+
+{
+#ifdef SHPMAP_NO_MMAP
+    FILE	*fp;
+    long	nSize;
+
+    fp = fopen( pszFilename, "rb" );
+    if( fp == NULL )
+        return FALSE;
+
+    if( fseek( fp, 0, SEEK_END ) != 0 || (nSize = ftell( fp )) <= 0 )
+    {
+        fclose( fp );
+        return FALSE;
+    }
+    fseek( fp, 0, SEEK_SET );
+
+    psMap->pabyMap = (uchar *) malloc( nSize );
+    if( psMap->pabyMap == NULL
+        || fread( psMap->pabyMap, nSize, 1, fp ) != 1 )
+    {
+        free( psMap->pabyMap );
+        psMap->pabyMap = NULL;
+        fclose( fp );
+        return FALSE;
+    }
+    fclose( fp );
+
+    psMap->nMapSize = (SAOffset) nSize;
+    psMap->bMapped = FALSE;
+
+    return TRUE;
+#else
+    int		fd;
+    struct stat sStat;
+    void	*pMap;
+
+    fd = open( pszFilename, O_RDONLY );
+    if( fd < 0 )
+        return FALSE;
+
+    if( fstat( fd, &sStat ) != 0 || sStat.st_size <= 0 )
+    {
+        close( fd );
+        return FALSE;
+    }
+
+    pMap = mmap( NULL, (size_t) sStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    close( fd );
+
+    if( pMap == MAP_FAILED )
+        return FALSE;
+
+#ifdef MADV_SEQUENTIAL
+    /* records are mostly visited in file order, so read ahead */
+    madvise( pMap, (size_t) sStat.st_size, MADV_SEQUENTIAL );
+#endif
+
+    psMap->pabyMap = (uchar *) pMap;
+    psMap->nMapSize = (SAOffset) sStat.st_size;
+    psMap->bMapped = TRUE;
+
+    return TRUE;
+#endif
+}
+
+/************************************************************************/
+/*                             SHPMapOpen()                             */
+/*                                                                      */
+/*      Open the .shp and .shx files based on the basename of the       */
+/*      files or either file name, and map the .shp file.               */
+/************************************************************************/
+
+SHPMapHandle SHPAPI_CALL
+SHPMapOpen( const char * pszLayer )
+
+{
+    SHPMapHandle	psMap;
+    SHPHandle		hSHP;
+    char		*pszFullname, *pszBasename;
+    int			i, bOpened;
+
+/* -------------------------------------------------------------------- */
+/*	Establish the byte order on this machine.			*/
+/* -------------------------------------------------------------------- */
+    i = 1;
+    if( *((uchar *) &i) == 1 )
+        bBigEndian = FALSE;
+    else
+        bBigEndian = TRUE;
+
+/* -------------------------------------------------------------------- */
+/*      Read the header and the record offsets from the .shx.           */
+/* -------------------------------------------------------------------- */
+    hSHP = SHPOpen( pszLayer, "rb" );
+    if( hSHP == NULL )
+        return NULL;
+
+/* -------------------------------------------------------------------- */
+/*	Compute the base (layer) name.  If there is any extension	*/
+/*	on the passed in filename we will strip it off.			*/
+/* -------------------------------------------------------------------- */
+    pszBasename = (char *) malloc(strlen(pszLayer)+5);
+    strcpy( pszBasename, pszLayer );
+    for( i = strlen(pszBasename)-1;
+         i > 0 && pszBasename[i] != '.' && pszBasename[i] != '/'
+             && pszBasename[i] != '\\';
+         i-- ) {}
+
+    if( pszBasename[i] == '.' )
+        pszBasename[i] = '\0';
+
+/* -------------------------------------------------------------------- */
+/*      Map the .shp file.                                              */
+/* -------------------------------------------------------------------- */
+    psMap = (SHPMapHandle) calloc(sizeof(SHPMapInfo),1);
+    psMap->hSHP = hSHP;
+
+    pszFullname = (char *) malloc(strlen(pszBasename) + 5);
+    sprintf( pszFullname, "%s.shp", pszBasename );
+    bOpened = SHPMapFile( psMap, pszFullname );
+    if( !bOpened )
+    {
+        sprintf( pszFullname, "%s.SHP", pszBasename );
+        bOpened = SHPMapFile( psMap, pszFullname );
+    }
+
+    if( !bOpened || psMap->nMapSize < 100 )
+    {
+        char *pszMessage = (char *) malloc(strlen(pszBasename)*2+256);
+        sprintf( pszMessage, "Unable to map %s.shp or %s.SHP.",
+                 pszBasename, pszBasename );
+        hSHP->sHooks.Error( pszMessage );
+        free( pszMessage );
+
+        free( pszBasename );
+        free( pszFullname );
+        SHPMapClose( psMap );
+
+        return NULL;
+    }
+
+    free( pszBasename );
+    free( pszFullname );
+
+    return psMap;
+}
+
+/************************************************************************/
+/*                            SHPMapClose()                             */
+/************************************************************************/
+
+void SHPAPI_CALL
+SHPMapClose( SHPMapHandle psMap )
+
+{
+    if( psMap == NULL )
+        return;
+
+    if( psMap->pabyMap != NULL )
+    {
+#ifndef SHPMAP_NO_MMAP
+        if( psMap->bMapped )
+            munmap( psMap->pabyMap, (size_t) psMap->nMapSize );
+        else
+#endif
+            free( psMap->pabyMap );
+    }
+
+    if( psMap->hSHP != NULL )
+        SHPClose( psMap->hSHP );
+
+    free( psMap );
+}
+
+/************************************************************************/
+/*                           SHPMapGetInfo()                            */
+/*                                                                      */
+/*      Fetch general information about the shape file.                 */
+/************************************************************************/
+
+void SHPAPI_CALL
+SHPMapGetInfo( SHPMapHandle psMap, int * pnEntities, int * pnShapeType,
+               double * padfMinBound, double * padfMaxBound )
+
+{
+    if( psMap == NULL )
+        return;
+
+    SHPGetInfo( psMap->hSHP, pnEntities, pnShapeType,
+                padfMinBound, padfMaxBound );
+}
+
+/************************************************************************/
+/*                          SHPMapGetRecord()                           */
+/*                                                                      */
+/*      Point a view at the indicated shape.  Returns FALSE if the      */
+/*      record is corrupt, with the same checks as SHPReadObject().     */
+/************************************************************************/
+
+int SHPAPI_CALL
+SHPMapGetRecord( SHPMapHandle psMap, int hEntity, SHPRecordView * psView )
+
+{
+    SHPHandle		psSHP = psMap->hSHP;
+    const uchar		*pabyRec;
+    SAOffset		nRecOffset;
+    int                 nEntitySize, nRequiredSize;
+    char                szErrorMsg[128];
+
+    memset( psView, 0, sizeof(SHPRecordView) );
+
+/* -------------------------------------------------------------------- */
+/*      Validate the record/entity number.                              */
+/* -------------------------------------------------------------------- */
+    if( hEntity < 0 || hEntity >= psSHP->nRecords )
+        return FALSE;
+
+/* -------------------------------------------------------------------- */
+/*      Ensure the whole record is inside the mapped file.              */
+/* -------------------------------------------------------------------- */
+    nRecOffset = psSHP->panRecOffset[hEntity];
+    nEntitySize = psSHP->panRecSize[hEntity]+8;
+    if( nEntitySize < 8 || nRecOffset > psMap->nMapSize
+        || (SAOffset) nEntitySize > psMap->nMapSize - nRecOffset )
+    {
+        snprintf(szErrorMsg, sizeof(szErrorMsg),
+                 "Corrupted .shp file : shape %d : record of size %u "
+                 "at offset %u is past the end of the file",
+                 hEntity, psSHP->panRecSize[hEntity]+8,
+                 psSHP->panRecOffset[hEntity]);
+        psSHP->sHooks.Error( szErrorMsg );
+        return FALSE;
+    }
+
+    pabyRec = psMap->pabyMap + nRecOffset;
+
+    psView->nShapeId = hEntity;
+
+    if ( 8 + 4 > nEntitySize )
+    {
+        snprintf(szErrorMsg, sizeof(szErrorMsg),
+                 "Corrupted .shp file : shape %d : nEntitySize = %d",
+                 hEntity, nEntitySize);
+        psSHP->sHooks.Error( szErrorMsg );
+        return FALSE;
+    }
+    psView->nSHPType = GetInt32( pabyRec + 8 );
+
+/* ==================================================================== */
+/*  Polygon, Arc or MultiPatch.                                         */
+/* ==================================================================== */
+    if( psView->nSHPType == SHPT_POLYGON || psView->nSHPType == SHPT_ARC
+        || psView->nSHPType == SHPT_POLYGONZ
+        || psView->nSHPType == SHPT_POLYGONM
+        || psView->nSHPType == SHPT_ARCZ
+        || psView->nSHPType == SHPT_ARCM
+        || psView->nSHPType == SHPT_MULTIPATCH )
+    {
+        int		nPoints, nParts;
+        int    		i, nOffset, nPrevStart = 0;
+
+        if ( 40 + 8 + 4 > nEntitySize )
+        {
+            snprintf(szErrorMsg, sizeof(szErrorMsg),
+                     "Corrupted .shp file : shape %d : nEntitySize = %d",
+                     hEntity, nEntitySize);
+            psSHP->sHooks.Error( szErrorMsg );
+            return FALSE;
+        }
+
+        psView->dfXMin = GetDouble( pabyRec + 8 +  4 );
+        psView->dfYMin = GetDouble( pabyRec + 8 + 12 );
+        psView->dfXMax = GetDouble( pabyRec + 8 + 20 );
+        psView->dfYMax = GetDouble( pabyRec + 8 + 28 );
+
+        nPoints = GetInt32( pabyRec + 40 + 8 );
+        nParts = GetInt32( pabyRec + 36 + 8 );
+
+        if (nPoints < 0 || nParts < 0 ||
+            nPoints > 50 * 1000 * 1000 || nParts > 10 * 1000 * 1000)
+        {
+            snprintf(szErrorMsg, sizeof(szErrorMsg),
+                     "Corrupted .shp file : shape %d, nPoints=%d, nParts=%d.",
+                     hEntity, nPoints, nParts);
+            psSHP->sHooks.Error( szErrorMsg );
+            return FALSE;
+        }
+
+        nRequiredSize = 44 + 8 + 4 * nParts + 16 * nPoints;
+        if ( psView->nSHPType == SHPT_POLYGONZ
+             || psView->nSHPType == SHPT_ARCZ
+             || psView->nSHPType == SHPT_MULTIPATCH )
+        {
+            nRequiredSize += 16 + 8 * nPoints;
+        }
+        if( psView->nSHPType == SHPT_MULTIPATCH )
+        {
+            nRequiredSize += 4 * nParts;
+        }
+        if (nRequiredSize > nEntitySize)
+        {
+            snprintf(szErrorMsg, sizeof(szErrorMsg),
+                     "Corrupted .shp file : shape %d, nPoints=%d, nParts=%d, nEntitySize=%d.",
+                     hEntity, nPoints, nParts, nEntitySize);
+            psSHP->sHooks.Error( szErrorMsg );
+            return FALSE;
+        }
+
+        psView->nVertices = nPoints;
+        psView->nParts = nParts;
+
+/* -------------------------------------------------------------------- */
+/*      Check that the parts are in order and inside the vertex array.  */
+/* -------------------------------------------------------------------- */
+        psView->pabyPartStart = pabyRec + 44 + 8;
+        for( i = 0; i < nParts; i++ )
+        {
+            int nStart = GetInt32( psView->pabyPartStart + 4*i );
+
+            if (nStart < 0 || (nStart >= nPoints && nPoints > 0) )
+            {
+                snprintf(szErrorMsg, sizeof(szErrorMsg),
+                         "Corrupted .shp file : shape %d : panPartStart[%d] = %d, nVertices = %d",
+                         hEntity, i, nStart, nPoints);
+                psSHP->sHooks.Error( szErrorMsg );
+                return FALSE;
+            }
+            if (i > 0 && nStart <= nPrevStart)
+            {
+                snprintf(szErrorMsg, sizeof(szErrorMsg),
+                         "Corrupted .shp file : shape %d : panPartStart[%d] = %d, panPartStart[%d] = %d",
+                         hEntity, i, nStart, i - 1, nPrevStart);
+                psSHP->sHooks.Error( szErrorMsg );
+                return FALSE;
+            }
+            nPrevStart = nStart;
+        }
+
+        nOffset = 44 + 8 + 4*nParts;
+
+        if( psView->nSHPType == SHPT_MULTIPATCH )
+        {
+            psView->pabyPartType = pabyRec + nOffset;
+            nOffset += 4*nParts;
+        }
+
+        psView->pabyXY = pabyRec + nOffset;
+        nOffset += 16*nPoints;
+
+        if( psView->nSHPType == SHPT_POLYGONZ
+            || psView->nSHPType == SHPT_ARCZ
+            || psView->nSHPType == SHPT_MULTIPATCH )
+        {
+            psView->dfZMin = GetDouble( pabyRec + nOffset );
+            psView->dfZMax = GetDouble( pabyRec + nOffset + 8 );
+            psView->pabyZ = pabyRec + nOffset + 16;
+
+            nOffset += 16 + 8*nPoints;
+        }
+
+/* -------------------------------------------------------------------- */
+/*      As in SHPReadObject(), any shape may have measures if the       */
+/*      record is big enough.                                           */
+/* -------------------------------------------------------------------- */
+        if( nEntitySize >= nOffset + 16 + 8*nPoints )
+        {
+            psView->dfMMin = GetDouble( pabyRec + nOffset );
+            psView->dfMMax = GetDouble( pabyRec + nOffset + 8 );
+            psView->pabyM = pabyRec + nOffset + 16;
+            psView->bMeasureIsUsed = TRUE;
+        }
+    }
+
+/* ==================================================================== */
+/*  MultiPoint.                                                         */
+/* ==================================================================== */
+    else if( psView->nSHPType == SHPT_MULTIPOINT
+             || psView->nSHPType == SHPT_MULTIPOINTM
+             || psView->nSHPType == SHPT_MULTIPOINTZ )
+    {
+        int		nPoints, nOffset;
+
+        if ( 44 + 4 > nEntitySize )
+        {
+            snprintf(szErrorMsg, sizeof(szErrorMsg),
+                     "Corrupted .shp file : shape %d : nEntitySize = %d",
+                     hEntity, nEntitySize);
+            psSHP->sHooks.Error( szErrorMsg );
+            return FALSE;
+        }
+        nPoints = GetInt32( pabyRec + 44 );
+
+        if (nPoints < 0 || nPoints > 50 * 1000 * 1000)
+        {
+            snprintf(szErrorMsg, sizeof(szErrorMsg),
+                     "Corrupted .shp file : shape %d : nPoints = %d",
+                     hEntity, nPoints);
+            psSHP->sHooks.Error( szErrorMsg );
+            return FALSE;
+        }
+
+        nRequiredSize = 48 + nPoints * 16;
+        if( psView->nSHPType == SHPT_MULTIPOINTZ )
+        {
+            nRequiredSize += 16 + nPoints * 8;
+        }
+        if (nRequiredSize > nEntitySize)
+        {
+            snprintf(szErrorMsg, sizeof(szErrorMsg),
+                     "Corrupted .shp file : shape %d : nPoints = %d, nEntitySize = %d",
+                     hEntity, nPoints, nEntitySize);
+            psSHP->sHooks.Error( szErrorMsg );
+            return FALSE;
+        }
+
+        psView->nVertices = nPoints;
+        psView->pabyXY = pabyRec + 48;
+        nOffset = 48 + 16*nPoints;
+
+        psView->dfXMin = GetDouble( pabyRec + 8 +  4 );
+        psView->dfYMin = GetDouble( pabyRec + 8 + 12 );
+        psView->dfXMax = GetDouble( pabyRec + 8 + 20 );
+        psView->dfYMax = GetDouble( pabyRec + 8 + 28 );
+
+        if( psView->nSHPType == SHPT_MULTIPOINTZ )
+        {
+            psView->dfZMin = GetDouble( pabyRec + nOffset );
+            psView->dfZMax = GetDouble( pabyRec + nOffset + 8 );
+            psView->pabyZ = pabyRec + nOffset + 16;
+
+            nOffset += 16 + 8*nPoints;
+        }
+
+        if( nEntitySize >= nOffset + 16 + 8*nPoints )
+        {
+            psView->dfMMin = GetDouble( pabyRec + nOffset );
+            psView->dfMMax = GetDouble( pabyRec + nOffset + 8 );
+            psView->pabyM = pabyRec + nOffset + 16;
+            psView->bMeasureIsUsed = TRUE;
+        }
+    }
+
+/* ==================================================================== */
+/*      Point.                                                          */
+/* ==================================================================== */
+    else if( psView->nSHPType == SHPT_POINT
+             || psView->nSHPType == SHPT_POINTM
+             || psView->nSHPType == SHPT_POINTZ )
+    {
+        int	nOffset;
+
+        if (20 + 8 + (( psView->nSHPType == SHPT_POINTZ ) ? 8 : 0)> nEntitySize)
+        {
+            snprintf(szErrorMsg, sizeof(szErrorMsg),
+                     "Corrupted .shp file : shape %d : nEntitySize = %d",
+                     hEntity, nEntitySize);
+            psSHP->sHooks.Error( szErrorMsg );
+            return FALSE;
+        }
+
+        psView->nVertices = 1;
+        psView->pabyXY = pabyRec + 12;
+        nOffset = 20 + 8;
+
+        if( psView->nSHPType == SHPT_POINTZ )
+        {
+            psView->pabyZ = pabyRec + nOffset;
+            nOffset += 8;
+        }
+
+        if( nEntitySize >= nOffset + 8 )
+        {
+            psView->pabyM = pabyRec + nOffset;
+            psView->bMeasureIsUsed = TRUE;
+        }
+
+/* -------------------------------------------------------------------- */
+/*      Since no extents are supplied in the record, we will apply      */
+/*      them from the single vertex.                                    */
+/* -------------------------------------------------------------------- */
+        psView->dfXMin = psView->dfXMax = GetDouble( psView->pabyXY );
+        psView->dfYMin = psView->dfYMax = GetDouble( psView->pabyXY + 8 );
+        if( psView->pabyZ != NULL )
+            psView->dfZMin = psView->dfZMax = GetDouble( psView->pabyZ );
+        if( psView->pabyM != NULL )
+            psView->dfMMin = psView->dfMMax = GetDouble( psView->pabyM );
+    }
+
+    return TRUE;
+}
+
+/************************************************************************/
+/*                         SHPMapGetPartStart()                         */
+/************************************************************************/
+
+int SHPAPI_CALL
+SHPMapGetPartStart( const SHPRecordView * psView, int iPart )
+
+{
+    if( iPart < 0 || iPart >= psView->nParts )
+        return 0;
+
+    return GetInt32( psView->pabyPartStart + 4*iPart );
+}
+
+/************************************************************************/
+/*                         SHPMapGetPartType()                          */
+/************************************************************************/
+
+int SHPAPI_CALL
+SHPMapGetPartType( const SHPRecordView * psView, int iPart )
+
+{
+    if( iPart < 0 || iPart >= psView->nParts
+        || psView->pabyPartType == NULL )
+        return SHPP_RING;
+
+    return GetInt32( psView->pabyPartType + 4*iPart );
+}
+
+/************************************************************************/
+/*                         SHPMapReadVertices()                         */
+/*                                                                      */
+/*      Copy nCount vertices starting at iStart out of the record       */
+/*      into separate arrays.  Any of the arrays may be NULL, and Z     */
+/*      and M are zero filled when the record doesn't have them.        */
+/*      The copies are straight loops over memcpy(), so they are        */
+/*      vectorized and the cost is dominated by touching the            */
+/*      mapped pages.                                                   */
+/************************************************************************/
+
+void SHPAPI_CALL
+SHPMapReadVertices( const SHPRecordView * psView, int iStart, int nCount,
+                    double * padfX, double * padfY,
+                    double * padfZ, double * padfM )
+
+{
+    const uchar	*pabyXY;
+    int		i;
+
+    if( iStart < 0 || nCount <= 0 || iStart > psView->nVertices - nCount )
+        return;
+
+/* -------------------------------------------------------------------- */
+/*      De-interleave the X/Y pairs.                                    */
+/* -------------------------------------------------------------------- */
+    pabyXY = psView->pabyXY + 16 * iStart;
+    if( padfX != NULL )
+    {
+        for( i = 0; i < nCount; i++ )
+            memcpy( padfX + i, pabyXY + 16*i, 8 );
+        if( bBigEndian ) SwapDoubles( padfX, nCount );
+    }
+    if( padfY != NULL )
+    {
+        for( i = 0; i < nCount; i++ )
+            memcpy( padfY + i, pabyXY + 16*i + 8, 8 );
+        if( bBigEndian ) SwapDoubles( padfY, nCount );
+    }
+
+/* -------------------------------------------------------------------- */
+/*      Z and M are already contiguous.                                 */
+/* -------------------------------------------------------------------- */
+    if( padfZ != NULL )
+    {
+        if( psView->pabyZ != NULL )
+        {
+            memcpy( padfZ, psView->pabyZ + 8 * iStart, 8 * nCount );
+            if( bBigEndian ) SwapDoubles( padfZ, nCount );
+        }
+        else
+            memset( padfZ, 0, sizeof(double) * nCount );
+    }
+    if( padfM != NULL )
+    {
+        if( psView->pabyM != NULL )
+        {
+            memcpy( padfM, psView->pabyM + 8 * iStart, 8 * nCount );
+            if( bBigEndian ) SwapDoubles( padfM, nCount );
+        }
+        else
+            memset( padfM, 0, sizeof(double) * nCount );
+    }
+}
+
+/************************************************************************/
+/*                          SHPMapReadObject()                          */
+/*                                                                      */
+/*      Read a shape into an SHPObject, the same as SHPReadObject()     */
+/*      but without seeking/reading the .shp file.  This is safe to     */
+/*      call from several threads with the same handle.                 */
+/************************************************************************/
+
+SHPObject SHPAPI_CALL1(*)
+SHPMapReadObject( SHPMapHandle psMap, int hEntity )
+
+{
+    SHPRecordView	sView;
+    SHPObject		*psShape;
+    int			i;
+
+    if( !SHPMapGetRecord( psMap, hEntity, &sView ) )
+        return NULL;
+
+    psShape = (SHPObject *) calloc(1,sizeof(SHPObject));
+    psShape->nSHPType = sView.nSHPType;
+    psShape->nShapeId = sView.nShapeId;
+    psShape->bMeasureIsUsed = sView.bMeasureIsUsed;
+
+    psShape->dfXMin = sView.dfXMin;
+    psShape->dfYMin = sView.dfYMin;
+    psShape->dfZMin = sView.dfZMin;
+    psShape->dfMMin = sView.dfMMin;
+    psShape->dfXMax = sView.dfXMax;
+    psShape->dfYMax = sView.dfYMax;
+    psShape->dfZMax = sView.dfZMax;
+    psShape->dfMMax = sView.dfMMax;
+
+    if( sView.pabyXY == NULL )
+        return psShape;
+
+    psShape->nVertices = sView.nVertices;
+    psShape->padfX = (double *) calloc(sView.nVertices,sizeof(double));
+    psShape->padfY = (double *) calloc(sView.nVertices,sizeof(double));
+    psShape->padfZ = (double *) calloc(sView.nVertices,sizeof(double));
+    psShape->padfM = (double *) calloc(sView.nVertices,sizeof(double));
+
+    psShape->nParts = sView.nParts;
+    if( sView.pabyPartStart != NULL )
+    {
+        psShape->panPartStart = (int *) calloc(sView.nParts,sizeof(int));
+        psShape->panPartType = (int *) calloc(sView.nParts,sizeof(int));
+    }
+
+    if( (sView.nVertices > 0
+         && (psShape->padfX == NULL || psShape->padfY == NULL
+             || psShape->padfZ == NULL || psShape->padfM == NULL))
+        || (sView.nParts > 0
+            && (psShape->panPartStart == NULL
+                || psShape->panPartType == NULL)) )
+    {
+        char szErrorMsg[128];
+
+        snprintf(szErrorMsg, sizeof(szErrorMsg),
+                 "Not enough memory to allocate requested memory (nPoints=%d, nParts=%d) for shape %d. "
+                 "Probably broken SHP file", sView.nVertices, sView.nParts, hEntity );
+        psMap->hSHP->sHooks.Error( szErrorMsg );
+        SHPDestroyObject(psShape);
+        return NULL;
+    }
+
+    for( i = 0; i < sView.nParts; i++ )
+    {
+        psShape->panPartStart[i] = SHPMapGetPartStart( &sView, i );
+        psShape->panPartType[i] = SHPMapGetPartType( &sView, i );
+    }
+
+    SHPMapReadVertices( &sView, 0, sView.nVertices,
+                        psShape->padfX, psShape->padfY,
+                        psShape->padfZ, psShape->padfM );
+
+    return psShape;
+}
+
+/************************************************************************/
+/*                            SHPMapForEach()                           */
+/*                                                                      */
+/*      Call pfnCallback with a view of each record in [iStart,iEnd)    */
+/*      using nThreads threads (or one per core if nThreads <= 0).      */
+/*      The calling thread is used as thread 0.  Threads take blocks    */
+/*      of consecutive records as they finish, so records are visited  */
+/*      in order within a block but blocks run concurrently, and the    */
+/*      callback must be safe to call from several threads at once.     */
+/*                                                                      */
+/*      Returns FALSE if a record couldn't be read or a callback        */
+/*      returned FALSE; the remaining blocks are skipped in the         */
+/*      latter case.                                                    */
+/************************************************************************/
+
+typedef struct
+{
+    SHPMapHandle	psMap;
+    SHPMapCallback	pfnCallback;
+    void		*pUserData;
+
+    /* protected by hMutex when there is more than one thread */
+    int			iNext;
+    int			iEnd;
+    int			bStop;
+    int			bFailed;
+
+#ifndef SHPMAP_NO_THREADS
+    pthread_mutex_t	hMutex;
+#endif
+} SHPMapJob;
+
+typedef struct
+{
+    SHPMapJob		*psJob;
+    int			iThread;
+} SHPMapWorker;
+
+static void *SHPMapRunWorker( void * pArg )
+
+{
+    SHPMapWorker	*psWorker = (SHPMapWorker *) pArg;
+    SHPMapJob		*psJob = psWorker->psJob;
+    SHPHandle		psSHP = psJob->psMap->hSHP;
+    SHPRecordView	sView;
+    int			iFirst, iLast, bFailed, bStop;
+
+    for( ;; )
+    {
+/* -------------------------------------------------------------------- */
+/*      Claim the next block.                                           */
+/* -------------------------------------------------------------------- */
+#ifndef SHPMAP_NO_THREADS
+        pthread_mutex_lock( &psJob->hMutex );
+#endif
+        iFirst = iLast = psJob->iNext;
+        if( !psJob->bStop )
+        {
+            unsigned int nBytes = 0;
+
+            while( iLast < psJob->iEnd
+                   && iLast - iFirst < SHPMAP_BLOCK_RECORDS
+                   && nBytes < SHPMAP_BLOCK_BYTES )
+            {
+                nBytes += psSHP->panRecSize[iLast];
+                iLast++;
+            }
+        }
+        psJob->iNext = iLast;
+#ifndef SHPMAP_NO_THREADS
+        pthread_mutex_unlock( &psJob->hMutex );
+#endif
+
+        if( iFirst == iLast )
+            break;
+
+/* -------------------------------------------------------------------- */
+/*      Visit it.                                                       */
+/* -------------------------------------------------------------------- */
+        bFailed = bStop = FALSE;
+        for( ; iFirst < iLast && !bStop; iFirst++ )
+        {
+            if( !SHPMapGetRecord( psJob->psMap, iFirst, &sView ) )
+                bFailed = TRUE;
+            else if( !psJob->pfnCallback( &sView, psWorker->iThread,
+                                          psJob->pUserData ) )
+                bStop = TRUE;
+        }
+
+        if( bFailed || bStop )
+        {
+#ifndef SHPMAP_NO_THREADS
+            pthread_mutex_lock( &psJob->hMutex );
+#endif
+            psJob->bFailed |= bFailed;
+            psJob->bStop |= bStop;
+#ifndef SHPMAP_NO_THREADS
+            pthread_mutex_unlock( &psJob->hMutex );
+#endif
+        }
+    }
+
+    return NULL;
+}
+
+int SHPAPI_CALL
+SHPMapForEach( SHPMapHandle psMap, int iStart, int iEnd, int nThreads,
+               SHPMapCallback pfnCallback, void * pUserData )
+
+{
+    SHPMapJob		sJob;
+    SHPMapWorker	*pasWorkers;
+    int			i;
+
+    if( psMap == NULL || pfnCallback == NULL )
+        return FALSE;
+
+    if( iStart < 0 )
+        iStart = 0;
+    if( iEnd > psMap->hSHP->nRecords )
+        iEnd = psMap->hSHP->nRecords;
+    if( iStart >= iEnd )
+        return TRUE;
+
+    memset( &sJob, 0, sizeof(sJob) );
+    sJob.psMap = psMap;
+    sJob.pfnCallback = pfnCallback;
+    sJob.pUserData = pUserData;
+    sJob.iNext = iStart;
+    sJob.iEnd = iEnd;
+
+/* -------------------------------------------------------------------- */
+/*      Work out how many threads to use.                               */
+/* -------------------------------------------------------------------- */
+#ifdef SHPMAP_NO_THREADS
+    nThreads = 1;
+#else
+    if( nThreads <= 0 )
+    {
+        long nCores = sysconf( _SC_NPROCESSORS_ONLN );
+        nThreads = (nCores > 0) ? (int) nCores : 1;
+    }
+#endif
+    if( nThreads > iEnd - iStart )
+        nThreads = iEnd - iStart;
+
+    pasWorkers = (SHPMapWorker *) calloc(nThreads,sizeof(SHPMapWorker));
+    if( pasWorkers == NULL )
+        return FALSE;
+
+    for( i = 0; i < nThreads; i++ )
+    {
+        pasWorkers[i].psJob = &sJob;
+        pasWorkers[i].iThread = i;
+    }
+
+/* -------------------------------------------------------------------- */
+/*      Run.  If a thread can't be started its blocks are just taken    */
+/*      by the others.                                                  */
+/* -------------------------------------------------------------------- */
+#ifdef SHPMAP_NO_THREADS
+    SHPMapRunWorker( pasWorkers );
+#else
+    pthread_mutex_init( &sJob.hMutex, NULL );
+    {
+        pthread_t	*pahThreads;
+        int		*pabStarted;
+
+        pahThreads = (pthread_t *) calloc(nThreads,sizeof(pthread_t));
+        pabStarted = (int *) calloc(nThreads,sizeof(int));
+
+        for( i = 1; i < nThreads && pahThreads && pabStarted; i++ )
+        {
+            pabStarted[i] = (pthread_create( pahThreads + i, NULL,
+                                             SHPMapRunWorker,
+                                             pasWorkers + i ) == 0);
+        }
+
+        SHPMapRunWorker( pasWorkers );
+
+        for( i = 1; i < nThreads && pahThreads && pabStarted; i++ )
+        {
+            if( pabStarted[i] )
+                pthread_join( pahThreads[i], NULL );
+        }
+
+        free( pahThreads );
+        free( pabStarted );
+    }
+    pthread_mutex_destroy( &sJob.hMutex );
+#endif
+
+    free( pasWorkers );
+
+    return !sJob.bFailed && !sJob.bStop;
+}
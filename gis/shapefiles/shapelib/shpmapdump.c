@@ -0,0 +1,294 @@
+/******************************************************************************
+ * $Id$
+ *
+ * Project:  Shapelib
+ * Purpose:  Sample application for dumping contents of a shapefile to
+ *           the terminal in human readable form using the memory mapped
+ *           reader.  The output is the same as shpdump's.
+ *
+ ******************************************************************************
+ *
+ * This software is available under the following "MIT Style" license,
+ * or at the option of the licensee under the LGPL (see LICENSE.LGPL).  This
+ * option is discussed in more detail in shapelib.html.
+ *
+ * --
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ ******************************************************************************
+ */
+
+#include <stdarg.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include "shapefil.h"
+
+SHP_CVSID("$Id$")
+
+/* Shapes are formatted in batches on the worker threads and then */
+/* printed in order.                                              */
+#define BATCH_SIZE	4096
+
+/* Vertices are decoded this many at a time. */
+#define CHUNK_SIZE	256
+
+typedef struct
+{
+    char	*pszText;
+    int		nLength;
+    int		nAlloc;
+} TextBuf;
+
+typedef struct
+{
+    int		iBatchStart;
+    TextBuf	*pasText;	/* one per shape in the batch */
+} DumpBatch;
+
+/************************************************************************/
+/*                             AppendText()                             */
+/************************************************************************/
+
+static void AppendText( TextBuf *psBuf, const char *pszFormat, ... )
+
+{
+    va_list	args;
+    int		nNeeded;
+
+    for( ;; )
+    {
+        int nFree = psBuf->nAlloc - psBuf->nLength;
+
+        va_start( args, pszFormat );
+        nNeeded = vsnprintf( psBuf->pszText + psBuf->nLength, nFree,
+                             pszFormat, args );
+        va_end( args );
+
+        if( nNeeded >= 0 && nNeeded < nFree )
+        {
+            psBuf->nLength += nNeeded;
+            return;
+        }
+
+        psBuf->nAlloc = psBuf->nAlloc * 2 + (nNeeded > 0 ? nNeeded : 0) + 256;
+        psBuf->pszText = (char *) realloc( psBuf->pszText, psBuf->nAlloc );
+    }
+}
+
+/************************************************************************/
+/*                             DumpShape()                              */
+/*                                                                      */
+/*      Format one shape the way shpdump prints it.                     */
+/************************************************************************/
+
+static int DumpShape( const SHPRecordView *psView, int iThread,
+                      void *pUserData )
+
+{
+    DumpBatch	*psBatch = (DumpBatch *) pUserData;
+    TextBuf	*psBuf = psBatch->pasText + (psView->nShapeId
+                                             - psBatch->iBatchStart);
+    double	adfX[CHUNK_SIZE], adfY[CHUNK_SIZE];
+    double	adfZ[CHUNK_SIZE], adfM[CHUNK_SIZE];
+    int		j, iPart, nNextPartStart;
+    const char 	*pszPlus;
+
+    (void) iThread;
+
+    if( psView->bMeasureIsUsed )
+        AppendText( psBuf,
+                    "\nShape:%d (%s)  nVertices=%d, nParts=%d\n"
+                    "  Bounds:(%.15g,%.15g, %.15g, %.15g)\n"
+                    "      to (%.15g,%.15g, %.15g, %.15g)\n",
+                    psView->nShapeId, SHPTypeName(psView->nSHPType),
+                    psView->nVertices, psView->nParts,
+                    psView->dfXMin, psView->dfYMin,
+                    psView->dfZMin, psView->dfMMin,
+                    psView->dfXMax, psView->dfYMax,
+                    psView->dfZMax, psView->dfMMax );
+    else
+        AppendText( psBuf,
+                    "\nShape:%d (%s)  nVertices=%d, nParts=%d\n"
+                    "  Bounds:(%.15g,%.15g, %.15g)\n"
+                    "      to (%.15g,%.15g, %.15g)\n",
+                    psView->nShapeId, SHPTypeName(psView->nSHPType),
+                    psView->nVertices, psView->nParts,
+                    psView->dfXMin, psView->dfYMin,
+                    psView->dfZMin,
+                    psView->dfXMax, psView->dfYMax,
+                    psView->dfZMax );
+
+    if( psView->nParts > 0 && SHPMapGetPartStart( psView, 0 ) != 0 )
+    {
+        fprintf( stderr, "panPartStart[0] = %d, not zero as expected.\n",
+                 SHPMapGetPartStart( psView, 0 ) );
+    }
+
+    iPart = 1;
+    nNextPartStart = (psView->nParts > 1) ? SHPMapGetPartStart( psView, 1 )
+                                          : -1;
+
+    for( j = 0; j < psView->nVertices; j++ )
+    {
+        const char	*pszPartType = "";
+        int		k = j % CHUNK_SIZE;
+
+        if( k == 0 )
+        {
+            int nCount = psView->nVertices - j;
+            if( nCount > CHUNK_SIZE )
+                nCount = CHUNK_SIZE;
+            SHPMapReadVertices( psView, j, nCount, adfX, adfY, adfZ, adfM );
+        }
+
+        if( j == 0 && psView->nParts > 0 )
+            pszPartType = SHPPartTypeName( SHPMapGetPartType( psView, 0 ) );
+
+        if( iPart < psView->nParts && nNextPartStart == j )
+        {
+            pszPartType = SHPPartTypeName( SHPMapGetPartType( psView, iPart ) );
+            iPart++;
+            nNextPartStart = (iPart < psView->nParts)
+                ? SHPMapGetPartStart( psView, iPart ) : -1;
+            pszPlus = "+";
+        }
+        else
+            pszPlus = " ";
+
+        if( psView->bMeasureIsUsed )
+            AppendText( psBuf, "   %s (%.15g,%.15g, %.15g, %.15g) %s \n",
+                        pszPlus, adfX[k], adfY[k], adfZ[k], adfM[k],
+                        pszPartType );
+        else
+            AppendText( psBuf, "   %s (%.15g,%.15g, %.15g) %s \n",
+                        pszPlus, adfX[k], adfY[k], adfZ[k],
+                        pszPartType );
+    }
+
+    return 1;
+}
+
+int main( int argc, char ** argv )
+
+{
+    SHPMapHandle hMap;
+    int		nShapeType, nEntities, i, nThreads = 1;
+    int         bHeaderOnly = 0;
+    double 	adfMinBound[4], adfMaxBound[4];
+    DumpBatch	sBatch;
+
+    if( argc > 2 && strcmp(argv[1],"-threads") == 0 )
+    {
+        nThreads = atoi(argv[2]);
+        argv += 2;
+        argc -= 2;
+    }
+
+    if( argc > 1 && strcmp(argv[1],"-ho") == 0 )
+    {
+        bHeaderOnly = 1;
+        argv++;
+        argc--;
+    }
+
+/* -------------------------------------------------------------------- */
+/*      Display a usage message.                                        */
+/* -------------------------------------------------------------------- */
+    if( argc != 2 )
+    {
+        printf( "shpmapdump [-threads n] [-ho] shp_file\n" );
+        printf( "  -threads n  Read with n threads, 0 for one per core.\n" );
+        exit( 1 );
+    }
+
+/* -------------------------------------------------------------------- */
+/*      Open the passed shapefile.                                      */
+/* -------------------------------------------------------------------- */
+    hMap = SHPMapOpen( argv[1] );
+
+    if( hMap == NULL )
+    {
+        printf( "Unable to open:%s\n", argv[1] );
+        exit( 1 );
+    }
+
+/* -------------------------------------------------------------------- */
+/*      Print out the file bounds.                                      */
+/* -------------------------------------------------------------------- */
+    SHPMapGetInfo( hMap, &nEntities, &nShapeType, adfMinBound, adfMaxBound );
+
+    printf( "Shapefile Type: %s   # of Shapes: %d\n\n",
+            SHPTypeName( nShapeType ), nEntities );
+
+    printf( "File Bounds: (%.15g,%.15g,%.15g,%.15g)\n"
+            "         to  (%.15g,%.15g,%.15g,%.15g)\n",
+            adfMinBound[0],
+            adfMinBound[1],
+            adfMinBound[2],
+            adfMinBound[3],
+            adfMaxBound[0],
+            adfMaxBound[1],
+            adfMaxBound[2],
+            adfMaxBound[3] );
+
+/* -------------------------------------------------------------------- */
+/*      Format the shapes a batch at a time and print them in order.    */
+/* -------------------------------------------------------------------- */
+    sBatch.pasText = (TextBuf *) calloc(BATCH_SIZE,sizeof(TextBuf));
+
+    /* the text of a shape that couldn't be read is left empty */
+    for( i = 0; i < nEntities && !bHeaderOnly; i += BATCH_SIZE )
+    {
+        int	j, nBatch = nEntities - i, bFailed = 0;
+
+        if( nBatch > BATCH_SIZE )
+            nBatch = BATCH_SIZE;
+
+        sBatch.iBatchStart = i;
+        for( j = 0; j < nBatch; j++ )
+            sBatch.pasText[j].nLength = 0;
+
+        SHPMapForEach( hMap, i, i + nBatch, nThreads, DumpShape, &sBatch );
+
+        for( j = 0; j < nBatch; j++ )
+        {
+            if( sBatch.pasText[j].nLength == 0 )
+            {
+                fprintf( stderr,
+                         "Unable to read shape %d, terminating object reading.\n",
+                         i + j );
+                bFailed = 1;
+                break;
+            }
+            fputs( sBatch.pasText[j].pszText, stdout );
+        }
+
+        if( bFailed )
+            break;
+    }
+
+    for( i = 0; i < BATCH_SIZE; i++ )
+        free( sBatch.pasText[i].pszText );
+    free( sBatch.pasText );
+
+    SHPMapClose( hMap );
+
+    exit( 0 );
+}
@@ -0,0 +1,15 @@
+#!/bin/sh
+
+for i in 0 1 2 3 4 5 6 7 8 9 10 11 12 13; do
+  ./shptest $i > /dev/null
+  ./shpdump test${i}.shp > shpdump.out
+  ./shpmapdump -threads 4 test${i}.shp > shpmapdump.out
+  if cmp -s shpdump.out shpmapdump.out ; then
+    echo Test 4/$i matches
+  else
+    echo Test 4/$i differs
+    diff shpdump.out shpmapdump.out
+  fi
+done
+
+rm -f shpdump.out shpmapdump.out
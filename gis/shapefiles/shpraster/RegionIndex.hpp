@@ -0,0 +1,265 @@
+#ifndef SHPRASTER_REGION_INDEX_HPP
+#define SHPRASTER_REGION_INDEX_HPP
+
+// STL
+#include <string>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+
+// sys
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// A region id raster (see RegionRaster.hpp) stored as
+// runs of ids along each row so it can be mapped and
+// queried without decoding anything. Written by
+// shp2regionindex; the layout is (native byte order):
+//
+//   RegionIndexHeader
+//   uint64_t listRowBegin[height]    first run of each row
+//   uint32_t listRowNumRuns[height]  (padded to 8 bytes)
+//   uint32_t listRunX[numRuns]       first column of each run
+//   uint32_t listRunId[numRuns]      id of each run
+//
+// Every row starts with a run at column 0 and rows that
+// are the same as the row above share its runs.
+
+#define K_REGION_INDEX_MAGIC "RGNIDX01"
+
+struct RegionIndexHeader
+{
+    char magic[8];
+    uint32_t pxPerDeg;
+    uint32_t width;
+    uint32_t height;
+    uint32_t numRegions;
+    uint64_t numRuns;
+};
+
+// Usage:
+//   RegionIndex index;
+//   if(index.Open("admin1.idx"))   {
+//       uint32_t id = index.Lookup(lon,lat);    // 0 if none
+//   }
+class RegionIndex
+{
+public:
+    RegionIndex() :
+        m_fd(-1),
+        m_data(NULL),
+        m_size(0),
+        m_header(NULL),
+        m_listRowBegin(NULL),
+        m_listRowNumRuns(NULL),
+        m_listRunX(NULL),
+        m_listRunId(NULL)
+    {}
+
+    ~RegionIndex()
+    {
+        Close();
+    }
+
+    bool Open(std::string const &filePath)
+    {
+        Close();
+
+        m_fd = open(filePath.c_str(),O_RDONLY);
+        if(m_fd < 0)   {
+            return false;
+        }
+
+        struct stat fileStat;
+        if(fstat(m_fd,&fileStat) != 0 ||
+           size_t(fileStat.st_size) < sizeof(RegionIndexHeader))   {
+            Close();
+            return false;
+        }
+        m_size = fileStat.st_size;
+
+        void * data = mmap(NULL,m_size,PROT_READ,MAP_PRIVATE,m_fd,0);
+        if(data == MAP_FAILED)   {
+            Close();
+            return false;
+        }
+        m_data = static_cast<char const *>(data);
+
+        // check the header and that every array fits; numRuns
+        // is bounded by the file size before it's used so the
+        // size can't wrap
+        m_header = reinterpret_cast<RegionIndexHeader const *>(m_data);
+        if(memcmp(m_header->magic,K_REGION_INDEX_MAGIC,8) != 0 ||
+           m_header->pxPerDeg == 0 ||
+           m_header->width != uint64_t(360)*m_header->pxPerDeg ||
+           m_header->height != uint64_t(180)*m_header->pxPerDeg ||
+           m_size < GetRowTableEnd(*m_header) ||
+           m_header->numRuns > (m_size-GetRowTableEnd(*m_header))/(2*sizeof(uint32_t)) ||
+           m_size != GetFileSize(*m_header))   {
+            Close();
+            return false;
+        }
+
+        size_t offset = sizeof(RegionIndexHeader);
+        m_listRowBegin = reinterpret_cast<uint64_t const *>(m_data+offset);
+        offset += sizeof(uint64_t)*m_header->height;
+        m_listRowNumRuns = reinterpret_cast<uint32_t const *>(m_data+offset);
+        offset += sizeof(uint64_t)*((m_header->height+1)/2);
+        m_listRunX = reinterpret_cast<uint32_t const *>(m_data+offset);
+        offset += sizeof(uint32_t)*m_header->numRuns;
+        m_listRunId = reinterpret_cast<uint32_t const *>(m_data+offset);
+
+        for(uint32_t i=0; i < m_header->height; i++)   {
+            if(m_listRowNumRuns[i] == 0 ||
+               m_listRowNumRuns[i] > m_header->numRuns ||
+               m_listRowBegin[i] > m_header->numRuns - m_listRowNumRuns[i] ||
+               m_listRunX[m_listRowBegin[i]] != 0)   {
+                Close();
+                return false;
+            }
+        }
+
+        // ids index per region tables so they have to be
+        // in [0,numRegions]
+        for(uint64_t i=0; i < m_header->numRuns; i++)   {
+            if(m_listRunId[i] > m_header->numRegions)   {
+                Close();
+                return false;
+            }
+        }
+
+        // queries are random access
+        madvise(data,m_size,MADV_RANDOM);
+        return true;
+    }
+
+    void Close()
+    {
+        if(m_data != NULL)   {
+            munmap(const_cast<char*>(m_data),m_size);
+        }
+        if(m_fd >= 0)   {
+            close(m_fd);
+        }
+        m_fd = -1;
+        m_data = NULL;
+        m_size = 0;
+        m_header = NULL;
+        m_listRowBegin = NULL;
+        m_listRowNumRuns = NULL;
+        m_listRunX = NULL;
+        m_listRunId = NULL;
+    }
+
+    bool IsOpen() const
+    {
+        return (m_data != NULL);
+    }
+
+    uint32_t GetPxPerDeg() const
+    {
+        return m_header->pxPerDeg;
+    }
+
+    uint32_t GetNumRegions() const
+    {
+        return m_header->numRegions;
+    }
+
+    uint64_t GetNumRuns() const
+    {
+        return m_header->numRuns;
+    }
+
+    // Returns the id of the region containing the pixel
+    // that (lon,lat) falls in, or 0 if there isn't one
+    uint32_t Lookup(double lon, double lat) const
+    {
+        double const x = (lon+180.0)*m_header->pxPerDeg;
+        double const y = (90.0-lat)*m_header->pxPerDeg;
+
+        // also rejects NaN
+        if(!(x >= 0 && x <= m_header->width &&
+             y >= 0 && y <= m_header->height))   {
+            return 0;
+        }
+
+        // lon 180 and lat -90 are in the last column/row
+        uint32_t const col = std::min(uint32_t(x),m_header->width-1);
+        uint32_t const row = std::min(uint32_t(y),m_header->height-1);
+
+        // last run starting at or before col
+        uint32_t const * runX = m_listRunX + m_listRowBegin[row];
+        uint32_t numRuns = m_listRowNumRuns[row];
+        uint32_t ix = 0;
+        while(numRuns > 1)   {
+            uint32_t const half = numRuns/2;
+            if(runX[ix+half] <= col)   {
+                ix += half;
+            }
+            numRuns -= half;
+        }
+        return m_listRunId[m_listRowBegin[row] + ix];
+    }
+
+    // Looks up numPts points, split over numThreads threads
+    void Lookup(size_t numPts,
+                double const * listLon,
+                double const * listLat,
+                uint32_t * listIds,
+                size_t numThreads=1) const
+    {
+        numThreads = std::max(size_t(1),std::min(numThreads,numPts/4096));
+        if(numThreads == 1)   {
+            for(size_t i=0; i < numPts; i++)   {
+                listIds[i] = Lookup(listLon[i],listLat[i]);
+            }
+            return;
+        }
+
+        std::vector<std::thread> listWorkers;
+        for(size_t t=0; t < numThreads; t++)   {
+            listWorkers.push_back(std::thread([=]() {
+                size_t const ixBegin = (numPts*t)/numThreads;
+                size_t const ixEnd = (numPts*(t+1))/numThreads;
+                for(size_t i=ixBegin; i < ixEnd; i++)   {
+                    listIds[i] = Lookup(listLon[i],listLat[i]);
+                }
+            }));
+        }
+        for(size_t t=0; t < listWorkers.size(); t++)   {
+            listWorkers[t].join();
+        }
+    }
+
+    // Size of the header, listRowBegin and listRowNumRuns
+    static uint64_t GetRowTableEnd(RegionIndexHeader const &header)
+    {
+        return sizeof(RegionIndexHeader) +
+               sizeof(uint64_t)*uint64_t(header.height) +
+               sizeof(uint64_t)*((uint64_t(header.height)+1)/2);
+    }
+
+    static uint64_t GetFileSize(RegionIndexHeader const &header)
+    {
+        return GetRowTableEnd(header) +
+               sizeof(uint32_t)*2*header.numRuns;
+    }
+
+private:
+    int m_fd;
+    char const * m_data;
+    size_t m_size;
+
+    RegionIndexHeader const * m_header;
+    uint64_t const * m_listRowBegin;
+    uint32_t const * m_listRowNumRuns;
+    uint32_t const * m_listRunX;
+    uint32_t const * m_listRunId;
+};
+
+#endif // SHPRASTER_REGION_INDEX_HPP
@@ -0,0 +1,229 @@
+#ifndef SHPRASTER_REGION_RASTER_HPP
+#define SHPRASTER_REGION_RASTER_HPP
+
+// STL
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// shapelib libs
+#include "shapelib/shapefil.h"
+
+// Rasterizes the polygons of an admin region shapefile
+// into buffers of region ids. The world is rasterized at
+// pxPerDeg pixels per degree (x = lon+180, y = 90-lat)
+// and a region's id is its record number+1, leaving 0
+// for pixels outside every region.
+
+struct Region
+{
+    // all rings, in pixels
+    std::vector<double> listX;
+    std::vector<double> listY;
+    std::vector<int> listRingOffsets;   // numRings+1
+
+    double minX,minY,maxX,maxY;
+};
+
+struct Edge
+{
+    double x;       // crossing at the center of rowBegin
+    double dxdy;
+    int dir;
+    int rowBegin;
+    int rowEnd;
+};
+
+struct Crossing
+{
+    double x;
+    int dir;
+
+    bool operator < (Crossing const &other) const
+    {   return x < other.x;   }
+};
+
+struct ReadContext
+{
+    std::vector<Region> * listRegions;
+    double pxPerDeg;
+};
+
+// SHPMapForEach callback; records are converted to
+// pixels on the reader threads
+inline int ReadRegion(SHPRecordView const * pView, int, void * pUserData)
+{
+    ReadContext * pContext = static_cast<ReadContext*>(pUserData);
+    Region &region = (*(pContext->listRegions))[pView->nShapeId];
+    double const pxPerDeg = pContext->pxPerDeg;
+
+    int const numPts = pView->nVertices;
+    region.listX.resize(numPts);
+    region.listY.resize(numPts);
+    if(numPts > 0)   {
+        SHPMapReadVertices(pView,0,numPts,
+                           &(region.listX[0]),&(region.listY[0]),
+                           NULL,NULL);
+    }
+
+    region.minX = region.minY = 1E300;
+    region.maxX = region.maxY = -1E300;
+    for(int i=0; i < numPts; i++)   {
+        double const x = (region.listX[i]+180.0)*pxPerDeg;
+        double const y = (90.0-region.listY[i])*pxPerDeg;
+        region.listX[i] = x;
+        region.listY[i] = y;
+        region.minX = std::min(region.minX,x);
+        region.minY = std::min(region.minY,y);
+        region.maxX = std::max(region.maxX,x);
+        region.maxY = std::max(region.maxY,y);
+    }
+
+    region.listRingOffsets.resize(pView->nParts+1);
+    for(int i=0; i < pView->nParts; i++)   {
+        region.listRingOffsets[i] = SHPMapGetPartStart(pView,i);
+    }
+    region.listRingOffsets[pView->nParts] = numPts;
+
+    return 1;
+}
+
+// Fills the pixels of the tile at (tileX0,tileY0) whose
+// centers are inside the region (non zero winding) with
+// the given id. Edges to the right of the tile are skipped
+// and crossings to its left are clamped to it since only
+// the winding they add matters.
+inline void RasterizeRegion(Region const &region,
+                     uint32_t id,
+                     int tileX0, int tileY0,
+                     int tileW, int tileH,
+                     std::vector<uint32_t> &listIds,
+                     std::vector<Edge> &listEdges,
+                     std::vector<Edge> &listActive,
+                     std::vector<Crossing> &listCrossings)
+{
+    double const tileX1 = tileX0+tileW;
+
+    listEdges.clear();
+    for(size_t i=0; i+1 < region.listRingOffsets.size(); i++)   {
+        int const ixBegin = region.listRingOffsets[i];
+        int const ixEnd = region.listRingOffsets[i+1];
+
+        for(int j=ixBegin; j < ixEnd; j++)   {
+            int const k = (j+1 < ixEnd) ? j+1 : ixBegin;
+            double x0 = region.listX[j];   double y0 = region.listY[j];
+            double x1 = region.listX[k];   double y1 = region.listY[k];
+
+            if(y0 == y1 || std::min(x0,x1) >= tileX1)   {
+                continue;
+            }
+
+            int dir = 1;
+            if(y0 > y1)   {
+                std::swap(x0,x1);
+                std::swap(y0,y1);
+                dir = -1;
+            }
+
+            // rows whose centers are in [y0,y1)
+            Edge edge;
+            edge.rowBegin = std::max(0,int(std::ceil(y0-0.5-tileY0)));
+            edge.rowEnd = std::min(tileH,int(std::ceil(y1-0.5-tileY0)));
+            if(edge.rowBegin >= edge.rowEnd)   {
+                continue;
+            }
+            edge.dxdy = (x1-x0)/(y1-y0);
+            edge.x = x0 + (tileY0+edge.rowBegin+0.5-y0)*edge.dxdy;
+            edge.dir = dir;
+            listEdges.push_back(edge);
+        }
+    }
+
+    if(listEdges.empty())   {
+        return;
+    }
+
+    std::sort(listEdges.begin(),listEdges.end(),
+              [](Edge const &a, Edge const &b) {
+        return a.rowBegin < b.rowBegin;
+    });
+
+    listActive.clear();
+    size_t ixNext = 0;
+    for(int row=listEdges[0].rowBegin; row < tileH; row++)
+    {
+        // update the active edges
+        size_t numActive = 0;
+        for(size_t i=0; i < listActive.size(); i++)   {
+            if(listActive[i].rowEnd > row)   {
+                listActive[numActive++] = listActive[i];
+            }
+        }
+        listActive.resize(numActive);
+
+        while(ixNext < listEdges.size() &&
+              listEdges[ixNext].rowBegin == row)   {
+            listActive.push_back(listEdges[ixNext++]);
+        }
+
+        if(listActive.empty())   {
+            if(ixNext == listEdges.size())   {
+                break;
+            }
+            continue;
+        }
+
+        // fill the spans between crossings; the last span
+        // runs to the end of the tile if the edges closing
+        // it were skipped
+        listCrossings.clear();
+        for(size_t i=0; i < listActive.size(); i++)   {
+            Crossing crossing;
+            crossing.x = std::max(listActive[i].x,double(tileX0));
+            crossing.dir = listActive[i].dir;
+            listCrossings.push_back(crossing);
+            listActive[i].x += listActive[i].dxdy;
+        }
+        std::sort(listCrossings.begin(),listCrossings.end());
+
+        uint32_t * rowIds = &(listIds[size_t(row)*tileW]);
+        int winding = 0;
+        for(size_t i=0; i < listCrossings.size(); i++)   {
+            winding += listCrossings[i].dir;
+            if(winding == 0)   {
+                continue;
+            }
+            double const xEnd = (i+1 < listCrossings.size()) ?
+                        listCrossings[i+1].x : tileX1;
+            int colBegin = int(std::ceil(listCrossings[i].x-0.5-tileX0));
+            int colEnd = int(std::ceil(xEnd-0.5-tileX0));
+            colBegin = std::max(colBegin,0);
+            colEnd = std::min(colEnd,tileW);
+            for(int col=colBegin; col < colEnd; col++)   {
+                rowIds[col] = id;
+            }
+        }
+    }
+}
+
+// Reads every record of the shapefile into listRegions
+// (converted to pixels) using numThreads threads
+inline bool ReadRegions(SHPMapHandle hMap,
+                        double pxPerDeg,
+                        int numThreads,
+                        std::vector<Region> &listRegions)
+{
+    int nRecords;
+    SHPMapGetInfo(hMap,&nRecords,NULL,NULL,NULL);
+
+    listRegions.clear();
+    listRegions.resize(nRecords);
+
+    ReadContext readContext;
+    readContext.listRegions = &listRegions;
+    readContext.pxPerDeg = pxPerDeg;
+    return SHPMapForEach(hMap,0,nRecords,numThreads,ReadRegion,&readContext);
+}
+
+#endif // SHPRASTER_REGION_RASTER_HPP
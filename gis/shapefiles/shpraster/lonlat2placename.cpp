@@ -2,39 +2,26 @@
 #include <QCoreApplication>
 #include <QStringList>
 #include <QDebug>
-#include <QImage>
-#include <QPainter>
-#include <QDir>
 
 #include <string>
+#include <vector>
+#include <thread>
+#include <fstream>
 #include <iostream>
+#include <sys/time.h>
 
 // kompex libs
 #include "kompex/KompexSQLiteDatabase.h"
 #include "kompex/KompexSQLiteStatement.h"
 
-void GetTilePixel(double mLon,double mLat,bool &isWest,
-                  int &tileNum,int &tileX,int&tileY)
-{
-    if(mLon < 0)   {
-        // west tiles
-        mLon += 180.0;
-        isWest = true;
-    }
-    else   {
-        // east tiles
-        isWest = false;
-    }
-
-    mLat = (mLat-90)*-1;
+// mmap'd region id index (built by shp2regionindex)
+#include "RegionIndex.hpp"
 
-    int rowIdx = mLat/10;
-    int colIdx = mLon/10;
-
-    // note we assume kSzMult = 100;
-    tileNum = rowIdx*18 + colIdx;
-    tileX = (mLon*100) - (colIdx*1000);
-    tileY = (mLat*100) - (rowIdx*1000);
+double GetTimeMs()
+{
+    timeval t;
+    gettimeofday(&t,NULL);
+    return (t.tv_sec*1000.0) + (t.tv_usec/1000.0);
 }
 
 int main(int argc, char *argv[])
@@ -47,46 +34,84 @@ int main(int argc, char *argv[])
     if(inputArgs.size() < 3)   {
         qDebug() << "Error: Invalid input:";
         qDebug() << "Pass the required arguments as follows: ";
-        qDebug() << "./lonlat2placename <dir_tilesW> <dir_tilesE> <db>";
+        qDebug() << "./lonlat2placename <region_index> <db> [queryfile]";
+        qDebug() << "* Build region_index with shp2regionindex";
+        qDebug() << "* Without a queryfile, coordinates are read interactively";
+        qDebug() << "* Each line of queryfile is 'lon lat'; the results";
+        qDebug() << "  are written to stdout as 'lon lat regionid name'";
         return -1;
     }
 
-    QStringList filterList; filterList << "*.png";
-
-    // get list of tiles for west_input_dir (expect 324)
-    QDir dirTilesWest = inputArgs[1];
-    QStringList listFilesTilesWest =
-        dirTilesWest.entryList(filterList,QDir::Files);
-
-    if(listFilesTilesWest.size() != 324)   {
-        qDebug() << "Error: Expected 324 West Tiles, got"
-                 << listFilesTilesWest.size();
-        return -1;
-    }
-
-    // get list of tiles for east_input_dir (expect 324)
-    QDir dirTilesEast = inputArgs[2];
-    QStringList listFilesTilesEast =
-        dirTilesEast.entryList(filterList,QDir::Files);
-
-    if(listFilesTilesEast.size() != 324)   {
-        qDebug() << "Error: Expected 324 East Tiles, got"
-                 << listFilesTilesEast.size();
+    // open index
+    RegionIndex regionIndex;
+    if(!regionIndex.Open(inputArgs[1].toStdString()))   {
+        qDebug() << "Error: Could not open region index" << inputArgs[1];
         return -1;
     }
 
     // open database
     // returns exception if file dne/invalid
     qDebug() << "Info: Opening Admin Regions Database...";
-    QString argDb  = inputArgs[3];
+    QString argDb  = inputArgs[2];
 
     Kompex::SQLiteDatabase * pDatabase =
             new Kompex::SQLiteDatabase(argDb.toStdString(),
-                SQLITE_OPEN_READWRITE,0);
+                SQLITE_OPEN_READONLY,0);
 
     Kompex::SQLiteStatement * pStmt =
             new Kompex::SQLiteStatement(pDatabase);
 
+    // load every name up front so lookups don't
+    // have to go through the database
+    // (Open checks that every id is <= GetNumRegions)
+    std::vector<std::string> listNames(size_t(regionIndex.GetNumRegions())+1);
+    pStmt->Sql("SELECT regionid,name FROM data");
+    while(pStmt->FetchRow())   {
+        int regionId = pStmt->GetColumnInt(0);
+        if(regionId > 0 && size_t(regionId) < listNames.size())   {
+            listNames[regionId] = pStmt->GetColumnString(1);
+        }
+    }
+    pStmt->FreeQuery();
+
+    // clean up database
+    delete pStmt;
+    delete pDatabase;
+
+    // batch queries
+    if(inputArgs.size() > 3)   {
+        std::ifstream queryFile(inputArgs[3].toLocal8Bit().data());
+        if(!queryFile.is_open())   {
+            qDebug() << "Error: Could not open" << inputArgs[3];
+            return -1;
+        }
+
+        std::vector<double> listLon,listLat;
+        double lon,lat;
+        while(queryFile >> lon >> lat)   {
+            listLon.push_back(lon);
+            listLat.push_back(lat);
+        }
+
+        std::vector<uint32_t> listIds(listLon.size());
+        double t0 = GetTimeMs();
+        if(!listIds.empty())   {
+            regionIndex.Lookup(listIds.size(),&(listLon[0]),&(listLat[0]),
+                               &(listIds[0]),std::thread::hardware_concurrency());
+        }
+        double t1 = GetTimeMs();
+
+        for(size_t i=0; i < listIds.size(); i++)   {
+            std::cout << listLon[i] << " " << listLat[i] << " "
+                      << listIds[i] << " " << listNames[listIds[i]] << "\n";
+        }
+        std::cout.flush();
+
+        qDebug() << "Info: Looked up" << int(listIds.size())
+                 << "points in" << (t1-t0) << "ms";
+        return 0;
+    }
+
     // start main loop
     while(1)   {
         qDebug() << "Enter Coordinates (entering 'n' quits)? [y/n]";
@@ -106,75 +131,18 @@ int main(int argc, char *argv[])
         qDebug() << "Enter Latitude: ";
         std::cin >> userLat;
 
-        // get corresponding pixel from image
-
-        QRgb pixelRgb;
-        QString tilePath;
-        bool isWest = false;
-        int tileNum,tileX,tileY;
-
-        GetTilePixel(userLon,userLat,isWest,
-                     tileNum,tileX,tileY);
-
-        if(isWest)   {
-            tilePath = dirTilesWest.canonicalPath() +
-                    QDir::separator();
-        }
-        else   {
-            tilePath = dirTilesEast.canonicalPath() +
-                    QDir::separator();
-        }
-
-        qDebug() << "Info: Search in dir" << tilePath;
-        qDebug() << "Info: Search in Tile" << tileNum;
-        qDebug() << "Info:" << tileX << "," << tileY;
-
-        QString tileName = QString::number(tileNum,10);
-        tileName.prepend("tile_");
-        tileName.append(".png");
+        uint32_t regionId = regionIndex.Lookup(userLon,userLat);
+        qDebug() << "Info: Region Id:" << regionId;
 
-        QImage tileImg(tilePath + tileName);
-        if(tileImg.isNull())   {
-            qDebug() << "Error: Could not open tile";
-            return -1;
-        }
-
-        pixelRgb = tileImg.pixel(tileX,tileY);
-
-        // convert color into id
-        // id #abc000 -> (abc) -> 2748 (ignore trailing zeros)
-        QColor pixelColor(pixelRgb);
-
-        QString colorName = pixelColor.name();          // #RRGGBB
-        colorName.remove(0,1);                          // remove '#'
-//        while(colorName[colorName.size()-1] == '0')
-//        {   colorName.remove(colorName.size()-1,1);   } // remove trailing zeros
-
-        // smarter to create a lookup table for this
-        // when its actually implemented
-        bool opOk; int dbIdx = colorName.toInt(&opOk,16);
-        QString regionId = QString::number(dbIdx,10);
-
-        qDebug() << "Info: Color String: " << pixelColor.name();
-        qDebug() << "Info: Color Index:" << dbIdx;
-
-        // lookup name using database
-        QString sqlQuery = "SELECT name FROM data WHERE data.regionid = " + regionId;
-        pStmt->Sql(sqlQuery.toStdString());
-        if(pStmt->FetchRow())   {
-            QString placeName = QString::fromStdString(pStmt->GetColumnString(0));
+        if(regionId != 0 && !listNames[regionId].empty())   {
+            QString placeName = QString::fromStdString(listNames[regionId]);
             qDebug() << "Found" << placeName << " at ("
                      << userLon << "," << userLat << ")";
         }
         else   {
             qDebug() << "Couldn't find anything at location!";
         }
-        pStmt->FreeQuery();
     }
 
-    // clean up database
-    delete pStmt;
-    delete pDatabase;
-
     return 0;
 }
@@ -35,5 +35,12 @@ SOURCES += \
     shapelib/dbfopen.c \
     shapelib/safileio.c
 
+# region index
+HEADERS += RegionIndex.hpp
+
+# batch lookups are split over threads
+LIBS += -lpthread
+QMAKE_CXXFLAGS += -std=c++0x
+
 # main
 SOURCES += lonlat2placename.cpp
@@ -3,21 +3,25 @@
 #include <QStringList>
 #include <QDebug>
 #include <QImage>
-#include <QPainter>
 #include <QDir>
 
-// shapelib libs
-#include "shapelib/shapefil.h"
+// STL
+#include <vector>
+#include <thread>
+#include <atomic>
 
-struct Vec2d
-{
-    Vec2d(double sx=0,double sy=0,QColor cy=QColor())
-    {   x = sx;   y = sy;   c = cy;   }
+// id rasterizer
+#include "RegionRaster.hpp"
 
-    double x;
-    double y;
-    QColor c;
-};
+// The world is rendered at pxPerDeg pixels per degree
+// (x = lon+180, y = 90-lat) as a grid of tiles so the
+// output size isn't limited by what QPainter or memory
+// can handle in one image. Each tile is rasterized on
+// its own into a buffer of region ids and then saved,
+// so only numThreads tiles are ever in memory.
+//
+// A region's id is saved as the pixel colour #RRGGBB;
+// pixels outside every region are white.
 
 int main(int argc, char *argv[])
 {
@@ -29,7 +33,29 @@ int main(int argc, char *argv[])
     if(inputArgs.size() < 2)   {
         qDebug() << "Error: No shapefile directory: ";
         qDebug() << "Pass the shapefile directory as an argument: ";
-        qDebug() << "./paint_shapefile /my/shapefiledir";
+        qDebug() << "./shp2img /my/shapefiledir [px_per_degree] [tile_size] [numthreads]";
+        qDebug() << "* Tiles are saved as tiles/tile_<row>_<col>.png";
+        qDebug() << "* px_per_degree defaults to 50, tile_size to 1000 pixels";
+        qDebug() << "  and numthreads to the number of cores";
+        return -1;
+    }
+
+    int kSzMult = 50;
+    int kTileSz = 1000;
+    int numThreads = std::thread::hardware_concurrency();
+    if(inputArgs.size() > 2)   {
+        kSzMult = inputArgs[2].toInt();
+    }
+    if(inputArgs.size() > 3)   {
+        kTileSz = inputArgs[3].toInt();
+    }
+    if(inputArgs.size() > 4)   {
+        numThreads = inputArgs[4].toInt();
+    }
+    numThreads = std::max(numThreads,1);
+
+    if(kSzMult < 1 || kTileSz < 1)   {
+        qDebug() << "Error: Invalid px_per_degree or tile_size";
         return -1;
     }
 
@@ -59,123 +85,138 @@ int main(int argc, char *argv[])
     }
 
     // open the shape file
-    SHPHandle hSHP = SHPOpen(fileShp.toLocal8Bit().data(),"rb");
-    if(hSHP == NULL)   {
+    SHPMapHandle hMap = SHPMapOpen(fileShp.toLocal8Bit().data());
+    if(hMap == NULL)   {
         qDebug() << "Error: Could not open shape file";
         return -1;
     }
 
-    if(hSHP->nShapeType != SHPT_POLYGON)   {
+    int nRecords,nShapeType;
+    double adfMinBound[4],adfMaxBound[4];
+    SHPMapGetInfo(hMap,&nRecords,&nShapeType,adfMinBound,adfMaxBound);
+
+    if(nShapeType != SHPT_POLYGON)   {
         qDebug() << "Error: Wrong shape file type:";
         qDebug() << "Expect POLYGON";
+        SHPMapClose(hMap);
+        return -1;
+    }
+
+    // ids have to fit in 24 bits without being white
+    if(nRecords >= 0xFFFFFF)   {
+        qDebug() << "Error: Too many records to colour code:" << nRecords;
+        SHPMapClose(hMap);
         return -1;
     }
 
-    size_t nRecords = hSHP->nRecords;
-    double xMax = hSHP->adBoundsMax[0];
-    double yMax = hSHP->adBoundsMax[1];
-    double xMin = hSHP->adBoundsMin[0];
-    double yMin = hSHP->adBoundsMin[1];
-    qDebug() << "Info: Bounds: x: " << xMin << "<>" << xMax;
-    qDebug() << "Info: Bounds: y: " << yMin << "<>" << yMax;
+    qDebug() << "Info: Bounds: x: " << adfMinBound[0] << "<>" << adfMaxBound[0];
+    qDebug() << "Info: Bounds: y: " << adfMinBound[1] << "<>" << adfMaxBound[1];
     qDebug() << "Info: Found " << nRecords << "POLYGONS";
     qDebug() << "Info: Reading in data...";
 
-    qDebug() << "Info: Creating color list...";
-    QStringList listColors;
-    for(size_t i=0; i < nRecords; i++)   {
-        QString strColor = QString::number((i+1),16);
-        while(strColor.length() < 6)   {    // pad with zeros
-            strColor.append("0");
-        }
-        strColor.prepend("#");
-        listColors.push_back(strColor);
+    std::vector<Region> listRegions;
+    if(!ReadRegions(hMap,kSzMult,numThreads,listRegions))   {
+        qDebug() << "Warning: Some records could not be read";
     }
-
-    QList<QList<Vec2d> > listPolygons;
-    SHPObject * pSHPObj;
-
-    for(size_t i=0; i < nRecords; i++)
-    {   // for each object
-        pSHPObj = SHPReadObject(hSHP,i);
-        size_t nParts = pSHPObj->nParts;
-
-        // build a list of start and end pts
-        QList<int> listStartPts;
-        QList<int> listEndB4Pts;
-        for(size_t j=0; j < nParts-1; j++)   {
-            listStartPts.push_back(pSHPObj->panPartStart[j]);
-            listEndB4Pts.push_back(pSHPObj->panPartStart[j+1]);
+    SHPMapClose(hMap);
+
+    // bin regions by the tiles their bounds overlap; bins
+    // are in record order so later records are drawn over
+    // earlier ones
+    int const imgW = 360*kSzMult;
+    int const imgH = 180*kSzMult;
+    int const numCols = (imgW+kTileSz-1)/kTileSz;
+    int const numRows = (imgH+kTileSz-1)/kTileSz;
+
+    qDebug() << "Info: Binning regions into" << numRows << "x" << numCols
+             << "tiles of" << kTileSz << "pixels...";
+
+    std::vector<std::vector<uint32_t> > listTileBins(size_t(numRows)*numCols);
+    for(size_t i=0; i < listRegions.size(); i++)   {
+        Region const &region = listRegions[i];
+        if(region.listX.empty())   {
+            continue;
         }
-        listStartPts.push_back(pSHPObj->panPartStart[nParts-1]);
-        listEndB4Pts.push_back(pSHPObj->nVertices);
-
-        // build polys from start/end pts
-        for(size_t j=0; j < listStartPts.size(); j++)
-        {
-            QList<Vec2d> listPts;
-            size_t sIx = listStartPts[j];
-            size_t eIx = listEndB4Pts[j];
-
-            for(size_t k=sIx; k < eIx; k++)
-            {
-                listPts.push_back(Vec2d(pSHPObj->padfX[k]+180,
-                                       (pSHPObj->padfY[k]-90)*-1,
-                                        QColor(listColors[i])));
+        int const colBegin = std::max(0,int(std::floor(region.minX/kTileSz)));
+        int const colEnd = std::min(numCols-1,int(std::floor(region.maxX/kTileSz)));
+        int const rowBegin = std::max(0,int(std::floor(region.minY/kTileSz)));
+        int const rowEnd = std::min(numRows-1,int(std::floor(region.maxY/kTileSz)));
+        for(int r=rowBegin; r <= rowEnd; r++)   {
+            for(int c=colBegin; c <= colEnd; c++)   {
+                listTileBins[size_t(r)*numCols + c].push_back(i);
             }
-            listPolygons.push_back(listPts);
         }
-        SHPDestroyObject(pSHPObj);
     }
-    SHPClose(hSHP);
-
-    qDebug() << "Info: Rendering shape file to image...";
-    int kSzMult=50;
 
-    if(360*kSzMult > 32767)    {
-        qDebug() << "Error: Image width is too large:";
-        qDebug() << "Error: Max width is 32767 pixels";
+    QString tileDir = "tiles";
+    if(!QDir().mkpath(tileDir))   {
+        qDebug() << "Error: Could not create" << tileDir;
         return -1;
     }
 
-    QImage shImage(360*kSzMult,180*kSzMult,
-                   QImage::Format_RGB888);
-
-    shImage.fill(Qt::white);
-
-    // setup painter
-    QPainter shPainter(&shImage);
-    QBrush shBrush(Qt::blue);
-
-    shPainter.setPen(Qt::NoPen);
-    shPainter.setBrush(shBrush);
-
-
-    // draw polys
-    for(size_t i=0; i < listPolygons.size(); i++)
-    {
-        QPainterPath pPath;
-        pPath.setFillRule(Qt::WindingFill);
-        pPath.moveTo(listPolygons[i][0].x*kSzMult,
-                     listPolygons[i][0].y*kSzMult);
-
-        for(size_t j=0; j < listPolygons[i].size(); j++)   {
-            pPath.lineTo(listPolygons[i][j].x*kSzMult,
-                         listPolygons[i][j].y*kSzMult);
-        }
-        pPath.closeSubpath();
-
-        shBrush.setColor(listPolygons[i][0].c);
-        shPainter.setBrush(shBrush);
-        shPainter.drawPath(pPath);
-    }
-
-    if(shImage.save("admin1.png"))   {
-        qDebug() << "Info: Saved image as 'admin1.png'";
+    qDebug() << "Info: Rendering shape file to tiles...";
+
+    // threads take the next tile until they run out
+    std::atomic<size_t> ixNextTile(0);
+    std::atomic<size_t> numTilesSaved(0);
+    std::vector<std::thread> listWorkers;
+    for(int t=0; t < numThreads; t++)   {
+        listWorkers.push_back(std::thread([&]() {
+            std::vector<uint32_t> listIds;
+            std::vector<Edge> listEdges;
+            std::vector<Edge> listActive;
+            std::vector<Crossing> listCrossings;
+
+            for(;;)   {
+                size_t const ixTile = ixNextTile++;
+                if(ixTile >= listTileBins.size())   {
+                    break;
+                }
+                int const row = ixTile/numCols;
+                int const col = ixTile%numCols;
+                int const tileX0 = col*kTileSz;
+                int const tileY0 = row*kTileSz;
+                int const tileW = std::min(kTileSz,imgW-tileX0);
+                int const tileH = std::min(kTileSz,imgH-tileY0);
+
+                listIds.assign(size_t(tileW)*tileH,0);
+                std::vector<uint32_t> const &listBin = listTileBins[ixTile];
+                for(size_t i=0; i < listBin.size(); i++)   {
+                    RasterizeRegion(listRegions[listBin[i]],listBin[i]+1,
+                                    tileX0,tileY0,tileW,tileH,listIds,
+                                    listEdges,listActive,listCrossings);
+                }
+
+                // ids -> #RRGGBB
+                QImage tileImg(tileW,tileH,QImage::Format_RGB888);
+                for(int y=0; y < tileH; y++)   {
+                    uchar * line = tileImg.scanLine(y);
+                    uint32_t const * rowIds = &(listIds[size_t(y)*tileW]);
+                    for(int x=0; x < tileW; x++)   {
+                        uint32_t const id = (rowIds[x] == 0) ? 0xFFFFFF : rowIds[x];
+                        line[3*x+0] = (id >> 16) & 0xFF;
+                        line[3*x+1] = (id >> 8) & 0xFF;
+                        line[3*x+2] = id & 0xFF;
+                    }
+                }
+
+                QString tileName = tileDir + QDir::separator() + "tile_" +
+                        QString::number(row) + "_" + QString::number(col) + ".png";
+                if(tileImg.save(tileName))   {
+                    numTilesSaved++;
+                }
+                else   {
+                    qDebug() << "Error: Could not save" << tileName;
+                }
+            }
+        }));
     }
-    else   {
-        qDebug() << "Error: Could not save image";
+    for(size_t t=0; t < listWorkers.size(); t++)   {
+        listWorkers[t].join();
     }
 
-    return 0;
+    qDebug() << "Info: Saved" << int(numTilesSaved) << "/" << int(listTileBins.size())
+             << "tiles in" << tileDir;
+
+    return (numTilesSaved == listTileBins.size()) ? 0 : -1;
 }
@@ -1,7 +1,7 @@
 QT       += core
 #QT       -= gui
 
-TARGET = shp2img2
+TARGET = shp2img
 CONFIG   += console
 CONFIG   -= app_bundle
 
@@ -15,7 +15,13 @@ SOURCES += \
     shapelib/shpopen.c \
     shapelib/shptree.c \
     shapelib/dbfopen.c \
-    shapelib/safileio.c
+    shapelib/safileio.c \
+    shapelib/shpmap.c
+
+# tiles are rendered on their own threads
+LIBS += -lpthread
+QMAKE_CXXFLAGS += -std=c++0x
 
 # main
-SOURCES += shp2img2.cpp
+HEADERS += RegionRaster.hpp
+SOURCES += shp2img.cpp
@@ -0,0 +1,256 @@
+// Qt libs
+#include <QCoreApplication>
+#include <QStringList>
+#include <QDebug>
+#include <QDir>
+
+// STL
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <fstream>
+
+// id rasterizer
+#include "RegionRaster.hpp"
+
+// index file
+#include "RegionIndex.hpp"
+
+// Builds the index used by lonlat2placename. The world
+// is rasterized in bands of rows (one band per thread at
+// a time) and each row of region ids is stored as runs,
+// see RegionIndex.hpp for the layout.
+
+#define K_BAND_ROWS 64
+
+// The runs of a band of rows
+struct BandRuns
+{
+    std::vector<uint32_t> listRowNumRuns;
+    std::vector<uint32_t> listRunX;
+    std::vector<uint32_t> listRunId;
+};
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication myApp(argc, argv);
+
+    // check input args
+    QStringList inputArgs = myApp.arguments();
+
+    if(inputArgs.size() < 3)   {
+        qDebug() << "Error: Invalid input:";
+        qDebug() << "Pass the required arguments as follows: ";
+        qDebug() << "./shp2regionindex /my/shapefiledir <output_index> [px_per_degree] [numthreads]";
+        qDebug() << "* px_per_degree defaults to 100 and numthreads to the number of cores";
+        return -1;
+    }
+
+    int kSzMult = 100;
+    int numThreads = std::thread::hardware_concurrency();
+    if(inputArgs.size() > 3)   {
+        kSzMult = inputArgs[3].toInt();
+    }
+    if(inputArgs.size() > 4)   {
+        numThreads = inputArgs[4].toInt();
+    }
+    numThreads = std::max(numThreads,1);
+
+    if(kSzMult < 1)   {
+        qDebug() << "Error: Invalid px_per_degree";
+        return -1;
+    }
+
+    // find the shape file
+    QStringList shFilterList;
+    shFilterList << "*.shp";
+
+    QDir shDir = inputArgs[1];
+    QStringList shDirList = shDir.entryList(shFilterList,QDir::Files);
+    if(shDirList.empty())   {
+        qDebug() << "Error: No shape file in" << inputArgs[1];
+        return -1;
+    }
+    QString fileShp = shDir.absoluteFilePath(shDirList[0]);
+
+    // open the shape file
+    SHPMapHandle hMap = SHPMapOpen(fileShp.toLocal8Bit().data());
+    if(hMap == NULL)   {
+        qDebug() << "Error: Could not open shape file";
+        return -1;
+    }
+
+    int nRecords,nShapeType;
+    SHPMapGetInfo(hMap,&nRecords,&nShapeType,NULL,NULL);
+
+    if(nShapeType != SHPT_POLYGON)   {
+        qDebug() << "Error: Wrong shape file type:";
+        qDebug() << "Expect POLYGON";
+        SHPMapClose(hMap);
+        return -1;
+    }
+
+    qDebug() << "Info: Found " << nRecords << "POLYGONS";
+    qDebug() << "Info: Reading in data...";
+
+    std::vector<Region> listRegions;
+    if(!ReadRegions(hMap,kSzMult,numThreads,listRegions))   {
+        qDebug() << "Warning: Some records could not be read";
+    }
+    SHPMapClose(hMap);
+
+    // bin regions by the bands their bounds overlap
+    int const imgW = 360*kSzMult;
+    int const imgH = 180*kSzMult;
+    int const numBands = (imgH+K_BAND_ROWS-1)/K_BAND_ROWS;
+
+    std::vector<std::vector<uint32_t> > listBandBins(numBands);
+    for(size_t i=0; i < listRegions.size(); i++)   {
+        Region const &region = listRegions[i];
+        if(region.listX.empty())   {
+            continue;
+        }
+        int const bandBegin = std::max(0,int(std::floor(region.minY/K_BAND_ROWS)));
+        int const bandEnd = std::min(numBands-1,int(std::floor(region.maxY/K_BAND_ROWS)));
+        for(int b=bandBegin; b <= bandEnd; b++)   {
+            listBandBins[b].push_back(i);
+        }
+    }
+
+    qDebug() << "Info: Rasterizing" << imgW << "x" << imgH << "pixels...";
+
+    // threads take the next band until they run out
+    std::vector<BandRuns> listBandRuns(numBands);
+    std::atomic<size_t> ixNextBand(0);
+    std::vector<std::thread> listWorkers;
+    for(int t=0; t < numThreads; t++)   {
+        listWorkers.push_back(std::thread([&]() {
+            std::vector<uint32_t> listIds;
+            std::vector<Edge> listEdges;
+            std::vector<Edge> listActive;
+            std::vector<Crossing> listCrossings;
+
+            for(;;)   {
+                size_t const ixBand = ixNextBand++;
+                if(ixBand >= listBandBins.size())   {
+                    break;
+                }
+                int const bandY0 = ixBand*K_BAND_ROWS;
+                int const bandH = std::min(K_BAND_ROWS,imgH-bandY0);
+
+                listIds.assign(size_t(imgW)*bandH,0);
+                std::vector<uint32_t> const &listBin = listBandBins[ixBand];
+                for(size_t i=0; i < listBin.size(); i++)   {
+                    RasterizeRegion(listRegions[listBin[i]],listBin[i]+1,
+                                    0,bandY0,imgW,bandH,listIds,
+                                    listEdges,listActive,listCrossings);
+                }
+
+                // ids -> runs
+                BandRuns &bandRuns = listBandRuns[ixBand];
+                for(int y=0; y < bandH; y++)   {
+                    uint32_t const * rowIds = &(listIds[size_t(y)*imgW]);
+                    uint32_t numRuns = 0;
+                    for(int x=0; x < imgW; x++)   {
+                        if(x == 0 || rowIds[x] != rowIds[x-1])   {
+                            bandRuns.listRunX.push_back(x);
+                            bandRuns.listRunId.push_back(rowIds[x]);
+                            numRuns++;
+                        }
+                    }
+                    bandRuns.listRowNumRuns.push_back(numRuns);
+                }
+            }
+        }));
+    }
+    for(size_t t=0; t < listWorkers.size(); t++)   {
+        listWorkers[t].join();
+    }
+
+    // lay the rows out, sharing the runs of rows that
+    // are the same as the row above
+    std::vector<uint64_t> listRowBegin;
+    std::vector<uint32_t> listRowNumRuns;
+    std::vector<uint32_t> listRunX;
+    std::vector<uint32_t> listRunId;
+    size_t numSharedRows = 0;
+    for(size_t b=0; b < listBandRuns.size(); b++)   {
+        BandRuns &bandRuns = listBandRuns[b];
+        size_t ixRun = 0;
+        for(size_t r=0; r < bandRuns.listRowNumRuns.size(); r++)   {
+            uint32_t const numRuns = bandRuns.listRowNumRuns[r];
+            bool sameAsAbove = false;
+            if(!listRowBegin.empty() && listRowNumRuns.back() == numRuns)   {
+                uint64_t const ixAbove = listRowBegin.back();
+                sameAsAbove =
+                    std::equal(bandRuns.listRunX.begin()+ixRun,
+                               bandRuns.listRunX.begin()+ixRun+numRuns,
+                               listRunX.begin()+ixAbove) &&
+                    std::equal(bandRuns.listRunId.begin()+ixRun,
+                               bandRuns.listRunId.begin()+ixRun+numRuns,
+                               listRunId.begin()+ixAbove);
+            }
+
+            if(sameAsAbove)   {
+                listRowBegin.push_back(listRowBegin.back());
+                numSharedRows++;
+            }
+            else   {
+                listRowBegin.push_back(listRunX.size());
+                listRunX.insert(listRunX.end(),
+                                bandRuns.listRunX.begin()+ixRun,
+                                bandRuns.listRunX.begin()+ixRun+numRuns);
+                listRunId.insert(listRunId.end(),
+                                 bandRuns.listRunId.begin()+ixRun,
+                                 bandRuns.listRunId.begin()+ixRun+numRuns);
+            }
+            listRowNumRuns.push_back(numRuns);
+            ixRun += numRuns;
+        }
+
+        // done with this band
+        std::vector<uint32_t>().swap(bandRuns.listRunX);
+        std::vector<uint32_t>().swap(bandRuns.listRunId);
+    }
+
+    // write the index
+    RegionIndexHeader header;
+    memcpy(header.magic,K_REGION_INDEX_MAGIC,8);
+    header.pxPerDeg = kSzMult;
+    header.width = imgW;
+    header.height = imgH;
+    header.numRegions = nRecords;
+    header.numRuns = listRunX.size();
+
+    // pad the row run counts to 8 bytes
+    listRowNumRuns.resize(2*((listRowNumRuns.size()+1)/2),0);
+
+    std::ofstream indexFile;
+    indexFile.open(inputArgs[2].toLocal8Bit().data(),std::ios::out | std::ios::binary);
+    if(!indexFile.is_open())   {
+        qDebug() << "Error: Could not open" << inputArgs[2];
+        return -1;
+    }
+    indexFile.write(reinterpret_cast<char const *>(&header),sizeof(header));
+    indexFile.write(reinterpret_cast<char const *>(&(listRowBegin[0])),
+                    sizeof(uint64_t)*listRowBegin.size());
+    indexFile.write(reinterpret_cast<char const *>(&(listRowNumRuns[0])),
+                    sizeof(uint32_t)*listRowNumRuns.size());
+    indexFile.write(reinterpret_cast<char const *>(&(listRunX[0])),
+                    sizeof(uint32_t)*listRunX.size());
+    indexFile.write(reinterpret_cast<char const *>(&(listRunId[0])),
+                    sizeof(uint32_t)*listRunId.size());
+    indexFile.close();
+
+    if(!indexFile)   {
+        qDebug() << "Error: Could not write" << inputArgs[2];
+        return -1;
+    }
+
+    qDebug() << "Info: Wrote" << qulonglong(header.numRuns) << "runs ("
+             << int(numSharedRows) << "rows shared),"
+             << qulonglong(RegionIndex::GetFileSize(header)) << "bytes to"
+             << inputArgs[2];
+
+    return 0;
+}
@@ -0,0 +1,25 @@
+QT       += core
+QT       -= gui
+
+TARGET = shp2regionindex
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+# statically include shapelib
+HEADERS += \
+    shapelib/shapefil.h
+
+SOURCES += \
+    shapelib/shpopen.c \
+    shapelib/safileio.c \
+    shapelib/shpmap.c
+
+# bands are rasterized on their own threads
+LIBS += -lpthread
+QMAKE_CXXFLAGS += -std=c++0x
+
+# main
+HEADERS += RegionRaster.hpp RegionIndex.hpp
+SOURCES += shp2regionindex.cpp
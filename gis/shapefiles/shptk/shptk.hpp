@@ -36,17 +36,8 @@
 // average radius
 #define RAD_AV 6371000
 
-// WGS84 ellipsoid parameters
-// (http://en.wikipedia.org/wiki/WGS_84)
-#define ELL_SEMI_MAJOR 6378137.0            // meters
-#define ELL_SEMI_MAJOR_EXP2 40680631590769.0
-
-#define ELL_SEMI_MINOR 6356752.3142         // meters
-#define ELL_SEMI_MINOR_EXP2 40408299984087.1
-
-#define ELL_F 1.0/298.257223563
-#define ELL_ECC_EXP2 6.69437999014e-3
-#define ELL_ECC2_EXP2 6.73949674228e-3
+// WGS84 ellipsoid and LLA <-> ECEF conversions
+#include <geodesy.hpp>
 
 // circumference
 #define CIR_EQ 40075017.0   // around equator  (meters)
@@ -265,18 +256,12 @@ struct PointLLA
 Vec3 ConvLLAToECEF(const PointLLA &pointLLA)
 {
     Vec3 pointECEF;
-
-    // remember to convert deg->rad
-    double sinLat = sin(pointLLA.lat * K_DEG2RAD);
-    double sinLon = sin(pointLLA.lon * K_DEG2RAD);
-    double cosLat = cos(pointLLA.lat * K_DEG2RAD);
-    double cosLon = cos(pointLLA.lon * K_DEG2RAD);
-
-    // v = radius of curvature (meters)
-    double v = ELL_SEMI_MAJOR / (sqrt(1-(ELL_ECC_EXP2*sinLat*sinLat)));
-    pointECEF.x = (v + pointLLA.alt) * cosLat * cosLon;
-    pointECEF.y = (v + pointLLA.alt) * cosLat * sinLon;
-    pointECEF.z = ((1-ELL_ECC_EXP2)*v + pointLLA.alt)*sinLat;
+    geodesy::ConvLLAToECEF(pointLLA.lon,
+                           pointLLA.lat,
+                           pointLLA.alt,
+                           pointECEF.x,
+                           pointECEF.y,
+                           pointECEF.z);
 
     return pointECEF;
 }
@@ -284,26 +269,12 @@ Vec3 ConvLLAToECEF(const PointLLA &pointLLA)
 PointLLA ConvECEFToLLA(const Vec3 &pointECEF)
 {
     PointLLA pointLLA;
-
-    double p = (sqrt(pow(pointECEF.x,2) + pow(pointECEF.y,2)));
-    double th = atan2(pointECEF.z*ELL_SEMI_MAJOR, p*ELL_SEMI_MINOR);
-    double sinTh = sin(th);
-    double cosTh = cos(th);
-
-    // calc longitude
-    pointLLA.lon = atan2(pointECEF.y, pointECEF.x);
-
-    // calc latitude
-    pointLLA.lat = atan2(pointECEF.z + ELL_ECC2_EXP2*ELL_SEMI_MINOR*sinTh*sinTh*sinTh,
-                         p - ELL_ECC_EXP2*ELL_SEMI_MAJOR*cosTh*cosTh*cosTh);
-    // calc altitude
-    double sinLat = sin(pointLLA.lat);
-    double N = ELL_SEMI_MAJOR / (sqrt(1-(ELL_ECC_EXP2*sinLat*sinLat)));
-    pointLLA.alt = (p/cos(pointLLA.lat)) - N;
-
-    // convert from rad to deg
-    pointLLA.lon = pointLLA.lon * K_RAD2DEG;
-    pointLLA.lat = pointLLA.lat * K_RAD2DEG;
+    geodesy::ConvECEFToLLA(pointECEF.x,
+                           pointECEF.y,
+                           pointECEF.z,
+                           pointLLA.lon,
+                           pointLLA.lat,
+                           pointLLA.alt);
 
     return pointLLA;
 }
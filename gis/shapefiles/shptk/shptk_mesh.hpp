@@ -0,0 +1,146 @@
+/*
+   This source is part of osmsrender
+
+   Copyright 2012 Preet Desai
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef SHPTK_MESH_HPP
+#define SHPTK_MESH_HPP
+
+// shptk
+#include "shptk.hpp"
+#include "shptk_prepair.hpp"
+
+// vxweld
+#include <vxweld.hpp>
+
+// Simplifies ipPoly, repairs and triangulates it and then
+// appends the mesh to listMeshVx and listMeshIx. Returns
+// false if the triangulation failed. Only touches local
+// state so different polygons can be meshed in parallel.
+bool BuildPolygonMesh(OGRPolygon * ipPoly,
+                      std::vector<Vec2> &listMeshVx,
+                      std::vector<size_t> &listMeshIx)
+{
+    // simplify geometry
+    // note: we temp. convert to ecef for simplifcation
+    OGRPolygon * sPolygon = new OGRPolygon;
+
+    // outer ring
+    std::vector<Vec3> listOuterVx, listOuterVxSimp;
+    OGRLinearRing * ipOuterRing = ipPoly->getExteriorRing();
+    for(int i=0; i < ipOuterRing->getNumPoints(); i++)   {
+        PointLLA lla(ipOuterRing->getY(i),ipOuterRing->getX(i));
+        listOuterVx.push_back(ConvLLAToECEF(lla));
+    }
+    CalcPolylineSimplifyVW(listOuterVx,listOuterVxSimp,VW_AREA,1500.0);
+    OGRLinearRing * sOuterRing = new OGRLinearRing;
+    for(size_t i=0; i < listOuterVxSimp.size(); i++)   {
+        PointLLA lla = ConvECEFToLLA(listOuterVxSimp[i]);
+        sOuterRing->addPoint(lla.lon,lla.lat,0);
+    }
+    if(sOuterRing->getNumPoints() < 3)   {
+        delete sOuterRing;
+        delete sPolygon;
+        return true;
+    }
+    sPolygon->addRingDirectly(sOuterRing);
+
+    // inner rings
+    for(int i=0; i < ipPoly->getNumInteriorRings(); i++)   {
+        std::vector<Vec3> listInnerVx,listInnerVxSimp;
+        OGRLinearRing * ipInnerRing = ipPoly->getInteriorRing(i);
+        for(int j=0; j < ipInnerRing->getNumPoints(); j++)   {
+            PointLLA lla(ipInnerRing->getY(j),ipInnerRing->getX(j));
+            listInnerVx.push_back(ConvLLAToECEF(lla));
+        }
+        CalcPolylineSimplifyVW(listInnerVx,listInnerVxSimp,VW_AREA,1500.0);
+        OGRLinearRing * sInnerRing = new OGRLinearRing;
+        for(size_t j=0; j < listInnerVxSimp.size(); j++)   {
+            PointLLA lla = ConvECEFToLLA(listInnerVxSimp[j]);
+            sInnerRing->addPoint(lla.lon,lla.lat,0);
+        }
+        if(sInnerRing->getNumPoints() < 3)   {
+            delete sInnerRing;
+            continue;
+        }
+        sPolygon->addRingDirectly(sInnerRing);
+    }
+    sPolygon->flattenTo2D();    // required to convert to wkbPolygon
+
+    // geometry mesh (triangle corners are welded
+    // as they're added)
+    vxweld::Welder<2> welder;
+    std::vector<Vec2> listVx;
+    std::vector<size_t> listIx;
+
+    // simultaneously repair ipGeometry and retrieve
+    // the triangulation used in the repair process
+    void * interior;
+    void * exterior;
+    Triangulation opTriangulation;
+    OGRMultiPolygon * opPolygons = repair(sPolygon,
+                                          opTriangulation,
+                                          interior,
+                                          exterior);
+
+    if(opPolygons == NULL)   {
+        delete sPolygon;
+        return false;
+    }
+
+    Triangulation::Finite_faces_iterator fIt;
+    for(fIt  = opTriangulation.finite_faces_begin();
+        fIt != opTriangulation.finite_faces_end(); ++fIt)
+    {
+        // std::cout << "sf->info(): " << fIt->info() << ", "
+        //           << "interior: " << (interior) << ", "
+        //           << "exterior: " << (exterior) << std::endl;
+
+        if(fIt->info() == NULL)   {
+            // get triangle
+            Triangulation::Triangle cdtTri =
+                    opTriangulation.triangle(fIt);
+
+            // points A, B and C
+            for(int k=0; k < 3; k++)   {
+                double const vx[2] = {cdtTri[k].x(),cdtTri[k].y()};
+                listIx.push_back(welder.Add(vx));
+            }
+        }
+    }
+    listVx.reserve(welder.GetNumVertices());
+    for(size_t i=0; i < welder.GetNumVertices(); i++)   {
+        double const * vx = welder.GetVertex(i);
+        listVx.push_back(Vec2(vx[0],vx[1]));
+    }
+
+    // adj indices
+    for(size_t i=0; i < listIx.size(); i++)   {
+        listIx[i] += listMeshVx.size();
+    }
+
+    // copy data to mesh
+    listMeshVx.insert(listMeshVx.end(),listVx.begin(),listVx.end());
+    listMeshIx.insert(listMeshIx.end(),listIx.begin(),listIx.end());
+
+    // clean up
+    delete opPolygons;
+    delete sPolygon;
+
+    return true;
+}
+
+#endif // SHPTK_MESH_HPP
@@ -8,6 +8,14 @@
 #include <fstream>
 #include <stack>
 #include <set>
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <memory>
+#include <condition_variable>
 
 // openctm
 #include <openctm.h>
@@ -22,22 +30,7 @@
 
 // shptk
 #include "shptk.hpp"
-#include "shptk_prepair.hpp"
-
-bool vxExistsInList(Vec2 const &vx,
-                    std::vector<Vec2> const &listVx,
-                    int &idx)
-{
-    bool exists = false;
-    for(size_t i=0; i < listVx.size(); i++)   {
-        if(vx == listVx[i])   {
-            exists = true;
-            idx = i;
-            break;
-        }
-    }
-    return exists;
-}
+#include "shptk_mesh.hpp"
 
 // custom write function to store ctm mesh as an sqlite blob
 //unsigned int g_pos;
@@ -58,32 +51,198 @@ bool vxExistsInList(Vec2 const &vx,
 //    return bytesWritten;
 //}
 
-size_t g_bytesWritten;
 static CTMuint CTMCALL ctmWriteBlob(const void * aBuf,
                                     CTMuint aCount,
                                     void * aUserData)
 {
-    // copy data over
+    // append data to the blob
     const char * sourceBuffer = (const char *) aBuf;
     std::vector<char> * targetBuffer = (std::vector<char>*)aUserData;
-    targetBuffer->reserve(aCount);
-    for(size_t i=0; i < aCount; i++)   {
-        targetBuffer->push_back(sourceBuffer[i]);
-        g_bytesWritten++;
+    targetBuffer->insert(targetBuffer->end(),
+                         sourceBuffer,
+                         sourceBuffer+aCount);
+    return aCount;
+}
+
+struct TileMesh
+{
+    std::string fileName;
+    size_t lonIx;
+    size_t latIx;
+    bool opened;                // false if the file couldn't be opened
+    std::vector<char> ctmBlob;  // empty if the tile has no mesh data
+};
+
+// Reads and triangulates the polygons in a tile's shapefile
+// and compresses the mesh with OpenCTM
+void BuildTileMesh(std::string const &ipPath,
+                   GeoBounds const &rootBounds,
+                   double lonWidth,
+                   double latWidth,
+                   TileMesh &tileMesh)
+{
+    // get quadkey and bounds
+    std::string quadKey  = tileMesh.fileName.substr(5,tileMesh.fileName.size()-4);
+    GeoBounds tileBounds;
+    CalcBoundsFromQuadKey(quadKey,rootBounds,tileBounds);
+
+    double adjLon = (tileBounds.minLon + (lonWidth/2.0)) + 180.0;       // 0-360 [W->E]
+    double adjLat = 90.0 - (tileBounds.minLat + (latWidth/2.0));        // 0-180 [N->S]
+
+    tileMesh.lonIx = adjLon/lonWidth;
+    tileMesh.latIx = adjLat/latWidth;
+
+    // std::cout << "LONIX: " << lonIx << " , LATIX: " << latIx << std::endl;
+
+    // open input file and feature layer
+    std::string fullFilePath = ipPath + tileMesh.fileName;
+    OGRDataSource * ipShpFile = OGRSFDriverRegistrar::Open(fullFilePath.c_str(),FALSE);
+    if(ipShpFile == NULL)   {
+        tileMesh.opened = false;
+        return;
+    }
+    tileMesh.opened = true;
+
+    OGRLayer * ipLayer = ipShpFile->GetLayer(0);
+    ipLayer->ResetReading();
+
+    // iterate through input features and build mesh
+    std::vector<Vec2> listMeshVx;
+    std::vector<size_t> listMeshIx;
+    size_t ixFeature = 0;
+    OGRFeature * ipFeature;
+    while( (ipFeature = ipLayer->GetNextFeature()) != NULL )
+    {
+        OGRGeometry * ipGeometry;
+        ipGeometry = ipFeature->GetGeometryRef();
+
+        if(ipGeometry == NULL)   {
+            std::cout << "WARN: Ignoring NULL feature: "
+                      << ixFeature << std::endl;
+            continue;
+        }
+
+        if(ipGeometry->getGeometryType() != wkbPolygon)   {
+            std::cout << "WARN: Feature type is not POLYGON "
+                      << "(its " << ipGeometry->getGeometryName()
+                      << ") " << std::endl;
+            continue;
+        }
+
+        if(!BuildPolygonMesh((OGRPolygon *)ipGeometry,
+                             listMeshVx,
+                             listMeshIx))   {
+            std::cout << "WARN: Triangulation failed for "
+                      << "feature " << ixFeature << std::endl;
+        }
+
+        // clean up
+        OGRFeature::DestroyFeature(ipFeature);
+        ixFeature++;
+    }
+    OGRDataSource::DestroyDataSource(ipShpFile);
+
+    if(listMeshIx.size() < 3)   {
+        return;
     }
-    return g_bytesWritten;
+
+    // convert mesh to CTM format
+    CTMcontext context;
+    CTMuint vertCount, triCount, *indices;
+    CTMfloat *vertices;
+
+    // create context
+    context = ctmNewContext(CTM_EXPORT);
+    ctmCompressionMethod(context,CTM_METHOD_MG1);
+    ctmCompressionLevel(context,5);
+
+    // create mesh
+    vertCount   = listMeshVx.size();
+    triCount    = listMeshIx.size()/3;
+    vertices    = (CTMfloat *) malloc(3 * sizeof(CTMfloat) * vertCount);
+    indices     = (CTMuint *) malloc(3 * sizeof(CTMuint) * triCount);
+
+    unsigned int vIdx=0;
+    for(int i=0; i < vertCount; i++)   {
+        vertices[vIdx] = listMeshVx[i].x; vIdx++;
+        vertices[vIdx] = listMeshVx[i].y; vIdx++;
+        vertices[vIdx] = 0.0; vIdx++;
+    }
+
+    for(int i=0; i < triCount*3; i++)   {
+        indices[i] = listMeshIx[i];
+    }
+
+    // define mesh
+    ctmDefineMesh(context,vertices,vertCount,indices,triCount,NULL);
+
+    // save as a blob
+    ctmSaveCustom(context,ctmWriteBlob,&(tileMesh.ctmBlob));
+
+    // free context/mesh
+    ctmFreeContext(context);
+    free(indices);
+    free(vertices);
 }
 
+// Finished tiles are passed from the worker threads
+// to the thread writing the database through this
+class TileMeshQueue
+{
+public:
+    TileMeshQueue(size_t numWorkers) :
+        m_numWorkers(numWorkers)
+    {}
 
+    void Push(std::unique_ptr<TileMesh> tileMesh)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_listTileMeshes.push_back(std::move(tileMesh));
+        m_cv.notify_one();
+    }
+
+    void WorkerDone()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_numWorkers--;
+        m_cv.notify_one();
+    }
+
+    // Waits for the next tile; returns false once all
+    // workers are done and every tile has been popped
+    bool Pop(std::unique_ptr<TileMesh> &tileMesh)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock,[this]() {
+            return (!m_listTileMeshes.empty() || m_numWorkers == 0);
+        });
+
+        if(m_listTileMeshes.empty())   {
+            return false;
+        }
+
+        tileMesh = std::move(m_listTileMeshes.front());
+        m_listTileMeshes.pop_front();
+        return true;
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    size_t m_numWorkers;
+    std::deque<std::unique_ptr<TileMesh>> m_listTileMeshes;
+};
 
 int main(int argc, const char *argv[])
 {
-    if(argc != 3) {
-        std::cout << "Usage: #> ./shptk_meshgen inputdir outputfile.sqlite\n";
+    if(argc < 3 || argc > 4) {
+        std::cout << "Usage: #> ./shptk_meshdb inputdir outputfile.sqlite [numthreads]\n";
         std::cout << "* This util will convert the shapefiles in inputdir to \n";
         std::cout << "  meshes in OpenCTM format and save them in an sqlite db\n";
         std::cout << "* Expect inputdir to contain shapefiles with POLYGON data only\n";
         std::cout << "* Expect shapefiles to be named TILE_(quadkey), ie TILE_00110011\n";
+        std::cout << "* Tiles are built with numthreads threads (defaults to\n";
+        std::cout << "  the number of cores) and written by one thread\n";
         return 0;
     }
 
@@ -101,6 +260,12 @@ int main(int argc, const char *argv[])
     std::string ipPath(argv[1]);
     std::string opPath(argv[2]);
 
+    size_t numThreads = std::thread::hardware_concurrency();
+    if(argc == 4)   {
+        numThreads = atoi(argv[3]);
+    }
+    numThreads = std::max(numThreads,size_t(1));
+
     //
     GeoBounds rootBounds;
     rootBounds.minLon = -180.0;
@@ -158,254 +323,124 @@ int main(int argc, const char *argv[])
                         "Y INTEGER NOT NULL, "
                         "MESH BLOB)");
 
-    // process file by file
-    for(size_t f=0; f < numFiles; f++)
-    {
-        std::cout << "File " << f << "/" << numFiles << std::endl;
-
-        // get quadkey and bounds
-        std::string quadKey  = listFiles[f].substr(5,listFiles[f].size()-4);
-        GeoBounds tileBounds;
-        CalcBoundsFromQuadKey(quadKey,rootBounds,tileBounds);
-
-        double adjLon = (tileBounds.minLon + (lonWidth/2.0)) + 180.0;       // 0-360 [W->E]
-        double adjLat = 90.0 - (tileBounds.minLat + (latWidth/2.0));        // 0-180 [N->S]
-
-        size_t lonIx = adjLon/lonWidth;
-        size_t latIx = adjLat/latWidth;
-
-        // std::cout << "LONIX: " << lonIx << " , LATIX: " << latIx << std::endl;
-
-        // open input file and feature layer
-        std::string fullFilePath = ipPath + listFiles[f];
-        OGRDataSource * ipShpFile = OGRSFDriverRegistrar::Open(fullFilePath.c_str(),FALSE);
-        if(ipShpFile == NULL)   {
-            std::cout << "ERROR: Could not open input file: "
-                      << listFiles[f] << std::endl;
-            return -1;
-        }
+    // Worker threads read, triangulate and compress
+    // tiles; this thread writes them to the database
+    TileMeshQueue queueTileMeshes(numThreads);
+    std::atomic<size_t> nextFile(0);
+    std::atomic<bool> cancel(false);
+
+    std::vector<std::thread> listWorkers;
+    for(size_t t=0; t < numThreads; t++)   {
+        listWorkers.push_back(std::thread([&]() {
+            while(!cancel)   {
+                size_t const f = nextFile++;
+                if(f >= numFiles)   {
+                    break;
+                }
 
-        OGRLayer * ipLayer = ipShpFile->GetLayer(0);
-        size_t numFeatures = ipLayer->GetFeatureCount();
-        ipLayer->ResetReading();
-
-        // iterate through input features and build mesh
-        std::vector<Vec2> listMeshVx;
-        std::vector<size_t> listMeshIx;
-        size_t ixFeature = 0;
-        OGRFeature * ipFeature;
-        while( (ipFeature = ipLayer->GetNextFeature()) != NULL )
-        {
-            // std::cout << "INFO: Feature " << ixFeature
-            //           << "/" << numFeatures << std::endl;
-
-            OGRGeometry * ipGeometry;
-            ipGeometry = ipFeature->GetGeometryRef();
-
-            if(ipGeometry == NULL)   {
-                std::cout << "WARN: Ignoring NULL feature: "
-                          << ixFeature << std::endl;
-                continue;
+                std::unique_ptr<TileMesh> tileMesh(new TileMesh);
+                tileMesh->fileName = listFiles[f];
+                BuildTileMesh(ipPath,rootBounds,lonWidth,latWidth,*tileMesh);
+                queueTileMeshes.Push(std::move(tileMesh));
             }
+            queueTileMeshes.WorkerDone();
+        }));
+    }
 
-            if(ipGeometry->getGeometryType() != wkbPolygon)   {
-                std::cout << "WARN: Feature type is not POLYGON "
-                          << "(its " << ipGeometry->getGeometryName()
-                          << ") " << std::endl;
-                continue;
-            }
+    std::cout << "INFO: Building tiles with " << numThreads
+              << " threads" << std::endl;
 
-            // simplify geometry
-            // note: we temp. convert to ecef for simplifcation
-            OGRPolygon * ipPoly = (OGRPolygon *)ipGeometry;
-            OGRPolygon * sPolygon = new OGRPolygon;
-
-            // outer ring
-            std::vector<Vec3> listOuterVx, listOuterVxSimp;
-            OGRLinearRing * ipOuterRing = ipPoly->getExteriorRing();
-            for(int i=0; i < ipOuterRing->getNumPoints(); i++)   {
-                PointLLA lla(ipOuterRing->getY(i),ipOuterRing->getX(i));
-                listOuterVx.push_back(ConvLLAToECEF(lla));
-            }
-            CalcPolylineSimplifyVW(listOuterVx,listOuterVxSimp,VW_AREA,1500.0);
-            OGRLinearRing * sOuterRing = new OGRLinearRing;
-            for(size_t i=0; i < listOuterVxSimp.size(); i++)   {
-                PointLLA lla = ConvECEFToLLA(listOuterVxSimp[i]);
-                sOuterRing->addPoint(lla.lon,lla.lat,0);
-            }
-            if(sOuterRing->getNumPoints() < 3)   {
-                delete sOuterRing;
-                continue;
-            }
-            sPolygon->addRingDirectly(sOuterRing);
-
-            // inner rings
-            for(int i=0; i < ipPoly->getNumInteriorRings(); i++)   {
-                std::vector<Vec3> listInnerVx,listInnerVxSimp;
-                OGRLinearRing * ipInnerRing = ipPoly->getInteriorRing(i);
-                for(int j=0; j < ipInnerRing->getNumPoints(); j++)   {
-                    PointLLA lla(ipInnerRing->getY(j),ipInnerRing->getX(j));
-                    listInnerVx.push_back(ConvLLAToECEF(lla));
-                }
-                CalcPolylineSimplifyVW(listInnerVx,listInnerVxSimp,VW_AREA,1500.0);
-                OGRLinearRing * sInnerRing = new OGRLinearRing;
-                for(size_t j=0; j < listInnerVxSimp.size(); j++)   {
-                    PointLLA lla = ConvECEFToLLA(listInnerVxSimp[j]);
-                    sInnerRing->addPoint(lla.lon,lla.lat,0);
-                }
-                if(sInnerRing->getNumPoints() < 3)   {
-                    delete sInnerRing;
-                    continue;
-                }
-                sPolygon->addRingDirectly(sInnerRing);
-            }
-            sPolygon->flattenTo2D();    // required to convert to wkbPolygon
-
-            // geometry mesh
-            int ix;
-            Vec2 vx;
-            std::vector<Vec2> listVx;
-            std::vector<size_t> listIx;
-
-            // simultaneously repair ipGeometry and retrieve
-            // the triangulation used in the repair process
-            void * interior;
-            void * exterior;
-            Triangulation opTriangulation;
-            OGRMultiPolygon * opPolygons = repair(sPolygon,
-                                                  opTriangulation,
-                                                  interior,
-                                                  exterior);
-
-            if(opPolygons == NULL)   {
-                std::cout << "WARN: Triangulation failed for "
-                          << "feature " << ixFeature << std::endl;
-                continue;
-            }
+    // insert tiles in batches, each in a single
+    // transaction instead of one per insert
+    size_t const numTilesPerTransaction = 256;
 
-            Triangulation::Finite_faces_iterator fIt;
-            for(fIt  = opTriangulation.finite_faces_begin();
-                fIt != opTriangulation.finite_faces_end(); ++fIt)
-            {
-                // std::cout << "sf->info(): " << fIt->info() << ", "
-                //           << "interior: " << (interior) << ", "
-                //           << "exterior: " << (exterior) << std::endl;
-
-                if(fIt->info() == NULL)   {
-                    // get triangle
-                    Triangulation::Triangle cdtTri =
-                            opTriangulation.triangle(fIt);
-
-                    // point A
-                    vx.x = cdtTri[0].x();
-                    vx.y = cdtTri[0].y();
-                    if(vxExistsInList(vx,listVx,ix))
-                    {   listIx.push_back(ix);   }
-                    else   {
-                        listVx.push_back(vx);
-                        listIx.push_back(listVx.size()-1);
-                    }
-
-                    // point B
-                    vx.x = cdtTri[1].x();
-                    vx.y = cdtTri[1].y();
-                    if(vxExistsInList(vx,listVx,ix))
-                    {   listIx.push_back(ix);   }
-                    else   {
-                        listVx.push_back(vx);
-                        listIx.push_back(listVx.size()-1);
-                    }
-
-                    // point C
-                    vx.x = cdtTri[2].x();
-                    vx.y = cdtTri[2].y();
-                    if(vxExistsInList(vx,listVx,ix))
-                    {   listIx.push_back(ix);   }
-                    else   {
-                        listVx.push_back(vx);
-                        listIx.push_back(listVx.size()-1);
-                    }
-                }
-            }
-            // adj indices
-            for(size_t i=0; i < listIx.size(); i++)   {
-                listIx[i] += listMeshVx.size();
-            }
+    Kompex::SQLiteStatement * pInsertStmt =
+            new Kompex::SQLiteStatement(pDatabase);
 
-            // copy data to mesh
-            listMeshVx.insert(listMeshVx.end(),listVx.begin(),listVx.end());
-            listMeshIx.insert(listMeshIx.end(),listIx.begin(),listIx.end());
+    pInsertStmt->Sql("INSERT INTO TILES(MAG,X,Y,MESH) VALUES(?,?,?,?);");
+    pStmt->SqlStatement("BEGIN;");
 
-            // clean up
-            delete opPolygons;
-            OGRFeature::DestroyFeature(ipFeature);
-            ixFeature++;
-        }
+    int result = 0;
+    size_t numFilesDone = 0;
+    size_t numTilesWritten = 0;
+    size_t numTilesInTransaction = 0;
+    size_t numBytesWritten = 0;
+    auto timeStart = std::chrono::steady_clock::now();
 
-        if(listMeshIx.size() < 3)   {
-            std::cout << "INFO: " << listFiles[f] << " has no mesh data ";
+    std::unique_ptr<TileMesh> tileMesh;
+    while(queueTileMeshes.Pop(tileMesh))
+    {
+        numFilesDone++;
+
+        if(!tileMesh->opened)   {
+            std::cout << "ERROR: Could not open input file: "
+                      << tileMesh->fileName << std::endl;
+            cancel = true;
+            result = -1;
             continue;
         }
 
-        // convert mesh to CTM format
-        CTMcontext context;
-        CTMuint vertCount, triCount, *indices;
-        CTMfloat *vertices;
-
-        // create context
-        context = ctmNewContext(CTM_EXPORT);
-        ctmCompressionMethod(context,CTM_METHOD_MG1);
-        ctmCompressionLevel(context,5);
-
-        // create mesh
-        vertCount   = listMeshVx.size();
-        triCount    = listMeshIx.size()/3;
-        vertices    = (CTMfloat *) malloc(3 * sizeof(CTMfloat) * vertCount);
-        indices     = (CTMuint *) malloc(3 * sizeof(CTMuint) * triCount);
-
-        unsigned int vIdx=0;
-        for(int i=0; i < vertCount; i++)   {
-            vertices[vIdx] = listMeshVx[i].x; vIdx++;
-            vertices[vIdx] = listMeshVx[i].y; vIdx++;
-            vertices[vIdx] = 0.0; vIdx++;
+        if(tileMesh->ctmBlob.empty())   {
+            std::cout << "INFO: " << tileMesh->fileName
+                      << " has no mesh data" << std::endl;
         }
+        else   {
+            try   {
+                pInsertStmt->BindInt(1,int(magLevel));
+                pInsertStmt->BindInt(2,int(tileMesh->lonIx));
+                pInsertStmt->BindInt(3,int(tileMesh->latIx));
+                pInsertStmt->BindBlob(4,&(tileMesh->ctmBlob[0]),
+                                      tileMesh->ctmBlob.size());
+                pInsertStmt->Execute();
+                pInsertStmt->Reset();
+
+                numTilesWritten++;
+                numTilesInTransaction++;
+                numBytesWritten += tileMesh->ctmBlob.size();
+            }
+            catch(Kompex::SQLiteException &exception)   {
+                std::cout << "sqlite exception: "
+                          << exception.GetString();
+            }
 
-        for(int i=0; i < triCount*3; i++)   {
-            indices[i] = listMeshIx[i];
+            if(numTilesInTransaction == numTilesPerTransaction)   {
+                pStmt->SqlStatement("COMMIT;");
+                pStmt->SqlStatement("BEGIN;");
+                numTilesInTransaction = 0;
+            }
         }
 
-        // define mesh
-        ctmDefineMesh(context,vertices,vertCount,indices,triCount,NULL);
+        // progress
+        double const secs = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now()-timeStart).count();
 
-        // save as a blob
-        std::vector<char> listData;
-        g_bytesWritten = 0;
-        ctmSaveCustom(context,ctmWriteBlob,&listData);
-
-        char * ctmBlob = new char[listData.size()];
-        for(size_t b=0; b < g_bytesWritten; b++)   {
-            ctmBlob[b] = listData[b];
-        }
+        std::cout << "File " << numFilesDone << "/" << numFiles
+                  << ": " << tileMesh->fileName << " ("
+                  << std::fixed << std::setprecision(1)
+                  << (numFilesDone/secs) << " files/s, "
+                  << (numBytesWritten/(1024.0*secs)) << " KB/s)"
+                  << std::endl;
+    }
+    pStmt->SqlStatement("COMMIT;");
+    pInsertStmt->FreeQuery();
 
-        try   {
-            pStmt->Sql("INSERT INTO TILES(MAG,X,Y,MESH) VALUES(?,?,?,?);");
-            pStmt->BindInt(1,int(magLevel));
-            pStmt->BindInt(2,int(lonIx));
-            pStmt->BindInt(3,int(latIx));
-            pStmt->BindBlob(4,ctmBlob,g_bytesWritten);
-            pStmt->ExecuteAndFree();
-        }
-        catch(Kompex::SQLiteException &exception)   {
-            std::cout << "sqlite exception: "
-                      << exception.GetString();
-        }
-        delete ctmBlob;
+    for(auto &worker : listWorkers)   {
+        worker.join();
     }
 
+    double const secs = std::chrono::duration<double>(
+                std::chrono::steady_clock::now()-timeStart).count();
+
+    std::cout << "INFO: Wrote " << numTilesWritten << " tiles ("
+              << numBytesWritten << " bytes) from "
+              << numFilesDone << " files in "
+              << secs << "s" << std::endl;
+
+    delete pInsertStmt;
     delete pStmt;
     delete pDatabase;
 
-    return 0;
+    return result;
 }
 
 
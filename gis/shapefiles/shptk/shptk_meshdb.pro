@@ -4,6 +4,7 @@ TEMPLATE = app
 
 # main
 SOURCES += shptk_meshdb.cpp
+HEADERS += shptk.hpp shptk_mesh.hpp
 
 # kompex
 PATH_KOMPEX = /home/preet/Dev/scratch/thirdparty/kompex
@@ -59,3 +60,14 @@ INCLUDEPATH += $${PATH_OPENCTM}
 # gdal/ogr and cgal
 LIBS += -lgdal -lCGAL_Core -lCGAL -lmpfr -lgmp -lboost_thread
 QMAKE_CXXFLAGS += -frounding-math -fno-strict-aliasing
+
+# geodesy (needs c++11)
+QMAKE_CXXFLAGS += -std=c++11
+PATH_GEODESY = /home/preet/Dev/scratch/utils/geodesy
+INCLUDEPATH += $${PATH_GEODESY}
+HEADERS += $${PATH_GEODESY}/geodesy.hpp
+
+# vxweld
+PATH_VXWELD = /home/preet/Dev/scratch/utils/vxweld
+INCLUDEPATH += $${PATH_VXWELD}
+HEADERS += $${PATH_VXWELD}/vxweld.hpp
@@ -5,6 +5,9 @@
 #include <fstream>
 #include <stack>
 #include <set>
+#include <atomic>
+#include <thread>
+#include <algorithm>
 
 // openctm
 #include <openctm.h>
@@ -19,29 +22,16 @@
 
 // shptk
 #include "shptk.hpp"
-#include "shptk_prepair.hpp"
-
-bool vxExistsInList(Vec2 const &vx,
-                    std::vector<Vec2> const &listVx,
-                    int &idx)
-{
-    bool exists = false;
-    for(size_t i=0; i < listVx.size(); i++)   {
-        if(vx == listVx[i])   {
-            exists = true;
-            idx = i;
-            break;
-        }
-    }
-    return exists;
-}
+#include "shptk_mesh.hpp"
 
 int main(int argc, const char *argv[])
 {
-    if(argc != 3) {
-        std::cout << "Usage: #> ./shptk_meshgen inputfile myoutputfile\n";
+    if(argc < 3 || argc > 4) {
+        std::cout << "Usage: #> ./shptk_meshgen inputfile myoutputfile [numthreads]\n";
         std::cout << "* Expect inputfile to be shapefile with POLYGON data only\n";
         std::cout << "* The output file is a mesh in OpenCTM format\n";
+        std::cout << "* Polygons are meshed with numthreads threads (defaults\n";
+        std::cout << "  to the number of cores)\n";
         return 0;
     }
 
@@ -61,6 +51,12 @@ int main(int argc, const char *argv[])
     std::string ipFilePath(argv[1]);
     std::string opFilePath(argv[2]);
 
+    size_t numThreads = std::thread::hardware_concurrency();
+    if(argc == 4)   {
+        numThreads = atoi(argv[3]);
+    }
+    numThreads = std::max(numThreads,size_t(1));
+
     // open input file and feature layer
     OGRDataSource * ipShpFile = OGRSFDriverRegistrar::Open(ipFilePath.c_str(),FALSE);
     if(ipShpFile == NULL)   {
@@ -74,9 +70,10 @@ int main(int argc, const char *argv[])
 
     std::cout << "Feature Count: " << numFeatures << std::endl;
 
-    // iterate through input features and build mesh
-    std::vector<Vec2> listMeshVx;
-    std::vector<size_t> listMeshIx;
+    // iterate through input features and keep their
+    // polygons so they can be meshed in parallel
+    std::vector<OGRPolygon*> listPolys;
+    std::vector<size_t> listPolyFeatureIx;
     size_t ixFeature = 0;
     OGRFeature * ipFeature;
     while( (ipFeature = ipLayer->GetNextFeature()) != NULL )
@@ -100,131 +97,54 @@ int main(int argc, const char *argv[])
             continue;
         }
 
-        // simplify geometry
-        // note: we temp. convert to ecef for simplifcation
-        OGRPolygon * ipPoly = (OGRPolygon *)ipGeometry;
-        OGRPolygon * sPolygon = new OGRPolygon;
-
-        // outer ring
-        std::vector<Vec3> listOuterVx, listOuterVxSimp;
-        OGRLinearRing * ipOuterRing = ipPoly->getExteriorRing();
-        for(int i=0; i < ipOuterRing->getNumPoints(); i++)   {
-            PointLLA lla(ipOuterRing->getY(i),ipOuterRing->getX(i));
-            listOuterVx.push_back(ConvLLAToECEF(lla));
-        }
-        CalcPolylineSimplifyVW(listOuterVx,listOuterVxSimp,VW_AREA,1500.0);
-        OGRLinearRing * sOuterRing = new OGRLinearRing;
-        for(size_t i=0; i < listOuterVxSimp.size(); i++)   {
-            PointLLA lla = ConvECEFToLLA(listOuterVxSimp[i]);
-            sOuterRing->addPoint(lla.lon,lla.lat,0);
-        }
-        if(sOuterRing->getNumPoints() < 3)   {
-            delete sOuterRing;
-            continue;
-        }
-        sPolygon->addRingDirectly(sOuterRing);
-
-        // inner rings
-        for(int i=0; i < ipPoly->getNumInteriorRings(); i++)   {
-            std::vector<Vec3> listInnerVx,listInnerVxSimp;
-            OGRLinearRing * ipInnerRing = ipPoly->getInteriorRing(i);
-            for(int j=0; j < ipInnerRing->getNumPoints(); j++)   {
-                PointLLA lla(ipInnerRing->getY(j),ipInnerRing->getX(j));
-                listInnerVx.push_back(ConvLLAToECEF(lla));
-            }
-            CalcPolylineSimplifyVW(listInnerVx,listInnerVxSimp,VW_AREA,1500.0);
-            OGRLinearRing * sInnerRing = new OGRLinearRing;
-            for(size_t j=0; j < listInnerVxSimp.size(); j++)   {
-                PointLLA lla = ConvECEFToLLA(listInnerVxSimp[j]);
-                sInnerRing->addPoint(lla.lon,lla.lat,0);
-            }
-            if(sInnerRing->getNumPoints() < 3)   {
-                delete sInnerRing;
-                continue;
-            }
-            sPolygon->addRingDirectly(sInnerRing);
-        }
-        sPolygon->flattenTo2D();    // required to convert to wkbPolygon
-
-        // geometry mesh
-        int ix;
-        Vec2 vx;
-        std::vector<Vec2> listVx;
-        std::vector<size_t> listIx;
-
-        // simultaneously repair ipGeometry and retrieve
-        // the triangulation used in the repair process
-        void * interior;
-        void * exterior;
-        Triangulation opTriangulation;
-        OGRMultiPolygon * opPolygons = repair(sPolygon,
-                                              opTriangulation,
-                                              interior,
-                                              exterior);
-
-        if(opPolygons == NULL)   {
-            std::cout << "WARN: Triangulation failed for "
-                      << "feature " << ixFeature << std::endl;
-            continue;
-        }
+        listPolys.push_back((OGRPolygon *)ipGeometry->clone());
+        listPolyFeatureIx.push_back(ixFeature);
 
-        Triangulation::Finite_faces_iterator fIt;
-        for(fIt  = opTriangulation.finite_faces_begin();
-            fIt != opTriangulation.finite_faces_end(); ++fIt)
-        {
-//            std::cout << "sf->info(): " << fIt->info() << ", "
-//                      << "interior: " << (interior) << ", "
-//                      << "exterior: " << (exterior) << std::endl;
-
-            if(fIt->info() == NULL)   {
-                // get triangle
-                Triangulation::Triangle cdtTri =
-                        opTriangulation.triangle(fIt);
-
-                // point A
-                vx.x = cdtTri[0].x();
-                vx.y = cdtTri[0].y();
-                if(vxExistsInList(vx,listVx,ix))
-                {   listIx.push_back(ix);   }
-                else   {
-                    listVx.push_back(vx);
-                    listIx.push_back(listVx.size()-1);
-                }
+        // clean up
+        OGRFeature::DestroyFeature(ipFeature);
+        ixFeature++;
+    }
 
-                // point B
-                vx.x = cdtTri[1].x();
-                vx.y = cdtTri[1].y();
-                if(vxExistsInList(vx,listVx,ix))
-                {   listIx.push_back(ix);   }
-                else   {
-                    listVx.push_back(vx);
-                    listIx.push_back(listVx.size()-1);
+    // mesh the polygons
+    std::vector<std::vector<Vec2>> listPolyVx(listPolys.size());
+    std::vector<std::vector<size_t>> listPolyIx(listPolys.size());
+    std::atomic<size_t> nextPoly(0);
+
+    std::vector<std::thread> listWorkers;
+    for(size_t t=0; t < numThreads; t++)   {
+        listWorkers.push_back(std::thread([&]() {
+            while(true)   {
+                size_t const p = nextPoly++;
+                if(p >= listPolys.size())   {
+                    break;
                 }
-
-                // point C
-                vx.x = cdtTri[2].x();
-                vx.y = cdtTri[2].y();
-                if(vxExistsInList(vx,listVx,ix))
-                {   listIx.push_back(ix);   }
-                else   {
-                    listVx.push_back(vx);
-                    listIx.push_back(listVx.size()-1);
+                if(!BuildPolygonMesh(listPolys[p],
+                                     listPolyVx[p],
+                                     listPolyIx[p]))   {
+                    std::cout << "WARN: Triangulation failed for "
+                              << "feature " << listPolyFeatureIx[p]
+                              << std::endl;
                 }
             }
-        }
+        }));
+    }
+    for(auto &worker : listWorkers)   {
+        worker.join();
+    }
+
+    // merge the polygon meshes in feature order
+    std::vector<Vec2> listMeshVx;
+    std::vector<size_t> listMeshIx;
+    for(size_t p=0; p < listPolys.size(); p++)   {
         // adj indices
-        for(size_t i=0; i < listIx.size(); i++)   {
-            listIx[i] += listMeshVx.size();
+        for(size_t i=0; i < listPolyIx[p].size(); i++)   {
+            listPolyIx[p][i] += listMeshVx.size();
         }
 
-        // copy data to mesh
-        listMeshVx.insert(listMeshVx.end(),listVx.begin(),listVx.end());
-        listMeshIx.insert(listMeshIx.end(),listIx.begin(),listIx.end());
+        listMeshVx.insert(listMeshVx.end(),listPolyVx[p].begin(),listPolyVx[p].end());
+        listMeshIx.insert(listMeshIx.end(),listPolyIx[p].begin(),listPolyIx[p].end());
 
-        // clean up
-        delete opPolygons;
-        OGRFeature::DestroyFeature(ipFeature);
-        ixFeature++;
+        delete listPolys[p];
     }
 
     std::cout << "szMeshVx: " << listMeshVx.size() << std::endl;
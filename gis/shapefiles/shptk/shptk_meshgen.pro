@@ -4,6 +4,7 @@ TEMPLATE = app
 
 # main
 SOURCES += shptk_meshgen.cpp
+HEADERS += shptk.hpp shptk_mesh.hpp
 
 # openscenegraph (for debug only)
 PKGCONFIG += openthreads openscenegraph
@@ -39,5 +40,16 @@ INCLUDEPATH += $${PATH_OPENCTM}
                $${PATH_OPENCTM}/compressMG1.c
 
 # gdal/ogr and cgal
-LIBS += -lgdal -lCGAL_Core -lCGAL -lmpfr -lgmp -lboost_thread
+LIBS += -lgdal -lCGAL_Core -lCGAL -lmpfr -lgmp -lboost_thread -lpthread
 QMAKE_CXXFLAGS += -frounding-math -fno-strict-aliasing
+
+# geodesy (needs c++11)
+QMAKE_CXXFLAGS += -std=c++11
+PATH_GEODESY = /home/preet/Dev/scratch/utils/geodesy
+INCLUDEPATH += $${PATH_GEODESY}
+HEADERS += $${PATH_GEODESY}/geodesy.hpp
+
+# vxweld
+PATH_VXWELD = /home/preet/Dev/scratch/utils/vxweld
+INCLUDEPATH += $${PATH_VXWELD}
+HEADERS += $${PATH_VXWELD}/vxweld.hpp
@@ -1,6 +1,7 @@
 // sys
 #include <dirent.h>
 #include <sys/time.h>
+#include <sys/stat.h>
 
 // stl
 #include <iostream>
@@ -11,6 +12,10 @@
 #include <fstream>
 #include <stack>
 #include <set>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <cerrno>
 
 // osg
 #include <ogrsf_frmts.h>
@@ -21,8 +26,6 @@
 // ========================================================================== //
 // ========================================================================== //
 
-#define DBLMT 1E10
-
 double stringToNumber ( const std::string &Text )
 {
     std::stringstream ss(Text);
@@ -30,77 +33,6 @@ double stringToNumber ( const std::string &Text )
     return ss >> result ? result : 0;
 }
 
-bool calcAreaRectOverlap(double r1_bl_x, double r1_bl_y,
-                         double r1_tr_x, double r1_tr_y,
-                         double r2_bl_x, double r2_bl_y,
-                         double r2_tr_x, double r2_tr_y)
-{
-    if((r1_tr_x < r2_bl_x) || (r1_bl_x > r2_tr_x) ||
-       (r1_tr_y < r2_bl_y) || (r1_bl_y > r2_tr_y))
-    {   return false;   }
-
-    return true;
-}
-
-struct BoundingBox
-{
-    double minLat;
-    double minLon;
-    double maxLat;
-    double maxLon;
-};
-
-BoundingBox getQuadKeyExtents(BoundingBox const &rootExtents,
-                              std::string const &quadKey)
-{
-    BoundingBox myExtents;
-    myExtents = rootExtents;
-
-    if(quadKey.size() < 2)   {
-        return myExtents;
-    }
-
-    if(quadKey.size() % 2 != 0)   {
-        return myExtents;
-    }
-
-    for(size_t i=0; i < quadKey.size(); i+=2)
-    {
-        std::string quadrant = quadKey.substr(i,2);
-        double halfLonStep = (myExtents.maxLon-myExtents.minLon)/2;
-        double halfLatStep = (myExtents.maxLat-myExtents.minLat)/2;
-
-        // top left quadrant
-        if(quadrant.compare("00") == 0)   {
-            myExtents.maxLon -= halfLonStep;
-            myExtents.minLat += halfLatStep;
-        }
-        // top right quadrant
-        else if(quadrant.compare("01") == 0)   {
-            myExtents.minLon += halfLonStep;
-            myExtents.minLat += halfLatStep;
-        }
-        // bottom left quadrant
-        else if(quadrant.compare("10") == 0)   {
-            myExtents.maxLon -= halfLonStep;
-            myExtents.maxLat -= halfLatStep;
-        }
-        // bottom right quadrant
-        else if(quadrant.compare("11") == 0)   {
-            myExtents.minLon += halfLonStep;
-            myExtents.maxLat -= halfLatStep;
-        }
-    }
-
-//    // debug
-//    std::cout << "New Extents: "
-//              << myExtents.minLon << "," << myExtents.maxLon << "|"
-//              << myExtents.minLat << "," << myExtents.maxLat
-//              << std::endl;
-
-    return myExtents;
-}
-
 namespace ClipperLib
 {
     struct ExPolygon {
@@ -135,12 +67,177 @@ namespace ClipperLib
 // ========================================================================== //
 // ========================================================================== //
 
+// in memory quadtree split (needs ExPolygon from above)
+#include <QuadifyInMemory.hpp>
+
+// Clipper call used by quadifyInMemory
+bool clipQuadIntersection(ClipperLib::Clipper &clipperObj,
+                          ClipperLib::ExPolygons &xsecPolys)
+{
+    ClipperLib::PolyTree xsecResult;
+    if(!clipperObj.Execute(ClipperLib::ctIntersection,xsecResult))   {
+        return false;
+    }
+    ClipperLib::PolyTreeToExPolygons(xsecResult,xsecPolys);
+    return true;
+}
+
+// Every leaf gets its own data source so threads can
+// write their leaves at the same time
+bool writeQuadItems(OGRSFDriver * opDriver,
+                    std::string const &opFilePath,
+                    std::string const &opLayerName,
+                    std::vector<QuadItem> const &listItems)
+{
+    OGRDataSource * opShp =
+            opDriver->CreateDataSource(opFilePath.c_str(),NULL);
+    if(opShp == NULL)   {
+        std::cout << "ERROR: Creating Output File Failed: "
+                  << opFilePath << std::endl;
+        return false;
+    }
+
+    OGRLayer * opShpLayer =
+            opShp->CreateLayer(opLayerName.c_str(),NULL,wkbPolygon,NULL);
+
+    for(size_t x=0; x < listItems.size(); x++)   {
+        OGRPolygon savePolygon;
+        ClipperLib::ExPolygon const &xsecPoly = listItems[x].poly;
+
+        OGRLinearRing outerRing;
+        for(size_t y=0; y < xsecPoly.outer.size(); y++)
+        {    outerRing.addPoint(double(xsecPoly.outer[y].X)/DBLMT,double(xsecPoly.outer[y].Y)/DBLMT);   }
+        outerRing.addPoint(double(xsecPoly.outer[0].X)/DBLMT,double(xsecPoly.outer[0].Y)/DBLMT);
+        savePolygon.addRing(&outerRing);
+
+        for(size_t y=0; y < xsecPoly.holes.size(); y++)   {
+            OGRLinearRing innerRing;
+            for(size_t z=0; z < xsecPoly.holes[y].size(); z++)
+            {   innerRing.addPoint(double(xsecPoly.holes[y][z].X)/DBLMT,double(xsecPoly.holes[y][z].Y)/DBLMT);   }
+            innerRing.addPoint(double(xsecPoly.holes[y][0].X)/DBLMT,double(xsecPoly.holes[y][0].Y)/DBLMT);
+            savePolygon.addRing(&innerRing);
+        }
+
+        // save to output file
+        OGRFeature * opFeature;
+        opFeature = OGRFeature::CreateFeature(opShpLayer->GetLayerDefn());
+        opFeature->SetGeometry(&savePolygon);
+
+        if(opShpLayer->CreateFeature(opFeature) != OGRERR_NONE)   {
+            std::cout << "ERROR: Failed to create output feature\n";
+            OGRFeature::DestroyFeature(opFeature);
+            OGRDataSource::DestroyDataSource(opShp);
+            return false;
+        }
+        OGRFeature::DestroyFeature(opFeature);
+    }
+
+    OGRDataSource::DestroyDataSource(opShp);
+    return true;
+}
+
+bool quadifyShpInMemory(std::string const &ipFilePath,
+                        BoundingBox const &rootExtents,
+                        size_t numLevels,
+                        size_t numThreads,
+                        OGRSFDriver * opDriver,
+                        std::string const &outputPrefix)
+{
+    // open input file
+    OGRDataSource * ipShpFile;
+    ipShpFile = OGRSFDriverRegistrar::Open(ipFilePath.c_str(),FALSE);
+    if(ipShpFile == NULL)   {
+        std::cout << "ERROR: Could not open shape file "
+                  << ipFilePath << "\n";
+        return false;
+    }
+
+    OGRLayer * ipLayer = ipShpFile->GetLayer(0);
+    std::string opLayerName(ipLayer->GetName());
+
+    // read in all the polygons
+    std::vector<QuadItem> listItems;
+    size_t ixFeature = 0;
+
+    ipLayer->ResetReading();
+    OGRFeature * ipFeature;
+    while( (ipFeature = ipLayer->GetNextFeature()) != NULL )
+    {
+        OGRGeometry * ipGeometry;
+        ipGeometry = ipFeature->GetGeometryRef();
+
+        if(ipGeometry == NULL)   {
+            std::cout << "WARN: Ignoring NULL feature: "
+                      << ixFeature << std::endl;
+        }
+        else if(ipGeometry->getGeometryType() != wkbPolygon)   {
+            std::cout << "WARN: Feature type is not POLYGON "
+                      << "(ignoring): " << ixFeature << std::endl;
+        }
+        else   {
+            OGRPolygon *singlePoly = (OGRPolygon*)ipGeometry;
+            OGRLinearRing* outerRing = singlePoly->getExteriorRing();
+
+            if(outerRing != NULL && outerRing->getNumPoints() > 3)   {
+                QuadItem item;
+
+                // outer ring
+                for(int j=0; j < outerRing->getNumPoints()-1; j++)   {
+                    ClipperLib::IntPoint intPt;
+                    intPt.X = ClipperLib::long64(outerRing->getX(j)*DBLMT);
+                    intPt.Y = ClipperLib::long64(outerRing->getY(j)*DBLMT);
+                    item.poly.outer.push_back(intPt);
+                }
+
+                // inner rings
+                for(int j=0; j < singlePoly->getNumInteriorRings(); j++)   {
+                    OGRLinearRing *innerRing = singlePoly->getInteriorRing(j);
+                    ClipperLib::Polygon innerPoly;
+                    for(int k=0; k < innerRing->getNumPoints()-1; k++)   {
+                        ClipperLib::IntPoint intPt;
+                        intPt.X = ClipperLib::long64(innerRing->getX(k)*DBLMT);
+                        intPt.Y = ClipperLib::long64(innerRing->getY(k)*DBLMT);
+                        innerPoly.push_back(intPt);
+                    }
+                    item.poly.holes.push_back(innerPoly);
+                }
+
+                calcQuadItemBounds(item);
+                listItems.push_back(item);
+            }
+        }
+        OGRFeature::DestroyFeature(ipFeature);
+        ixFeature++;
+    }
+    OGRDataSource::DestroyDataSource(ipShpFile);
+
+    std::cout << "INFO: Read " << listItems.size() << " polygons\n";
+
+    QuadWriteFunc writeFunc =
+            [&](std::string const &quadKey,
+                std::vector<QuadItem> const &listQItems) {
+        return writeQuadItems(opDriver,outputPrefix+quadKey+".shp",
+                              opLayerName,listQItems);
+    };
+
+    return quadifyInMemory(listItems,rootExtents,numLevels,numThreads,
+                           clipQuadIntersection,writeFunc,"INFO: ");
+}
+
+// ========================================================================== //
+// ========================================================================== //
+
 int main(int argc, const char *argv[])
 {
-    if(argc != 8)   {
-        std::cout << "Usage: #> ./shptk_quadify MINLON MAXLON MINLAT MAXLAT LEVELS inputfile.shp outputdir\n";
+    if(argc < 8 || argc > 9)   {
+        std::cout << "Usage: #> ./shptk_quadify MINLON MAXLON MINLAT MAXLAT LEVELS inputfile.shp outputdir [numthreads]\n";
         std::cout << "* Expect all geometry in shapefile to be of type POLYGON only\n";
         std::cout << "* The output files are in the same format as the input file\n";
+        std::cout << "* The input is read into memory once and split with numthreads\n";
+        std::cout << "  threads (defaults to the number of cores); only leaf tiles\n";
+        std::cout << "  that have polygons are written\n";
+        std::cout << "* Set numthreads to 0 to split the input level by level on\n";
+        std::cout << "  disk instead (for inputs that don't fit in memory)\n";
         return 0;
     }
 
@@ -176,10 +273,20 @@ int main(int argc, const char *argv[])
     inputStr = std::string(argv[5]);
     unsigned int numLevels = stringToNumber(inputStr);
 
+    size_t numThreads = std::thread::hardware_concurrency();
+    if(argc == 9)   {
+        numThreads = atoi(argv[8]);
+    }
+    else   {
+        numThreads = std::max(numThreads,size_t(1));
+    }
+
     // create output dir
-    std::string makeDir("mkdir ");
-    makeDir.append(argv[7]);
-    system(makeDir.c_str());
+    if(mkdir(argv[7],0755) != 0 && errno != EEXIST)   {
+        std::cout << "ERROR: Could not create output dir "
+                  << argv[7] << std::endl;
+        return -1;
+    }
 
     // create output prefix
     std::string outputDir = std::string(argv[7]) + std::string("/");
@@ -197,6 +304,13 @@ int main(int argc, const char *argv[])
         return -1;
     }
 
+    if(numThreads > 0)   {
+        bool ok = (numLevels == 0) ||
+                quadifyShpInMemory(argv[6],rootExtents,numLevels,
+                                   numThreads,opDriver,outputPrefix);
+        return ok ? 0 : -1;
+    }
+
     std::string str00("00");
     std::string str01("01");
     std::string str10("10");
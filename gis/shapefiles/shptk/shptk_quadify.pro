@@ -11,7 +11,12 @@ INCLUDEPATH += $${PATH_CLIPPER}
 HEADERS += $${PATH_CLIPPER}/clipper.hpp
 SOURCES += $${PATH_CLIPPER}/clipper.cpp
 
+# in memory quadtree split (shared with ptk_quadify_wkt)
+PATH_POLYTOOLKIT = /home/preet/Dev/scratch/gis/polytoolkit
+INCLUDEPATH += $${PATH_POLYTOOLKIT}
+HEADERS += $${PATH_POLYTOOLKIT}/QuadifyInMemory.hpp
+
 # ogr
-LIBS += -lgdal -lCGAL_Core -lCGAL -lmpfr -lgmp -lboost_thread
+LIBS += -lgdal -lCGAL_Core -lCGAL -lmpfr -lgmp -lboost_thread -lpthread
 
 
@@ -9,9 +9,17 @@
 #include <osgDB/ReadFile>
 #include <osg/Uniform>
 #include <osg/CullFace>
+#include <osg/buffered_value>
 
 #include <vector>
+#include <map>
+#include <deque>
 #include <fstream>
+#include <functional>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 // geometric defines!
 // PI!
@@ -21,17 +29,8 @@
 #define K_EPS 1E-11
 #define K_NEPS -1E-11
 
-// WGS84 ellipsoid parameters
-// (http://en.wikipedia.org/wiki/WGS_84)
-#define ELL_SEMI_MAJOR 6378137.0            // meters
-#define ELL_SEMI_MAJOR_EXP2 40680631590769.0
-
-#define ELL_SEMI_MINOR 6356752.3142         // meters
-#define ELL_SEMI_MINOR_EXP2 40408299984087.1
-
-#define ELL_F 1.0/298.257223563
-#define ELL_ECC_EXP2 6.69437999014e-3
-#define ELL_ECC2_EXP2 6.73949674228e-3
+// WGS84 ellipsoid and LLA <-> ECEF conversions
+#include "../../utils/geodesy/geodesy.hpp"
 
 // circumference
 #define CIR_EQ 40075017.0   // around equator  (meters)
@@ -85,48 +84,220 @@ struct TileTxCoords
     Vec2 btmRight;
 };
 
-struct TextureAtlas
+void SetTileTexCoords(std::vector<Vec2> const &listTx,
+                      TileTxCoords const &txCoords,
+                      osg::Geometry * gmTile);
+
+// ========================================================================== //
+
+// Skyline bin packer for variable size rectangles. The
+// skyline is the top edge of everything placed so far,
+// stored as a list of horizontal segments sorted by x.
+// A new rect goes wherever its top edge ends up lowest
+// (bottom left heuristic). Space under the skyline that
+// a rect doesn't cover is lost until the packer is reset.
+class SkylinePacker
 {
-    osg::ref_ptr<osg::Texture2D>    texture;
-    osg::ref_ptr<osg::Image>        image;
-    std::vector<std::string>        listTileSpaces;
-    size_t numTiles;
+public:
+    SkylinePacker(size_t width, size_t height);
+
+    // Finds a spot for a (width x height) rect and returns
+    // its top left corner in x,y; false if it doesn't fit
+    bool Insert(size_t width, size_t height,
+                size_t &x, size_t &y);
+
+    void Reset();
+
+private:
+    struct Segment
+    {
+        size_t x;
+        size_t y;
+        size_t width;
+    };
+
+    // returns false if a rect starting at segment idx
+    // would go past the right or bottom edge
+    bool calcFitY(size_t idx, size_t width,
+                  size_t height, size_t &y) const;
+
+    void mergeSegments();
+
+    size_t m_width;
+    size_t m_height;
+    std::vector<Segment> m_listSegments;
 };
 
-typedef std::vector<TextureAtlas> ListAtlases;
-typedef std::vector<TileTxCoords> ListAtlasTileCoords;
+// ========================================================================== //
+
+// Reads and decodes tile images on worker threads so
+// AddTileAsync never touches the disk on the render thread
+class TileImageLoader
+{
+public:
+    struct Result
+    {
+        std::string path;
+        osg::ref_ptr<osg::Image> image;
+    };
+
+    TileImageLoader(size_t numThreads, size_t maxImageSize);
+    ~TileImageLoader();
+
+    void Push(std::string const &path);
+
+    // moves all the finished images into listResults
+    void Pop(std::vector<Result> &listResults);
+
+    // reads the image and scales it down if it's larger
+    // than maxImageSize; safe to call from any thread
+    static osg::ref_ptr<osg::Image> Load(std::string const &path,
+                                         size_t maxImageSize);
+
+private:
+    void threadLoop();
+
+    size_t const m_maxImageSize;
+    bool m_stop;
+
+    std::mutex m_mutex;
+    std::condition_variable m_waitCond;
+    std::deque<std::string> m_queuePaths;
+    std::vector<Result> m_listResults;
+    std::vector<std::thread> m_listThreads;
+};
+
+// ========================================================================== //
+
+struct AtlasTile
+{
+    TileTxCoords txCoords;
+    size_t area;
+};
+
+// Uploads only the parts of an atlas that tiles have
+// been copied into instead of the whole atlas image. The
+// image is kept as the CPU copy for contexts that load
+// the texture later.
+class AtlasSubloadCallback : public osg::Texture2D::SubloadCallback
+{
+public:
+    AtlasSubloadCallback(osg::Image * image);
+
+    // Copies image into the atlas image at x,y and marks
+    // that region for upload
+    void CopyImage(size_t x, size_t y, osg::Image const * image);
 
-typedef std::vector<osg::ref_ptr<osg::Texture2D> >  AtlasListTextures;
-typedef std::vector<osg::ref_ptr<osg::Image> >      AtlasListImages;
-typedef std::vector<std::vector<std::string> >      AtlasListTileSpaces;
+    void load(osg::Texture2D const &texture,
+              osg::State &state) const;
 
-// List of tile coordinates in the atlas
-// (arranged in row major order) for quick lookup
-typedef std::vector<TileTxCoords>                   AtlasListTileCoords;
+    void subload(osg::Texture2D const &texture,
+                 osg::State &state) const;
 
+private:
+    struct Region
+    {
+        size_t x;
+        size_t y;
+        size_t width;
+        size_t height;
+    };
+
+    struct ContextData
+    {
+        ContextData() : loaded(false) {}
+
+        bool loaded;
+        std::vector<Region> listRegions;
+    };
 
+    osg::ref_ptr<osg::Image> m_image;
+    mutable std::mutex m_mutex;
+    mutable osg::buffered_object<ContextData> m_listCtxData;
+};
+
+struct TextureAtlas
+{
+    TextureAtlas(size_t imageSize) :
+        packer(imageSize,imageSize),
+        usedArea(0) {}
+
+    osg::ref_ptr<osg::Texture2D>    texture;
+    osg::ref_ptr<osg::Image>        image;
+    osg::ref_ptr<AtlasSubloadCallback> subload;
+    SkylinePacker                   packer;
+    std::map<std::string,AtlasTile> listTiles;
+    size_t usedArea;
+};
+
+typedef std::vector<TextureAtlas> ListAtlases;
 
 // ========================================================================== //
 
 class TileAtlasOSG
 {
 public:
-    TileAtlasOSG(size_t imageSize,size_t tileSize);
+    typedef std::function<void(bool,TileTxCoords const &)> AddTileCallback;
+
+    // * imageSize is the size of each atlas texture
+    // * tiles larger than maxTileSize are scaled down to
+    //   fit, anything smaller is packed at its own size
+    TileAtlasOSG(size_t imageSize,
+                 size_t maxTileSize,
+                 size_t numLoaderThreads=2);
 
     bool AddTile(std::string const &tilePath,
                  osg::StateSet * stateSet,
                  TileTxCoords &tileCoords);
 
+    // Queues the tile to be read and decoded on a loader
+    // thread; the tile is copied into an atlas and the
+    // callback is called from Update() (or right away if
+    // the tile is already in an atlas)
+    void AddTileAsync(std::string const &tilePath,
+                      osg::StateSet * stateSet,
+                      AddTileCallback callback);
+
+    // Adds an image that's already in memory (glyphs,
+    // icons, etc) under the given name
+    bool AddImage(std::string const &name,
+                  osg::Image * image,
+                  osg::StateSet * stateSet,
+                  TileTxCoords &tileCoords);
+
     bool RemTile(std::string const &tilePath,
                  osg::StateSet * stateSet);
 
+    // Copies any tiles the loader has finished into the
+    // atlases; call this from the render/update thread
+    void Update();
+
+    // Fraction of the allocated atlas area that's
+    // covered by tiles
+    double GetOccupancy() const;
+
+    size_t GetNumAtlases() const;
+
 private:
+    struct PendingTile
+    {
+        osg::ref_ptr<osg::StateSet> stateSet;
+        AddTileCallback callback;
+    };
+
     size_t calcNextPowerOfTwo(size_t x) const;
 
+    TextureAtlas * findTile(std::string const &name,
+                            TileTxCoords &tileCoords);
+
+    void applyAtlas(TextureAtlas const &atlas,
+                    osg::StateSet * stateSet);
+
+    void createAtlas();
+
     //
     size_t m_imageSize;
-    size_t m_tileSize;
-    size_t m_numSpaces;
+    size_t m_maxTileSize;
     size_t m_numBytes;
 
     osg::Texture2D::FilterMode m_minMode;
@@ -135,7 +306,9 @@ private:
     osg::Texture2D::WrapMode m_wrapMode_t;
 
     ListAtlases             m_listAtlases;
-    ListAtlasTileCoords     m_listAtlasTileCoords;
+
+    std::multimap<std::string,PendingTile> m_listPendingTiles;
+    TileImageLoader         m_loader;
 };
 
 int main(int argc, char *argv[])
@@ -244,80 +417,76 @@ int main(int argc, char *argv[])
     ss->setAttributeAndModes(coastShader,osg::StateAttribute::ON);
     gdTile1->addDrawable(gmTile1);
 
-    TileTxCoords txCoords1;
-    tileAtlas->AddTile(pathTile1,ss,txCoords1);
-    std::cout << " ## 1: TL: "
-              << txCoords1.topLeft.x << ","
-              << txCoords1.topLeft.y << " , BR: "
-              << txCoords1.btmRight.x << ","
-              << txCoords1.btmRight.y << std::endl;
-
-    for(size_t i=0; i < listTx1.size(); i++)   {
-        double kTemp = fabs(txCoords1.topLeft.x-txCoords1.btmRight.x);
-        Vec2 tileTx = listTx1[i].ScaledBy(kTemp);
-        tileTx = tileTx + Vec2(txCoords1.topLeft.x,txCoords1.topLeft.y);
-        gmListTx1->push_back(osg::Vec2(tileTx.x,tileTx.y));
-    }
+    gmListTx1->resize(listTx1.size());
+    tileAtlas->AddTileAsync(pathTile1,ss,
+        [&listTx1,gmTile1](bool tileOk, TileTxCoords const &txCoords1) {
+            if(!tileOk)   {
+                return;
+            }
+            std::cout << " ## 1: TL: "
+                      << txCoords1.topLeft.x << ","
+                      << txCoords1.topLeft.y << " , BR: "
+                      << txCoords1.btmRight.x << ","
+                      << txCoords1.btmRight.y << std::endl;
+            SetTileTexCoords(listTx1,txCoords1,gmTile1.get());
+        });
 
     osg::ref_ptr<osg::Geode> gdTile2 = new osg::Geode;
     ss = gdTile2->getOrCreateStateSet();
     ss->setAttributeAndModes(coastShader,osg::StateAttribute::ON);
     gdTile2->addDrawable(gmTile2);
 
-    TileTxCoords txCoords2;
-    tileAtlas->AddTile(pathTile2,ss,txCoords2);
-    std::cout << " ## 2: TL: "
-              << txCoords2.topLeft.x << ","
-              << txCoords2.topLeft.y << " , BR: "
-              << txCoords2.btmRight.x << ","
-              << txCoords2.btmRight.y << std::endl;
-
-    for(size_t i=0; i < listTx2.size(); i++)   {
-        double kTemp = fabs(txCoords2.topLeft.x-txCoords2.btmRight.x);
-        Vec2 tileTx = listTx2[i].ScaledBy(kTemp);
-        tileTx = tileTx + Vec2(txCoords2.topLeft.x,txCoords2.topLeft.y);
-        gmListTx2->push_back(osg::Vec2(tileTx.x,tileTx.y));
-    }
+    gmListTx2->resize(listTx2.size());
+    tileAtlas->AddTileAsync(pathTile2,ss,
+        [&listTx2,gmTile2](bool tileOk, TileTxCoords const &txCoords2) {
+            if(!tileOk)   {
+                return;
+            }
+            std::cout << " ## 2: TL: "
+                      << txCoords2.topLeft.x << ","
+                      << txCoords2.topLeft.y << " , BR: "
+                      << txCoords2.btmRight.x << ","
+                      << txCoords2.btmRight.y << std::endl;
+            SetTileTexCoords(listTx2,txCoords2,gmTile2.get());
+        });
 
     osg::ref_ptr<osg::Geode> gdTile3 = new osg::Geode;
     ss = gdTile3->getOrCreateStateSet();
     ss->setAttributeAndModes(coastShader,osg::StateAttribute::ON);
     gdTile3->addDrawable(gmTile3);
 
-    TileTxCoords txCoords3;
-    tileAtlas->AddTile(pathTile3,ss,txCoords3);
-    std::cout << " ## 3: TL: "
-              << txCoords3.topLeft.x << ","
-              << txCoords3.topLeft.y << " , BR: "
-              << txCoords3.btmRight.x << ","
-              << txCoords3.btmRight.y << std::endl;
-
-    for(size_t i=0; i < listTx3.size(); i++)   {
-        double kTemp = fabs(txCoords3.topLeft.x-txCoords3.btmRight.x);
-        Vec2 tileTx = listTx3[i].ScaledBy(kTemp);
-        tileTx = tileTx + Vec2(txCoords3.topLeft.x,txCoords3.topLeft.y);
-        gmListTx3->push_back(osg::Vec2(tileTx.x,tileTx.y));
-    }
+    gmListTx3->resize(listTx3.size());
+    tileAtlas->AddTileAsync(pathTile3,ss,
+        [&listTx3,gmTile3](bool tileOk, TileTxCoords const &txCoords3) {
+            if(!tileOk)   {
+                return;
+            }
+            std::cout << " ## 3: TL: "
+                      << txCoords3.topLeft.x << ","
+                      << txCoords3.topLeft.y << " , BR: "
+                      << txCoords3.btmRight.x << ","
+                      << txCoords3.btmRight.y << std::endl;
+            SetTileTexCoords(listTx3,txCoords3,gmTile3.get());
+        });
 
     osg::ref_ptr<osg::Geode> gdTile4 = new osg::Geode;
     ss = gdTile4->getOrCreateStateSet();
     ss->setAttributeAndModes(coastShader,osg::StateAttribute::ON);
     gdTile4->addDrawable(gmTile4);
 
-    TileTxCoords txCoords4;
-    tileAtlas->AddTile(pathTile4,ss,txCoords4);
-    std::cout << " ## 4: TL: "
-              << txCoords4.topLeft.x << ","
-              << txCoords4.topLeft.y << " , BR: "
-              << txCoords4.btmRight.x << ","
-              << txCoords4.btmRight.y << std::endl;
-
-    for(size_t i=0; i < listTx4.size(); i++)   {
-        double kTemp = fabs(txCoords4.topLeft.x-txCoords4.btmRight.x);
-        Vec2 tileTx = listTx4[i].ScaledBy(kTemp);
-        tileTx = tileTx + Vec2(txCoords4.topLeft.x,txCoords4.topLeft.y);
-        gmListTx4->push_back(osg::Vec2(tileTx.x,tileTx.y));
-    }
+    gmListTx4->resize(listTx4.size());
+    tileAtlas->AddTileAsync(pathTile4,ss,
+        [&listTx4,gmTile4](bool tileOk, TileTxCoords const &txCoords4) {
+            if(!tileOk)   {
+                return;
+            }
+            std::cout << " ## 4: TL: "
+                      << txCoords4.topLeft.x << ","
+                      << txCoords4.topLeft.y << " , BR: "
+                      << txCoords4.btmRight.x << ","
+                      << txCoords4.btmRight.y << std::endl;
+            SetTileTexCoords(listTx4,txCoords4,gmTile4.get());
+        });
 
     // [root]
     osg::ref_ptr<osg::Group> groupRoot = new osg::Group;
@@ -342,97 +511,54 @@ int main(int argc, char *argv[])
         (*itr)->getState()->setUseVertexAttributeAliasing(true);
     }
 
-    return viewer.run();
+    // tiles are copied into the atlas between frames
+    // as the loader finishes them
+    viewer.realize();
+    while(!viewer.done())   {
+        tileAtlas->Update();
+        viewer.frame();
+    }
+
+    std::cout << "TileAtlasOSG: " << tileAtlas->GetNumAtlases()
+              << " atlas(es), occupancy "
+              << tileAtlas->GetOccupancy()*100.0 << "%" << std::endl;
+
+    delete tileAtlas;
+    return 0;
 
 }
 
 void ConvLLAToECEF(const PointLLA &pointLLA, Vec3 &pointECEF)
 {
-    // conversion formula from...
-    // hxxp://www.microem.ru/pages/u_blox/tech/dataconvert/GPS.G1-X-00006.pdf
-
-    // remember to convert deg->rad
-    double sinLat = sin(pointLLA.lat * K_PI/180.0f);
-    double sinLon = sin(pointLLA.lon * K_PI/180.0f);
-    double cosLat = cos(pointLLA.lat * K_PI/180.0f);
-    double cosLon = cos(pointLLA.lon * K_PI/180.0f);
-
-    // v = radius of curvature (meters)
-    double v = ELL_SEMI_MAJOR / (sqrt(1-(ELL_ECC_EXP2*sinLat*sinLat)));
-    pointECEF.x = (v + pointLLA.alt) * cosLat * cosLon;
-    pointECEF.y = (v + pointLLA.alt) * cosLat * sinLon;
-    pointECEF.z = ((1-ELL_ECC_EXP2)*v + pointLLA.alt)*sinLat;
+    geodesy::ConvLLAToECEF(pointLLA.lon,
+                           pointLLA.lat,
+                           pointLLA.alt,
+                           pointECEF.x,
+                           pointECEF.y,
+                           pointECEF.z);
 }
 
 Vec3 ConvLLAToECEF(const PointLLA &pointLLA)
 {
     Vec3 pointECEF;
-
-    // remember to convert deg->rad
-    double sinLat = sin(pointLLA.lat * K_PI/180.0f);
-    double sinLon = sin(pointLLA.lon * K_PI/180.0f);
-    double cosLat = cos(pointLLA.lat * K_PI/180.0f);
-    double cosLon = cos(pointLLA.lon * K_PI/180.0f);
-
-    // v = radius of curvature (meters)
-    double v = ELL_SEMI_MAJOR / (sqrt(1-(ELL_ECC_EXP2*sinLat*sinLat)));
-    pointECEF.x = (v + pointLLA.alt) * cosLat * cosLon;
-    pointECEF.y = (v + pointLLA.alt) * cosLat * sinLon;
-    pointECEF.z = ((1-ELL_ECC_EXP2)*v + pointLLA.alt)*sinLat;
-
+    ConvLLAToECEF(pointLLA,pointECEF);
     return pointECEF;
 }
 
 void ConvECEFToLLA(const Vec3 &pointECEF, PointLLA &pointLLA)
 {
-    // conversion formula from...
-    // hxxp://www.microem.ru/pages/u_blox/tech/dataconvert/GPS.G1-X-00006.pdf
-
-    double p = (sqrt(pow(pointECEF.x,2) + pow(pointECEF.y,2)));
-    double th = atan2(pointECEF.z*ELL_SEMI_MAJOR, p*ELL_SEMI_MINOR);
-    double sinTh = sin(th);
-    double cosTh = cos(th);
-
-    // calc longitude
-    pointLLA.lon = atan2(pointECEF.y, pointECEF.x);
-
-    // calc latitude
-    pointLLA.lat = atan2(pointECEF.z + ELL_ECC2_EXP2*ELL_SEMI_MINOR*sinTh*sinTh*sinTh,
-                         p - ELL_ECC_EXP2*ELL_SEMI_MAJOR*cosTh*cosTh*cosTh);
-    // calc altitude
-    double sinLat = sin(pointLLA.lat);
-    double N = ELL_SEMI_MAJOR / (sqrt(1-(ELL_ECC_EXP2*sinLat*sinLat)));
-    pointLLA.alt = (p/cos(pointLLA.lat)) - N;
-
-    // convert from rad to deg
-    pointLLA.lon = pointLLA.lon * 180.0/K_PI;
-    pointLLA.lat = pointLLA.lat * 180.0/K_PI;
+    geodesy::ConvECEFToLLA(pointECEF.x,
+                           pointECEF.y,
+                           pointECEF.z,
+                           pointLLA.lon,
+                           pointLLA.lat,
+                           pointLLA.alt);
 }
 
 PointLLA ConvECEFToLLA(const Vec3 &pointECEF)
 {
     PointLLA pointLLA;
-
-    double p = (sqrt(pow(pointECEF.x,2) + pow(pointECEF.y,2)));
-    double th = atan2(pointECEF.z*ELL_SEMI_MAJOR, p*ELL_SEMI_MINOR);
-    double sinTh = sin(th);
-    double cosTh = cos(th);
-
-    // calc longitude
-    pointLLA.lon = atan2(pointECEF.y, pointECEF.x);
-
-    // calc latitude
-    pointLLA.lat = atan2(pointECEF.z + ELL_ECC2_EXP2*ELL_SEMI_MINOR*sinTh*sinTh*sinTh,
-                         p - ELL_ECC_EXP2*ELL_SEMI_MAJOR*cosTh*cosTh*cosTh);
-    // calc altitude
-    double sinLat = sin(pointLLA.lat);
-    double N = ELL_SEMI_MAJOR / (sqrt(1-(ELL_ECC_EXP2*sinLat*sinLat)));
-    pointLLA.alt = (p/cos(pointLLA.lat)) - N;
-
-    // convert from rad to deg
-    pointLLA.lon = pointLLA.lon * 180.0/K_PI;
-    pointLLA.lat = pointLLA.lat * 180.0/K_PI;
-
+    ConvECEFToLLA(pointECEF,pointLLA);
     return pointLLA;
 }
 
@@ -493,40 +619,341 @@ bool BuildEarthSurfaceGeometry(double minLon, double maxLon,
     return true;
 }
 
-TileAtlasOSG::TileAtlasOSG(size_t imageSize,
-                           size_t tileSize)
+void SetTileTexCoords(std::vector<Vec2> const &listTx,
+                      TileTxCoords const &txCoords,
+                      osg::Geometry * gmTile)
+{
+    // tiles aren't necessarily square anymore so
+    // s and t are scaled separately
+    osg::Vec2Array * gmListTx =
+            static_cast<osg::Vec2Array*>(gmTile->getTexCoordArray(0));
+
+    double kx = txCoords.btmRight.x-txCoords.topLeft.x;
+    double ky = txCoords.btmRight.y-txCoords.topLeft.y;
+
+    gmListTx->resize(listTx.size());
+    for(size_t i=0; i < listTx.size(); i++)   {
+        (*gmListTx)[i] = osg::Vec2(listTx[i].x*kx + txCoords.topLeft.x,
+                                   listTx[i].y*ky + txCoords.topLeft.y);
+    }
+    gmListTx->dirty();
+    gmTile->dirtyDisplayList();
+}
+
+// ========================================================================== //
+
+SkylinePacker::SkylinePacker(size_t width, size_t height) :
+    m_width(width),
+    m_height(height)
+{
+    Reset();
+}
+
+bool SkylinePacker::Insert(size_t width, size_t height,
+                           size_t &x, size_t &y)
+{
+    if(width == 0 || height == 0 ||
+       width > m_width || height > m_height)   {
+        return false;
+    }
+
+    // Find the segment where the rect's top edge would
+    // be lowest; break ties with the narrowest segment
+    size_t bestIdx = m_listSegments.size();
+    size_t bestTop = m_height+1;
+    size_t bestWidth = m_width+1;
+    size_t bestY = 0;
+
+    for(size_t i=0; i < m_listSegments.size(); i++)
+    {
+        size_t fitY;
+        if(!calcFitY(i,width,height,fitY))   {
+            continue;
+        }
+
+        size_t const top = fitY+height;
+        if(top < bestTop ||
+           (top == bestTop && m_listSegments[i].width < bestWidth))
+        {
+            bestIdx = i;
+            bestTop = top;
+            bestWidth = m_listSegments[i].width;
+            bestY = fitY;
+        }
+    }
+
+    if(bestIdx == m_listSegments.size())   {
+        return false;
+    }
+
+    x = m_listSegments[bestIdx].x;
+    y = bestY;
+
+    // Add the rect's top edge to the skyline
+    Segment segment;
+    segment.x = x;
+    segment.y = y+height;
+    segment.width = width;
+    m_listSegments.insert(m_listSegments.begin()+bestIdx,segment);
+
+    // Trim or remove the segments it covers
+    size_t const segmentEnd = x+width;
+    for(size_t i=bestIdx+1; i < m_listSegments.size();)
+    {
+        Segment &next = m_listSegments[i];
+        if(next.x >= segmentEnd)   {
+            break;
+        }
+
+        size_t const overlap = segmentEnd-next.x;
+        if(next.width <= overlap)   {
+            m_listSegments.erase(m_listSegments.begin()+i);
+            continue;
+        }
+
+        next.x += overlap;
+        next.width -= overlap;
+        break;
+    }
+
+    mergeSegments();
+    return true;
+}
+
+void SkylinePacker::Reset()
+{
+    m_listSegments.clear();
+
+    Segment segment;
+    segment.x = 0;
+    segment.y = 0;
+    segment.width = m_width;
+    m_listSegments.push_back(segment);
+}
+
+bool SkylinePacker::calcFitY(size_t idx, size_t width,
+                             size_t height, size_t &y) const
+{
+    if(m_listSegments[idx].x + width > m_width)   {
+        return false;
+    }
+
+    // The rect has to sit on the highest segment
+    // it spans; the segments always cover the full
+    // width so this can't run off the end
+    size_t remaining = width;
+    y = 0;
+
+    for(size_t i=idx; remaining > 0; i++)
+    {
+        y = std::max(y,m_listSegments[i].y);
+        if(y + height > m_height)   {
+            return false;
+        }
+        remaining -= std::min(remaining,m_listSegments[i].width);
+    }
+
+    return true;
+}
+
+void SkylinePacker::mergeSegments()
+{
+    for(size_t i=1; i < m_listSegments.size();)
+    {
+        if(m_listSegments[i-1].y == m_listSegments[i].y)   {
+            m_listSegments[i-1].width += m_listSegments[i].width;
+            m_listSegments.erase(m_listSegments.begin()+i);
+        }
+        else   {
+            i++;
+        }
+    }
+}
+
+// ========================================================================== //
+
+TileImageLoader::TileImageLoader(size_t numThreads,
+                                 size_t maxImageSize) :
+    m_maxImageSize(maxImageSize),
+    m_stop(false)
+{
+    numThreads = std::max(numThreads,size_t(1));
+    for(size_t i=0; i < numThreads; i++)   {
+        m_listThreads.push_back(std::thread(&TileImageLoader::threadLoop,this));
+    }
+}
+
+TileImageLoader::~TileImageLoader()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_waitCond.notify_all();
+
+    for(size_t i=0; i < m_listThreads.size(); i++)   {
+        m_listThreads[i].join();
+    }
+}
+
+void TileImageLoader::Push(std::string const &path)
 {
-    // Force tile textures to be power of two
-    m_imageSize = calcNextPowerOfTwo(imageSize);
-    m_tileSize  = calcNextPowerOfTwo(tileSize);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queuePaths.push_back(path);
+    }
+    m_waitCond.notify_one();
+}
 
-    // Check if invalid sizes; set to sane defaults
-    if(m_tileSize >= m_imageSize)   {
-        m_imageSize = 1024;
-        m_tileSize  = 256;
+void TileImageLoader::Pop(std::vector<Result> &listResults)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    listResults.insert(listResults.end(),
+                       m_listResults.begin(),
+                       m_listResults.end());
+    m_listResults.clear();
+}
+
+osg::ref_ptr<osg::Image> TileImageLoader::Load(std::string const &path,
+                                               size_t maxImageSize)
+{
+    osg::ref_ptr<osg::Image> image = osgDB::readImageFile(path);
+
+    // readImageFile returns null if it fails
+    if(!image.valid() || !image->valid())   {
+        return osg::ref_ptr<osg::Image>();
+    }
+
+    // scale down anything that won't fit in a tile
+    // while keeping its aspect ratio
+    size_t width = image->s();
+    size_t height = image->t();
+    if(width > maxImageSize || height > maxImageSize)   {
+        double k = double(maxImageSize)/std::max(width,height);
+        width = std::max(size_t(width*k),size_t(1));
+        height = std::max(size_t(height*k),size_t(1));
+        image->scaleImage(width,height,1);
     }
-    m_numBytes  = imageSize*imageSize*4;
-    m_numSpaces = (m_imageSize*m_imageSize)/
-                  (m_tileSize*m_tileSize);
 
-    // Calculate tile coordinates
-    size_t sideLength = m_imageSize/m_tileSize;
-    double tileFrac   = 1.0/sideLength;
-    for(size_t i=0; i < sideLength; i++)  // cols
+    return image;
+}
+
+void TileImageLoader::threadLoop()
+{
+    while(true)
     {
-        for(size_t j=0; j < sideLength; j++)  // rows
+        std::string path;
         {
-            TileTxCoords tileTxCoords;
-            tileTxCoords.topLeft.x  = tileFrac*j;
-            tileTxCoords.topLeft.y  = tileFrac*i;
-            tileTxCoords.btmRight.x = tileFrac*(j+1);
-            tileTxCoords.btmRight.y = tileFrac*(i+1);
-
-            // save
-            m_listAtlasTileCoords.push_back(tileTxCoords);
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_waitCond.wait(lock,[this]() {
+                return (m_stop || !m_queuePaths.empty());
+            });
+
+            if(m_stop)   {
+                return;
+            }
+
+            path = m_queuePaths.front();
+            m_queuePaths.pop_front();
+        }
+
+        Result result;
+        result.path = path;
+        result.image = Load(path,m_maxImageSize);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_listResults.push_back(result);
+    }
+}
+
+// ========================================================================== //
+
+AtlasSubloadCallback::AtlasSubloadCallback(osg::Image * image) :
+    m_image(image)
+{
+    // empty
+}
+
+void AtlasSubloadCallback::CopyImage(size_t x, size_t y,
+                                     osg::Image const * image)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_image->copySubImage(x,y,0,image);
+
+    Region region;
+    region.x = x;
+    region.y = y;
+    region.width = image->s();
+    region.height = image->t();
+
+    for(unsigned int i=0; i < m_listCtxData.size(); i++)   {
+        // contexts that haven't loaded the texture
+        // yet will get the whole image
+        ContextData &ctxData = m_listCtxData[i];
+        if(ctxData.loaded)   {
+            ctxData.listRegions.push_back(region);
         }
     }
+}
+
+void AtlasSubloadCallback::load(osg::Texture2D const &texture,
+                                osg::State &state) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    ContextData &ctxData = m_listCtxData[state.getContextID()];
+    ctxData.loaded = true;
+    ctxData.listRegions.clear();
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT,m_image->getPacking());
+    glTexImage2D(GL_TEXTURE_2D,0,
+                 texture.getInternalFormat(),
+                 m_image->s(),
+                 m_image->t(),0,
+                 m_image->getPixelFormat(),
+                 m_image->getDataType(),
+                 m_image->data());
+}
+
+void AtlasSubloadCallback::subload(osg::Texture2D const &,
+                                   osg::State &state) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    ContextData &ctxData = m_listCtxData[state.getContextID()];
+    if(ctxData.listRegions.empty())   {
+        return;
+    }
+
+    // upload each region straight from the atlas image
+    glPixelStorei(GL_UNPACK_ALIGNMENT,m_image->getPacking());
+    glPixelStorei(GL_UNPACK_ROW_LENGTH,m_image->s());
+    for(size_t i=0; i < ctxData.listRegions.size(); i++)   {
+        Region const &region = ctxData.listRegions[i];
+        glTexSubImage2D(GL_TEXTURE_2D,0,
+                        region.x,region.y,
+                        region.width,region.height,
+                        m_image->getPixelFormat(),
+                        m_image->getDataType(),
+                        m_image->data(region.x,region.y));
+    }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH,0);
+    ctxData.listRegions.clear();
+}
+
+// ========================================================================== //
 
+TileAtlasOSG::TileAtlasOSG(size_t imageSize,
+                           size_t maxTileSize,
+                           size_t numLoaderThreads) :
+    // Force atlas textures to be power of two; the
+    // tiles in them can be any size
+    m_imageSize(calcNextPowerOfTwo(imageSize)),
+    m_maxTileSize((maxTileSize == 0 || maxTileSize > m_imageSize) ?
+                  m_imageSize : maxTileSize),
+    m_numBytes(m_imageSize*m_imageSize*4),
+    m_loader(numLoaderThreads,m_maxTileSize)
+{
     //
     m_minMode = osg::Texture2D::NEAREST;
     m_magMode = osg::Texture2D::NEAREST;
@@ -548,95 +975,116 @@ bool TileAtlasOSG::AddTile(std::string const &tilePath,
                            osg::StateSet * stateSet,
                            TileTxCoords &tileCoords)
 {
-    osg::ref_ptr<osg::Image> tileImg =
-            osgDB::readImageFile(tilePath);
+    // don't read tiles that are already in an atlas
+    TextureAtlas * atlas = findTile(tilePath,tileCoords);
+    if(atlas)   {
+        applyAtlas(*atlas,stateSet);
+        return true;
+    }
 
-    bool opOk = tileImg.valid() &&      // check if readImage was successful
-                tileImg->valid();       // check if the image is valid
+    osg::ref_ptr<osg::Image> tileImg =
+            TileImageLoader::Load(tilePath,m_maxTileSize);
 
-    if(!opOk)   {
+    if(!tileImg.valid())   {
         std::cout << "TileAtlas: AddTile: path/image invalid!" << std::endl;
         return false;
     }
 
-    // scale image to the correct size
-    tileImg->scaleImage(m_tileSize,m_tileSize,1);
+    return AddImage(tilePath,tileImg.get(),stateSet,tileCoords);
+}
 
-    // Check each atlas to see if there is any
-    // empty space available
-    for(size_t i=0; i < m_listAtlases.size(); i++)
-    {
-        std::vector<std::string> &listTileSpaces =
-                m_listAtlases[i].listTileSpaces;
+void TileAtlasOSG::AddTileAsync(std::string const &tilePath,
+                                osg::StateSet * stateSet,
+                                AddTileCallback callback)
+{
+    TileTxCoords tileCoords;
+    TextureAtlas * atlas = findTile(tilePath,tileCoords);
+    if(atlas)   {
+        applyAtlas(*atlas,stateSet);
+        if(callback)   {
+            callback(true,tileCoords);
+        }
+        return;
+    }
 
-        for(size_t j=0; j < listTileSpaces.size(); j++)
-        {
-            if(listTileSpaces[j].empty())
-            {
-                // copy the tile image into the atlas image
-                tileCoords = m_listAtlasTileCoords[j];
-                size_t xBeg = tileCoords.topLeft.x * m_imageSize;
-                size_t yBeg = tileCoords.topLeft.y * m_imageSize;
-                std::cout << "xBeg is " << xBeg << std::endl;
-                std::cout << "yBeg is " << yBeg << std::endl;
-
-                // save
-                m_listAtlases[i].listTileSpaces[j] = tilePath;
-                m_listAtlases[i].image->copySubImage(xBeg,yBeg,0,tileImg);
-                m_listAtlases[i].numTiles++;
-
-                std::cout << "!! : " << m_listAtlases[i].numTiles << std::endl;
-
-                // update state set
-                stateSet->setTextureAttributeAndModes(0,m_listAtlases[i].texture);
-
-                return true;
-            }
+    // only read the tile once if it's added again
+    // before the loader has finished it
+    bool const queued = (m_listPendingTiles.count(tilePath) > 0);
+
+    PendingTile pending;
+    pending.stateSet = stateSet;
+    pending.callback = callback;
+    m_listPendingTiles.insert(std::make_pair(tilePath,pending));
+
+    if(!queued)   {
+        m_loader.Push(tilePath);
+    }
+}
+
+bool TileAtlasOSG::AddImage(std::string const &name,
+                            osg::Image * image,
+                            osg::StateSet * stateSet,
+                            TileTxCoords &tileCoords)
+{
+    TextureAtlas * atlas = findTile(name,tileCoords);
+    if(atlas)   {
+        applyAtlas(*atlas,stateSet);
+        return true;
+    }
+
+    if(image == NULL || !image->valid())   {
+        std::cout << "TileAtlas: AddImage: image invalid!" << std::endl;
+        return false;
+    }
+
+    size_t const width = image->s();
+    size_t const height = image->t();
+    if(width > m_maxTileSize || height > m_maxTileSize)   {
+        std::cout << "TileAtlas: AddImage: image larger than "
+                  << m_maxTileSize << "px!" << std::endl;
+        return false;
+    }
+
+    // Check each atlas to see if there is space
+    // available, otherwise create a new one
+    size_t xBeg,yBeg;
+    size_t i=0;
+    for(i=0; i < m_listAtlases.size(); i++)   {
+        if(m_listAtlases[i].packer.Insert(width,height,xBeg,yBeg))   {
+            break;
         }
     }
 
-    // If there is no space available create
-    // a new texture atlas
-    TextureAtlas texAtlas;
-    texAtlas.numTiles = 0;
-    texAtlas.listTileSpaces.resize(m_numSpaces);
-    texAtlas.image = new osg::Image;
-    texAtlas.image->allocateImage(m_imageSize,m_imageSize,1,
-                                  GL_RGBA,GL_UNSIGNED_BYTE);
-    // (temp pixel color data)
-    unsigned char * initData = texAtlas.image->data();
-    for(size_t i=0; i < m_numBytes; i+=4)   {
-        initData[i  ] = 155;
-        initData[i+1] = 155;
-        initData[i+2] = 155;
-        initData[i+3] = 0;
+    if(i == m_listAtlases.size())   {
+        createAtlas();
+        if(!m_listAtlases.back().packer.Insert(width,height,xBeg,yBeg))   {
+            // can't happen since width and height are
+            // no larger than the atlas
+            std::cout << "TileAtlas: AddImage: no space!" << std::endl;
+            return false;
+        }
     }
-    // copy the tile image into the first
-    // atlas tile space
-    tileCoords = m_listAtlasTileCoords[0];
-    size_t xBeg = tileCoords.topLeft.x * m_imageSize;
-    size_t yBeg = tileCoords.topLeft.y * m_imageSize;
-    std::cout << "xBeg is " << xBeg << std::endl;
-    std::cout << "yBeg is " << yBeg << std::endl;
-    texAtlas.image->copySubImage(0,0,0,tileImg);
-    texAtlas.listTileSpaces[0] = tilePath;
-    texAtlas.numTiles++;
-
-    // setup texture
-    texAtlas.texture = new osg::Texture2D;
-    texAtlas.texture->setFilter(osg::Texture2D::MIN_FILTER,m_minMode);
-    texAtlas.texture->setFilter(osg::Texture2D::MAG_FILTER,m_magMode);
-    texAtlas.texture->setWrap(osg::Texture2D::WRAP_S,m_wrapMode_s);
-    texAtlas.texture->setWrap(osg::Texture2D::WRAP_T,m_wrapMode_t);
-    texAtlas.texture->setImage(texAtlas.image);
 
-    // save atlas
-    m_listAtlases.push_back(texAtlas);
+    // copy the tile image into the atlas image; this
+    // is the only part of adding a tile that has to
+    // happen on the render thread, and only the tile's
+    // region of the texture is uploaded
+    TextureAtlas &texAtlas = m_listAtlases[i];
+    texAtlas.subload->CopyImage(xBeg,yBeg,image);
+
+    tileCoords.topLeft.x  = double(xBeg)/m_imageSize;
+    tileCoords.topLeft.y  = double(yBeg)/m_imageSize;
+    tileCoords.btmRight.x = double(xBeg+width)/m_imageSize;
+    tileCoords.btmRight.y = double(yBeg+height)/m_imageSize;
+
+    // save
+    AtlasTile &tile = texAtlas.listTiles[name];
+    tile.txCoords = tileCoords;
+    tile.area = width*height;
+    texAtlas.usedArea += tile.area;
 
     // update state set
-    osg::ref_ptr<osg::Uniform> uSampler = new osg::Uniform("Texture",0);
-    stateSet->addUniform(uSampler);
-    stateSet->setTextureAttributeAndModes(0,texAtlas.texture);
+    applyAtlas(texAtlas,stateSet);
 
     return true;
 }
@@ -738,51 +1186,104 @@ bool TileAtlasOSG::AddTile(std::string const &tilePath,
 bool TileAtlasOSG::RemTile(std::string const &tilePath,
                            osg::StateSet * stateSet)
 {
-    size_t i = 0;
-    bool foundPath = false;
+    // The tile might still be loading, in which case only
+    // this state set stops waiting for it; if nothing else
+    // is waiting the loaded image is dropped in Update()
+    auto range = m_listPendingTiles.equal_range(tilePath);
+    for(auto it = range.first; it != range.second; ++it)   {
+        if(it->second.stateSet == stateSet)   {
+            m_listPendingTiles.erase(it);
+            return true;
+        }
+    }
 
     // Find the tile to remove
-    for(i=0; i < m_listAtlases.size(); i++)
+    for(size_t i=0; i < m_listAtlases.size(); i++)
     {
-        std::vector<std::string> &listTileSpaces =
-                m_listAtlases[i].listTileSpaces;
+        TextureAtlas &texAtlas = m_listAtlases[i];
+
+        auto it = texAtlas.listTiles.find(tilePath);
+        if(it == texAtlas.listTiles.end())   {
+            continue;
+        }
+
+        // we don't explicitly overwrite the pixel data
+        // here; the skyline can't reuse the space so it
+        // only comes back once the whole atlas is empty
+        texAtlas.usedArea -= it->second.area;
+        texAtlas.listTiles.erase(it);
+
+        // remove the atlas if it's empty
+        if(texAtlas.listTiles.empty())   {
+            m_listAtlases.erase(m_listAtlases.begin()+i);
+        }
 
-        for(size_t j=0; j < listTileSpaces.size(); j++)
+        return true;
+    }
+
+    std::cout << "TileAtlas: RemTile: path not found!" << std::endl;
+    return false;
+}
+
+void TileAtlasOSG::Update()
+{
+    std::vector<TileImageLoader::Result> listResults;
+    m_loader.Pop(listResults);
+
+    for(size_t i=0; i < listResults.size(); i++)
+    {
+        TileImageLoader::Result const &result = listResults[i];
+
+        auto range = m_listPendingTiles.equal_range(result.path);
+        if(range.first == range.second)   {
+            // removed while it was loading
+            continue;
+        }
+
+        std::vector<PendingTile> listPending;
+        for(auto it = range.first; it != range.second; ++it)   {
+            listPending.push_back(it->second);
+        }
+        m_listPendingTiles.erase(range.first,range.second);
+
+        if(!result.image.valid())   {
+            std::cout << "TileAtlas: AddTile: path/image invalid!" << std::endl;
+        }
+
+        // the first AddImage copies the tile in, the
+        // rest find it already in the atlas
+        for(size_t j=0; j < listPending.size(); j++)
         {
-            if(listTileSpaces[j].compare(tilePath) == 0)
-            {   // just clear the tile path string -- we don't
-                // explicitly overwrite the pixel data here
-                listTileSpaces[j].clear();
-                foundPath = true;
-                break;
+            TileTxCoords tileCoords;
+            bool tileOk = result.image.valid() &&
+                          AddImage(result.path,result.image.get(),
+                                   listPending[j].stateSet.get(),
+                                   tileCoords);
+
+            if(listPending[j].callback)   {
+                listPending[j].callback(tileOk,tileCoords);
             }
         }
     }
+}
 
-    if(!foundPath)   {
-        std::cout << "TileAtlas: RemTile: path not found!" << std::endl;
-        return false;
+double TileAtlasOSG::GetOccupancy() const
+{
+    if(m_listAtlases.empty())   {
+        return 0.0;
     }
 
-    // check if the atlas is empty
-    std::vector<std::string> &listTileSpaces =
-            m_listAtlases[i].listTileSpaces;
-
-    for(size_t j=0; j < listTileSpaces.size(); j++)   {
-        if(!listTileSpaces[j].empty())
-        {   // the atlas isn't empty, just return
-            return true;
-        }
+    double usedArea = 0.0;
+    for(size_t i=0; i < m_listAtlases.size(); i++)   {
+        usedArea += m_listAtlases[i].usedArea;
     }
 
-    // remove the empty atlas
-//    stateSet->removeTextureAttribute(0,m_listAtlases[i].texture);
-//    if(stateSet->getUniform("Texture") != NULL)   {
-//        stateSet->removeUniform("Texture");
-//    }
+    return usedArea/(double(m_imageSize*m_imageSize)*m_listAtlases.size());
+}
 
-    m_listAtlases.erase(m_listAtlases.begin()+i);
-    return true;
+size_t TileAtlasOSG::GetNumAtlases() const
+{
+    return m_listAtlases.size();
 }
 
 size_t TileAtlasOSG::calcNextPowerOfTwo(size_t x) const
@@ -794,3 +1295,60 @@ size_t TileAtlasOSG::calcNextPowerOfTwo(size_t x) const
 
     return val;
 }
+
+TextureAtlas * TileAtlasOSG::findTile(std::string const &name,
+                                      TileTxCoords &tileCoords)
+{
+    for(size_t i=0; i < m_listAtlases.size(); i++)
+    {
+        auto it = m_listAtlases[i].listTiles.find(name);
+        if(it != m_listAtlases[i].listTiles.end())   {
+            tileCoords = it->second.txCoords;
+            return &(m_listAtlases[i]);
+        }
+    }
+
+    return NULL;
+}
+
+void TileAtlasOSG::applyAtlas(TextureAtlas const &atlas,
+                              osg::StateSet * stateSet)
+{
+    if(stateSet->getUniform("Texture") == NULL)   {
+        osg::ref_ptr<osg::Uniform> uSampler = new osg::Uniform("Texture",0);
+        stateSet->addUniform(uSampler);
+    }
+    stateSet->setTextureAttributeAndModes(0,atlas.texture);
+}
+
+void TileAtlasOSG::createAtlas()
+{
+    TextureAtlas texAtlas(m_imageSize);
+    texAtlas.image = new osg::Image;
+    texAtlas.image->allocateImage(m_imageSize,m_imageSize,1,
+                                  GL_RGBA,GL_UNSIGNED_BYTE);
+    // (temp pixel color data)
+    unsigned char * initData = texAtlas.image->data();
+    for(size_t i=0; i < m_numBytes; i+=4)   {
+        initData[i  ] = 155;
+        initData[i+1] = 155;
+        initData[i+2] = 155;
+        initData[i+3] = 0;
+    }
+
+    // setup texture; the image isn't set on the texture
+    // so osg never uploads all of it when a tile is added
+    texAtlas.subload = new AtlasSubloadCallback(texAtlas.image.get());
+
+    texAtlas.texture = new osg::Texture2D;
+    texAtlas.texture->setTextureSize(m_imageSize,m_imageSize);
+    texAtlas.texture->setInternalFormat(GL_RGBA);
+    texAtlas.texture->setSubloadCallback(texAtlas.subload.get());
+    texAtlas.texture->setFilter(osg::Texture2D::MIN_FILTER,m_minMode);
+    texAtlas.texture->setFilter(osg::Texture2D::MAG_FILTER,m_magMode);
+    texAtlas.texture->setWrap(osg::Texture2D::WRAP_S,m_wrapMode_s);
+    texAtlas.texture->setWrap(osg::Texture2D::WRAP_T,m_wrapMode_t);
+
+    // save atlas
+    m_listAtlases.push_back(texAtlas);
+}
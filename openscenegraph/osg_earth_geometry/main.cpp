@@ -19,12 +19,8 @@
 // PI!
 #define K_PI 3.141592653589
 
-// WGS84 ellipsoid parameters (http://en.wikipedia.org/wiki/WGS_84)
-#define ELL_SEMI_MAJOR 6378137.0            // meters
-#define ELL_SEMI_MINOR 6356752.3142         // meters
-#define ELL_F 1/298.257223563
-#define ELL_ECC_EXP2 6.69437999014e-3
-#define ELL_ECC2_EXP2 6.73949674228e-3
+// WGS84 ellipsoid and LLA <-> ECEF conversions
+#include <geodesy.hpp>
 
 
 // longitude, latitude, altitude point class
@@ -206,7 +202,7 @@ int main()
     myOriginNode->addDrawable(myOriginSphere.get());
 
     // node: frustum
-    double fSF = ELL_SEMI_MAJOR;    // scale factor
+    double fSF = geodesy::WGS84.a;    // scale factor
     scout::Vec3 camEye(859270.45,-4541000.3,4381186.5);
     scout::Vec3 camViewpoint(-3739340.3,-5001226.7,0);
     scout::Vec3 camUp(-0.68697857,-0.068752435,0.72341797);
@@ -562,45 +558,21 @@ bool createEarthSurfaceGeometry(int latSegments, int lonSegments,
 
 void convLLAToECEF(PointLLA const &pointLLA, Point3D &pointECEF)
 {
-    // conversion formula from...
-    // hxxp://www.microem.ru/pages/u_blox/tech/dataconvert/GPS.G1-X-00006.pdf
-
-    // remember to convert deg->rad
-    double sinLat = sin(pointLLA.lat * K_PI/180.0f);
-    double sinLon = sin(pointLLA.lon * K_PI/180.0f);
-    double cosLat = cos(pointLLA.lat * K_PI/180.0f);
-    double cosLon = cos(pointLLA.lon * K_PI/180.0f);
-
-    // v = radius of curvature (meters)
-    double v = ELL_SEMI_MAJOR / (sqrt(1-(ELL_ECC_EXP2*sinLat*sinLat)));
-    pointECEF.x = (v + pointLLA.alt) * cosLat * cosLon;
-    pointECEF.y = (v + pointLLA.alt) * cosLat * sinLon;
-    pointECEF.z = ((1-ELL_ECC_EXP2)*v + pointLLA.alt)*sinLat;
+    geodesy::ConvLLAToECEF(pointLLA.lon,
+                           pointLLA.lat,
+                           pointLLA.alt,
+                           pointECEF.x,
+                           pointECEF.y,
+                           pointECEF.z);
 }
 
 
 void convECEFToLLA(Point3D const &pointECEF, PointLLA &pointLLA)
 {
-    // conversion formula from...
-    // hxxp://www.microem.ru/pages/u_blox/tech/dataconvert/GPS.G1-X-00006.pdf
-
-    double p = (sqrt(pow(pointECEF.x,2) + pow(pointECEF.y,2)));
-    double th = atan2(pointECEF.z*ELL_SEMI_MAJOR, p*ELL_SEMI_MINOR);
-    double sinTh = sin(th);
-    double cosTh = cos(th);
-
-    // calc longitude
-    pointLLA.lon = atan2(pointECEF.y, pointECEF.x);
-
-    // calc latitude
-    pointLLA.lat = atan2(pointECEF.z + ELL_ECC2_EXP2*ELL_SEMI_MINOR*sinTh*sinTh*sinTh,
-                         p - ELL_ECC_EXP2*ELL_SEMI_MAJOR*cosTh*cosTh*cosTh);
-    // calc altitude
-    double sinLat = sin(pointLLA.lat);
-    double N = ELL_SEMI_MAJOR / (sqrt(1-(ELL_ECC_EXP2*sinLat*sinLat)));
-    pointLLA.alt = (p/cos(pointLLA.lat)) - N;
-
-    // convert from rad to deg
-    pointLLA.lon = pointLLA.lon * 180.0/K_PI;
-    pointLLA.lat = pointLLA.lat * 180.0/K_PI;
+    geodesy::ConvECEFToLLA(pointECEF.x,
+                           pointECEF.y,
+                           pointECEF.z,
+                           pointLLA.lon,
+                           pointLLA.lat,
+                           pointLLA.alt);
 }
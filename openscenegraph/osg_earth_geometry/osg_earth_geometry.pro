@@ -14,3 +14,8 @@ SOURCES += main.cpp
 moreFiles.path = $$OUT_PWD
 moreFiles.files += earth_map.jpg
 INSTALLS += moreFiles
+
+# geodesy (needs c++11)
+QMAKE_CXXFLAGS += -std=c++11
+INCLUDEPATH += $${PWD}/../../utils/geodesy
+HEADERS += $${PWD}/../../utils/geodesy/geodesy.hpp
@@ -30,3 +30,7 @@ moreFiles.files += \
     textures/earth_right.jpg
 
 INSTALLS += moreFiles
+
+# geodesy
+INCLUDEPATH += $${PWD}/../../utils/geodesy
+HEADERS += $${PWD}/../../utils/geodesy/geodesy.hpp
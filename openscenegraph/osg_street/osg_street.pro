@@ -19,3 +19,7 @@ LIBS += -L$${LIBOSMSCOUT_PATH}/lib -losmscout
 
 #
 QMAKE_CXXFLAGS = -std=c++11
+
+# geodesy
+INCLUDEPATH += $${PWD}/../../utils/geodesy
+HEADERS += $${PWD}/../../utils/geodesy/geodesy.hpp
@@ -4,15 +4,101 @@
 
 #include <OSGUtils.h>
 #include <osg/Texture2D>
+#include <osg/Program>
+#include <osg/Shader>
+#include <osg/Uniform>
+
+#include <limits>
 
 #include <TileAtlas.hpp>
+#include <TileAtlasArray.hpp>
 
 namespace scratch
 {
-    DataSetTilesLL::DataSetTilesLL(osg::Group * gp_tiles) :
+    namespace
+    {
+        uint32_t const k_no_atlas_layer = std::numeric_limits<uint32_t>::max();
+
+        // Tiles are split into segments of about
+        // k_seg_angle_degs, with at least one per side
+        double const k_seg_angle_degs = 360.0/32.0;
+
+        void CalcTileSegments(GeoBounds const &bounds,
+                              uint32_t &lon_segments,
+                              uint32_t &lat_segments)
+        {
+            lon_segments = std::max((bounds.maxLon-bounds.minLon)/k_seg_angle_degs,1.0);
+            lat_segments = std::max((bounds.maxLat-bounds.minLat)/k_seg_angle_degs,1.0);
+        }
+
+        // Tiles sample their layer of the atlas texture
+        // array; the color modulates the texture like
+        // the fixed function default
+        std::string const k_tile_vert_shader =
+                "#version 120\n"
+                "varying vec2 v_tx;\n"
+                "varying vec4 v_color;\n"
+                "void main()\n"
+                "{\n"
+                "    v_tx = gl_MultiTexCoord0.xy;\n"
+                "    v_color = gl_Color;\n"
+                "    gl_Position = ftransform();\n"
+                "}\n";
+
+        std::string const k_tile_frag_shader =
+                "#version 120\n"
+                "#extension GL_EXT_texture_array : enable\n"
+                "uniform sampler2DArray u_atlas;\n"
+                "uniform float u_layer; // < 0 if the tile has no layer\n"
+                "varying vec2 v_tx;\n"
+                "varying vec4 v_color;\n"
+                "void main()\n"
+                "{\n"
+                "    gl_FragColor = (u_layer < 0.0) ? v_color :\n"
+                "        texture2DArray(u_atlas,vec3(v_tx,u_layer))*v_color;\n"
+                "}\n";
+    }
+
+    DataSetTilesLL::DataSetTilesLL(osg::Group * gp_tiles,
+                                   std::vector<osg::GraphicsContext*> const &list_contexts) :
         m_gp_tiles(gp_tiles)
     {
-        m_tile_atlas.reset(new TileAtlas(1024,1024,256,256));
+        // Use a texture array if every context supports
+        // them, otherwise fall back to 2D atlases
+        bool tx_array_supported = !list_contexts.empty();
+        for(auto gc : list_contexts) {
+            if(!TileAtlasArray::IsSupported(gc)) {
+                tx_array_supported = false;
+                break;
+            }
+        }
+
+        if(tx_array_supported) {
+            TileAtlasArray::Options atlas_options;
+            atlas_options.tile_width_px = 256;
+            atlas_options.tile_height_px = 256;
+            atlas_options.num_contexts = list_contexts.size();
+            m_tile_atlas_array.reset(new TileAtlasArray(atlas_options));
+
+            // All tiles share the atlas texture and program
+            osg::ref_ptr<osg::Program> tile_program = new osg::Program;
+            tile_program->setName("TileAtlasArray");
+            tile_program->addShader(new osg::Shader(osg::Shader::VERTEX,k_tile_vert_shader));
+            tile_program->addShader(new osg::Shader(osg::Shader::FRAGMENT,k_tile_frag_shader));
+
+            osg::StateSet * ss_tiles = m_gp_tiles->getOrCreateStateSet();
+            ss_tiles->setAttributeAndModes(tile_program,osg::StateAttribute::ON);
+            ss_tiles->setTextureAttribute(0,m_tile_atlas_array->GetTexture());
+            ss_tiles->addUniform(new osg::Uniform("u_atlas",0));
+        }
+        else {
+            std::cout << "DataSetTilesLL: WARN: Texture arrays "
+                         "not supported, using 2D atlases" << std::endl;
+
+            // Each tile sets its atlas texture and is
+            // drawn with fixed function texturing
+            m_tile_atlas.reset(new TileAtlas(1024,1024,256,256));
+        }
 
 //        m_tile_atlas->add(281474976710656);
 //        m_tile_atlas->add(281474976710657);
@@ -65,6 +151,7 @@ namespace scratch
         // TileSet
         TileSetLL::Options options;
         options.max_tile_data = 64;
+        options.prefetch_horizon_s = 1.0;
         m_tileset.reset(new TileSetLL(std::move(tile_data_source),
                                       std::move(tile_visibility),
                                       options));
@@ -86,22 +173,29 @@ namespace scratch
 
     void DataSetTilesLL::Update(osg::Camera const * cam)
     {
-        std::vector<TileLL::Id> list_tiles_add;
-        std::vector<TileLL::Id> list_tiles_upd;
-        std::vector<TileLL::Id> list_tiles_rem;
+        // the change lists are kept between updates
+        // so their memory is reused
         m_tileset->UpdateTileSet(cam,
-                                 list_tiles_add,
-                                 list_tiles_upd,
-                                 list_tiles_rem);
+                                 m_list_tiles_add,
+                                 m_list_tiles_upd,
+                                 m_list_tiles_rem);
+
+        if(m_tile_atlas_array) {
+            m_tile_atlas_array->Update();
+        }
 
         // remove
-        for(auto const tile_id : list_tiles_rem) {
+        for(auto const tile_id : m_list_tiles_rem) {
             // find the sg data
             auto sg_it = m_lkup_sg_tiles.find(tile_id);
             SGData &sg_data = sg_it->second;
 
             // remove from texture atlas
-            assert(m_tile_atlas->remove(sg_data.sample_id));
+            if(sg_data.in_atlas) {
+                bool const removed = remAtlasTile(sg_data.sample_id);
+                assert(removed);
+                (void)removed;
+            }
 
             // remove from scene and lookup
             m_gp_tiles->removeChild(sg_data.gp.get());
@@ -109,7 +203,7 @@ namespace scratch
         }
 
         // add
-        for(auto const tile_id : list_tiles_add)
+        for(auto const tile_id : m_list_tiles_add)
         {
             TileSetLL::TileItem const * item =
                     m_tileset->GetTile(tile_id);
@@ -118,27 +212,12 @@ namespace scratch
                     static_cast<TileImageSourceLL::ImageData const*>(
                         item->data);
 
-            osg::Texture2D * atlas_texture;
-            osg::Vec4 atlas_region;
-
-            m_tile_atlas->add(item->sample->id,
-                              data->image,
-                              atlas_texture,
-                              atlas_region);
-
+            osg::Vec4 sample_region(0,0,1,1);
             if(item->sample != item->tile) {
                 // Adjust region against sampled tile
-                osg::Vec4 sample_region;
                 TileSetLL::GenerateSampleTexCoords(item->sample,
                                                    item->tile,
                                                    sample_region);
-
-                sample_region.x() = sample_region.x()*atlas_region.z() + atlas_region.x(); // s_start
-                sample_region.y() = sample_region.y()*atlas_region.w() + atlas_region.y(); // t_start
-                sample_region.z() *= atlas_region.z(); // s_delta
-                sample_region.w() *= atlas_region.w(); // t_delta
-
-                atlas_region = sample_region;
             }
 
             // create geometry and apply texture
@@ -147,9 +226,10 @@ namespace scratch
             if(item->sample) {
                 sg_data.sample_id = item->sample->id;
             }
-            applyAtlasTx(sg_data.gp.get(),
-                         atlas_texture,
-                         atlas_region);
+            sg_data.in_atlas = addAtlasTile(item->sample->id,
+                                            data->image,
+                                            sg_data.gp.get(),
+                                            sample_region);
 
             // save in scene and lookup
             m_lkup_sg_tiles.emplace(item->id,sg_data);
@@ -157,7 +237,7 @@ namespace scratch
         }
 
         // update
-        for(auto tile_id : list_tiles_upd)
+        for(auto tile_id : m_list_tiles_upd)
         {
             TileSetLL::TileItem const * item =
                     m_tileset->GetTile(tile_id);
@@ -173,15 +253,9 @@ namespace scratch
                         static_cast<TileImageSourceLL::ImageData const*>(
                             item->data);
 
-                osg::Texture2D * atlas_texture;
-                osg::Vec4 atlas_region;
-
-                m_tile_atlas->remove(sg_data.sample_id);
-                m_tile_atlas->add(item->sample->id,
-                                  data->image,
-                                  atlas_texture,
-                                  atlas_region);
-
+                if(sg_data.in_atlas) {
+                    remAtlasTile(sg_data.sample_id);
+                }
                 sg_data.sample_id = item->sample->id;
 
                 // Adjust region against sampled tile
@@ -190,17 +264,11 @@ namespace scratch
                                                    item->tile,
                                                    sample_region);
 
-                sample_region.x() = sample_region.x()*atlas_region.z() + atlas_region.x(); // s_start
-                sample_region.y() = sample_region.y()*atlas_region.w() + atlas_region.y(); // t_start
-                sample_region.z() *= atlas_region.z(); // s_delta
-                sample_region.w() *= atlas_region.w(); // t_delta
-
-                atlas_region = sample_region;
-
                 // apply texture changes
-                applyAtlasTx(sg_data.gp.get(),
-                             atlas_texture,
-                             atlas_region);
+                sg_data.in_atlas = addAtlasTile(item->sample->id,
+                                                data->image,
+                                                sg_data.gp.get(),
+                                                sample_region);
             }
         }
     }
@@ -278,8 +346,50 @@ namespace scratch
 //        }
 //    }
 
+    bool DataSetTilesLL::addAtlasTile(TileLL::Id sample_id,
+                                      osg::Image const * image,
+                                      osg::Group * gp,
+                                      osg::Vec4 const &sample_region)
+    {
+        if(m_tile_atlas_array) {
+            uint32_t atlas_layer = 0;
+            if(!m_tile_atlas_array->Add(sample_id,image,atlas_layer)) {
+                // out of layers; the tile is drawn
+                // untextured instead of with another
+                // tile's layer
+                applyAtlasTx(gp,nullptr,k_no_atlas_layer,sample_region);
+                return false;
+            }
+            applyAtlasTx(gp,nullptr,atlas_layer,sample_region);
+            return true;
+        }
+
+        osg::Texture2D * atlas_texture;
+        osg::Vec4 atlas_region;
+        m_tile_atlas->add(sample_id,image,atlas_texture,atlas_region);
+
+        // Adjust region against the tile's atlas slot
+        osg::Vec4 region;
+        region.x() = sample_region.x()*atlas_region.z() + atlas_region.x(); // s_start
+        region.y() = sample_region.y()*atlas_region.w() + atlas_region.y(); // t_start
+        region.z() = sample_region.z()*atlas_region.z(); // s_delta
+        region.w() = sample_region.w()*atlas_region.w(); // t_delta
+
+        applyAtlasTx(gp,atlas_texture,0,region);
+        return true;
+    }
+
+    bool DataSetTilesLL::remAtlasTile(TileLL::Id sample_id)
+    {
+        if(m_tile_atlas_array) {
+            return m_tile_atlas_array->Remove(sample_id);
+        }
+        return m_tile_atlas->remove(sample_id);
+    }
+
     void DataSetTilesLL::applyAtlasTx(osg::Group *gp,
-                                      osg::Texture2D *atlas_texture,
+                                      osg::Texture2D * atlas_texture,
+                                      uint32_t atlas_layer,
                                       osg::Vec4 const &atlas_region)
     {
         // create the texture coordinates (expect that
@@ -297,8 +407,6 @@ namespace scratch
         osg::ref_ptr<osg::Vec2dArray> tx_array_sample =
                 new osg::Vec2dArray;
 
-//        std::cout << "atlas_region: " << atlas_region << std::endl;
-
         for(size_t i=0; i < tx_array_full->size(); i++) {
             osg::Vec2d tx = tx_array_full->at(i);
             tx.x() = (tx.x()*atlas_region.z()) + atlas_region.x();
@@ -309,8 +417,19 @@ namespace scratch
 
         gm->setTexCoordArray(0,tx_array_sample,osg::Array::BIND_PER_VERTEX);
 
-        // apply the texture
-        gd->getOrCreateStateSet()->setTextureAttributeAndModes(0,atlas_texture);
+        if(atlas_texture) {
+            // 2D atlas: apply the tile's atlas texture
+            gd->getOrCreateStateSet()->setTextureAttributeAndModes(0,atlas_texture);
+        }
+        else {
+            // select the atlas layer; the texture
+            // itself is shared by all tiles
+            float const layer = (atlas_layer == k_no_atlas_layer) ?
+                        -1.0f : float(atlas_layer);
+
+            gd->getOrCreateStateSet()->getOrCreateUniform(
+                        "u_layer",osg::Uniform::FLOAT)->set(layer);
+        }
     }
 
     void DataSetTilesLL::applyTileTx(TileSetLL::TileItem const * tile_item,
@@ -390,51 +509,39 @@ namespace scratch
     //            std::max(static_cast<uint32_t>(lon_segments/2),
     //                     static_cast<uint32_t>(1));
 
-        double const min_angle_degs = 360.0/32.0;
-        uint32_t lon_segments = std::max((tile->bounds.maxLon-tile->bounds.minLon)/min_angle_degs,1.0);
-        uint32_t lat_segments = std::max((tile->bounds.maxLat-tile->bounds.minLat)/min_angle_degs,1.0);
-
-        std::vector<osg::Vec3d> list_vx;
-        std::vector<osg::Vec2d> list_tx;
-        std::vector<uint16_t> list_ix;
-        BuildEarthSurface(tile->bounds.minLon,
-                          tile->bounds.maxLon,
-                          tile->bounds.minLat,
-                          tile->bounds.maxLat,
-                          lon_segments,
-                          lat_segments,
-                          list_vx,
-                          list_tx,
-                          list_ix);
-
-        osg::ref_ptr<osg::Vec3dArray> vx_array = new osg::Vec3dArray;
-        vx_array->reserve(list_vx.size());
-        for(auto const &vx : list_vx) {
-            vx_array->push_back(vx);
+        uint32_t lon_segments,lat_segments;
+        CalcTileSegments(tile->bounds,lon_segments,lat_segments);
+
+        // Skirts hide the cracks between this tile and
+        // coarser neighbours. TileSetLL doesn't balance
+        // levels so a neighbour can be at any coarser
+        // level; tiles at an ancestor's level have the
+        // ancestor's segments, so the skirt covers the
+        // longest segment of any ancestor.
+        double max_seg_angle_degs = 0.0;
+        for(TileLL const * anc = tile->parent; anc != nullptr; anc = anc->parent) {
+            uint32_t anc_lon_segments,anc_lat_segments;
+            CalcTileSegments(anc->bounds,anc_lon_segments,anc_lat_segments);
+
+            max_seg_angle_degs = std::max(max_seg_angle_degs,std::max(
+                    (anc->bounds.maxLon-anc->bounds.minLon)/anc_lon_segments,
+                    (anc->bounds.maxLat-anc->bounds.minLat)/anc_lat_segments));
         }
 
-        osg::ref_ptr<osg::Vec2dArray> tx_array = new osg::Vec2dArray;
-        tx_array->reserve(list_tx.size());
-        for(auto const &tx : list_tx) {
-            tx_array->push_back(tx);
-        }
+        double const skirt_height_m =
+                TileMeshBuilder::CalcSkirtHeight(max_seg_angle_degs);
+
+        osg::Vec3d center;
+        osg::ref_ptr<osg::Geometry> gm =
+                m_mesh_builder.BuildSurface(tile->bounds,
+                                            lon_segments,
+                                            lat_segments,
+                                            center,
+                                            skirt_height_m);
 
         osg::ref_ptr<osg::Vec4Array>  cx_array = new osg::Vec4Array;
         cx_array->push_back(K_COLOR_TABLE[tile->level]);
-
-        osg::ref_ptr<osg::DrawElementsUShort> ix_array =
-                new osg::DrawElementsUShort(GL_TRIANGLES);
-        ix_array->reserve(list_ix.size());
-        for(auto ix : list_ix) {
-            ix_array->push_back(ix);
-        }
-
-        osg::ref_ptr<osg::Geometry> gm = new osg::Geometry;
-        gm->setVertexArray(vx_array);
-        gm->setTexCoordArray(0,tx_array,osg::Array::BIND_PER_VERTEX);
-        gm->setTexCoordArray(1,tx_array,osg::Array::BIND_PER_VERTEX);
         gm->setColorArray(cx_array,osg::Array::BIND_OVERALL);
-        gm->addPrimitiveSet(ix_array);
 
         osg::ref_ptr<osg::Geode> gd = new osg::Geode;
         gd->addDrawable(gm);
@@ -450,7 +557,9 @@ namespace scratch
 //                    m_poly_mode,
 //                    osg::StateAttribute::ON);
 
-        osg::ref_ptr<osg::Group> gp = new osg::Group;
+        // the mesh vertices are relative to the tile center
+        osg::ref_ptr<osg::MatrixTransform> gp = new osg::MatrixTransform;
+        gp->setMatrix(osg::Matrixd::translate(center));
         gp->addChild(gd);
 
         return gp;
@@ -18,18 +18,24 @@
 #define SCRATCH_DATASET_TILES_LL_H
 
 #include <TileSetLL.h>
+#include <TileMeshBuilder.h>
 #include <osg/PolygonMode>
 
 #include <osg/Texture2D>
+#include <osg/GraphicsContext>
 
 namespace scratch
 {
     class TileAtlas;
+    class TileAtlasArray;
 
     class DataSetTilesLL
     {
     public:
-        DataSetTilesLL(osg::Group * gp_tiles);
+        // list_contexts are the graphics contexts the
+        // tiles are drawn in
+        DataSetTilesLL(osg::Group * gp_tiles,
+                       std::vector<osg::GraphicsContext*> const &list_contexts);
 
         ~DataSetTilesLL();
 
@@ -42,8 +48,13 @@ namespace scratch
         // scene graph
         struct SGData
         {
+            SGData() :
+                in_atlas(false)
+            {}
+
             osg::ref_ptr<osg::Group> gp;
             TileLL::Id sample_id;
+            bool in_atlas; // sample_id was added to the atlas
         };
 
         //
@@ -53,19 +64,37 @@ namespace scratch
         void applyTileTx(TileSetLL::TileItem const * tile_item,
                          osg::Group * gp);
 
+        bool addAtlasTile(TileLL::Id sample_id,
+                          osg::Image const * image,
+                          osg::Group * gp,
+                          osg::Vec4 const &sample_region);
+
+        bool remAtlasTile(TileLL::Id sample_id);
+
         void applyAtlasTx(osg::Group * gp,
                           osg::Texture2D * atlas_texture,
+                          uint32_t atlas_layer,
                           osg::Vec4 const &atlas_region);
 
         //
         std::unique_ptr<TileSetLL> m_tileset;
 
+        // Only one of the atlases is used; the 2D atlas
+        // is the fallback for when texture arrays aren't
+        // supported by every context
+        std::unique_ptr<TileAtlasArray> m_tile_atlas_array;
         std::unique_ptr<TileAtlas> m_tile_atlas;
 
+        TileMeshBuilder m_mesh_builder;
+
         osg::Group * m_gp_tiles;
         osg::ref_ptr<osg::PolygonMode> m_poly_mode;
         std::map<TileLL::Id,SGData> m_lkup_sg_tiles;
 
+        std::vector<TileLL::Id> m_list_tiles_add;
+        std::vector<TileLL::Id> m_list_tiles_upd;
+        std::vector<TileLL::Id> m_list_tiles_rem;
+
         size_t m_tile_count;
     };
 }
@@ -22,53 +22,70 @@
 
 LLA ConvECEFToLLA(const osg::Vec3d &pointECEF)
 {
-    double radius = pointECEF.length();
-
     LLA pointLLA;
-    pointLLA.lon = (atan2(pointECEF.y(),pointECEF.x()))*K_RAD2DEG;
-    pointLLA.lat = (asin(pointECEF.z()/radius))*K_RAD2DEG;
-    pointLLA.alt = radius-RAD_AV;
+    geodesy::ConvECEFToLLA(pointECEF.x(),
+                           pointECEF.y(),
+                           pointECEF.z(),
+                           pointLLA.lon,
+                           pointLLA.lat,
+                           pointLLA.alt,
+                           geodesy::SPHERE_AV);
 
     return pointLLA;
 }
 
 osg::Vec3d ConvLLAToECEF(const LLA &pointLLA)
 {
-    // remember to convert deg->rad
-    double sinLat = sin(pointLLA.lat * K_DEG2RAD);
-    double sinLon = sin(pointLLA.lon * K_DEG2RAD);
-    double cosLat = cos(pointLLA.lat * K_DEG2RAD);
-    double cosLon = cos(pointLLA.lon * K_DEG2RAD);
-    double radius = RAD_AV+pointLLA.alt;
-
     osg::Vec3d pointECEF;
-    pointECEF.x() = cosLat * cosLon * radius;
-    pointECEF.y() = cosLat * sinLon * radius;
-    pointECEF.z() = sinLat * radius;
+    geodesy::ConvLLAToECEF(pointLLA.lon,
+                           pointLLA.lat,
+                           pointLLA.alt,
+                           pointECEF.x(),
+                           pointECEF.y(),
+                           pointECEF.z(),
+                           geodesy::SPHERE_AV);
 
     return pointECEF;
 }
 
 std::vector<LLA> ConvListECEFToLLA(std::vector<osg::Vec3d> const &list_ecef)
 {
-    std::vector<LLA> list_lla;
-    list_lla.reserve(list_ecef.size());
-
-    for(auto const &ecef : list_ecef) {
-        list_lla.push_back(ConvECEFToLLA(ecef));
-    }
+    std::vector<LLA> list_lla(list_ecef.size());
+    if(list_ecef.empty()) {
+        return list_lla;
+    }
+
+    geodesy::ConvECEFToLLA(list_ecef.size(),
+                           list_ecef[0].ptr(),
+                           list_ecef[0].ptr()+1,
+                           list_ecef[0].ptr()+2,
+                           3,
+                           &(list_lla[0].lon),
+                           &(list_lla[0].lat),
+                           &(list_lla[0].alt),
+                           sizeof(LLA)/sizeof(double),
+                           geodesy::SPHERE_AV);
 
     return list_lla;
 }
 
 std::vector<osg::Vec3d> ConvListLLAToECEF(std::vector<LLA> const &list_lla)
 {
-    std::vector<osg::Vec3d> list_ecef;
-    list_ecef.reserve(list_lla.size());
-
-    for(auto const &lla : list_lla) {
-        list_ecef.push_back(ConvLLAToECEF(lla));
-    }
+    std::vector<osg::Vec3d> list_ecef(list_lla.size());
+    if(list_lla.empty()) {
+        return list_ecef;
+    }
+
+    geodesy::ConvLLAToECEF(list_lla.size(),
+                           &(list_lla[0].lon),
+                           &(list_lla[0].lat),
+                           &(list_lla[0].alt),
+                           sizeof(LLA)/sizeof(double),
+                           list_ecef[0].ptr(),
+                           list_ecef[0].ptr()+1,
+                           list_ecef[0].ptr()+2,
+                           3,
+                           geodesy::SPHERE_AV);
 
     return list_ecef;
 }
@@ -29,6 +29,8 @@
 #include <osg/io_utils>
 #include <osg/Camera>
 
+#include <geodesy.hpp>
+
 // ============================================================= //
 // ============================================================= //
 
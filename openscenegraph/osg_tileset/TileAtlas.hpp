@@ -1,7 +1,11 @@
 #include <osg/Vec4>
 #include <osgDB/ReadFile>
 #include <osg/Texture2D>
+#include <osg/BufferObject>
+#include <osg/buffered_value>
 #include <list>
+#include <mutex>
+#include <cstring>
 
 
 namespace scratch
@@ -18,6 +22,254 @@ namespace scratch
     typedef int32_t s32;
     typedef int64_t s64;
 
+    // Uploads only the atlas slots that have changed
+    // instead of the whole atlas image. The atlas image
+    // is kept as the CPU copy; tiles are written to it
+    // through CopyTile() and the next time the texture is
+    // applied for a context, dirty slots are uploaded with
+    // one glTexSubImage2D call per run of adjacent slots
+    // in a row.
+    // * If pixel buffer objects are supported, changed
+    //   slots are staged through a small ring of PBOs so
+    //   the copy to the texture doesn't stall the draw
+    // * PBOs aren't released until their context is
+    class AtlasSubloadCallback : public osg::Texture2D::SubloadCallback
+    {
+    public:
+        AtlasSubloadCallback(osg::Image * image,
+                             uint cols,
+                             uint rows,
+                             uint tile_width_px,
+                             uint tile_height_px) :
+            m_image(image),
+            m_cols(cols),
+            m_rows(rows),
+            m_tile_width_px(tile_width_px),
+            m_tile_height_px(tile_height_px)
+        {
+            // empty
+        }
+
+        // Copies a tile into the atlas image at the
+        // given slot and marks the slot for upload
+        void CopyTile(uint col, uint row, osg::Image const * tile_image)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_image->copySubImage(col*m_tile_width_px,
+                                  row*m_tile_height_px,0,
+                                  tile_image);
+
+            for(uint i=0; i < m_list_ctx_data.size(); i++) {
+                ContextData &ctx_data = m_list_ctx_data[i];
+                if(!ctx_data.loaded) {
+                    // will get the whole image on load
+                    continue;
+                }
+
+                u8 &dirty = ctx_data.list_dirty[row*m_cols + col];
+                if(!dirty) {
+                    dirty = 1;
+                    ctx_data.num_dirty++;
+                }
+            }
+        }
+
+        void load(osg::Texture2D const &texture,
+                  osg::State &state) const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            ContextData &ctx_data = m_list_ctx_data[state.getContextID()];
+            ctx_data.list_dirty.assign(m_cols*m_rows,0);
+            ctx_data.num_dirty = 0;
+            ctx_data.loaded = true;
+
+            glPixelStorei(GL_UNPACK_ALIGNMENT,m_image->getPacking());
+            glTexImage2D(GL_TEXTURE_2D,0,
+                         texture.getInternalFormat(),
+                         m_image->s(),
+                         m_image->t(),0,
+                         m_image->getPixelFormat(),
+                         m_image->getDataType(),
+                         m_image->data());
+        }
+
+        void subload(osg::Texture2D const &,
+                     osg::State &state) const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            ContextData &ctx_data = m_list_ctx_data[state.getContextID()];
+            if(ctx_data.num_dirty == 0) {
+                return;
+            }
+
+            // Collect runs of adjacent dirty slots
+            m_list_runs.clear();
+            for(uint r=0; r < m_rows; r++) {
+                u8 * row_dirty = &(ctx_data.list_dirty[r*m_cols]);
+                for(uint c=0; c < m_cols; c++) {
+                    if(!row_dirty[c]) {
+                        continue;
+                    }
+                    Run run;
+                    run.col = c;
+                    run.row = r;
+                    run.cols = 0;
+                    while(c < m_cols && row_dirty[c]) {
+                        row_dirty[c] = 0;
+                        run.cols++;
+                        c++;
+                    }
+                    m_list_runs.push_back(run);
+                }
+            }
+            ctx_data.num_dirty = 0;
+
+            glPixelStorei(GL_UNPACK_ALIGNMENT,m_image->getPacking());
+
+            if(!subloadPBO(ctx_data,state.getContextID())) {
+                // Upload straight from the atlas image
+                glPixelStorei(GL_UNPACK_ROW_LENGTH,m_image->s());
+                for(auto const &run : m_list_runs) {
+                    uint const x = run.col*m_tile_width_px;
+                    uint const y = run.row*m_tile_height_px;
+
+                    glTexSubImage2D(GL_TEXTURE_2D,0,x,y,
+                                    run.cols*m_tile_width_px,
+                                    m_tile_height_px,
+                                    m_image->getPixelFormat(),
+                                    m_image->getDataType(),
+                                    m_image->data(x,y));
+                }
+                glPixelStorei(GL_UNPACK_ROW_LENGTH,0);
+            }
+        }
+
+    private:
+        static uint const k_pbo_ring_size = 3;
+
+        struct Run
+        {
+            uint col;
+            uint row;
+            uint cols;
+        };
+
+        struct ContextData
+        {
+            ContextData() :
+                loaded(false),
+                num_dirty(0),
+                pbo_idx(0)
+            {
+                for(uint i=0; i < k_pbo_ring_size; i++) {
+                    list_pbos[i] = 0;
+                    list_pbo_sizes[i] = 0;
+                }
+            }
+
+            bool loaded;
+            std::vector<u8> list_dirty;
+            uint num_dirty;
+
+            GLuint list_pbos[k_pbo_ring_size];
+            size_t list_pbo_sizes[k_pbo_ring_size];
+            uint pbo_idx;
+        };
+
+        bool subloadPBO(ContextData &ctx_data,
+                        uint context_id) const
+        {
+            osg::GLBufferObject::Extensions * ext =
+                    osg::GLBufferObject::getExtensions(context_id,true);
+
+            if(!ext->isPBOSupported()) {
+                return false;
+            }
+
+            size_t const row_bytes = m_image->getRowSizeInBytes();
+            size_t const px_bytes = row_bytes/m_image->s();
+            size_t const tile_row_bytes = m_tile_width_px*px_bytes;
+
+            size_t size = 0;
+            for(auto const &run : m_list_runs) {
+                size += run.cols*tile_row_bytes*m_tile_height_px;
+            }
+
+            // Use the next buffer in the ring so we
+            // don't write to one that may still be
+            // in use by an earlier upload
+            uint const idx = ctx_data.pbo_idx;
+            ctx_data.pbo_idx = (ctx_data.pbo_idx+1)%k_pbo_ring_size;
+
+            GLuint &pbo = ctx_data.list_pbos[idx];
+            if(pbo == 0) {
+                ext->glGenBuffers(1,&pbo);
+            }
+
+            ext->glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB,pbo);
+            if(ctx_data.list_pbo_sizes[idx] < size) {
+                ctx_data.list_pbo_sizes[idx] = size;
+            }
+
+            // Orphan the old storage
+            ext->glBufferData(GL_PIXEL_UNPACK_BUFFER_ARB,
+                              ctx_data.list_pbo_sizes[idx],
+                              nullptr,
+                              GL_STREAM_DRAW_ARB);
+
+            u8 * staging = static_cast<u8*>(
+                        ext->glMapBuffer(GL_PIXEL_UNPACK_BUFFER_ARB,
+                                         GL_WRITE_ONLY_ARB));
+            if(staging == nullptr) {
+                ext->glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB,0);
+                return false;
+            }
+
+            // Pack each run tightly into the buffer
+            size_t offset = 0;
+            for(auto const &run : m_list_runs) {
+                size_t const run_row_bytes = run.cols*tile_row_bytes;
+                uint const x = run.col*m_tile_width_px;
+                uint const y = run.row*m_tile_height_px;
+
+                for(uint i=0; i < m_tile_height_px; i++) {
+                    memcpy(staging+offset,m_image->data(x,y+i),run_row_bytes);
+                    offset += run_row_bytes;
+                }
+            }
+            ext->glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER_ARB);
+
+            offset = 0;
+            for(auto const &run : m_list_runs) {
+                glTexSubImage2D(GL_TEXTURE_2D,0,
+                                run.col*m_tile_width_px,
+                                run.row*m_tile_height_px,
+                                run.cols*m_tile_width_px,
+                                m_tile_height_px,
+                                m_image->getPixelFormat(),
+                                m_image->getDataType(),
+                                reinterpret_cast<GLvoid*>(offset));
+
+                offset += run.cols*tile_row_bytes*m_tile_height_px;
+            }
+
+            ext->glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB,0);
+            return true;
+        }
+
+        osg::ref_ptr<osg::Image> m_image;
+        uint const m_cols;
+        uint const m_rows;
+        uint const m_tile_width_px;
+        uint const m_tile_height_px;
+
+        mutable std::mutex m_mutex;
+        mutable osg::buffered_object<ContextData> m_list_ctx_data;
+        mutable std::vector<Run> m_list_runs;
+    };
+
 
     class TileAtlas
     {
@@ -67,9 +319,19 @@ namespace scratch
                 image = new osg::Image;
                 image->allocateImage(width,height,1,GL_RGBA,GL_UNSIGNED_BYTE);
 
-                // create texture
+                // create texture; the image isn't set on the
+                // texture so osg never uploads the whole image
+                // when it changes, the subload callback uploads
+                // only the slots that have been modified
+                subload = new AtlasSubloadCallback(image.get(),
+                                                   cols,rows,
+                                                   width/cols,
+                                                   height/rows);
+
                 texture = new osg::Texture2D;
-                texture->setImage(image.get());
+                texture->setTextureSize(width,height);
+                texture->setInternalFormat(GL_RGBA);
+                texture->setSubloadCallback(subload.get());
                 texture->setFilter(osg::Texture2D::MIN_FILTER,osg::Texture2D::LINEAR);
                 texture->setFilter(osg::Texture2D::MAG_FILTER,osg::Texture2D::LINEAR);
                 texture->setWrap(osg::Texture2D::WRAP_S,osg::Texture2D::CLAMP_TO_EDGE);
@@ -80,6 +342,7 @@ namespace scratch
             std::vector<Space> list_spaces;
             osg::ref_ptr<osg::Image> image;
             osg::ref_ptr<osg::Texture2D> texture;
+            osg::ref_ptr<AtlasSubloadCallback> subload;
         };
 
     public:
@@ -165,12 +428,7 @@ namespace scratch
 
                 // update texture
                 if(tile_image != nullptr) {
-                    uint s = space.col*m_tile_width_px;
-                    uint t = space.row*m_tile_height_px;
-                    uint r = 0;
-
-                    atlas_it->image->copySubImage(s,t,r,tile_image);
-                    atlas_it->image->dirty();
+                    atlas_it->subload->CopyTile(space.col,space.row,tile_image);
                 }
 
                 // save lookup
@@ -214,11 +472,10 @@ namespace scratch
                 // make this space available again
 
                 // DEBUG update texture
-                atlas_it->image->copySubImage(
-                            space.col*m_tile_width_px,
-                            space.row*m_tile_height_px,0,
-                            m_noise_tile.get());
-                atlas_it->image->dirty();
+                if(m_noise_tile.valid()) {
+                    atlas_it->subload->CopyTile(space.col,space.row,
+                                                m_noise_tile.get());
+                }
 
                 space.id = 0;
                 atlas_it->list_avail.push_back(lkup_it->second.second);
@@ -0,0 +1,631 @@
+/*
+   Copyright (C) 2014 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef SCRATCH_TILE_ATLAS_ARRAY_HPP
+#define SCRATCH_TILE_ATLAS_ARRAY_HPP
+
+#include <list>
+#include <mutex>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <unordered_map>
+
+#include <osg/Texture2DArray>
+#include <osg/FrameBufferObject>
+#include <osg/GraphicsContext>
+#include <osg/buffered_value>
+
+#ifndef GL_READ_FRAMEBUFFER_BINDING_EXT
+#define GL_READ_FRAMEBUFFER_BINDING_EXT 0x8CAA
+#endif
+
+namespace scratch
+{
+    // Uploads the layers of a TileAtlasArray that have
+    // changed since the texture was last applied.
+    // * a layer's image is only kept until all num_contexts
+    //   contexts have loaded the texture and uploaded it; a
+    //   null image clears the layer so a recycled layer
+    //   doesn't show the texels of its previous tile
+    // * resizing doesn't recreate the texture object, each
+    //   context reallocates the storage in place and copies
+    //   the layers it already has across on the GPU
+    class TileAtlasArraySubloadCallback :
+            public osg::Texture2DArray::SubloadCallback
+    {
+    public:
+        TileAtlasArraySubloadCallback(uint32_t tile_width_px,
+                                      uint32_t tile_height_px,
+                                      uint32_t num_contexts) :
+            m_tile_width_px(tile_width_px),
+            m_tile_height_px(tile_height_px),
+            m_num_contexts(std::max(num_contexts,uint32_t(1))),
+            m_num_layers(0),
+            m_list_clear_px(tile_width_px*tile_height_px*4,0)
+        {
+            // empty
+        }
+
+        void SetNumLayers(uint32_t num_layers)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_num_layers = num_layers;
+
+            // Drop any uploads to layers that were released
+            for(auto it = m_lkup_pending.begin(); it != m_lkup_pending.end();) {
+                if(it->first >= num_layers) {
+                    it = m_lkup_pending.erase(it);
+                }
+                else {
+                    ++it;
+                }
+            }
+
+            for(uint32_t i=0; i < m_list_ctx_data.size(); i++) {
+                ContextData &ctx_data = m_list_ctx_data[i];
+                if(!ctx_data.loaded) {
+                    continue;
+                }
+                ctx_data.list_dirty_layers.erase(
+                            std::remove_if(ctx_data.list_dirty_layers.begin(),
+                                           ctx_data.list_dirty_layers.end(),
+                                           [num_layers](uint32_t layer) {
+                                               return layer >= num_layers;
+                                           }),
+                            ctx_data.list_dirty_layers.end());
+                ctx_data.list_dirty.resize(num_layers,0);
+            }
+        }
+
+        void SetLayerImage(uint32_t layer, osg::Image const * image)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_lkup_pending[layer] = image;
+
+            for(uint32_t i=0; i < m_list_ctx_data.size(); i++) {
+                ContextData &ctx_data = m_list_ctx_data[i];
+                if(ctx_data.loaded && !ctx_data.list_dirty[layer]) {
+                    ctx_data.list_dirty[layer] = 1;
+                    ctx_data.list_dirty_layers.push_back(layer);
+                }
+            }
+        }
+
+        void load(osg::Texture2DArray const &texture,
+                  osg::State &state) const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            uint32_t const context_id = state.getContextID();
+            osg::Texture2DArray::Extensions * ext =
+                    osg::Texture2DArray::getExtensions(context_id,true);
+
+            ContextData &ctx_data = m_list_ctx_data[context_id];
+            ctx_data.list_dirty.assign(m_num_layers,0);
+            ctx_data.list_dirty_layers.clear();
+            ctx_data.num_layers = m_num_layers;
+            ctx_data.loaded = true;
+
+            allocStorage(ext,texture,m_num_layers);
+
+            for(auto const &layer_image : m_lkup_pending) {
+                uploadLayer(ext,layer_image.first,layer_image.second.get());
+            }
+            releaseUploaded();
+        }
+
+        void subload(osg::Texture2DArray const &texture,
+                     osg::State &state) const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            uint32_t const context_id = state.getContextID();
+            ContextData &ctx_data = m_list_ctx_data[context_id];
+            if(ctx_data.num_layers == m_num_layers &&
+               ctx_data.list_dirty_layers.empty()) {
+                return;
+            }
+
+            osg::Texture2DArray::Extensions * ext =
+                    osg::Texture2DArray::getExtensions(context_id,true);
+
+            if(ctx_data.num_layers != m_num_layers) {
+                resizeStorage(ext,texture,context_id,ctx_data);
+            }
+
+            for(auto layer : ctx_data.list_dirty_layers) {
+                ctx_data.list_dirty[layer] = 0;
+                uploadLayer(ext,layer,m_lkup_pending[layer].get());
+            }
+            ctx_data.list_dirty_layers.clear();
+            releaseUploaded();
+        }
+
+    private:
+        struct ContextData
+        {
+            ContextData() :
+                loaded(false),
+                num_layers(0)
+            {}
+
+            bool loaded;
+            uint32_t num_layers;
+            std::vector<uint8_t> list_dirty;
+            std::vector<uint32_t> list_dirty_layers;
+        };
+
+        void allocStorage(osg::Texture2DArray::Extensions * ext,
+                          osg::Texture2DArray const &texture,
+                          uint32_t num_layers) const
+        {
+            ext->glTexImage3D(GL_TEXTURE_2D_ARRAY_EXT,0,
+                              texture.getInternalFormat(),
+                              m_tile_width_px,
+                              m_tile_height_px,
+                              num_layers,0,
+                              GL_RGBA,GL_UNSIGNED_BYTE,
+                              nullptr);
+        }
+
+        // Reallocates the storage of the bound texture object
+        // for the current number of layers. The layers that are
+        // kept are copied out to a temporary texture and back
+        // again through a read framebuffer.
+        void resizeStorage(osg::Texture2DArray::Extensions * ext,
+                           osg::Texture2DArray const &texture,
+                           uint32_t context_id,
+                           ContextData &ctx_data) const
+        {
+            osg::FBOExtensions * fbo_ext =
+                    osg::FBOExtensions::instance(context_id,true);
+
+            GLuint const tx_id = texture.getTextureObject(context_id)->id();
+            uint32_t const num_copy = std::min(ctx_data.num_layers,m_num_layers);
+
+            GLuint tmp_tx_id = 0;
+            if(num_copy > 0) {
+                if(fbo_ext->isSupported()) {
+                    glGenTextures(1,&tmp_tx_id);
+                    glBindTexture(GL_TEXTURE_2D_ARRAY_EXT,tmp_tx_id);
+                    allocStorage(ext,texture,num_copy);
+                    copyLayers(ext,fbo_ext,tx_id,num_copy);
+                    glBindTexture(GL_TEXTURE_2D_ARRAY_EXT,tx_id);
+                }
+                else {
+                    std::cout << "TileAtlasArray: ERROR: "
+                                 "Can't copy layers without FBOs" << std::endl;
+                }
+            }
+
+            allocStorage(ext,texture,m_num_layers);
+
+            if(tmp_tx_id != 0) {
+                copyLayers(ext,fbo_ext,tmp_tx_id,num_copy);
+                glDeleteTextures(1,&tmp_tx_id);
+            }
+
+            ctx_data.num_layers = m_num_layers;
+            ctx_data.list_dirty.resize(m_num_layers,0);
+        }
+
+        // Copies the first num_layers layers of src_tx_id
+        // into the texture array that's currently bound
+        void copyLayers(osg::Texture2DArray::Extensions * ext,
+                        osg::FBOExtensions * fbo_ext,
+                        GLuint src_tx_id,
+                        uint32_t num_layers) const
+        {
+            GLint prev_fbo = 0;
+            glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING_EXT,&prev_fbo);
+
+            GLuint fbo = 0;
+            fbo_ext->glGenFramebuffers(1,&fbo);
+            fbo_ext->glBindFramebuffer(GL_READ_FRAMEBUFFER_EXT,fbo);
+
+            for(uint32_t i=0; i < num_layers; i++) {
+                fbo_ext->glFramebufferTextureLayer(GL_READ_FRAMEBUFFER_EXT,
+                                                   GL_COLOR_ATTACHMENT0_EXT,
+                                                   src_tx_id,0,i);
+
+                ext->glCopyTexSubImage3D(GL_TEXTURE_2D_ARRAY_EXT,0,
+                                         0,0,i,0,0,
+                                         m_tile_width_px,
+                                         m_tile_height_px);
+            }
+
+            fbo_ext->glBindFramebuffer(GL_READ_FRAMEBUFFER_EXT,prev_fbo);
+            fbo_ext->glDeleteFramebuffers(1,&fbo);
+        }
+
+        void uploadLayer(osg::Texture2DArray::Extensions * ext,
+                         uint32_t layer,
+                         osg::Image const * image) const
+        {
+            if(image == nullptr) {
+                glPixelStorei(GL_UNPACK_ALIGNMENT,4);
+                ext->glTexSubImage3D(GL_TEXTURE_2D_ARRAY_EXT,0,
+                                     0,0,layer,
+                                     m_tile_width_px,
+                                     m_tile_height_px,1,
+                                     GL_RGBA,GL_UNSIGNED_BYTE,
+                                     &(m_list_clear_px[0]));
+                return;
+            }
+
+            // The image's own pixel format is used so
+            // ie RGB tiles are expanded by the driver
+            glPixelStorei(GL_UNPACK_ALIGNMENT,image->getPacking());
+            ext->glTexSubImage3D(GL_TEXTURE_2D_ARRAY_EXT,0,
+                                 0,0,layer,
+                                 m_tile_width_px,
+                                 m_tile_height_px,1,
+                                 image->getPixelFormat(),
+                                 image->getDataType(),
+                                 image->data());
+        }
+
+        // Drops the images that every context has uploaded
+        void releaseUploaded() const
+        {
+            uint32_t num_loaded = 0;
+            for(uint32_t i=0; i < m_list_ctx_data.size(); i++) {
+                if(m_list_ctx_data[i].loaded) {
+                    num_loaded++;
+                }
+            }
+            if(num_loaded < m_num_contexts) {
+                return;
+            }
+
+            for(auto it = m_lkup_pending.begin(); it != m_lkup_pending.end();) {
+                bool uploaded = true;
+                for(uint32_t i=0; i < m_list_ctx_data.size(); i++) {
+                    ContextData const &ctx_data = m_list_ctx_data[i];
+                    if(ctx_data.loaded && ctx_data.list_dirty[it->first]) {
+                        uploaded = false;
+                        break;
+                    }
+                }
+
+                if(uploaded) {
+                    it = m_lkup_pending.erase(it);
+                }
+                else {
+                    ++it;
+                }
+            }
+        }
+
+        uint32_t const m_tile_width_px;
+        uint32_t const m_tile_height_px;
+        uint32_t const m_num_contexts;
+
+        mutable std::mutex m_mutex;
+        uint32_t m_num_layers;
+        std::vector<uint8_t> const m_list_clear_px;
+
+        // layer images waiting to be uploaded
+        mutable std::unordered_map<uint32_t,osg::ref_ptr<osg::Image const>> m_lkup_pending;
+        mutable osg::buffered_object<ContextData> m_list_ctx_data;
+    };
+
+    // ============================================================= //
+
+    // Tile atlas backed by a single texture array where
+    // each layer holds one tile.
+    // * layers are allocated from a free stack and tile
+    //   ids are looked up with a hash map
+    // * a layer whose tile is no longer referenced keeps
+    //   its texels and goes into an LRU list; if the tile
+    //   is added again before the layer is recycled it's
+    //   reused without another upload
+    // * the array grows by 'layers_per_chunk' when there are
+    //   no free or cached layers, and only shrinks after
+    //   usage has stayed low for 'release_updates' calls to
+    //   Update() so a view that moves back and forth doesn't
+    //   keep reallocating the texture
+    // * 'num_contexts' is the number of graphics contexts
+    //   the texture is drawn in; tile images are kept until
+    //   all of them have uploaded it
+    class TileAtlasArray
+    {
+    public:
+        struct Options
+        {
+            Options() :
+                tile_width_px(256),
+                tile_height_px(256),
+                layers_per_chunk(32),
+                max_layers(512),
+                release_updates(300),
+                num_contexts(1)
+            {}
+
+            uint32_t tile_width_px;
+            uint32_t tile_height_px;
+            uint32_t layers_per_chunk;
+            uint32_t max_layers;
+            uint32_t release_updates;
+            uint32_t num_contexts;
+        };
+
+        TileAtlasArray(Options const &options) :
+            m_opts(options),
+            m_num_used(0),
+            m_low_usage_updates(0)
+        {
+            m_subload = new TileAtlasArraySubloadCallback(
+                        m_opts.tile_width_px,
+                        m_opts.tile_height_px,
+                        m_opts.num_contexts);
+
+            m_texture = new osg::Texture2DArray;
+            m_texture->setInternalFormat(GL_RGBA);
+            m_texture->setFilter(osg::Texture::MIN_FILTER,osg::Texture::LINEAR);
+            m_texture->setFilter(osg::Texture::MAG_FILTER,osg::Texture::LINEAR);
+            m_texture->setWrap(osg::Texture::WRAP_S,osg::Texture::CLAMP_TO_EDGE);
+            m_texture->setWrap(osg::Texture::WRAP_T,osg::Texture::CLAMP_TO_EDGE);
+            m_texture->setSubloadCallback(m_subload.get());
+
+            // The texture's size is left as it was created;
+            // resizing is done by the subload callback so
+            // osg keeps the same texture object
+            m_texture->setTextureSize(m_opts.tile_width_px,
+                                      m_opts.tile_height_px,
+                                      m_opts.layers_per_chunk);
+
+            resize(m_opts.layers_per_chunk);
+        }
+
+        // Returns true if gc supports texture arrays and
+        // the FBOs used to resize them; gc must be realized
+        static bool IsSupported(osg::GraphicsContext * gc)
+        {
+            if(gc == nullptr || !gc->makeCurrent()) {
+                return false;
+            }
+
+            uint32_t const context_id = gc->getState()->getContextID();
+            bool const supported =
+                    osg::Texture2DArray::getExtensions(context_id,true)->
+                        isTexture2DArraySupported() &&
+                    osg::FBOExtensions::instance(context_id,true)->
+                        isSupported();
+
+            gc->releaseContext();
+            return supported;
+        }
+
+        osg::Texture2DArray * GetTexture() const
+        {
+            return m_texture.get();
+        }
+
+        uint32_t GetNumLayers() const
+        {
+            return m_list_layers.size();
+        }
+
+        // Adds a reference to the tile with the given id and
+        // returns its layer. The image is only uploaded if
+        // the tile doesn't already have a layer with texels.
+        // Returns false if there are no layers left.
+        bool Add(uint64_t id,
+                 osg::Image const * image,
+                 uint32_t &layer)
+        {
+            auto lkup_it = m_lkup_id_layer.find(id);
+            if(lkup_it != m_lkup_id_layer.end()) {
+                layer = lkup_it->second;
+                Layer &l = m_list_layers[layer];
+
+                if(l.refs == 0) {
+                    // take it out of the lru
+                    m_lru_layers.erase(l.lru_it);
+                    m_num_used++;
+                }
+                l.refs++;
+
+                if(!l.has_image && image) {
+                    setLayerImage(layer,image);
+                }
+                return true;
+            }
+
+            if(!allocLayer(layer)) {
+                std::cout << "TileAtlasArray: ERROR: "
+                             "No layers available" << std::endl;
+                return false;
+            }
+
+            Layer &l = m_list_layers[layer];
+            l.id = id;
+            l.refs = 1;
+            m_lkup_id_layer.emplace(id,layer);
+            m_num_used++;
+
+            setLayerImage(layer,image);
+            return true;
+        }
+
+        // Removes a reference to the tile with the given id.
+        // Unreferenced layers are kept for reuse until they
+        // are recycled.
+        bool Remove(uint64_t id)
+        {
+            auto lkup_it = m_lkup_id_layer.find(id);
+            if(lkup_it == m_lkup_id_layer.end()) {
+                return false;
+            }
+
+            Layer &l = m_list_layers[lkup_it->second];
+            if(l.refs == 0) {
+                return false;
+            }
+
+            l.refs--;
+            if(l.refs == 0) {
+                m_lru_layers.push_front(lkup_it->second);
+                l.lru_it = m_lru_layers.begin();
+                m_num_used--;
+            }
+            return true;
+        }
+
+        // Should be called once per frame; releases the
+        // top chunk of layers once usage has been low
+        // for long enough
+        void Update()
+        {
+            uint32_t const num_layers = m_list_layers.size();
+            uint32_t const chunk = m_opts.layers_per_chunk;
+
+            if(num_layers <= chunk ||
+               m_num_used+(2*chunk) > num_layers) {
+                m_low_usage_updates = 0;
+                return;
+            }
+
+            m_low_usage_updates++;
+            if(m_low_usage_updates < m_opts.release_updates) {
+                return;
+            }
+
+            // The top chunk can only be released if none of
+            // its layers are referenced
+            uint32_t const new_num_layers = num_layers-chunk;
+            for(uint32_t i=new_num_layers; i < num_layers; i++) {
+                if(m_list_layers[i].refs > 0) {
+                    return;
+                }
+            }
+
+            for(uint32_t i=new_num_layers; i < num_layers; i++) {
+                Layer &l = m_list_layers[i];
+                if(l.id_valid) {
+                    m_lru_layers.erase(l.lru_it);
+                    m_lkup_id_layer.erase(l.id);
+                }
+            }
+
+            std::vector<uint32_t> list_free;
+            list_free.reserve(m_list_free_layers.size());
+            for(auto layer : m_list_free_layers) {
+                if(layer < new_num_layers) {
+                    list_free.push_back(layer);
+                }
+            }
+            m_list_free_layers.swap(list_free);
+
+            resize(new_num_layers);
+            m_low_usage_updates = 0;
+        }
+
+    private:
+        struct Layer
+        {
+            Layer() :
+                id(0),
+                id_valid(false),
+                has_image(false),
+                refs(0)
+            {}
+
+            uint64_t id;
+            bool id_valid;
+            bool has_image;
+            uint32_t refs;
+            std::list<uint32_t>::iterator lru_it;
+        };
+
+        bool allocLayer(uint32_t &layer)
+        {
+            if(m_list_free_layers.empty() && m_lru_layers.empty()) {
+                uint32_t const num_layers = m_list_layers.size();
+                if(num_layers >= m_opts.max_layers) {
+                    return false;
+                }
+                resize(std::min(num_layers+m_opts.layers_per_chunk,
+                                m_opts.max_layers));
+            }
+
+            if(!m_list_free_layers.empty()) {
+                layer = m_list_free_layers.back();
+                m_list_free_layers.pop_back();
+            }
+            else {
+                // recycle the least recently used layer
+                layer = m_lru_layers.back();
+                m_lru_layers.pop_back();
+                m_lkup_id_layer.erase(m_list_layers[layer].id);
+            }
+
+            m_list_layers[layer].id_valid = true;
+            m_list_layers[layer].has_image = false;
+            return true;
+        }
+
+        // Uploads image to the layer, or clears the layer
+        // if there's no usable image so a recycled layer
+        // doesn't keep showing its previous tile
+        void setLayerImage(uint32_t layer, osg::Image const * image)
+        {
+            if(image &&
+               (uint32_t(image->s()) != m_opts.tile_width_px ||
+                uint32_t(image->t()) != m_opts.tile_height_px)) {
+                std::cout << "TileAtlasArray: WARN: "
+                             "Tile image has the wrong size" << std::endl;
+                image = nullptr;
+            }
+
+            m_list_layers[layer].has_image = (image != nullptr);
+            m_subload->SetLayerImage(layer,image);
+        }
+
+        void resize(uint32_t num_layers)
+        {
+            uint32_t const prev_num_layers = m_list_layers.size();
+            m_list_layers.resize(num_layers);
+
+            // new layers are pushed in reverse so
+            // the lowest layers are used first
+            for(uint32_t i=num_layers; i > prev_num_layers; i--) {
+                m_list_free_layers.push_back(i-1);
+            }
+
+            // Layers that are kept are copied across
+            // on the GPU, nothing is uploaded again
+            m_subload->SetNumLayers(num_layers);
+        }
+
+        Options const m_opts;
+
+        osg::ref_ptr<osg::Texture2DArray> m_texture;
+        osg::ref_ptr<TileAtlasArraySubloadCallback> m_subload;
+
+        std::vector<Layer> m_list_layers;
+        std::vector<uint32_t> m_list_free_layers;
+        std::list<uint32_t> m_lru_layers;  // front is most recent
+        std::unordered_map<uint64_t,uint32_t> m_lkup_id_layer;
+
+        uint32_t m_num_used;
+        uint32_t m_low_usage_updates;
+    };
+}
+
+#endif // SCRATCH_TILE_ATLAS_ARRAY_HPP
@@ -31,6 +31,14 @@ namespace scratch
         struct Data
         {
             virtual ~Data() {}
+
+            // Approximate size of this data in bytes,
+            // used for memory budgets. Returns 0 if the
+            // implementation doesn't track size
+            virtual uint64_t GetSizeBytes() const
+            {
+                return 0;
+            }
         };
 
         // ============================================================= //
@@ -116,6 +124,17 @@ namespace scratch
         virtual std::shared_ptr<Request>
         RequestData(TileLL::Id id) = 0;
 
+        // Same as RequestData(...) but for speculative data
+        // (ie prefetched tiles). Low priority requests should
+        // be processed after any regular requests made in the
+        // same request block. Implementations that don't
+        // prioritize requests can use the default.
+        virtual std::shared_ptr<Request>
+        RequestDataLowPriority(TileLL::Id id)
+        {
+            return RequestData(id);
+        }
+
     private:
         GeoBounds const m_bounds;
         uint8_t const m_max_level;
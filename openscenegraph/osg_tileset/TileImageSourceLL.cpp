@@ -15,18 +15,79 @@
 */
 
 #include <thread>
+#include <streambuf>
+#include <istream>
 
 #include <TileImageSourceLL.h>
 
 #include <osgDB/ReadFile>
+#include <osgDB/ReaderWriter>
 
 namespace scratch
 {
+    namespace
+    {
+        // read only streambuf over a block of memory
+        class MemoryStreamBuf : public std::streambuf
+        {
+        public:
+            MemoryStreamBuf(char const * data, uint64_t size)
+            {
+                char * p = const_cast<char*>(data);
+                this->setg(p,p,p+size);
+            }
+
+        protected:
+            pos_type seekoff(off_type off,
+                             std::ios_base::seekdir dir,
+                             std::ios_base::openmode which)
+            {
+                if(!(which & std::ios_base::in)) {
+                    return pos_type(off_type(-1));
+                }
+
+                char * pos = nullptr;
+                if(dir == std::ios_base::beg) {
+                    pos = this->eback()+off;
+                }
+                else if(dir == std::ios_base::cur) {
+                    pos = this->gptr()+off;
+                }
+                else {
+                    pos = this->egptr()+off;
+                }
+
+                if(pos < this->eback() || pos > this->egptr()) {
+                    return pos_type(off_type(-1));
+                }
+
+                this->setg(this->eback(),pos,this->egptr());
+                return pos_type(off_type(pos-this->eback()));
+            }
+
+            pos_type seekpos(pos_type pos,
+                             std::ios_base::openmode which)
+            {
+                return seekoff(off_type(pos),std::ios_base::beg,which);
+            }
+        };
+    }
+
+    // ============================================================= //
+
     TileImageSourceLL::ImageData::~ImageData()
     {
         // empty
     }
 
+    uint64_t TileImageSourceLL::ImageData::GetSizeBytes() const
+    {
+        if(image) {
+            return image->getTotalSizeInBytes();
+        }
+        return 0;
+    }
+
     // ============================================================= //
 
     TileImageSourceLL::ImageRequest::ImageRequest(TileLL::Id id, std::string path) :
@@ -95,9 +156,32 @@ namespace scratch
         // empty
     }
 
+    osg::ref_ptr<osg::Image>
+    TileImageSourceLL::ReadImage(osgDB::ReaderWriter const * reader,
+                                 char const * data,
+                                 uint64_t size)
+    {
+        if(reader == nullptr || data == nullptr) {
+            return osg::ref_ptr<osg::Image>();
+        }
+
+        MemoryStreamBuf buffer(data,size);
+        std::istream stream(&buffer);
+
+        osgDB::ReaderWriter::ReadResult result =
+                reader->readImage(stream);
+
+        if(!result.success()) {
+            return osg::ref_ptr<osg::Image>();
+        }
+
+        return result.getImage();
+    }
+
     void TileImageSourceLL::StartRequestBlock()
     {
         m_list_requests.clear();
+        m_list_requests_low.clear();
     }
 
     void TileImageSourceLL::EndRequestBlock()
@@ -118,6 +202,10 @@ namespace scratch
 
         // We need to provide an option to choose
         m_thread_pool.PushFront(m_list_requests);
+
+        // Low priority requests always go to the back of
+        // the queue so they don't delay regular requests
+        m_thread_pool.PushBack(m_list_requests_low);
 //        std::cout << "task_count: "
 //                  << m_thread_pool.GetTaskCount() << std::endl;
 
@@ -143,6 +231,7 @@ namespace scratch
 
 
         m_list_requests.clear();
+        m_list_requests_low.clear();
     }
 
     std::shared_ptr<TileDataSourceLL::Request>
@@ -156,6 +245,17 @@ namespace scratch
         return request;
     }
 
+    std::shared_ptr<TileDataSourceLL::Request>
+    TileImageSourceLL::RequestDataLowPriority(TileLL::Id id)
+    {
+        std::shared_ptr<ImageRequest> request =
+                std::make_shared<ImageRequest>(
+                    id,m_path_gen(id));
+
+        m_list_requests_low.push_back(request);
+        return request;
+    }
+
 
 
 } // scratch
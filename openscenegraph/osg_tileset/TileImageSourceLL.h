@@ -21,6 +21,11 @@
 
 #include <TileDataSourceLL.h>
 
+namespace osgDB
+{
+    class ReaderWriter;
+}
+
 namespace scratch
 {
     //
@@ -31,6 +36,7 @@ namespace scratch
         struct ImageData : public Data
         {
             ~ImageData();
+            uint64_t GetSizeBytes() const;
             osg::ref_ptr<osg::Image> image;
         };
 
@@ -60,6 +66,13 @@ namespace scratch
                           uint8_t num_threads=2);
         ~TileImageSourceLL();
 
+        // Decodes an image held in memory (ie png data
+        // from a packed file or database) without copying
+        // it. Returns an invalid ref_ptr on failure.
+        static osg::ref_ptr<osg::Image> ReadImage(osgDB::ReaderWriter const * reader,
+                                                  char const * data,
+                                                  uint64_t size);
+
         bool CanBeSampled() const;
 
         void StartRequestBlock();
@@ -68,11 +81,14 @@ namespace scratch
 
         std::shared_ptr<Request> RequestData(TileLL::Id id);
 
+        std::shared_ptr<Request> RequestDataLowPriority(TileLL::Id id);
+
     private:
         std::function<std::string(TileLL::Id)> m_path_gen;
         ThreadPool m_thread_pool;
 
         std::vector<std::shared_ptr<ThreadPool::Task>> m_list_requests;
+        std::vector<std::shared_ptr<ThreadPool::Task>> m_list_requests_low;
     };
 
 } // scratch
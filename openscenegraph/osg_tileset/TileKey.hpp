@@ -0,0 +1,341 @@
+/*
+   Copyright (C) 2014 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef SCRATCH_TILE_KEY_HPP
+#define SCRATCH_TILE_KEY_HPP
+
+#include <cstdint>
+
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+// Tile keys are an alternative to TileLL::Id for sorting
+// and storing tiles. TileLL::Id puts x above y, so sorting
+// by id walks a level column by column and tiles that are
+// next to each other vertically end up far apart. A tile
+// key interleaves x and y along a space filling curve
+// instead:
+//
+// z  code
+// FF FFFFFFFFFFFF
+// z: tile level (8 bits, same place as in TileLL::Id)
+// code: x and y (24 bits each) along a Morton (Z-order)
+//       or Hilbert curve
+//
+// * sorting keys sorts by level first and then along the
+//   curve, so nearby tiles stay near each other in memory
+//   and on disk
+// * Morton keys can be used directly for parent, child
+//   and neighbour lookups (all bit ops)
+// * Hilbert keys have better locality (the curve never
+//   jumps) but only support conversion to and from x,y
+//
+// Everything here is constexpr (C++11 style, so it's all
+// single expressions) except the *Fast functions, which
+// use BMI2 pdep/pext when it's available.
+
+namespace scratch
+{
+    typedef uint64_t TileKey;
+
+    namespace tilekey_detail
+    {
+        static const uint64_t k_mask_x = 0x555555555555ULL;    // even bits
+        static const uint64_t k_mask_y = 0xAAAAAAAAAAAAULL;    // odd bits
+        static const uint64_t k_mask_code = 0xFFFFFFFFFFFFULL; // 48 bits
+        static const uint32_t k_mask_xy = 0xFFFFFF;           // 24 bits
+
+        // spread the low 24 bits of v out to the even bits
+        constexpr uint64_t Spread1(uint64_t v) { return (v | (v << 1)) & 0x5555555555555555ULL; }
+        constexpr uint64_t Spread2(uint64_t v) { return (v | (v << 2)) & 0x3333333333333333ULL; }
+        constexpr uint64_t Spread4(uint64_t v) { return (v | (v << 4)) & 0x0F0F0F0F0F0F0F0FULL; }
+        constexpr uint64_t Spread8(uint64_t v) { return (v | (v << 8)) & 0x00FF00FF00FF00FFULL; }
+        constexpr uint64_t Spread16(uint64_t v) { return (v | (v << 16)) & 0x0000FFFF0000FFFFULL; }
+
+        constexpr uint64_t SpreadBits(uint32_t v)
+        {
+            return Spread1(Spread2(Spread4(Spread8(Spread16(v & k_mask_xy)))));
+        }
+
+        // inverse of SpreadBits
+        constexpr uint64_t Compact1(uint64_t v) { return (v | (v >> 1)) & 0x3333333333333333ULL; }
+        constexpr uint64_t Compact2(uint64_t v) { return (v | (v >> 2)) & 0x0F0F0F0F0F0F0F0FULL; }
+        constexpr uint64_t Compact4(uint64_t v) { return (v | (v >> 4)) & 0x00FF00FF00FF00FFULL; }
+        constexpr uint64_t Compact8(uint64_t v) { return (v | (v >> 8)) & 0x0000FFFF0000FFFFULL; }
+        constexpr uint64_t Compact16(uint64_t v) { return (v | (v >> 16)) & 0x00000000FFFFFFFFULL; }
+
+        constexpr uint32_t CompactBits(uint64_t v)
+        {
+            return static_cast<uint32_t>(
+                        Compact16(Compact8(Compact4(Compact2(Compact1(v & k_mask_x))))));
+        }
+
+        // Adds a spread delta to the x (or y) bits of a Morton
+        // code. Filling the other axis' bits with ones lets the
+        // carry run straight through them; wraps at 24 bits.
+        constexpr uint64_t MortonAdd(uint64_t code,
+                                     uint64_t delta,
+                                     uint64_t mask,
+                                     uint64_t other_mask)
+        {
+            return (((code | other_mask) + (delta & mask)) & mask) |
+                    (code & other_mask);
+        }
+
+        // Hilbert curve (order 24), see the xy2d / d2xy
+        // functions on wikipedia; the loops are written as
+        // recursion for constexpr
+        constexpr uint64_t HilbertEncodeRot(uint32_t x, uint32_t y, uint32_t s,
+                                            uint64_t d, uint32_t rx, uint32_t ry);
+
+        constexpr uint64_t HilbertEncodeStep(uint32_t x, uint32_t y,
+                                             uint32_t s, uint64_t d)
+        {
+            return (s == 0) ? d :
+                HilbertEncodeRot(x & (s-1), y & (s-1), s,
+                                 d + uint64_t(s)*s*((3*((x & s) ? 1u : 0u)) ^ ((y & s) ? 1u : 0u)),
+                                 (x & s) ? 1u : 0u,
+                                 (y & s) ? 1u : 0u);
+        }
+
+        constexpr uint64_t HilbertEncodeRot(uint32_t x, uint32_t y, uint32_t s,
+                                            uint64_t d, uint32_t rx, uint32_t ry)
+        {
+            return (ry != 0) ? HilbertEncodeStep(x,y,s >> 1,d) :
+                   (rx != 0) ? HilbertEncodeStep(s-1-y,s-1-x,s >> 1,d) :
+                               HilbertEncodeStep(y,x,s >> 1,d);
+        }
+
+        // decodes to (x << 32 | y)
+        constexpr uint64_t HilbertDecodeRot(uint64_t t, uint32_t s, uint32_t x,
+                                            uint32_t y, uint32_t rx, uint32_t ry);
+
+        constexpr uint64_t HilbertDecodeStep(uint64_t t, uint32_t s,
+                                             uint32_t x, uint32_t y)
+        {
+            return (s == (1u << 24)) ? ((uint64_t(x) << 32) | y) :
+                HilbertDecodeRot(t,s,x,y,
+                                 uint32_t(1 & (t >> 1)),
+                                 uint32_t(1 & (t ^ (1 & (t >> 1)))));
+        }
+
+        constexpr uint64_t HilbertDecodeRot(uint64_t t, uint32_t s, uint32_t x,
+                                            uint32_t y, uint32_t rx, uint32_t ry)
+        {
+            return (ry != 0) ? HilbertDecodeStep(t >> 2, s << 1, x + s*rx, y + s) :
+                   (rx != 0) ? HilbertDecodeStep(t >> 2, s << 1, (s-1-y) + s, s-1-x) :
+                               HilbertDecodeStep(t >> 2, s << 1, y, x);
+        }
+    }
+
+    // ============================================================= //
+
+    // Morton code: x in the even bits, y in the odd bits
+    constexpr uint64_t MortonEncode(uint32_t x, uint32_t y)
+    {
+        return tilekey_detail::SpreadBits(x) |
+                (tilekey_detail::SpreadBits(y) << 1);
+    }
+
+    constexpr uint32_t MortonDecodeX(uint64_t code)
+    {
+        return tilekey_detail::CompactBits(code);
+    }
+
+    constexpr uint32_t MortonDecodeY(uint64_t code)
+    {
+        return tilekey_detail::CompactBits(code >> 1);
+    }
+
+    constexpr uint64_t HilbertEncode(uint32_t x, uint32_t y)
+    {
+        return tilekey_detail::HilbertEncodeStep(
+                    x & tilekey_detail::k_mask_xy,
+                    y & tilekey_detail::k_mask_xy,
+                    1u << 23, 0);
+    }
+
+    constexpr uint32_t HilbertDecodeX(uint64_t code)
+    {
+        return static_cast<uint32_t>(
+                    tilekey_detail::HilbertDecodeStep(
+                        code & tilekey_detail::k_mask_code,1,0,0) >> 32);
+    }
+
+    constexpr uint32_t HilbertDecodeY(uint64_t code)
+    {
+        return static_cast<uint32_t>(
+                    tilekey_detail::HilbertDecodeStep(
+                        code & tilekey_detail::k_mask_code,1,0,0));
+    }
+
+    // Runtime versions of MortonEncode/Decode
+    inline uint64_t MortonEncodeFast(uint32_t x, uint32_t y)
+    {
+#if defined(__BMI2__)
+        return _pdep_u64(x & tilekey_detail::k_mask_xy,tilekey_detail::k_mask_x) |
+                _pdep_u64(y & tilekey_detail::k_mask_xy,tilekey_detail::k_mask_y);
+#else
+        return MortonEncode(x,y);
+#endif
+    }
+
+    inline void MortonDecodeFast(uint64_t code,
+                                 uint32_t &x,
+                                 uint32_t &y)
+    {
+#if defined(__BMI2__)
+        x = static_cast<uint32_t>(_pext_u64(code,tilekey_detail::k_mask_x));
+        y = static_cast<uint32_t>(_pext_u64(code,tilekey_detail::k_mask_y));
+#else
+        x = MortonDecodeX(code);
+        y = MortonDecodeY(code);
+#endif
+    }
+
+    // ============================================================= //
+
+    // Morton tile keys
+
+    constexpr TileKey TileKeyFromLevelXY(uint8_t level,
+                                         uint32_t x,
+                                         uint32_t y)
+    {
+        return (uint64_t(level) << 48) | MortonEncode(x,y);
+    }
+
+    constexpr uint8_t TileKeyGetLevel(TileKey key)
+    {
+        return static_cast<uint8_t>(key >> 48);
+    }
+
+    constexpr uint32_t TileKeyGetX(TileKey key)
+    {
+        return MortonDecodeX(key);
+    }
+
+    constexpr uint32_t TileKeyGetY(TileKey key)
+    {
+        return MortonDecodeY(key);
+    }
+
+    // TileLL::Id (level:8 | x:24 | y:24) <-> TileKey
+    constexpr TileKey TileKeyFromTileId(uint64_t id)
+    {
+        return (id & 0xFFFF000000000000ULL) |
+                MortonEncode(uint32_t(id >> 24),uint32_t(id));
+    }
+
+    constexpr uint64_t TileKeyToTileId(TileKey key)
+    {
+        return (key & 0xFFFF000000000000ULL) |
+                (uint64_t(TileKeyGetX(key)) << 24) |
+                uint64_t(TileKeyGetY(key));
+    }
+
+    inline TileKey TileKeyFromTileIdFast(uint64_t id)
+    {
+        return (id & 0xFFFF000000000000ULL) |
+                MortonEncodeFast(uint32_t(id >> 24),uint32_t(id));
+    }
+
+    inline uint64_t TileKeyToTileIdFast(TileKey key)
+    {
+        uint32_t x,y;
+        MortonDecodeFast(key,x,y);
+        return (key & 0xFFFF000000000000ULL) |
+                (uint64_t(x) << 24) |
+                uint64_t(y);
+    }
+
+    // * the parent of a level 0 tile isn't defined; callers
+    //   should check the level first
+    constexpr TileKey TileKeyGetParent(TileKey key)
+    {
+        return (uint64_t(TileKeyGetLevel(key)-1) << 48) |
+                ((key & tilekey_detail::k_mask_code) >> 2);
+    }
+
+    // * child: bit 0 is x, bit 1 is y, ie.
+    //   0: LB, 1: RB, 2: LT, 3: RT
+    constexpr TileKey TileKeyGetChild(TileKey key, uint8_t child)
+    {
+        return (uint64_t(TileKeyGetLevel(key)+1) << 48) |
+                (((key & tilekey_detail::k_mask_code) << 2) & tilekey_detail::k_mask_code) |
+                (child & 3);
+    }
+
+    // * offsets wrap around at 2^24; callers need to
+    //   check the result against the number of tiles
+    //   in the level
+    constexpr TileKey TileKeyGetNeighbor(TileKey key,
+                                         int32_t dx,
+                                         int32_t dy)
+    {
+        return (key & 0xFFFF000000000000ULL) |
+                tilekey_detail::MortonAdd(
+                    tilekey_detail::MortonAdd(
+                        key & tilekey_detail::k_mask_code,
+                        tilekey_detail::SpreadBits(uint32_t(dx)),
+                        tilekey_detail::k_mask_x,
+                        tilekey_detail::k_mask_y),
+                    tilekey_detail::SpreadBits(uint32_t(dy)) << 1,
+                    tilekey_detail::k_mask_y,
+                    tilekey_detail::k_mask_x);
+    }
+
+    // ============================================================= //
+
+    // Hilbert tile keys
+
+    constexpr TileKey HilbertKeyFromLevelXY(uint8_t level,
+                                            uint32_t x,
+                                            uint32_t y)
+    {
+        return (uint64_t(level) << 48) | HilbertEncode(x,y);
+    }
+
+    constexpr uint32_t HilbertKeyGetX(TileKey key)
+    {
+        return HilbertDecodeX(key);
+    }
+
+    constexpr uint32_t HilbertKeyGetY(TileKey key)
+    {
+        return HilbertDecodeY(key);
+    }
+
+    // ============================================================= //
+
+    static_assert(MortonEncode(0xFFFFFF,0) == tilekey_detail::k_mask_x,
+                  "MortonEncode: x should fill the even bits");
+
+    static_assert(TileKeyToTileId(TileKeyFromTileId(0x0005123456ABCDEFULL)) ==
+                  0x0005123456ABCDEFULL,
+                  "TileKey: id round trip");
+
+    static_assert(TileKeyGetParent(TileKeyGetChild(TileKeyFromLevelXY(3,5,6),3)) ==
+                  TileKeyFromLevelXY(3,5,6),
+                  "TileKey: parent of child");
+
+    static_assert(HilbertDecodeX(HilbertEncode(12345,678)) == 12345 &&
+                  HilbertDecodeY(HilbertEncode(12345,678)) == 678,
+                  "HilbertEncode: round trip");
+
+} // scratch
+
+#endif // SCRATCH_TILE_KEY_HPP
@@ -0,0 +1,493 @@
+/*
+   Copyright (C) 2014 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <algorithm>
+#include <map>
+
+#include <TileMBTilesSourceLL.h>
+
+#include <osgDB/Registry>
+
+// kompex
+#include <KompexSQLitePrerequisites.h>
+#include <KompexSQLiteDatabase.h>
+#include <KompexSQLiteStatement.h>
+#include <KompexSQLiteException.h>
+
+namespace scratch
+{
+    namespace
+    {
+        // Max number of distinct columns and rows in a
+        // batch. The bundled sqlite doesn't support row
+        // values so a batch is queried as the columns x rows
+        // product within a level, which the MBTiles
+        // (zoom_level,tile_column,tile_row) index serves
+        // directly. Rows that weren't requested are skipped
+        // without reading their tile_data
+        size_t const k_batch_max_xy = 16;
+
+        std::string BuildBatchQuery()
+        {
+            std::string placeholders;
+            for(size_t i=0; i < k_batch_max_xy; i++) {
+                placeholders.append((i==0) ? "?" : ",?");
+            }
+
+            return "SELECT tile_column,tile_row,tile_data FROM tiles "
+                   "WHERE zoom_level=? "
+                   "AND tile_column IN ("+placeholders+") "
+                   "AND tile_row IN ("+placeholders+");";
+        }
+    }
+
+    // ============================================================= //
+
+    TileMBTilesSourceLL::MBTilesRequest::MBTilesRequest(TileLL::Id id) :
+        TileDataSourceLL::Request(id)
+    {
+        // empty
+    }
+
+    TileMBTilesSourceLL::MBTilesRequest::~MBTilesRequest()
+    {
+        Cancel();
+        Wait();
+    }
+
+    std::shared_ptr<TileDataSourceLL::Data>
+    TileMBTilesSourceLL::MBTilesRequest::GetData() const
+    {
+        return m_data;
+    }
+
+    void TileMBTilesSourceLL::MBTilesRequest::Cancel()
+    {
+        this->onCanceled();
+    }
+
+    void TileMBTilesSourceLL::MBTilesRequest::process()
+    {
+        // empty
+    }
+
+    void TileMBTilesSourceLL::MBTilesRequest::setData(
+            std::shared_ptr<TileImageSourceLL::ImageData> data)
+    {
+        this->onStarted();
+        m_data = std::move(data);
+        this->onFinished();
+        this->onEnded();
+    }
+
+    // ============================================================= //
+
+    TileMBTilesSourceLL::BatchRequest::BatchRequest(TileMBTilesSourceLL * source,
+                                                    TileLL::Id first_id) :
+        ThreadPool::Task(first_id),
+        m_source(source),
+        m_level(first_id >> 48)
+    {
+        // empty
+    }
+
+    TileMBTilesSourceLL::BatchRequest::~BatchRequest()
+    {
+        Cancel();
+        Wait();
+    }
+
+    bool TileMBTilesSourceLL::BatchRequest::Add(
+            std::shared_ptr<MBTilesRequest> const &request)
+    {
+        uint8_t level; uint32_t x; uint32_t y;
+        TileLL::GetLevelXYFromId(request->GetTileId(),level,x,y);
+
+        if(level != m_level) {
+            return false;
+        }
+
+        bool const new_x =
+                (std::find(m_list_x.begin(),m_list_x.end(),x) == m_list_x.end());
+
+        bool const new_y =
+                (std::find(m_list_y.begin(),m_list_y.end(),y) == m_list_y.end());
+
+        if((new_x && m_list_x.size() == k_batch_max_xy) ||
+           (new_y && m_list_y.size() == k_batch_max_xy)) {
+            return false;
+        }
+
+        if(new_x) {
+            m_list_x.push_back(x);
+        }
+        if(new_y) {
+            m_list_y.push_back(y);
+        }
+
+        // Only hold weak references so requests the
+        // tile set has dropped don't stay alive
+        m_list_requests.push_back(request);
+        return true;
+    }
+
+    void TileMBTilesSourceLL::BatchRequest::Cancel()
+    {
+        this->onCanceled();
+    }
+
+    void TileMBTilesSourceLL::BatchRequest::process()
+    {
+        if(!this->IsCanceled()) {
+            this->onStarted();
+
+            // Get the requests that are still wanted
+            std::vector<std::shared_ptr<MBTilesRequest>> list_requests;
+            list_requests.reserve(m_list_requests.size());
+
+            for(auto &weak_request : m_list_requests) {
+                auto request = weak_request.lock();
+                if(request && !request->IsCanceled()) {
+                    list_requests.push_back(std::move(request));
+                }
+            }
+
+            if(!list_requests.empty()) {
+                std::vector<std::shared_ptr<TileImageSourceLL::ImageData>>
+                        list_data(list_requests.size());
+
+                Connection * connection = m_source->acquireConnection();
+                if(connection) {
+                    query(connection,list_requests,list_data);
+                    m_source->releaseConnection(connection);
+                }
+
+                // Tiles that aren't in the database finish
+                // with a null image (same as a missing file
+                // with TileImageSourceLL)
+                for(size_t i=0; i < list_requests.size(); i++) {
+                    if(!list_data[i]) {
+                        list_data[i] = std::make_shared<TileImageSourceLL::ImageData>();
+                    }
+                    list_requests[i]->setData(std::move(list_data[i]));
+                }
+            }
+
+            this->onFinished();
+        }
+
+        this->onEnded();
+    }
+
+    void TileMBTilesSourceLL::BatchRequest::query(
+            Connection * connection,
+            std::vector<std::shared_ptr<MBTilesRequest>> &list_requests,
+            std::vector<std::shared_ptr<TileImageSourceLL::ImageData>> &list_data)
+    {
+        Kompex::SQLiteStatement * stmt = connection->stmt;
+
+        try {
+            stmt->BindInt(1,m_level);
+            for(size_t i=0; i < k_batch_max_xy; i++) {
+                int const col_x = 2+i;
+                int const col_y = 2+k_batch_max_xy+i;
+
+                if(i < m_list_x.size()) {
+                    stmt->BindInt(col_x,m_list_x[i]);
+                }
+                else {
+                    stmt->BindNull(col_x);
+                }
+
+                if(i < m_list_y.size()) {
+                    stmt->BindInt(col_y,m_list_y[i]);
+                }
+                else {
+                    stmt->BindNull(col_y);
+                }
+            }
+
+            while(stmt->FetchRow()) {
+                TileLL::Id const id =
+                        TileLL::GetIdFromLevelXY(m_level,
+                                                 stmt->GetColumnInt(0),
+                                                 stmt->GetColumnInt(1));
+
+                for(size_t i=0; i < list_requests.size(); i++) {
+                    if(list_requests[i]->GetTileId() != id || list_data[i]) {
+                        continue;
+                    }
+
+                    // The blob is only valid until the next
+                    // step so decode it in place
+                    list_data[i] = std::make_shared<TileImageSourceLL::ImageData>();
+                    list_data[i]->image = TileImageSourceLL::ReadImage(
+                                m_source->m_reader.get(),
+                                static_cast<char const *>(stmt->GetColumnBlob(2)),
+                                stmt->GetColumnBytes(2));
+                    break;
+                }
+            }
+
+            stmt->Reset();
+        }
+        catch(Kompex::SQLiteException &exception) {
+            std::cout << "TileMBTilesSourceLL: ERROR: "
+                      << exception.GetString() << std::endl;
+
+            try {
+                stmt->Reset();
+            }
+            catch(Kompex::SQLiteException &) {
+                // empty
+            }
+        }
+    }
+
+    // ============================================================= //
+
+    TileMBTilesSourceLL::Connection::Connection() :
+        db(nullptr),
+        stmt(nullptr)
+    {
+        // empty
+    }
+
+    TileMBTilesSourceLL::Connection::~Connection()
+    {
+        delete stmt;
+        delete db;
+    }
+
+    // ============================================================= //
+
+    TileMBTilesSourceLL::TileMBTilesSourceLL(GeoBounds const &bounds,
+                                             uint8_t max_level,
+                                             uint8_t num_root_tiles_x,
+                                             uint8_t num_root_tiles_y,
+                                             std::string const &path,
+                                             uint8_t num_threads,
+                                             bool enable_wal) :
+        TileDataSourceLL(bounds,
+                         max_level,
+                         num_root_tiles_x,
+                         num_root_tiles_y),
+        m_num_threads(std::max<uint8_t>(num_threads,1)),
+        m_thread_pool(m_num_threads)
+    {
+        openConnections(path,m_num_threads,enable_wal);
+    }
+
+    TileMBTilesSourceLL::~TileMBTilesSourceLL()
+    {
+        // empty
+    }
+
+    bool TileMBTilesSourceLL::IsValid() const
+    {
+        return !m_list_connections.empty();
+    }
+
+    bool TileMBTilesSourceLL::CanBeSampled() const
+    {
+        return true;
+    }
+
+    void TileMBTilesSourceLL::StartRequestBlock()
+    {
+        m_list_requests.clear();
+        m_list_requests_low.clear();
+    }
+
+    void TileMBTilesSourceLL::EndRequestBlock()
+    {
+        std::vector<std::shared_ptr<ThreadPool::Task>> list_batches;
+
+        // Same ordering as TileImageSourceLL
+        createBatches(m_list_requests,list_batches);
+        m_thread_pool.PushFront(list_batches);
+        list_batches.clear();
+
+        createBatches(m_list_requests_low,list_batches);
+        m_thread_pool.PushBack(list_batches);
+
+        m_list_requests.clear();
+        m_list_requests_low.clear();
+    }
+
+    std::shared_ptr<TileDataSourceLL::Request>
+    TileMBTilesSourceLL::RequestData(TileLL::Id id)
+    {
+        auto request = std::make_shared<MBTilesRequest>(id);
+        m_list_requests.push_back(request);
+        return request;
+    }
+
+    std::shared_ptr<TileDataSourceLL::Request>
+    TileMBTilesSourceLL::RequestDataLowPriority(TileLL::Id id)
+    {
+        auto request = std::make_shared<MBTilesRequest>(id);
+        m_list_requests_low.push_back(request);
+        return request;
+    }
+
+    bool TileMBTilesSourceLL::openConnections(std::string const &path,
+                                              uint8_t num_connections,
+                                              bool enable_wal)
+    {
+        std::string const batch_query = BuildBatchQuery();
+        std::string format = "png";
+
+        // WAL mode needs a read/write connection; in WAL
+        // mode a writer updating the database doesn't
+        // block the readers
+        int flags = (enable_wal) ?
+                    (SQLITE_OPEN_READWRITE | SQLITE_OPEN_NOMUTEX) :
+                    (SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX);
+
+        try {
+            for(uint8_t i=0; i < num_connections; i++) {
+                std::unique_ptr<Connection> connection(new Connection);
+
+                try {
+                    connection->db = new Kompex::SQLiteDatabase(path,flags,0);
+                }
+                catch(Kompex::SQLiteException &) {
+                    if(i != 0 || !(flags & SQLITE_OPEN_READWRITE)) {
+                        throw;
+                    }
+                    std::cout << "TileMBTilesSourceLL: WARN: "
+                                 "Could not open read/write, "
+                                 "WAL mode not enabled" << std::endl;
+                    flags = SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX;
+                    connection->db = new Kompex::SQLiteDatabase(path,flags,0);
+                }
+
+                connection->stmt = new Kompex::SQLiteStatement(connection->db);
+
+                if(i == 0) {
+                    if(flags & SQLITE_OPEN_READWRITE) {
+                        std::string const mode = connection->stmt->
+                                GetSqlResultString("PRAGMA journal_mode=WAL;");
+
+                        if(mode != "wal") {
+                            std::cout << "TileMBTilesSourceLL: WARN: "
+                                         "Could not enable WAL mode"
+                                      << std::endl;
+                        }
+                    }
+
+                    // The metadata table is optional
+                    try {
+                        format = connection->stmt->GetSqlResultString(
+                                    "SELECT value FROM metadata WHERE name='format';",
+                                    format);
+                    }
+                    catch(Kompex::SQLiteException &) {
+                        // empty
+                    }
+                }
+
+                // Each connection keeps one prepared batch
+                // statement; there are as many connections
+                // as worker threads
+                connection->stmt->Sql(batch_query);
+
+                m_list_free_connections.push_back(connection.get());
+                m_list_connections.push_back(std::move(connection));
+            }
+        }
+        catch(Kompex::SQLiteException &exception) {
+            std::cout << "TileMBTilesSourceLL: ERROR: "
+                      << "Could not open " << path << ": "
+                      << exception.GetString() << std::endl;
+
+            m_list_free_connections.clear();
+            m_list_connections.clear();
+            return false;
+        }
+
+        m_reader = osgDB::Registry::instance()->
+                getReaderWriterForExtension(format);
+
+        if(!m_reader.valid()) {
+            std::cout << "TileMBTilesSourceLL: ERROR: "
+                      << "No reader for format: "
+                      << format << std::endl;
+        }
+
+        return true;
+    }
+
+    TileMBTilesSourceLL::Connection *
+    TileMBTilesSourceLL::acquireConnection()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex_connections);
+        if(m_list_free_connections.empty()) {
+            return nullptr;
+        }
+
+        Connection * connection = m_list_free_connections.back();
+        m_list_free_connections.pop_back();
+        return connection;
+    }
+
+    void TileMBTilesSourceLL::releaseConnection(Connection * connection)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex_connections);
+        m_list_free_connections.push_back(connection);
+    }
+
+    void TileMBTilesSourceLL::createBatches(
+            std::vector<std::shared_ptr<MBTilesRequest>> const &list_requests,
+            std::vector<std::shared_ptr<ThreadPool::Task>> &list_batches)
+    {
+        if(list_requests.empty()) {
+            return;
+        }
+
+        // Split the block evenly across the worker
+        // threads but don't let batches get too small
+        size_t const batch_size =
+                std::max<size_t>(
+                    (list_requests.size()+m_num_threads-1)/m_num_threads,
+                    4);
+
+        // Requests are added in the order they were made
+        // so batches roughly keep the tile set's ranking;
+        // there's one open batch per level at a time
+        std::map<uint8_t,std::pair<std::shared_ptr<BatchRequest>,size_t>> lkup_open;
+
+        for(auto const &request : list_requests) {
+            uint8_t const level = request->GetTileId() >> 48;
+            auto &open = lkup_open[level];
+
+            if(open.first && open.second < batch_size &&
+               open.first->Add(request)) {
+                open.second++;
+                continue;
+            }
+
+            open.first = std::make_shared<BatchRequest>(
+                        this,request->GetTileId());
+
+            open.first->Add(request);
+            open.second = 1;
+            list_batches.push_back(open.first);
+        }
+    }
+
+} // scratch
@@ -0,0 +1,162 @@
+/*
+   Copyright (C) 2014 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef SCRATCH_TILE_MBTILES_SOURCE_LL_H
+#define SCRATCH_TILE_MBTILES_SOURCE_LL_H
+
+#include <osgDB/ReaderWriter>
+
+#include <TileImageSourceLL.h>
+
+namespace Kompex
+{
+    class SQLiteDatabase;
+    class SQLiteStatement;
+}
+
+namespace scratch
+{
+    // * reads tile images from an MBTiles style sqlite
+    //   database: tiles(zoom_level,tile_column,tile_row,tile_data)
+    //   with tile_row counted from the bottom like TileLL
+    // * all the requests made in a request block are grouped
+    //   into batches that are each read with one query
+    // * each worker thread gets its own connection and
+    //   prepared batch statement
+    // * data is provided as TileImageSourceLL::ImageData so
+    //   this can replace a TileImageSourceLL directly
+    // * the database is opened read only; enable_wal opens
+    //   it read/write and switches it to WAL mode so another
+    //   process can update it while it's being read. This
+    //   is stored in the file and creates -wal and -shm
+    //   files next to it.
+    class TileMBTilesSourceLL : public TileDataSourceLL
+    {
+        class BatchRequest;
+
+    public:
+        //
+        class MBTilesRequest : public Request
+        {
+            friend class BatchRequest;
+
+        public:
+            MBTilesRequest(TileLL::Id id);
+            ~MBTilesRequest();
+
+            std::shared_ptr<Data> GetData() const;
+
+            void Cancel();
+
+        private:
+            // never queued directly, requests are
+            // completed by their BatchRequest
+            void process();
+
+            void setData(std::shared_ptr<TileImageSourceLL::ImageData> data);
+
+            std::shared_ptr<TileImageSourceLL::ImageData> m_data;
+        };
+
+        TileMBTilesSourceLL(GeoBounds const &bounds,
+                            uint8_t max_level,
+                            uint8_t num_root_tiles_x,
+                            uint8_t num_root_tiles_y,
+                            std::string const &path,
+                            uint8_t num_threads=2,
+                            bool enable_wal=false);
+        ~TileMBTilesSourceLL();
+
+        // false if the database couldn't be opened or
+        // doesn't have a tiles table; requests will
+        // finish without any image data
+        bool IsValid() const;
+
+        bool CanBeSampled() const;
+
+        void StartRequestBlock();
+
+        void EndRequestBlock();
+
+        std::shared_ptr<Request> RequestData(TileLL::Id id);
+
+        std::shared_ptr<Request> RequestDataLowPriority(TileLL::Id id);
+
+    private:
+        struct Connection
+        {
+            Connection();
+            ~Connection();
+
+            Kompex::SQLiteDatabase * db;
+            Kompex::SQLiteStatement * stmt;
+        };
+
+        class BatchRequest : public ThreadPool::Task
+        {
+        public:
+            BatchRequest(TileMBTilesSourceLL * source,
+                         TileLL::Id first_id);
+            ~BatchRequest();
+
+            // returns false if the request couldn't be
+            // added without going over the query limits
+            bool Add(std::shared_ptr<MBTilesRequest> const &request);
+
+            void Cancel();
+
+        private:
+            void process();
+
+            void query(Connection * connection,
+                       std::vector<std::shared_ptr<MBTilesRequest>> &list_requests,
+                       std::vector<std::shared_ptr<TileImageSourceLL::ImageData>> &list_data);
+
+            TileMBTilesSourceLL * const m_source;
+            uint8_t const m_level;
+            std::vector<uint32_t> m_list_x;
+            std::vector<uint32_t> m_list_y;
+            std::vector<std::weak_ptr<MBTilesRequest>> m_list_requests;
+        };
+
+        bool openConnections(std::string const &path,
+                             uint8_t num_connections,
+                             bool enable_wal);
+
+        Connection * acquireConnection();
+
+        void releaseConnection(Connection * connection);
+
+        void createBatches(std::vector<std::shared_ptr<MBTilesRequest>> const &list_requests,
+                           std::vector<std::shared_ptr<ThreadPool::Task>> &list_batches);
+
+        std::vector<std::unique_ptr<Connection>> m_list_connections;
+        std::vector<Connection*> m_list_free_connections;
+        std::mutex m_mutex_connections;
+        osg::ref_ptr<osgDB::ReaderWriter> m_reader;
+        uint8_t const m_num_threads;
+
+        // the thread pool must be stopped before the
+        // connections are closed, so it's declared after them
+        ThreadPool m_thread_pool;
+
+        std::vector<std::shared_ptr<MBTilesRequest>> m_list_requests;
+        std::vector<std::shared_ptr<MBTilesRequest>> m_list_requests_low;
+    };
+
+} // scratch
+
+#endif // SCRATCH_TILE_MBTILES_SOURCE_LL_H
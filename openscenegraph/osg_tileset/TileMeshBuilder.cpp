@@ -0,0 +1,286 @@
+/*
+   Copyright (C) 2014 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <cmath>
+#include <algorithm>
+
+#include <TileMeshBuilder.h>
+
+namespace scratch
+{
+    namespace
+    {
+        // number of vertices converted from LLA at a time;
+        // small enough that the scratch space stays in cache
+        size_t const k_batch_size = 256;
+
+        // max number of vertex arrays kept for reuse per
+        // grid resolution; arrays beyond this are freed
+        // with their geometry
+        size_t const k_max_pooled_vx_arrays = 256;
+    }
+
+    TileMeshBuilder::TileMeshBuilder() :
+        m_batch_lla(k_batch_size),
+        m_batch_ecef(k_batch_size)
+    {
+        // empty
+    }
+
+    TileMeshBuilder::~TileMeshBuilder()
+    {
+        // empty
+    }
+
+    double TileMeshBuilder::CalcSkirtHeight(double max_seg_angle_degs)
+    {
+        // The largest gap is the sag of the longest segment
+        // on the coarser tile's edge (its endpoints are on
+        // the surface but its midpoint is below it)
+        double const half_seg_angle =
+                std::min(max_seg_angle_degs*0.5,90.0);
+
+        return RAD_AV*(1.0-cos(half_seg_angle*K_DEG2RAD));
+    }
+
+    osg::ref_ptr<osg::Geometry>
+    TileMeshBuilder::BuildSurface(GeoBounds const &bounds,
+                                  uint16_t lon_segments,
+                                  uint16_t lat_segments,
+                                  osg::Vec3d &center,
+                                  double skirt_height_m)
+    {
+        bool const skirts = (skirt_height_m > 0.0);
+        Grid * grid = getGrid(lon_segments,lat_segments,skirts);
+        if(grid == nullptr) {
+            return nullptr;
+        }
+
+        size_t const row_size = size_t(lon_segments)+1;
+        size_t const num_vx = grid->tx_array->size();
+
+        double const lon_step = (bounds.maxLon-bounds.minLon)/lon_segments;
+        double const lat_step = (bounds.maxLat-bounds.minLat)/lat_segments;
+
+        center = ConvLLAToECEF(LLA((bounds.minLon+bounds.maxLon)*0.5,
+                                   (bounds.minLat+bounds.maxLat)*0.5));
+
+        osg::ref_ptr<osg::Vec3Array> vx_array =
+                acquireVxArray(grid,num_vx);
+
+        osg::Vec3 * vx_out = &((*vx_array)[0]);
+
+        // Walk the grid row by row (same order as
+        // BuildEarthSurface) and then the skirts, a
+        // batch at a time
+        for(size_t k=0; k < num_vx; k+=k_batch_size) {
+            size_t const count = std::min(k_batch_size,num_vx-k);
+
+            for(size_t n=0; n < count; n++) {
+                size_t v_idx = k+n;
+                double alt = 0.0;
+                if(v_idx >= grid->num_grid_vx) {
+                    v_idx = grid->list_skirt_src[v_idx-grid->num_grid_vx];
+                    alt = -1.0*skirt_height_m;
+                }
+
+                LLA &lla = m_batch_lla[n];
+                lla.lon = ((v_idx%row_size)*lon_step)+bounds.minLon;
+                lla.lat = ((v_idx/row_size)*lat_step)+bounds.minLat;
+                lla.alt = alt;
+            }
+
+            geodesy::ConvLLAToECEF(count,
+                                   &(m_batch_lla[0].lon),
+                                   &(m_batch_lla[0].lat),
+                                   &(m_batch_lla[0].alt),
+                                   sizeof(LLA)/sizeof(double),
+                                   m_batch_ecef[0].ptr(),
+                                   m_batch_ecef[0].ptr()+1,
+                                   m_batch_ecef[0].ptr()+2,
+                                   3,
+                                   geodesy::SPHERE_AV);
+
+            for(size_t n=0; n < count; n++) {
+                vx_out[k+n] = m_batch_ecef[n]-center;
+            }
+        }
+
+        osg::ref_ptr<osg::Geometry> gm = new osg::Geometry;
+        gm->setVertexArray(vx_array);
+        gm->setTexCoordArray(0,grid->tx_array,osg::Array::BIND_PER_VERTEX);
+        gm->setTexCoordArray(1,grid->tx_array,osg::Array::BIND_PER_VERTEX);
+        gm->addPrimitiveSet(getIxArray(grid));
+
+        return gm;
+    }
+
+    void TileMeshBuilder::Clear()
+    {
+        m_lkup_grids.clear();
+    }
+
+    TileMeshBuilder::Grid *
+    TileMeshBuilder::getGrid(uint16_t lon_segments,
+                             uint16_t lat_segments,
+                             bool skirts)
+    {
+        uint64_t const key =
+                (uint64_t(lon_segments) << 32) |
+                (uint64_t(lat_segments) << 16) |
+                uint64_t(skirts);
+
+        auto it = m_lkup_grids.find(key);
+        if(it != m_lkup_grids.end()) {
+            return &(it->second);
+        }
+
+        size_t const row_size = size_t(lon_segments)+1;
+        size_t const col_size = size_t(lat_segments)+1;
+        size_t const num_grid_vx = row_size*col_size;
+        size_t const num_skirt_vx = skirts ? (row_size+col_size)*2 : 0;
+        if(lon_segments == 0 || lat_segments == 0 ||
+           num_grid_vx+num_skirt_vx > 65536) {
+            std::cout << "TileMeshBuilder: ERROR: "
+                         "Invalid grid size: "
+                      << lon_segments << "x" << lat_segments
+                      << std::endl;
+            return nullptr;
+        }
+
+        Grid grid;
+        grid.lon_segments = lon_segments;
+        grid.lat_segments = lat_segments;
+        grid.num_grid_vx = num_grid_vx;
+
+        // skirt vertices go counter clockwise around the
+        // tile: south (west to east), east (south to north),
+        // north (east to west), west (north to south)
+        if(skirts) {
+            grid.list_skirt_src.reserve(num_skirt_vx);
+            for(size_t j=0; j < row_size; j++) {
+                grid.list_skirt_src.push_back(j);
+            }
+            for(size_t i=0; i < col_size; i++) {
+                grid.list_skirt_src.push_back(i*row_size + lon_segments);
+            }
+            for(size_t j=row_size; j > 0; j--) {
+                grid.list_skirt_src.push_back(lat_segments*row_size + j-1);
+            }
+            for(size_t i=col_size; i > 0; i--) {
+                grid.list_skirt_src.push_back((i-1)*row_size);
+            }
+        }
+
+        // tex coords; skirt vertices use the tex
+        // coords of the vertex they hang from
+        grid.tx_array = new osg::Vec2dArray(num_grid_vx+num_skirt_vx);
+        size_t k=0;
+        for(uint16_t i=0; i <= lat_segments; i++) {
+            for(uint16_t j=0; j <= lon_segments; j++) {
+                (*grid.tx_array)[k] = osg::Vec2d(double(j)/lon_segments,
+                                                 double(i)/lat_segments);
+                k++;
+            }
+        }
+        for(auto src : grid.list_skirt_src) {
+            (*grid.tx_array)[k] = (*grid.tx_array)[src];
+            k++;
+        }
+
+        return &(m_lkup_grids.emplace(key,grid).first->second);
+    }
+
+    osg::DrawElementsUShort *
+    TileMeshBuilder::getIxArray(Grid * grid)
+    {
+        if(grid->ix_array.valid()) {
+            return grid->ix_array.get();
+        }
+
+        uint16_t const lon_segments = grid->lon_segments;
+        uint16_t const lat_segments = grid->lat_segments;
+        size_t const row_size = size_t(lon_segments)+1;
+        std::vector<uint16_t> const &list_src = grid->list_skirt_src;
+
+        osg::ref_ptr<osg::DrawElementsUShort> ix_array =
+                new osg::DrawElementsUShort(GL_TRIANGLES);
+        ix_array->reserve(size_t(lon_segments)*lat_segments*6 +
+                          list_src.size()*6);
+
+        auto add_tri = [&](size_t a, size_t b, size_t c) {
+            ix_array->push_back(a);
+            ix_array->push_back(b);
+            ix_array->push_back(c);
+        };
+
+        // stitch faces together (same winding as
+        // BuildEarthSurface with tex coords)
+        size_t v_idx=0;
+        for(uint16_t i=0; i < lat_segments; i++) {
+            for(uint16_t j=0; j < lon_segments; j++) {
+                add_tri(v_idx,v_idx+lon_segments+2,v_idx+lon_segments+1);
+                add_tri(v_idx,v_idx+1,v_idx+lon_segments+2);
+                v_idx++;
+            }
+            v_idx++;
+        }
+
+        // skirts face outward; the outside is on the
+        // right of each counter clockwise edge
+        size_t const edge_size[4] = {
+            row_size, size_t(lat_segments)+1,
+            row_size, size_t(lat_segments)+1
+        };
+
+        size_t edge_start=0;
+        for(size_t e=0; e < 4 && !list_src.empty(); e++) {
+            for(size_t n=edge_start; n+1 < edge_start+edge_size[e]; n++) {
+                size_t const sa = grid->num_grid_vx + n;
+                size_t const sb = sa+1;
+                add_tri(sa,sb,list_src[n+1]);
+                add_tri(sa,list_src[n+1],list_src[n]);
+            }
+            edge_start += edge_size[e];
+        }
+
+        grid->ix_array = ix_array;
+        return ix_array.get();
+    }
+
+    osg::ref_ptr<osg::Vec3Array>
+    TileMeshBuilder::acquireVxArray(Grid * grid,
+                                    size_t num_vx)
+    {
+        // An array is free once the pool holds the
+        // only reference to it
+        for(auto &vx_array : grid->list_vx_pool) {
+            if(vx_array->referenceCount() == 1) {
+                vx_array->dirty();
+                return vx_array;
+            }
+        }
+
+        osg::ref_ptr<osg::Vec3Array> vx_array =
+                new osg::Vec3Array(num_vx);
+
+        if(grid->list_vx_pool.size() < k_max_pooled_vx_arrays) {
+            grid->list_vx_pool.push_back(vx_array);
+        }
+
+        return vx_array;
+    }
+}
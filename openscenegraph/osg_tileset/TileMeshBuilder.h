@@ -0,0 +1,122 @@
+/*
+   Copyright (C) 2014 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef SCRATCH_TILE_MESH_BUILDER_H
+#define SCRATCH_TILE_MESH_BUILDER_H
+
+#include <map>
+#include <vector>
+
+#include <osg/Geometry>
+
+#include <GeometryUtils.h>
+
+namespace scratch
+{
+    // Builds earth surface meshes for tiles.
+    //
+    // Every tile with the same number of lon and lat
+    // segments has the same index buffer and the same
+    // (unsampled) tex coords, so those are built once
+    // per grid resolution and shared by all tiles.
+    //
+    // Vertices are stored as floats relative to the tile
+    // center (RTC) so they keep their precision on the
+    // GPU; the caller places the tile with the returned
+    // center (ie with an osg::MatrixTransform). They're
+    // converted from LLA in batches and written into
+    // vertex arrays that are reused once the geometry
+    // that last used them has been released.
+    //
+    // Tiles next to coarser tiles get T-junctions along
+    // the shared edge. They're hidden with skirts: a strip
+    // of triangles hanging down from each edge, deep enough
+    // to cover the sag of the coarser tile's edge segments
+    // (see CalcSkirtHeight). Neighbours aren't tracked so
+    // the skirt has to be sized for the coarsest neighbour
+    // the tile could have.
+    //
+    // Not thread safe; meant to be used from the thread
+    // that updates the scene.
+    class TileMeshBuilder
+    {
+    public:
+        TileMeshBuilder();
+
+        ~TileMeshBuilder();
+
+        // Returns a skirt height that covers the gap
+        // between a tile and any coarser neighbour whose
+        // edge segments span at most max_seg_angle_degs
+        static double CalcSkirtHeight(double max_seg_angle_degs);
+
+        // Returns the surface geometry for the given bounds
+        // and sets center to the ECEF position its vertices
+        // are relative to. Tex coord sets 0 and 1 both
+        // start out as the shared tex coords for the grid.
+        // Returns a null ref_ptr if the grid has more
+        // vertices than can be indexed with a uint16_t.
+        // Skirts are added if skirt_height_m > 0.
+        osg::ref_ptr<osg::Geometry>
+        BuildSurface(GeoBounds const &bounds,
+                     uint16_t lon_segments,
+                     uint16_t lat_segments,
+                     osg::Vec3d &center,
+                     double skirt_height_m=0.0);
+
+        // Drops all shared grids and pooled vertex arrays
+        // (geometry that's still referenced is unaffected)
+        void Clear();
+
+    private:
+        struct Grid
+        {
+            uint16_t lon_segments;
+            uint16_t lat_segments;
+
+            // number of vertices in the lon/lat grid; any
+            // skirt vertices come after these
+            size_t num_grid_vx;
+
+            // the grid vertex each skirt vertex hangs from;
+            // the skirt for every edge has its own vertices
+            // (in counter clockwise order around the tile)
+            std::vector<uint16_t> list_skirt_src;
+
+            osg::ref_ptr<osg::DrawElementsUShort> ix_array;
+
+            osg::ref_ptr<osg::Vec2dArray> tx_array;
+            std::vector<osg::ref_ptr<osg::Vec3Array>> list_vx_pool;
+        };
+
+        Grid * getGrid(uint16_t lon_segments,
+                       uint16_t lat_segments,
+                       bool skirts);
+
+        osg::DrawElementsUShort * getIxArray(Grid * grid);
+
+        osg::ref_ptr<osg::Vec3Array> acquireVxArray(Grid * grid,
+                                                    size_t num_vx);
+
+        std::map<uint64_t,Grid> m_lkup_grids;
+
+        // scratch space for batched LLA -> ECEF
+        std::vector<LLA> m_batch_lla;
+        std::vector<osg::Vec3d> m_batch_ecef;
+    };
+}
+
+#endif // SCRATCH_TILE_MESH_BUILDER_H
@@ -0,0 +1,112 @@
+/*
+   Copyright (C) 2014 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef SCRATCH_TILE_PYRAMID_FORMAT_H
+#define SCRATCH_TILE_PYRAMID_FORMAT_H
+
+#include <cstdint>
+#include <cstring>
+
+#include <TileKey.hpp>
+
+// Layout of a packed tile pyramid file. This header only
+// depends on TileKey.hpp so it can be shared by the packer
+// tool and TilePyramidSourceLL.
+//
+// [TilePyramidHeader]
+// [TilePyramidLevel x num_levels]
+// [TilePyramidEntry x num_tiles] (sorted by key)
+// [padding up to alignment]
+// [tile payloads, each starting on a multiple of alignment]
+//
+// * entries are keyed by Morton TileKey (level:8 | z-order
+//   code:48), so sorting by key groups entries by level and
+//   then keeps neighbouring tiles together; payloads are
+//   written in the same order so tiles that are loaded
+//   together are close together in the file
+// * TilePyramidLevel has the entry range for each level
+// * payloads are stored as is (ie png or jpg data), the
+//   header's format field is the extension used to decode them
+// * the header and index are read in place from the mapped
+//   file, so values are in host (little endian) byte order
+
+namespace scratch
+{
+    static const char k_tile_pyramid_magic[8] =
+        {'S','C','T','I','L','E','P','Y'};
+
+    // version 1 sorted entries by TileLL::Id
+    static const uint32_t k_tile_pyramid_version = 2;
+
+    struct TilePyramidHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t alignment;
+        uint32_t num_levels;
+        uint8_t num_root_tiles_x;
+        uint8_t num_root_tiles_y;
+        uint8_t reserved[2];
+        uint64_t num_tiles;
+        double min_lon;
+        double max_lon;
+        double min_lat;
+        double max_lat;
+        char format[16];
+    };
+
+    struct TilePyramidLevel
+    {
+        uint64_t first;   // index of the first entry
+        uint64_t count;   // number of entries
+    };
+
+    struct TilePyramidEntry
+    {
+        TileKey key;
+        uint64_t offset;  // from the start of the file
+        uint64_t size;    // payload size in bytes
+    };
+
+    static_assert(sizeof(TilePyramidHeader) == 80,
+                  "TilePyramidHeader must be tightly packed");
+
+    static_assert(sizeof(TilePyramidLevel) == 16,
+                  "TilePyramidLevel must be tightly packed");
+
+    static_assert(sizeof(TilePyramidEntry) == 24,
+                  "TilePyramidEntry must be tightly packed");
+
+    // ============================================================= //
+
+    inline uint64_t TilePyramidAlign(uint64_t offset,
+                                     uint64_t alignment)
+    {
+        return ((offset+alignment-1)/alignment)*alignment;
+    }
+
+    // size of the header and index, not including padding
+    inline uint64_t TilePyramidIndexEnd(uint64_t num_levels,
+                                        uint64_t num_tiles)
+    {
+        return sizeof(TilePyramidHeader) +
+                (num_levels*sizeof(TilePyramidLevel)) +
+                (num_tiles*sizeof(TilePyramidEntry));
+    }
+
+} // scratch
+
+#endif // SCRATCH_TILE_PYRAMID_FORMAT_H
@@ -0,0 +1,365 @@
+/*
+   Copyright (C) 2014 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <TilePyramidSourceLL.h>
+
+#include <osgDB/Registry>
+
+namespace scratch
+{
+    namespace
+    {
+        // Hint that a range of the mapping will be needed
+        // soon so the kernel can start reading it in before
+        // a worker thread faults on it
+        void AdviseWillNeed(char const * data,
+                            char const * base,
+                            uint64_t size)
+        {
+            static const uint64_t page_size = sysconf(_SC_PAGESIZE);
+            uint64_t const offset = data-base;
+            uint64_t const page_offset = (offset/page_size)*page_size;
+
+            madvise(const_cast<char*>(base)+page_offset,
+                    size+(offset-page_offset),
+                    MADV_WILLNEED);
+        }
+    }
+
+    // ============================================================= //
+
+    TilePyramidSourceLL::PyramidRequest::PyramidRequest(TileLL::Id id,
+                                                        char const * payload,
+                                                        uint64_t payload_size,
+                                                        osgDB::ReaderWriter * reader) :
+        TileDataSourceLL::Request(id),
+        m_payload(payload),
+        m_payload_size(payload_size),
+        m_reader(reader)
+    {
+        // empty
+    }
+
+    TilePyramidSourceLL::PyramidRequest::~PyramidRequest()
+    {
+        Cancel();
+        Wait();
+    }
+
+    std::shared_ptr<TileDataSourceLL::Data>
+    TilePyramidSourceLL::PyramidRequest::GetData() const
+    {
+        return m_data;
+    }
+
+    void TilePyramidSourceLL::PyramidRequest::Cancel()
+    {
+        this->onCanceled();
+    }
+
+    void TilePyramidSourceLL::PyramidRequest::process()
+    {
+        if(!this->IsCanceled()) {
+            this->onStarted();
+            m_data = std::make_shared<TileImageSourceLL::ImageData>();
+
+            // tiles that aren't in the pyramid finish
+            // with a null image (same as a missing file
+            // with TileImageSourceLL)
+            m_data->image = TileImageSourceLL::ReadImage(
+                        m_reader,m_payload,m_payload_size);
+
+            this->onFinished();
+        }
+
+        this->onEnded();
+    }
+
+    // ============================================================= //
+
+    TilePyramidSourceLL::MappedFile::MappedFile() :
+        fd(-1),
+        data(nullptr),
+        size(0),
+        header(nullptr),
+        list_levels(nullptr),
+        list_entries(nullptr)
+    {
+        // empty
+    }
+
+    TilePyramidSourceLL::MappedFile::~MappedFile()
+    {
+        if(data) {
+            munmap(data,size);
+        }
+        if(fd >= 0) {
+            close(fd);
+        }
+    }
+
+    // ============================================================= //
+
+    TilePyramidSourceLL::TilePyramidSourceLL(std::string const &path,
+                                             uint8_t num_threads) :
+        TilePyramidSourceLL(mapFile(path),num_threads)
+    {
+        // empty
+    }
+
+    TilePyramidSourceLL::TilePyramidSourceLL(std::unique_ptr<MappedFile> file,
+                                             uint8_t num_threads) :
+        TileDataSourceLL(getBounds(file.get()),
+                         (file->header) ? (file->header->num_levels-1) : 0,
+                         (file->header) ? file->header->num_root_tiles_x : 1,
+                         (file->header) ? file->header->num_root_tiles_y : 1),
+        m_file(std::move(file)),
+        m_thread_pool(num_threads)
+    {
+        if(!IsValid()) {
+            return;
+        }
+
+        std::string const format(m_file->header->format,
+                                 strnlen(m_file->header->format,
+                                         sizeof(m_file->header->format)));
+
+        m_reader = osgDB::Registry::instance()->
+                getReaderWriterForExtension(format);
+
+        if(!m_reader.valid()) {
+            std::cout << "TilePyramidSourceLL: ERROR: "
+                      << "No reader for format: "
+                      << format << std::endl;
+        }
+    }
+
+    TilePyramidSourceLL::~TilePyramidSourceLL()
+    {
+        // empty
+    }
+
+    bool TilePyramidSourceLL::IsValid() const
+    {
+        return (m_file->header != nullptr);
+    }
+
+    bool TilePyramidSourceLL::CanBeSampled() const
+    {
+        return true;
+    }
+
+    void TilePyramidSourceLL::StartRequestBlock()
+    {
+        m_list_requests.clear();
+        m_list_requests_low.clear();
+    }
+
+    void TilePyramidSourceLL::EndRequestBlock()
+    {
+        // Same ordering as TileImageSourceLL; decoding
+        // from the mapped file is fast enough that the
+        // most recent requests should go first
+        m_thread_pool.PushFront(m_list_requests);
+        m_thread_pool.PushBack(m_list_requests_low);
+
+        m_list_requests.clear();
+        m_list_requests_low.clear();
+    }
+
+    std::shared_ptr<TileDataSourceLL::Request>
+    TilePyramidSourceLL::RequestData(TileLL::Id id)
+    {
+        auto request = createRequest(id);
+        m_list_requests.push_back(request);
+        return request;
+    }
+
+    std::shared_ptr<TileDataSourceLL::Request>
+    TilePyramidSourceLL::RequestDataLowPriority(TileLL::Id id)
+    {
+        auto request = createRequest(id);
+        m_list_requests_low.push_back(request);
+        return request;
+    }
+
+    std::unique_ptr<TilePyramidSourceLL::MappedFile>
+    TilePyramidSourceLL::mapFile(std::string const &path)
+    {
+        std::unique_ptr<MappedFile> file(new MappedFile);
+
+        file->fd = open(path.c_str(),O_RDONLY);
+        if(file->fd < 0) {
+            std::cout << "TilePyramidSourceLL: ERROR: "
+                         "Could not open " << path << std::endl;
+            return file;
+        }
+
+        struct stat file_stat;
+        if(fstat(file->fd,&file_stat) != 0 ||
+           uint64_t(file_stat.st_size) < sizeof(TilePyramidHeader)) {
+            std::cout << "TilePyramidSourceLL: ERROR: "
+                         "Invalid file " << path << std::endl;
+            return file;
+        }
+
+        void * data = mmap(nullptr,file_stat.st_size,
+                           PROT_READ,MAP_SHARED,
+                           file->fd,0);
+
+        if(data == MAP_FAILED) {
+            std::cout << "TilePyramidSourceLL: ERROR: "
+                         "Could not map " << path << std::endl;
+            return file;
+        }
+
+        file->data = static_cast<char*>(data);
+        file->size = file_stat.st_size;
+
+        // Tiles are accessed in view order rather than
+        // file order so the kernel's readahead would
+        // mostly read in tiles that aren't needed
+        madvise(file->data,file->size,MADV_RANDOM);
+
+        // Validate the header and index
+        auto header = reinterpret_cast<TilePyramidHeader const *>(file->data);
+
+        if(memcmp(header->magic,k_tile_pyramid_magic,
+                  sizeof(k_tile_pyramid_magic)) != 0 ||
+           header->version != k_tile_pyramid_version ||
+           header->num_levels == 0 ||
+           header->num_levels > 32 ||
+           header->num_root_tiles_x == 0 ||
+           header->num_root_tiles_y == 0 ||
+           TilePyramidIndexEnd(header->num_levels,0) > file->size) {
+            std::cout << "TilePyramidSourceLL: ERROR: "
+                         "Invalid header " << path << std::endl;
+            return file;
+        }
+
+        // num_levels is bounded above so only num_tiles can
+        // overflow the size of the index
+        uint64_t const max_tiles =
+                (file->size-TilePyramidIndexEnd(header->num_levels,0))/
+                sizeof(TilePyramidEntry);
+
+        if(header->num_tiles > max_tiles) {
+            std::cout << "TilePyramidSourceLL: ERROR: "
+                         "Invalid header " << path << std::endl;
+            return file;
+        }
+
+        file->list_levels = reinterpret_cast<TilePyramidLevel const *>(
+                    file->data+sizeof(TilePyramidHeader));
+
+        file->list_entries = reinterpret_cast<TilePyramidEntry const *>(
+                    file->data+sizeof(TilePyramidHeader)+
+                    header->num_levels*sizeof(TilePyramidLevel));
+
+        for(uint32_t i=0; i < header->num_levels; i++) {
+            auto const &level = file->list_levels[i];
+            if(level.count > header->num_tiles ||
+               level.first > header->num_tiles-level.count) {
+                std::cout << "TilePyramidSourceLL: ERROR: "
+                             "Invalid level table " << path << std::endl;
+                return file;
+            }
+        }
+
+        // The index is touched on every lookup
+        madvise(file->data,
+                TilePyramidIndexEnd(header->num_levels,header->num_tiles),
+                MADV_WILLNEED);
+
+        file->header = header;
+        return file;
+    }
+
+    GeoBounds TilePyramidSourceLL::getBounds(MappedFile const * file)
+    {
+        if(file->header == nullptr) {
+            return GeoBounds(-180.0,180.0,-90.0,90.0);
+        }
+
+        return GeoBounds(file->header->min_lon,
+                         file->header->max_lon,
+                         file->header->min_lat,
+                         file->header->max_lat);
+    }
+
+    TilePyramidEntry const *
+    TilePyramidSourceLL::findEntry(TileLL::Id id) const
+    {
+        if(!IsValid()) {
+            return nullptr;
+        }
+
+        TileKey const key = TileKeyFromTileIdFast(id);
+        uint8_t const level = TileKeyGetLevel(key);
+        if(level >= m_file->header->num_levels) {
+            return nullptr;
+        }
+
+        auto const &range = m_file->list_levels[level];
+        TilePyramidEntry const * begin = m_file->list_entries+range.first;
+        TilePyramidEntry const * end = begin+range.count;
+
+        auto it = std::lower_bound(
+                    begin,end,key,
+                    [](TilePyramidEntry const &entry, TileKey key) {
+                        return (entry.key < key);
+                    });
+
+        if(it == end || it->key != key) {
+            return nullptr;
+        }
+
+        // Check the payload against the file size in
+        // case the file was truncated
+        if(it->offset > m_file->size ||
+           it->size > m_file->size-it->offset) {
+            return nullptr;
+        }
+
+        return it;
+    }
+
+    std::shared_ptr<TilePyramidSourceLL::PyramidRequest>
+    TilePyramidSourceLL::createRequest(TileLL::Id id)
+    {
+        TilePyramidEntry const * entry = findEntry(id);
+
+        char const * payload = nullptr;
+        uint64_t payload_size = 0;
+
+        if(entry && entry->size > 0) {
+            payload = m_file->data+entry->offset;
+            payload_size = entry->size;
+            AdviseWillNeed(payload,m_file->data,payload_size);
+        }
+
+        return std::make_shared<PyramidRequest>(
+                    id,payload,payload_size,m_reader.get());
+    }
+
+} // scratch
@@ -0,0 +1,117 @@
+/*
+   Copyright (C) 2014 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef SCRATCH_TILE_PYRAMID_SOURCE_LL_H
+#define SCRATCH_TILE_PYRAMID_SOURCE_LL_H
+
+#include <osgDB/ReaderWriter>
+
+#include <TilePyramidFormat.h>
+#include <TileImageSourceLL.h>
+
+namespace scratch
+{
+    // * reads tile images from a single packed pyramid
+    //   file (see TilePyramidFormat.h and tilepyramid_pack)
+    // * the file is memory mapped; lookups are a binary search
+    //   over the mapped index and only the payload pages for
+    //   requested tiles are ever read from disk
+    // * data is provided as TileImageSourceLL::ImageData so
+    //   this can replace a TileImageSourceLL directly
+    class TilePyramidSourceLL : public TileDataSourceLL
+    {
+    public:
+        //
+        class PyramidRequest : public Request
+        {
+        public:
+            PyramidRequest(TileLL::Id id,
+                           char const * payload,
+                           uint64_t payload_size,
+                           osgDB::ReaderWriter * reader);
+            ~PyramidRequest();
+
+            std::shared_ptr<Data> GetData() const;
+
+            void Cancel();
+
+        private:
+            void process();
+
+            char const * const m_payload;
+            uint64_t const m_payload_size;
+            osgDB::ReaderWriter * const m_reader;
+            std::shared_ptr<TileImageSourceLL::ImageData> m_data;
+        };
+
+        TilePyramidSourceLL(std::string const &path,
+                            uint8_t num_threads=2);
+        ~TilePyramidSourceLL();
+
+        // false if the file couldn't be opened or
+        // isn't a valid pyramid file; requests will
+        // finish without any image data
+        bool IsValid() const;
+
+        bool CanBeSampled() const;
+
+        void StartRequestBlock();
+
+        void EndRequestBlock();
+
+        std::shared_ptr<Request> RequestData(TileLL::Id id);
+
+        std::shared_ptr<Request> RequestDataLowPriority(TileLL::Id id);
+
+    private:
+        struct MappedFile
+        {
+            MappedFile();
+            ~MappedFile();
+
+            int fd;
+            char * data;
+            uint64_t size;
+
+            TilePyramidHeader const * header;
+            TilePyramidLevel const * list_levels;
+            TilePyramidEntry const * list_entries;
+        };
+
+        TilePyramidSourceLL(std::unique_ptr<MappedFile> file,
+                            uint8_t num_threads);
+
+        static std::unique_ptr<MappedFile> mapFile(std::string const &path);
+
+        static GeoBounds getBounds(MappedFile const * file);
+
+        TilePyramidEntry const * findEntry(TileLL::Id id) const;
+
+        std::shared_ptr<PyramidRequest> createRequest(TileLL::Id id);
+
+        // the thread pool must be stopped before the
+        // file is unmapped, so m_file is declared first
+        std::unique_ptr<MappedFile> m_file;
+        osg::ref_ptr<osgDB::ReaderWriter> m_reader;
+        ThreadPool m_thread_pool;
+
+        std::vector<std::shared_ptr<ThreadPool::Task>> m_list_requests;
+        std::vector<std::shared_ptr<ThreadPool::Task>> m_list_requests_low;
+    };
+
+} // scratch
+
+#endif // SCRATCH_TILE_PYRAMID_SOURCE_LL_H
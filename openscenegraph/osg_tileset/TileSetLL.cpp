@@ -25,7 +25,9 @@ namespace scratch
         m_tile_visibility(std::move(tile_visibility)),
         m_opts(initOptions(options)),
         m_num_preload_data(initNumPreloadData()),
-        m_max_view_data(initMaxViewData())
+        m_max_view_data(initMaxViewData()),
+        m_bfs_idx(0),
+        m_item_gen(1)
     {
         // debug
         std::cout << "m_opts.max_tile_data: " << m_opts.max_tile_data << std::endl;
@@ -54,6 +56,10 @@ namespace scratch
 
                 // save
                 m_list_root_tiles.emplace_back(new TileLL(b,x,y));
+
+                // the prefetch stage traverses its own
+                // copy of the quadtree
+                m_list_prefetch_root_tiles.emplace_back(new TileLL(b,x,y));
             }
         }
 
@@ -72,7 +78,7 @@ namespace scratch
         // Preload the base textures
         m_preloaded_data_ready = false;
 
-        m_list_level_is_preloaded.resize(m_opts.max_level,0);
+        m_list_level_is_preloaded.resize(m_opts.max_level+1,0);
 
         m_tile_data_source->StartRequestBlock();
         for(auto level : m_opts.list_preload_levels) {
@@ -101,7 +107,7 @@ namespace scratch
 
     TileSetLL::~TileSetLL()
     {
-        // empty
+        cancelPrefetch();
     }
 
     GeoBounds const & TileSetLL::GetBounds() const
@@ -129,6 +135,43 @@ namespace scratch
                                   std::vector<TileLL::Id> &list_tile_id_upd,
                                   std::vector<TileLL::Id> &list_tile_id_rem)
     {
+        updateTileSet(cam,
+                      TimePoint::max(),
+                      list_tile_id_add,
+                      list_tile_id_upd,
+                      list_tile_id_rem);
+    }
+
+    bool TileSetLL::UpdateTileSet(osg::Camera const * cam,
+                                  std::chrono::microseconds budget,
+                                  std::vector<TileLL::Id> &list_tile_id_add,
+                                  std::vector<TileLL::Id> &list_tile_id_upd,
+                                  std::vector<TileLL::Id> &list_tile_id_rem)
+    {
+        return updateTileSet(cam,
+                             Clock::now()+budget,
+                             list_tile_id_add,
+                             list_tile_id_upd,
+                             list_tile_id_rem);
+    }
+
+    TileSetLL::UpdateStats const & TileSetLL::GetUpdateStats() const
+    {
+        return m_stats;
+    }
+
+    bool TileSetLL::updateTileSet(osg::Camera const * cam,
+                                  TimePoint const &deadline,
+                                  std::vector<TileLL::Id> &list_tile_id_add,
+                                  std::vector<TileLL::Id> &list_tile_id_upd,
+                                  std::vector<TileLL::Id> &list_tile_id_rem)
+    {
+        m_stats = UpdateStats();
+
+        list_tile_id_add.clear();
+        list_tile_id_upd.clear();
+        list_tile_id_rem.clear();
+
         // Save new camera eye LLA
         osg::Vec3d eye,vpt,up;
         cam->getViewMatrixAsLookAt(eye,vpt,up);
@@ -140,7 +183,7 @@ namespace scratch
                 if(!id_req.second->IsFinished()) {
                     // We don't do anything until all of
                     // the base data is finished loading
-                    return;
+                    return false;
                 }
             }
             m_preloaded_data_ready = true;
@@ -148,42 +191,33 @@ namespace scratch
         }
 
         // Update tile visibility
+        TimePoint t_start = Clock::now();
         m_tile_visibility->Update(cam);
+        TimePoint t_end = Clock::now();
+        m_stats.visibility_ms += CalcDurationMs(t_start,t_end);
 
-        // Build tile set
+        // Build tile set; tiles added, updated and removed
+        // wrt the previous tile set are recorded during
+        // the traversal
 //        std::vector<TileItem> list_tiles_new =
 //                buildTileSetBFS_czm();
 
-        std::vector<TileItem> list_tiles_new =
-                buildTileSetRanked();
-
-        // We need to sort by tile_id before we can
-        // split into tiles added/removed
-        std::sort(list_tiles_new.begin(),
-                  list_tiles_new.end(),
-                  TileSetLL::CompareTileItemIdIncreasing);
-
-        // Create new and old id lists
-        std::vector<TileLL::Id> list_tile_id_new;
-        list_tile_id_new.reserve(list_tiles_new.size());
-        for(auto const &item : list_tiles_new) {
-            list_tile_id_new.push_back(item.id);
+        buildTileSetRanked(deadline,
+                           list_tile_id_add,
+                           list_tile_id_upd,
+                           list_tile_id_rem);
+        t_end = Clock::now();
+
+        // Request data for tiles the camera is expected
+        // to see soon. Prefetching is speculative so it's
+        // skipped if we've run out of time.
+        if((m_opts.prefetch_horizon_s > 0.0) && m_stats.complete) {
+            t_start = t_end;
+            updatePrefetch(cam);
+            m_stats.prefetch_ms += CalcDurationMs(t_start,Clock::now());
         }
 
-        std::vector<TileLL::Id> list_tile_id_old;
-        list_tile_id_old.reserve(m_list_tiles.size());
-        for(auto const &item : m_list_tiles) {
-            list_tile_id_old.push_back(item.id);
-        }
-
-        SplitSets(list_tile_id_new,
-                  list_tile_id_old,
-                  list_tile_id_add,
-                  list_tile_id_rem,
-                  list_tile_id_upd);
-
-        // save new tile set
-        std::swap(m_list_tiles,list_tiles_new);
+        return m_stats.complete;
     }
 
     void TileSetLL::quickTest()
@@ -233,23 +267,48 @@ namespace scratch
 
     TileSetLL::TileItem const * TileSetLL::GetTile(TileLL::Id tile_id) const
     {
-        // expect m_list_tiles to be sorted
-        // in increasing order (default)
-
-        // TODO check if function or functor faster than lambda
-        auto it = std::lower_bound(
-                    m_list_tiles.begin(),
-                    m_list_tiles.end(),
-                    tile_id,
-                    [](TileItem const &a, TileLL::Id b) {
-                        return (a.id < b);
-                    });
+        // Find the tile by walking down the quadtree
+        // from its root tile
+        uint8_t level; uint32_t x; uint32_t y;
+        TileLL::GetLevelXYFromId(tile_id,level,x,y);
+
+        uint32_t const num_root_tiles_x = GetNumRootTilesX();
+        uint32_t const root_x = x >> level;
+        uint32_t const root_y = y >> level;
+        if((root_x >= num_root_tiles_x) ||
+           (root_y >= GetNumRootTilesY())) {
+            return nullptr;
+        }
+
+        TileLL const * tile =
+                m_list_root_tiles[root_y*num_root_tiles_x + root_x].get();
+
+        for(uint8_t i=level; i > 0; i--) {
+            if(tile->clip != TileLL::k_clip_ALL) {
+                return nullptr;
+            }
+
+            bool const right = (x >> (i-1)) & 1;
+            bool const top   = (y >> (i-1)) & 1;
 
-        if(it == m_list_tiles.end()) {
+            if(right) {
+                tile = (top) ? tile->tile_RT.get() : tile->tile_RB.get();
+            }
+            else {
+                tile = (top) ? tile->tile_LT.get() : tile->tile_LB.get();
+            }
+        }
+
+        // Only tiles saved during the last update
+        // are part of the tile set
+        TileMetaData const * meta =
+                static_cast<TileMetaData const *>(tile->data.get());
+
+        if((meta == nullptr) || (meta->item_gen != m_item_gen)) {
             return nullptr;
         }
 
-        return (&(*it));
+        return &(m_list_tiles[meta->item_idx]);
     }
 
     std::vector<TileSetLL::TileItem> TileSetLL::buildTileSetBFS_czm()
@@ -593,7 +652,10 @@ namespace scratch
         return list_tile_items;
     }
 
-    std::vector<TileSetLL::TileItem> TileSetLL::buildTileSetRanked()
+    void TileSetLL::buildTileSetRanked(TimePoint const &deadline,
+                                       std::vector<TileLL::Id> &list_tile_id_add,
+                                       std::vector<TileLL::Id> &list_tile_id_upd,
+                                       std::vector<TileLL::Id> &list_tile_id_rem)
     {
         // In this method, tiles don't necessarily have
         // a unique associated TileData.
@@ -605,8 +667,18 @@ namespace scratch
         // immediately available, TileData is substituted
         // in by sampling from TileData that is available
 
-        std::vector<TileItem> list_tile_items;
+        // If @deadline passes before the traversal is complete,
+        // tiles that haven't been subdivided yet are used as is
+        // and the traversal continues from the same point in the
+        // next call
 
+        // The quadtree is kept between updates. Each tile saved
+        // to the tile set is stamped with the current generation
+        // (@m_item_gen), so tiles that were saved in the last
+        // update can be identified without diffing sorted lists:
+        // * saved again: updated
+        // * subdivided or pruned from the quadtree: removed
+        // * otherwise: added
 
         // Mark the start of this update/tile traversal in
         // the view data LRU cache.
@@ -615,11 +687,17 @@ namespace scratch
                     std::make_pair(TileLL::GetIdFromLevelXY(255,0,0),
                                    nullptr));
 
-        std::vector<TileMetaData*> queue_bfs;
+        bool const resume = (m_bfs_idx < m_queue_bfs.size());
+        if(!resume) {
+            m_queue_bfs.clear();
+            m_bfs_idx = 0;
+        }
+
+        TimePoint t_start = Clock::now();
 
         // Root tiles
         for(auto & tile : m_list_root_tiles) {
-            TileMetaData * meta = createMetaData(tile.get());
+            TileMetaData * meta = getOrCreateMetaData(tile.get());
 
             // All root tiles must always be available
             m_tile_data_source->StartRequestBlock();
@@ -627,125 +705,159 @@ namespace scratch
             m_tile_data_source->EndRequestBlock();
 
             if(!meta->request->IsFinished()) {
-                return list_tile_items;
+                // Everything in the current tile set is removed
+                for(auto const &item : m_list_tiles) {
+                    list_tile_id_rem.push_back(item.id);
+                }
+                m_list_tiles.clear();
+                m_item_gen++;
+
+                m_queue_bfs.clear();
+                m_bfs_idx = 0;
+                m_ll_view_data.erase(TileLL::GetIdFromLevelXY(255,0,0));
+                return;
             }
 
-            // start with an empty quadtree
-            destroyChildren(tile.get());
+            if(resume) {
+                continue;
+            }
 
             // get visibility
-            m_tile_visibility->GetVisibility(
-                        meta->tile,
-                        getData(meta->tile),
-                        meta->is_visible,
-                        meta->norm_error,
-                        meta->closest_point);
+            calcVisibility(meta,getData(meta->tile));
 
-            queue_bfs.push_back(meta);
+            m_queue_bfs.push_back(meta);
         }
 
+        // Generation of tiles saved in the last update
+        uint32_t const prev_item_gen = m_item_gen;
+        m_item_gen++;
+
         // Create a list of tiles according to tile visibility
-        for(size_t i=0; i < queue_bfs.size(); i++)
+        size_t num_traversed=0;
+        for(; m_bfs_idx < m_queue_bfs.size(); m_bfs_idx++)
         {
-            TileMetaData * meta = queue_bfs[i];
+            // Checking the clock for every tile is wasteful,
+            // so check every few tiles. At least a few tiles
+            // are always traversed so a resumed traversal
+            // eventually completes.
+            num_traversed++;
+            if(((num_traversed & 15) == 0) &&
+               (deadline != TimePoint::max()) &&
+               (Clock::now() > deadline)) {
+                break;
+            }
+
+            TileMetaData * meta = m_queue_bfs[m_bfs_idx];
             TileLL * tile = meta->tile;
 
             if((meta->norm_error > 1.0) &&
                (tile->level < m_opts.max_level))
             {
-                // Enqueue children for traversal
+                // A subdivided tile is no longer part
+                // of the tile set
+                if(meta->item_gen == prev_item_gen) {
+                    list_tile_id_rem.push_back(tile->id);
+                }
+
+                // Enqueue children for traversal; children
+                // kept from previous updates are reused
                 createChildren(tile);
 
-                std::vector<TileMetaData*> list_children {
-                    createMetaData(tile->tile_LT.get()),
-                    createMetaData(tile->tile_LB.get()),
-                    createMetaData(tile->tile_RB.get()),
-                    createMetaData(tile->tile_RT.get())
+                TileLL * const list_children[4] = {
+                    tile->tile_LT.get(),
+                    tile->tile_LB.get(),
+                    tile->tile_RB.get(),
+                    tile->tile_RT.get()
                 };
 
-                for(auto &child : list_children) {
-                    m_tile_visibility->GetVisibility(
-                                child->tile,
-                                getData(meta->tile),
-                                child->is_visible,
-                                child->norm_error,
-                                child->closest_point);
-
-                    queue_bfs.push_back(child);
+                for(auto child : list_children) {
+                    TileMetaData * child_meta = getOrCreateMetaData(child);
+                    calcVisibility(child_meta,getData(meta->tile));
+                    m_queue_bfs.push_back(child_meta);
                 }
             }
+            else {
+                // Children from previous updates are
+                // no longer needed
+                pruneChildren(tile,prev_item_gen,list_tile_id_rem);
+            }
         }
 
-        // Split into root and ranked tiles
-        auto it_tmd = queue_bfs.begin();
-        std::advance(it_tmd,m_list_root_tiles.size());
-
-        std::vector<TileMetaData*> list_root_tiles;
-        list_root_tiles.reserve(m_list_root_tiles.size());
-        list_root_tiles.insert(list_root_tiles.end(),
-                               queue_bfs.begin(),
-                               it_tmd);
+        m_stats.complete = (m_bfs_idx == m_queue_bfs.size());
+        m_stats.num_tiles_traversed = m_queue_bfs.size();
 
-        std::vector<TileMetaData*> list_ranked_tiles;
-        list_ranked_tiles.reserve(queue_bfs.size());
-        list_ranked_tiles.insert(list_ranked_tiles.end(),
-                                 it_tmd,
-                                 queue_bfs.end());
+        // Tiles that weren't traversed in time are
+        // used in place of their children
+        for(size_t i=m_bfs_idx; i < m_queue_bfs.size(); i++) {
+            pruneChildren(m_queue_bfs[i]->tile,prev_item_gen,list_tile_id_rem);
+        }
 
-        // Sort non root tiles with a ranking function
+        // Rank non root tiles with a ranking function
         // that factors in tile level and distance
-        std::sort(list_ranked_tiles.begin(),
-                  list_ranked_tiles.end(),
-                  [](TileMetaData const * a, TileMetaData const * b) {
-                        // TODO
-                        // Should tiles with clip==k_clip_ALL have
-                        // a rank of 0?
-
-                        double rank_a =
-                                double(a->tile->level)*
-                                double(a->is_visible)* // should work, false==0.0,true==1.0
-                                a->norm_error;
-
-                        double rank_b =
-                                double(b->tile->level)*
-                                double(b->is_visible)*
-                                b->norm_error;
-
-                        return (rank_a > rank_b);
-                    }
-                );
+        m_list_ranked_tiles.clear();
+        m_list_ranked_tiles.insert(m_list_ranked_tiles.end(),
+                                   m_queue_bfs.begin()+m_list_root_tiles.size(),
+                                   m_queue_bfs.end());
+
+        // Requests saved during a previous update may
+        // since have been dropped from the cache
+        for(auto meta : m_list_ranked_tiles) {
+            meta->request = nullptr;
+        }
 
-        // Request as much data as there is space: @max_view_data
-        // and use substitution for everything else
+        // Only the tiles that get requests need to be
+        // in order, so a partial sort is enough
         size_t const num_requests =
-                std::min(list_ranked_tiles.size(),
+                std::min(m_list_ranked_tiles.size(),
                          static_cast<size_t>(m_max_view_data));
 
+        std::partial_sort(m_list_ranked_tiles.begin(),
+                          m_list_ranked_tiles.begin()+num_requests,
+                          m_list_ranked_tiles.end(),
+                          [](TileMetaData const * a, TileMetaData const * b) {
+                                // TODO
+                                // Should tiles with clip==k_clip_ALL have
+                                // a rank of 0?
+
+                                double rank_a =
+                                        double(a->tile->level)*
+                                        double(a->is_visible)* // should work, false==0.0,true==1.0
+                                        a->norm_error;
+
+                                double rank_b =
+                                        double(b->tile->level)*
+                                        double(b->is_visible)*
+                                        b->norm_error;
+
+                                return (rank_a > rank_b);
+                            }
+                        );
+
+        TimePoint t_end = Clock::now();
+        m_stats.traversal_ms += CalcDurationMs(t_start,t_end);
+
+        // Request as much data as there is space: @max_view_data
+        // and use substitution for everything else
+        t_start = t_end;
         m_tile_data_source->StartRequestBlock();
         for(size_t i=0; i < num_requests; i++) {
-            TileMetaData * meta = list_ranked_tiles[i];
+            TileMetaData * meta = m_list_ranked_tiles[i];
             meta->request = getOrCreateDataRequest(meta->tile,true);
         }
         m_tile_data_source->EndRequestBlock();
+        t_end = Clock::now();
+        m_stats.request_ms += CalcDurationMs(t_start,t_end);
 
-
-        //
-        for(auto &meta : list_root_tiles) {
-            if(meta->tile->clip == TileLL::k_clip_NONE) {
-                list_tile_items.emplace_back(
-                            meta->tile->id,
-                            meta->tile,
-                            meta->tile,
-                            meta->request->GetData().get());
-            }
-        }
-
-        for(auto &meta : list_ranked_tiles) {
+        // Save the tile set
+        t_start = t_end;
+        m_list_tiles.clear();
+        for(auto meta : m_queue_bfs) {
             if(meta->tile->clip == TileLL::k_clip_ALL) {
                 continue;
             }
 
-            // determine sample if required
+            // determine sample if required; root tiles
+            // always have their own data
             TileLL * sample_tile = meta->tile;
             TileMetaData * sample_meta;
 
@@ -761,24 +873,82 @@ namespace scratch
                 }
             }
 
+            if(meta->item_gen == prev_item_gen) {
+                list_tile_id_upd.push_back(meta->tile->id);
+            }
+            else {
+                list_tile_id_add.push_back(meta->tile->id);
+            }
+            meta->item_gen = m_item_gen;
+            meta->item_idx = m_list_tiles.size();
+
             // save
-            list_tile_items.emplace_back(
+            m_list_tiles.emplace_back(
                         meta->tile->id,
                         meta->tile,
                         sample_tile,
                         sample_meta->request->GetData().get());
         }
+        t_end = Clock::now();
+        m_stats.diff_ms += CalcDurationMs(t_start,t_end);
 
         // trim cache
+        t_start = t_end;
         m_ll_view_data.trim(it_mark_upd_start,m_opts.cache_size_hint);
         m_ll_view_data.erase(TileLL::GetIdFromLevelXY(255,0,0));
         m_ll_view_data.trim(m_max_view_data);
 
+        m_stats.traversal_ms += CalcDurationMs(t_start,Clock::now());
+
         //
 //        std::cout << "#: sz ll view data: "
 //                     << m_ll_view_data.size() << std::endl;
+    }
 
-        return list_tile_items;
+    void TileSetLL::pruneChildren(TileLL * tile,
+                                  uint32_t item_gen,
+                                  std::vector<TileLL::Id> &list_tile_id_rem)
+    {
+        if(tile->clip != TileLL::k_clip_ALL) {
+            return;
+        }
+
+        TileLL * const list_children[4] = {
+            tile->tile_LT.get(),
+            tile->tile_LB.get(),
+            tile->tile_RB.get(),
+            tile->tile_RT.get()
+        };
+
+        for(auto child : list_children) {
+            TileMetaData const * meta = getMetaData(child);
+            if(meta && (meta->item_gen == item_gen)) {
+                list_tile_id_rem.push_back(child->id);
+            }
+            pruneChildren(child,item_gen,list_tile_id_rem);
+        }
+
+        destroyChildren(tile);
+    }
+
+    void TileSetLL::calcVisibility(TileMetaData * meta,
+                                   TileDataSourceLL::Data const * data)
+    {
+        TimePoint const t_start = Clock::now();
+
+        m_tile_visibility->GetVisibility(
+                    meta->tile,
+                    data,
+                    meta->is_visible,
+                    meta->norm_error,
+                    meta->closest_point);
+
+        double const ms = CalcDurationMs(t_start,Clock::now());
+        m_stats.visibility_ms += ms;
+
+        // visibility is timed separately from
+        // the rest of the traversal
+        m_stats.traversal_ms -= ms;
     }
 
     TileDataSourceLL::Data const *
@@ -836,12 +1006,23 @@ namespace scratch
         // check dynamic tile data
         auto it = m_ll_view_data.find(tile->id);
         if(it == m_ll_view_data.end()) {
-            // create request if it doesn't exist
+            // create request if it doesn't exist, taking
+            // over a prefetched request if there is one
+            std::shared_ptr<TileDataSourceLL::Request> request;
+            auto pf_it = m_lkup_prefetch_data.find(tile->id);
+            if(pf_it != m_lkup_prefetch_data.end()) {
+                request = std::move(pf_it->second);
+                m_lkup_prefetch_data.erase(pf_it);
+            }
+            else {
+                request = m_tile_data_source->RequestData(tile->id);
+            }
+
             it = m_ll_view_data.insert(
                         m_ll_view_data.begin(),
                         std::make_pair(
                             tile->id,
-                            m_tile_data_source->RequestData(tile->id)));
+                            std::move(request)));
 
             if(existed) {
                 *existed = false;
@@ -985,6 +1166,249 @@ namespace scratch
         return list_children;
     }
 
+    void TileSetLL::updatePrefetch(osg::Camera const * cam)
+    {
+        auto const now = std::chrono::steady_clock::now();
+
+        // Sample the current camera
+        CameraMotion motion;
+        motion.valid = true;
+        motion.time = now;
+
+        osg::Vec3d vpt;
+        cam->getViewMatrixAsLookAt(motion.eye,vpt,motion.up);
+        motion.dirn = vpt-motion.eye;
+        motion.alt = motion.eye.length()-RAD_AV;
+
+        if(motion.alt <= 0.0) {
+            // can't extrapolate from below the surface
+            cancelPrefetch();
+            m_cam_motion = CameraMotion();
+            return;
+        }
+
+        if(m_cam_motion.valid) {
+            double const dt =
+                    std::chrono::duration<double>(
+                        now-m_cam_motion.time).count();
+
+            if(dt <= 0.0) {
+                return;
+            }
+
+            // Cancel everything if the camera didn't
+            // go where it was expected to
+            osg::Vec3d eye_pred,dirn_pred,up_pred;
+            calcPredictedView(m_cam_motion,dt,eye_pred,dirn_pred,up_pred);
+
+            if((eye_pred-motion.eye).length() >
+               m_opts.prefetch_divergence*motion.alt) {
+                cancelPrefetch();
+            }
+
+            // Panning is treated as a rotation of the eye
+            // about the earth's center so the extrapolated
+            // camera stays at a sane altitude
+            osg::Vec3d n0 = m_cam_motion.eye; n0.normalize();
+            osg::Vec3d n1 = motion.eye; n1.normalize();
+            osg::Vec3d axis = n0^n1;
+            double const sin_angle = axis.length();
+            if(sin_angle > K_EPS) {
+                motion.pan_axis = axis/sin_angle;
+                motion.pan_rate = atan2(sin_angle,n0*n1)/dt;
+            }
+
+            // Zooming is roughly exponential wrt altitude
+            motion.zoom_rate = log(motion.alt/m_cam_motion.alt)/dt;
+        }
+
+        m_cam_motion = motion;
+
+        // Nothing to predict if the camera isn't moving
+        static const double k_min_rate = 1E-6;
+        if((fabs(motion.pan_rate) < k_min_rate) &&
+           (fabs(motion.zoom_rate) < k_min_rate)) {
+            return;
+        }
+
+        // Evaluate visibility for each predicted frustum
+        if(!m_prefetch_cam) {
+            m_prefetch_cam = new osg::Camera;
+        }
+        m_prefetch_cam->setProjectionMatrix(cam->getProjectionMatrix());
+
+        std::map<TileLL::Id,double> lkup_rank;
+        for(uint32_t i=1; i <= m_opts.prefetch_steps; i++) {
+            double const t = m_opts.prefetch_horizon_s*i/m_opts.prefetch_steps;
+
+            osg::Vec3d eye,dirn,up;
+            calcPredictedView(motion,t,eye,dirn,up);
+            m_prefetch_cam->setViewMatrixAsLookAt(eye,eye+dirn,up);
+
+            buildPrefetchTileSet(m_prefetch_cam.get(),lkup_rank);
+        }
+
+        std::vector<std::pair<double,TileLL::Id>> list_ranked;
+        list_ranked.reserve(lkup_rank.size());
+        for(auto const &id_rank : lkup_rank) {
+            list_ranked.emplace_back(id_rank.second,id_rank.first);
+        }
+        std::sort(list_ranked.begin(),
+                  list_ranked.end(),
+                  [](std::pair<double,TileLL::Id> const &a,
+                     std::pair<double,TileLL::Id> const &b) {
+                        return (a.first > b.first);
+                    });
+
+        // Request as much data as the prefetch budget allows,
+        // keeping existing prefetch requests that are still
+        // predicted and skipping anything already in use
+        std::map<
+            TileLL::Id,
+            std::shared_ptr<TileDataSourceLL::Request>
+            > lkup_prefetch_data;
+
+        uint64_t num_bytes=0;
+
+        m_tile_data_source->StartRequestBlock();
+        for(auto const &rank_id : list_ranked) {
+            TileLL::Id const tile_id = rank_id.second;
+
+            uint8_t level; uint32_t x; uint32_t y;
+            TileLL::GetLevelXYFromId(tile_id,level,x,y);
+            if(m_list_level_is_preloaded[level]) {
+                continue;
+            }
+
+            if(m_ll_view_data.find(tile_id) != m_ll_view_data.end()) {
+                continue;
+            }
+
+            std::shared_ptr<TileDataSourceLL::Request> request;
+            auto pf_it = m_lkup_prefetch_data.find(tile_id);
+            if(pf_it != m_lkup_prefetch_data.end()) {
+                request = pf_it->second;
+            }
+
+            uint64_t const req_bytes = calcPrefetchBytes(request.get());
+            if(num_bytes+req_bytes > m_opts.prefetch_max_bytes) {
+                break;
+            }
+            num_bytes += req_bytes;
+
+            if(!request) {
+                request = m_tile_data_source->RequestDataLowPriority(tile_id);
+            }
+
+            lkup_prefetch_data.emplace(tile_id,std::move(request));
+        }
+        m_tile_data_source->EndRequestBlock();
+
+        // Cancel requests that are no longer predicted
+        for(auto &id_req : m_lkup_prefetch_data) {
+            if(lkup_prefetch_data.count(id_req.first) == 0) {
+                id_req.second->Cancel();
+            }
+        }
+        std::swap(m_lkup_prefetch_data,lkup_prefetch_data);
+    }
+
+    void TileSetLL::buildPrefetchTileSet(osg::Camera const * cam,
+                                         std::map<TileLL::Id,double> &lkup_rank)
+    {
+        m_tile_visibility->Update(cam);
+
+        std::vector<TileLL*> queue_bfs;
+        for(auto & tile : m_list_prefetch_root_tiles) {
+            destroyChildren(tile.get());
+            queue_bfs.push_back(tile.get());
+        }
+
+        for(size_t i=0; i < queue_bfs.size(); i++)
+        {
+            TileLL * tile = queue_bfs[i];
+
+            bool is_visible;
+            double norm_error;
+            osg::Vec3d closest_point;
+            m_tile_visibility->GetVisibility(tile,
+                                             nullptr,
+                                             is_visible,
+                                             norm_error,
+                                             closest_point);
+            if(!is_visible) {
+                continue;
+            }
+
+            // Root tiles are always requested by the
+            // regular update
+            if(tile->parent) {
+                double const rank = double(tile->level)*norm_error;
+                auto it = lkup_rank.find(tile->id);
+                if(it == lkup_rank.end()) {
+                    lkup_rank.emplace(tile->id,rank);
+                }
+                else if(rank > it->second) {
+                    it->second = rank;
+                }
+            }
+
+            if((norm_error > 1.0) &&
+               (tile->level < m_opts.max_level))
+            {
+                createChildren(tile);
+                queue_bfs.push_back(tile->tile_LT.get());
+                queue_bfs.push_back(tile->tile_LB.get());
+                queue_bfs.push_back(tile->tile_RB.get());
+                queue_bfs.push_back(tile->tile_RT.get());
+            }
+        }
+    }
+
+    void TileSetLL::calcPredictedView(CameraMotion const &motion,
+                                      double t,
+                                      osg::Vec3d &eye,
+                                      osg::Vec3d &dirn,
+                                      osg::Vec3d &up)
+    {
+        // Keep extrapolated zooming within reason
+        static const double k_min_alt = 1.0;
+        static const double k_max_alt = RAD_AV*10.0;
+
+        osg::Quat const q(motion.pan_rate*t,motion.pan_axis);
+
+        double const alt = clamp(motion.alt*exp(motion.zoom_rate*t),
+                                 k_min_alt,
+                                 k_max_alt);
+
+        osg::Vec3d n = motion.eye;
+        n.normalize();
+
+        eye = (q*n)*(RAD_AV+alt);
+        dirn = q*motion.dirn;
+        up = q*motion.up;
+    }
+
+    uint64_t TileSetLL::calcPrefetchBytes(TileDataSourceLL::Request const * req) const
+    {
+        if(req && req->IsFinished()) {
+            auto const data = req->GetData();
+            if(data && (data->GetSizeBytes() > 0)) {
+                return data->GetSizeBytes();
+            }
+        }
+
+        return m_opts.prefetch_tile_bytes_hint;
+    }
+
+    void TileSetLL::cancelPrefetch()
+    {
+        for(auto &id_req : m_lkup_prefetch_data) {
+            id_req.second->Cancel();
+        }
+        m_lkup_prefetch_data.clear();
+    }
+
     TileSetLL::Options
     TileSetLL::initOptions(Options opts) const
     {
@@ -1022,6 +1446,11 @@ namespace scratch
             opts.upsample_hint = false;
         }
 
+        // need at least one predicted frustum to prefetch
+        if(opts.prefetch_steps == 0) {
+            opts.prefetch_horizon_s = 0.0;
+        }
+
         return opts;
     }
 
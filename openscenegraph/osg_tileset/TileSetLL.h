@@ -18,6 +18,7 @@
 #define SCRATCH_TILESET_LL_H
 
 #include <unordered_map>
+#include <chrono>
 #include <MiscUtils.h>
 #include <TileDataSourceLL.h>
 #include <TileVisibilityLL.h>
@@ -57,7 +58,12 @@ namespace scratch
                 max_tile_data(std::numeric_limits<uint64_t>::max()/2),
                 cache_size_hint(128),
                 list_preload_levels({0,1}),
-                upsample_hint(false)
+                upsample_hint(false),
+                prefetch_horizon_s(0.0),
+                prefetch_steps(2),
+                prefetch_max_bytes(32*1024*1024),
+                prefetch_tile_bytes_hint(256*256*4),
+                prefetch_divergence(0.25)
             {
                 // empty
             }
@@ -83,6 +89,70 @@ namespace scratch
             // tiles if its own data isn't available yet. The
             // TileDataSource implementation must allow sampling.
             bool upsample_hint;
+
+            // How far ahead (in seconds) camera motion is
+            // extrapolated to prefetch tile data. Prefetching
+            // is disabled if this is 0.
+            double prefetch_horizon_s;
+
+            // Number of predicted frustums evaluated across
+            // the prefetch horizon
+            uint8_t prefetch_steps;
+
+            // Byte budget for prefetched tile data. This is
+            // separate from max_tile_data; prefetched data only
+            // counts against max_tile_data once a regular
+            // update actually uses it.
+            uint64_t prefetch_max_bytes;
+
+            // Estimated size of a single tile's data, used for
+            // prefetch requests that haven't finished yet or
+            // whose data doesn't report a size
+            uint64_t prefetch_tile_bytes_hint;
+
+            // If the camera eye ends up further than this fraction
+            // of its altitude away from where it was predicted to
+            // be, all outstanding prefetch requests are canceled
+            double prefetch_divergence;
+        };
+
+        // Time spent in each phase of the last call
+        // to UpdateTileSet (in milliseconds)
+        struct UpdateStats
+        {
+            UpdateStats() :
+                visibility_ms(0.0),
+                traversal_ms(0.0),
+                diff_ms(0.0),
+                request_ms(0.0),
+                prefetch_ms(0.0),
+                num_tiles_traversed(0),
+                complete(false)
+            {
+                // empty
+            }
+
+            // TileVisibility updates and evaluation
+            double visibility_ms;
+
+            // quadtree traversal, ranking and building
+            // the list of TileItems (excludes visibility)
+            double traversal_ms;
+
+            // determining tiles added, updated and removed
+            double diff_ms;
+
+            // dispatching data requests to TileDataSource
+            double request_ms;
+
+            // predicting and requesting prefetched data
+            double prefetch_ms;
+
+            // number of tiles in the quadtree so far
+            size_t num_tiles_traversed;
+
+            // false if the traversal ran out of time
+            bool complete;
         };
 
         TileSetLL(std::unique_ptr<TileDataSourceLL> tile_data_source,
@@ -104,6 +174,22 @@ namespace scratch
                            std::vector<TileLL::Id> &list_tiles_upd,
                            std::vector<TileLL::Id> &list_tiles_rem);
 
+        // * same as above, but the quadtree traversal stops
+        //   once @budget has elapsed
+        // * the tileset is built from what was traversed so
+        //   far (tiles that weren't subdivided in time are
+        //   used in place of their children) and the
+        //   traversal resumes from the same point during
+        //   the next call
+        // * returns true if the traversal completed
+        bool UpdateTileSet(osg::Camera const * cam,
+                           std::chrono::microseconds budget,
+                           std::vector<TileLL::Id> &list_tiles_add,
+                           std::vector<TileLL::Id> &list_tiles_upd,
+                           std::vector<TileLL::Id> &list_tiles_rem);
+
+        UpdateStats const & GetUpdateStats() const;
+
         void quickTest();
 
         TileItem const * GetTile(TileLL::Id tile_id) const;
@@ -161,6 +247,15 @@ namespace scratch
         }
 
     private:
+        typedef std::chrono::steady_clock Clock;
+        typedef Clock::time_point TimePoint;
+
+        static double CalcDurationMs(TimePoint const &start,
+                                     TimePoint const &end)
+        {
+            return std::chrono::duration<double,std::milli>(end-start).count();
+        }
+
         struct TileMetaData : public TileLL::Data
         {
             TileMetaData(TileLL * tile) :
@@ -168,7 +263,9 @@ namespace scratch
                 request(nullptr),
                 ready(false),
                 is_visible(false),
-                norm_error(-1.0)
+                norm_error(-1.0),
+                item_gen(0),
+                item_idx(0)
             {
                 // empty
             }
@@ -182,13 +279,39 @@ namespace scratch
             bool is_visible;
             double norm_error;
             osg::Vec3d closest_point;
+
+            // generation of the last update this tile was
+            // saved to the tile set in, and its index in
+            // m_list_tiles for that update
+            uint32_t item_gen;
+            size_t item_idx;
         };
 
         // TODO desc
         std::vector<TileItem> buildTileSetBFS();
         std::vector<TileItem> buildTileSetBFS_czm();
 
-        std::vector<TileItem> buildTileSetRanked();
+        void buildTileSetRanked(TimePoint const &deadline,
+                                std::vector<TileLL::Id> &list_tiles_add,
+                                std::vector<TileLL::Id> &list_tiles_upd,
+                                std::vector<TileLL::Id> &list_tiles_rem);
+
+        // * destroys all descendants of @tile, saving the ids of
+        //   any that were part of the tile set for @item_gen
+        //   to @list_tiles_rem
+        void pruneChildren(TileLL * tile,
+                           uint32_t item_gen,
+                           std::vector<TileLL::Id> &list_tiles_rem);
+
+        bool updateTileSet(osg::Camera const * cam,
+                           TimePoint const &deadline,
+                           std::vector<TileLL::Id> &list_tiles_add,
+                           std::vector<TileLL::Id> &list_tiles_upd,
+                           std::vector<TileLL::Id> &list_tiles_rem);
+
+        // * timed wrapper around TileVisibility::GetVisibility
+        void calcVisibility(TileMetaData * meta,
+                            TileDataSourceLL::Data const * data);
 
 
         static bool compareMetaDataRankIncreasing(TileMetaData const * a,
@@ -234,6 +357,66 @@ namespace scratch
             return static_cast<TileMetaData*>(tile->data.get());
         }
 
+        TileMetaData * getOrCreateMetaData(TileLL * tile) const
+        {
+            if(tile->data) {
+                return getMetaData(tile);
+            }
+            return createMetaData(tile);
+        }
+
+
+        // Camera motion sampled at each update, used
+        // to extrapolate the camera for prefetching
+        struct CameraMotion
+        {
+            CameraMotion() :
+                valid(false),
+                alt(0.0),
+                pan_axis(0,0,1),
+                pan_rate(0.0),
+                zoom_rate(0.0)
+            {
+                // empty
+            }
+
+            bool valid;
+            std::chrono::steady_clock::time_point time;
+
+            osg::Vec3d eye;
+            osg::Vec3d dirn;
+            osg::Vec3d up;
+            double alt;
+
+            // rotation of the eye about the earth's
+            // center (rads/s) and rate of change of
+            // ln(altitude) (1/s)
+            osg::Vec3d pan_axis;
+            double pan_rate;
+            double zoom_rate;
+        };
+
+        // * updates the camera motion estimate, issues low
+        //   priority requests for tiles visible along the
+        //   predicted camera path and cancels requests that
+        //   are no longer predicted
+        void updatePrefetch(osg::Camera const * cam);
+
+        // * builds a list of tiles visible to @cam ranked
+        //   the same way as buildTileSetRanked; uses a separate
+        //   quadtree so m_list_tiles isn't invalidated
+        void buildPrefetchTileSet(osg::Camera const * cam,
+                                  std::map<TileLL::Id,double> &lkup_rank);
+
+        static void calcPredictedView(CameraMotion const &motion,
+                                      double t,
+                                      osg::Vec3d &eye,
+                                      osg::Vec3d &dirn,
+                                      osg::Vec3d &up);
+
+        uint64_t calcPrefetchBytes(TileDataSourceLL::Request const * req) const;
+
+        void cancelPrefetch();
 
         // init helpers
         Options initOptions(Options opts) const;
@@ -268,9 +451,35 @@ namespace scratch
 
         bool m_preloaded_data_ready;
 
+        // prefetch
+        std::vector<std::unique_ptr<TileLL>> m_list_prefetch_root_tiles;
+
+        std::map<
+            TileLL::Id,
+            std::shared_ptr<TileDataSourceLL::Request>
+            > m_lkup_prefetch_data;
+
+        CameraMotion m_cam_motion;
+        osg::ref_ptr<osg::Camera> m_prefetch_cam;
+
         // camera eye LLA
         LLA m_lla_cam_eye;
 
+        // traversal state; a traversal is incomplete
+        // (and resumed in the next update) if
+        // m_bfs_idx < m_queue_bfs.size()
+        std::vector<TileMetaData*> m_queue_bfs;
+        size_t m_bfs_idx;
+
+        // generation of the current tile set, starts at 1
+        // since 0 marks tiles that have never been saved
+        uint32_t m_item_gen;
+
+        // reused between updates to avoid reallocating
+        std::vector<TileMetaData*> m_list_ranked_tiles;
+
+        UpdateStats m_stats;
+
         std::vector<TileItem> m_list_tiles;
         std::vector<TileItem> m_list_tiles_prev;
         std::vector<TileItem> m_list_tiles_next;
@@ -114,10 +114,9 @@ int main()
     // mock
     auto gp_mock = BuildMockFrustum();
 
-    // create dataset
+    // tiles (the dataset is created once the
+    // views' graphics contexts exist)
     osg::ref_ptr<osg::Group> gp_tiles = new osg::Group;
-    std::unique_ptr<scratch::DataSetTilesLL> dataset(
-                new scratch::DataSetTilesLL(gp_tiles));
 
     // setup view
     osgViewer::CompositeViewer viewer;
@@ -181,6 +180,14 @@ int main()
         view->setCameraManipulator(view_manip);
     }
 
+    // create dataset
+    viewer.realize();
+    osgViewer::ViewerBase::Contexts list_contexts;
+    viewer.getContexts(list_contexts);
+
+    std::unique_ptr<scratch::DataSetTilesLL> dataset(
+                new scratch::DataSetTilesLL(gp_tiles,list_contexts));
+
     std::cout << "[starting render loop...]" << std::endl;
     size_t frame_count=0;
 
@@ -22,6 +22,27 @@ LIBS += -L$${PATH_OPENSCENEGRAPH_LIB} -losgDB
 LIBS += -L$${PATH_OPENSCENEGRAPH_LIB} -losg
 LIBS += -L$${PATH_OPENSCENEGRAPH_LIB} -lOpenThreads
 
+# geodesy
+PATH_GEODESY = /home/preet/Dev/scratch/utils/geodesy
+INCLUDEPATH += $${PATH_GEODESY}
+HEADERS += $${PATH_GEODESY}/geodesy.hpp
+
+# kompex (sqlite)
+PATH_KOMPEX = /home/preet/Dev/scratch/thirdparty/kompex
+INCLUDEPATH += $${PATH_KOMPEX}
+DEFINES += SQLITE_OMIT_LOAD_EXTENSION
+HEADERS += \
+    $${PATH_KOMPEX}/sqlite3.h \
+    $${PATH_KOMPEX}/KompexSQLiteStatement.h \
+    $${PATH_KOMPEX}/KompexSQLitePrerequisites.h \
+    $${PATH_KOMPEX}/KompexSQLiteException.h \
+    $${PATH_KOMPEX}/KompexSQLiteDatabase.h
+
+SOURCES += \
+    $${PATH_KOMPEX}/sqlite3.c \
+    $${PATH_KOMPEX}/KompexSQLiteStatement.cpp \
+    $${PATH_KOMPEX}/KompexSQLiteDatabase.cpp
+
 HEADERS += \
         ViewController.hpp \
         MiscUtils.h \
@@ -30,11 +51,18 @@ HEADERS += \
         OSGUtils.h \
         ThreadPool.h \
         TileLL.h \
+        TileKey.hpp \
         TileDataSourceLL.h \
         TileImageSourceLL.h \
+        TilePyramidFormat.h \
+        TilePyramidSourceLL.h \
+        TileMBTilesSourceLL.h \
         TileVisibilityLL.h \
         TileVisibilityLLPixelsPerMeter.h \
         TileSetLL.h \
+        TileMeshBuilder.h \
+        TileAtlas.hpp \
+        TileAtlasArray.hpp \
         DataSetTileAtlasLL.h
 	
 SOURCES += \
@@ -45,8 +73,11 @@ SOURCES += \
         TileLL.cpp \
         TileDataSourceLL.cpp \
         TileImageSourceLL.cpp \
+        TilePyramidSourceLL.cpp \
+        TileMBTilesSourceLL.cpp \
         TileVisibilityLLPixelsPerMeter.cpp \
         TileSetLL.cpp \
+        TileMeshBuilder.cpp \
         DataSetTileAtlasLL.cpp
 
 SOURCES += main.cpp
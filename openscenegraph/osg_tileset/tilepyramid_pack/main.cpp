@@ -0,0 +1,344 @@
+/*
+   Copyright (C) 2014 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Packs a directory of tiles laid out as <dir>/<level>/<x>/<y>.<ext>
+// into a single tile pyramid file that can be read with
+// TilePyramidSourceLL (see TilePyramidFormat.h)
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include <TilePyramidFormat.h>
+
+using namespace scratch;
+
+// timing var
+timeval t1,t2;
+std::string timingDesc;
+
+void StartTiming(std::string const &desc)
+{
+    timingDesc = desc;
+    gettimeofday(&t1,NULL);
+}
+
+void EndTiming()
+{
+    gettimeofday(&t2,NULL);
+    double timeTaken = 0;
+    timeTaken += (t2.tv_sec - t1.tv_sec) * 1000.0 * 1000.0;
+    timeTaken += (t2.tv_usec - t1.tv_usec);
+    std::cout << "INFO: " << timingDesc << ": \t\t"
+              << timeTaken << " microseconds" << std::endl;
+}
+
+// ============================================================= //
+
+struct TileFile
+{
+    TileKey key;
+    uint64_t size;
+    std::string path;
+};
+
+bool ParseIndex(std::string const &name, uint32_t &index)
+{
+    if(name.empty()) {
+        return false;
+    }
+    char * end = nullptr;
+    unsigned long value = strtoul(name.c_str(),&end,10);
+    if(*end != '\0' || value > 0xFFFFFF) {
+        return false;
+    }
+    index = value;
+    return true;
+}
+
+std::vector<std::string> ListDir(std::string const &path)
+{
+    std::vector<std::string> list_names;
+
+    DIR * dir = opendir(path.c_str());
+    if(dir == NULL) {
+        return list_names;
+    }
+
+    struct dirent * entry;
+    while((entry = readdir(dir)) != NULL) {
+        std::string name(entry->d_name);
+        if(name == "." || name == "..") {
+            continue;
+        }
+        list_names.push_back(name);
+    }
+    closedir(dir);
+
+    return list_names;
+}
+
+void PrintUsage()
+{
+    std::cout << "Usage: tilepyramid_pack <input_dir> <output_file> [options]\n"
+                 "  -ext <png>          tile file extension\n"
+                 "  -maxlevel <n>       ignore levels above n\n"
+                 "  -roots <x> <y>      number of root tiles (default 1 1)\n"
+                 "  -bounds <minlon> <maxlon> <minlat> <maxlat>\n"
+                 "                      (default -180 180 -90 90)\n"
+                 "  -align <4096>       payload alignment in bytes\n"
+                 "  -flipy              input y index starts at the top\n"
+              << std::endl;
+}
+
+int main(int argc, char const *argv[])
+{
+    if(argc < 3) {
+        PrintUsage();
+        return -1;
+    }
+
+    std::string const input_dir(argv[1]);
+    std::string const output_file(argv[2]);
+
+    std::string ext("png");
+    uint32_t max_level = 31;
+    uint32_t num_root_tiles_x = 1;
+    uint32_t num_root_tiles_y = 1;
+    double bounds[4] = {-180.0,180.0,-90.0,90.0};
+    uint64_t alignment = 4096;
+    bool flip_y = false;
+
+    for(int i=3; i < argc; i++) {
+        std::string const arg(argv[i]);
+        if(arg == "-ext" && i+1 < argc) {
+            ext = argv[++i];
+        }
+        else if(arg == "-maxlevel" && i+1 < argc) {
+            max_level = std::min(atoi(argv[++i]),31);
+        }
+        else if(arg == "-roots" && i+2 < argc) {
+            num_root_tiles_x = atoi(argv[++i]);
+            num_root_tiles_y = atoi(argv[++i]);
+        }
+        else if(arg == "-bounds" && i+4 < argc) {
+            for(int j=0; j < 4; j++) {
+                bounds[j] = atof(argv[++i]);
+            }
+        }
+        else if(arg == "-align" && i+1 < argc) {
+            alignment = strtoull(argv[++i],NULL,10);
+        }
+        else if(arg == "-flipy") {
+            flip_y = true;
+        }
+        else {
+            std::cout << "ERROR: Unknown option: " << arg << std::endl;
+            PrintUsage();
+            return -1;
+        }
+    }
+
+    if(num_root_tiles_x == 0 || num_root_tiles_x > 255 ||
+       num_root_tiles_y == 0 || num_root_tiles_y > 255) {
+        std::cout << "ERROR: Invalid number of root tiles" << std::endl;
+        return -1;
+    }
+
+    if(alignment == 0) {
+        std::cout << "ERROR: Invalid alignment" << std::endl;
+        return -1;
+    }
+
+    if(ext.size() >= sizeof(TilePyramidHeader::format)) {
+        std::cout << "ERROR: Extension too long: " << ext << std::endl;
+        return -1;
+    }
+
+    // Find all the tiles
+    StartTiming("Find tiles");
+    std::string const suffix = "."+ext;
+    std::vector<TileFile> list_tiles;
+    uint32_t num_levels = 0;
+
+    for(auto const &level_name : ListDir(input_dir)) {
+        uint32_t level;
+        if(!ParseIndex(level_name,level) || level > max_level) {
+            continue;
+        }
+        // tile keys only hold 24 bits of x and y
+        uint64_t const num_x = uint64_t(num_root_tiles_x) << level;
+        uint64_t const num_y = uint64_t(num_root_tiles_y) << level;
+        if(num_x > (uint64_t(1) << 24) || num_y > (uint64_t(1) << 24)) {
+            std::cout << "WARN: Skipping level " << level
+                      << ", too many tiles" << std::endl;
+            continue;
+        }
+        std::string const level_dir = input_dir+"/"+level_name;
+
+        for(auto const &x_name : ListDir(level_dir)) {
+            uint32_t x;
+            if(!ParseIndex(x_name,x) || x >= num_x) {
+                continue;
+            }
+            std::string const x_dir = level_dir+"/"+x_name;
+
+            for(auto const &y_name : ListDir(x_dir)) {
+                if(y_name.size() <= suffix.size() ||
+                   y_name.compare(y_name.size()-suffix.size(),
+                                  suffix.size(),suffix) != 0) {
+                    continue;
+                }
+                uint32_t y;
+                if(!ParseIndex(y_name.substr(0,y_name.size()-suffix.size()),y) ||
+                   y >= num_y) {
+                    continue;
+                }
+                if(flip_y) {
+                    y = uint32_t(num_y-1-y);
+                }
+
+                TileFile tile;
+                tile.path = x_dir+"/"+y_name;
+
+                struct stat file_stat;
+                if(stat(tile.path.c_str(),&file_stat) != 0) {
+                    std::cout << "WARN: Could not stat "
+                              << tile.path << std::endl;
+                    continue;
+                }
+
+                tile.key = TileKeyFromLevelXY(level,x,y);
+                tile.size = file_stat.st_size;
+                list_tiles.push_back(tile);
+
+                num_levels = std::max(num_levels,level+1);
+            }
+        }
+    }
+    EndTiming();
+
+    if(list_tiles.empty()) {
+        std::cout << "ERROR: No tiles found in " << input_dir << std::endl;
+        return -1;
+    }
+
+    // Sort by key so each level is a contiguous,
+    // searchable range in the index and neighbouring
+    // tiles are written next to each other
+    std::sort(list_tiles.begin(),list_tiles.end(),
+              [](TileFile const &a, TileFile const &b) {
+                  return (a.key < b.key);
+              });
+
+    // Build the index
+    TilePyramidHeader header;
+    memset(&header,0,sizeof(TilePyramidHeader));
+    memcpy(header.magic,k_tile_pyramid_magic,sizeof(header.magic));
+    header.version = k_tile_pyramid_version;
+    header.alignment = alignment;
+    header.num_levels = num_levels;
+    header.num_root_tiles_x = num_root_tiles_x;
+    header.num_root_tiles_y = num_root_tiles_y;
+    header.num_tiles = list_tiles.size();
+    header.min_lon = bounds[0];
+    header.max_lon = bounds[1];
+    header.min_lat = bounds[2];
+    header.max_lat = bounds[3];
+    memcpy(header.format,ext.c_str(),ext.size());
+
+    std::vector<TilePyramidLevel> list_levels(num_levels);
+    for(auto &level : list_levels) {
+        level.first = 0;
+        level.count = 0;
+    }
+
+    std::vector<TilePyramidEntry> list_entries(list_tiles.size());
+    uint64_t offset = TilePyramidAlign(
+                TilePyramidIndexEnd(num_levels,list_tiles.size()),
+                alignment);
+
+    for(size_t i=0; i < list_tiles.size(); i++) {
+        auto &level = list_levels[TileKeyGetLevel(list_tiles[i].key)];
+        if(level.count == 0) {
+            level.first = i;
+        }
+        level.count++;
+
+        list_entries[i].key = list_tiles[i].key;
+        list_entries[i].offset = offset;
+        list_entries[i].size = list_tiles[i].size;
+        offset = TilePyramidAlign(offset+list_tiles[i].size,alignment);
+    }
+
+    // Write everything out
+    StartTiming("Write pyramid");
+    FILE * output = fopen(output_file.c_str(),"wb");
+    if(output == NULL) {
+        std::cout << "ERROR: Could not open " << output_file << std::endl;
+        return -1;
+    }
+
+    fwrite(&header,sizeof(TilePyramidHeader),1,output);
+    fwrite(list_levels.data(),sizeof(TilePyramidLevel),list_levels.size(),output);
+    fwrite(list_entries.data(),sizeof(TilePyramidEntry),list_entries.size(),output);
+
+    std::vector<char> buffer;
+    std::vector<char> const padding(alignment,0);
+    uint64_t position = TilePyramidIndexEnd(num_levels,list_tiles.size());
+
+    for(size_t i=0; i < list_tiles.size(); i++) {
+        fwrite(padding.data(),1,list_entries[i].offset-position,output);
+        position = list_entries[i].offset;
+
+        buffer.resize(list_tiles[i].size);
+        FILE * input = fopen(list_tiles[i].path.c_str(),"rb");
+        if(input == NULL ||
+           fread(buffer.data(),1,buffer.size(),input) != buffer.size()) {
+            std::cout << "ERROR: Could not read "
+                      << list_tiles[i].path << std::endl;
+            if(input) {
+                fclose(input);
+            }
+            fclose(output);
+            return -1;
+        }
+        fclose(input);
+
+        fwrite(buffer.data(),1,buffer.size(),output);
+        position += buffer.size();
+    }
+
+    if(fclose(output) != 0) {
+        std::cout << "ERROR: Could not write " << output_file << std::endl;
+        return -1;
+    }
+    EndTiming();
+
+    std::cout << "INFO: Wrote " << list_tiles.size() << " tiles, "
+              << num_levels << " levels, "
+              << position << " bytes to " << output_file << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,11 @@
+TEMPLATE = app
+CONFIG -= qt
+TARGET = tilepyramid_pack
+
+QMAKE_CXXFLAGS += -std=c++11
+
+# only needs the file format and tile key headers
+INCLUDEPATH += ..
+HEADERS += ../TilePyramidFormat.h ../TileKey.hpp
+
+SOURCES += main.cpp
@@ -28,6 +28,8 @@
 #include <osg/Vec3d>
 #include <osg/Geometry>
 
+#include <geodesy.hpp>
+
 //////////////////////////////////////////////////////
 
 #define K_PI 3.141592653589
@@ -354,29 +356,28 @@ struct PointLLA
 
 PointLLA ConvECEFToLLA(const osg::Vec3d &pointECEF)
 {
-    double radius = pointECEF.length();
-
     PointLLA pointLLA;
-    pointLLA.lon = (atan2(pointECEF.y(),pointECEF.x()))*K_RAD2DEG;
-    pointLLA.lat = (asin(pointECEF.z()/radius))*K_RAD2DEG;
-    pointLLA.alt = radius-RAD_AV;
+    geodesy::ConvECEFToLLA(pointECEF.x(),
+                           pointECEF.y(),
+                           pointECEF.z(),
+                           pointLLA.lon,
+                           pointLLA.lat,
+                           pointLLA.alt,
+                           geodesy::SPHERE_AV);
 
     return pointLLA;
 }
 
 osg::Vec3d ConvLLAToECEF(const PointLLA &pointLLA)
 {
-    // remember to convert deg->rad
-    double sinLat = sin(pointLLA.lat * K_DEG2RAD);
-    double sinLon = sin(pointLLA.lon * K_DEG2RAD);
-    double cosLat = cos(pointLLA.lat * K_DEG2RAD);
-    double cosLon = cos(pointLLA.lon * K_DEG2RAD);
-    double radius = RAD_AV+pointLLA.alt;
-
     osg::Vec3d pointECEF;
-    pointECEF.x() = cosLat * cosLon * radius;
-    pointECEF.y() = cosLat * sinLon * radius;
-    pointECEF.z() = sinLat * radius;
+    geodesy::ConvLLAToECEF(pointLLA.lon,
+                           pointLLA.lat,
+                           pointLLA.alt,
+                           pointECEF.x(),
+                           pointECEF.y(),
+                           pointECEF.z(),
+                           geodesy::SPHERE_AV);
 
     return pointECEF;
 }
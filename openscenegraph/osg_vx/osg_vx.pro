@@ -22,6 +22,11 @@ LIBS += -L$${PATH_OPENSCENEGRAPH_LIB} -losgDB
 LIBS += -L$${PATH_OPENSCENEGRAPH_LIB} -losg
 LIBS += -L$${PATH_OPENSCENEGRAPH_LIB} -lOpenThreads
 
+# geodesy
+PATH_GEODESY = /home/preet/Dev/scratch/utils/geodesy
+INCLUDEPATH += $${PATH_GEODESY}
+HEADERS += $${PATH_GEODESY}/geodesy.hpp
+
 # clipper
 HEADERS += clipper.hpp
 SOURCES += clipper.cpp
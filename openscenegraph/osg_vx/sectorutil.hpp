@@ -0,0 +1,281 @@
+#ifndef SECTOR_UTIL_H
+#define SECTOR_UTIL_H
+
+#include <gmutil.hpp>
+
+// A lon/lat sector along with the sin and cos of its
+// bounds so it can be projected without any trig
+struct SectorProjDesc
+{
+    SectorProjDesc(double min_lon_degs,
+                   double min_lat_degs,
+                   double max_lon_degs,
+                   double max_lat_degs) :
+        min_lon_degs(min_lon_degs),
+        min_lat_degs(min_lat_degs),
+        max_lon_degs(max_lon_degs),
+        max_lat_degs(max_lat_degs),
+        sin_min_lon(sin(min_lon_degs*K_DEG2RAD)),
+        cos_min_lon(cos(min_lon_degs*K_DEG2RAD)),
+        sin_max_lon(sin(max_lon_degs*K_DEG2RAD)),
+        cos_max_lon(cos(max_lon_degs*K_DEG2RAD)),
+        sin_min_lat(sin(min_lat_degs*K_DEG2RAD)),
+        cos_min_lat(cos(min_lat_degs*K_DEG2RAD)),
+        sin_max_lat(sin(max_lat_degs*K_DEG2RAD)),
+        cos_max_lat(cos(max_lat_degs*K_DEG2RAD))
+    {
+
+    }
+
+    // For sectors whose sin and cos have already been
+    // calculated (see SectorProjTable)
+    SectorProjDesc(double min_lon_degs,
+                   double min_lat_degs,
+                   double max_lon_degs,
+                   double max_lat_degs,
+                   double sin_min_lon,
+                   double cos_min_lon,
+                   double sin_max_lon,
+                   double cos_max_lon,
+                   double sin_min_lat,
+                   double cos_min_lat,
+                   double sin_max_lat,
+                   double cos_max_lat) :
+        min_lon_degs(min_lon_degs),
+        min_lat_degs(min_lat_degs),
+        max_lon_degs(max_lon_degs),
+        max_lat_degs(max_lat_degs),
+        sin_min_lon(sin_min_lon),
+        cos_min_lon(cos_min_lon),
+        sin_max_lon(sin_max_lon),
+        cos_max_lon(cos_max_lon),
+        sin_min_lat(sin_min_lat),
+        cos_min_lat(cos_min_lat),
+        sin_max_lat(sin_max_lat),
+        cos_max_lat(cos_max_lat)
+    {
+
+    }
+
+    double const min_lon_degs;
+    double const min_lat_degs;
+    double const max_lon_degs;
+    double const max_lat_degs;
+
+    double const sin_min_lon;
+    double const cos_min_lon;
+
+    double const sin_max_lon;
+    double const cos_max_lon;
+
+    double const sin_min_lat;
+    double const cos_min_lat;
+
+    double const sin_max_lat;
+    double const cos_max_lat;
+};
+
+// ============================================================= //
+
+// The sin and cos of every tile boundary up to max_level
+// for tiles laid out like BuildBaseViewExtents (level 0 is
+// one tile, each level splits tiles into four).
+//
+// Every boundary line at a given level is also a line at
+// all finer levels, so one table of (2^max_level)+1 lon
+// and lat lines covers every level: line i at level L is
+// line i << (max_level-L) in the table.
+class SectorProjTable
+{
+public:
+    SectorProjTable(uint8_t max_level) :
+        m_max_level(max_level)
+    {
+        size_t const num_tiles_side = size_t(1) << max_level;
+        double const lon_step = 360.0/num_tiles_side;
+        double const lat_step = 180.0/num_tiles_side;
+
+        m_list_lon_sin.reserve(num_tiles_side+1);
+        m_list_lon_cos.reserve(num_tiles_side+1);
+        m_list_lat_sin.reserve(num_tiles_side+1);
+        m_list_lat_cos.reserve(num_tiles_side+1);
+
+        for(size_t i=0; i <= num_tiles_side; i++) {
+            double const lon = (-180.0 + lon_step*i)*K_DEG2RAD;
+            double const lat = (-90.0 + lat_step*i)*K_DEG2RAD;
+            m_list_lon_sin.push_back(sin(lon));
+            m_list_lon_cos.push_back(cos(lon));
+            m_list_lat_sin.push_back(sin(lat));
+            m_list_lat_cos.push_back(cos(lat));
+        }
+    }
+
+    uint8_t GetMaxLevel() const
+    {
+        return m_max_level;
+    }
+
+    // x is the lon index and y is the lat index of the
+    // tile at the given level, both starting at 0 for
+    // the tile at (-180,-90)
+    SectorProjDesc GetSector(uint8_t level,
+                             uint32_t x,
+                             uint32_t y) const
+    {
+        assert(level <= m_max_level);
+
+        size_t const num_tiles_side = size_t(1) << level;
+        double const lon_step = 360.0/num_tiles_side;
+        double const lat_step = 180.0/num_tiles_side;
+
+        uint8_t const shift = m_max_level-level;
+        size_t const ix0 = size_t(x) << shift;
+        size_t const ix1 = size_t(x+1) << shift;
+        size_t const iy0 = size_t(y) << shift;
+        size_t const iy1 = size_t(y+1) << shift;
+
+        return SectorProjDesc(-180.0 + lon_step*x,
+                              -90.0 + lat_step*y,
+                              -180.0 + lon_step*(x+1),
+                              -90.0 + lat_step*(y+1),
+                              m_list_lon_sin[ix0],
+                              m_list_lon_cos[ix0],
+                              m_list_lon_sin[ix1],
+                              m_list_lon_cos[ix1],
+                              m_list_lat_sin[iy0],
+                              m_list_lat_cos[iy0],
+                              m_list_lat_sin[iy1],
+                              m_list_lat_cos[iy1]);
+    }
+
+private:
+    uint8_t const m_max_level;
+    std::vector<double> m_list_lon_sin;
+    std::vector<double> m_list_lon_cos;
+    std::vector<double> m_list_lat_sin;
+    std::vector<double> m_list_lat_cos;
+};
+
+// ============================================================= //
+
+// Returns true if the direction (x,y) lies on the arc
+// that goes counter clockwise from angle a0 to angle a1,
+// given the cos and sin of both angles
+inline bool CheckDirnOnArc(double const cos_a0,
+                           double const sin_a0,
+                           double const cos_a1,
+                           double const sin_a1,
+                           bool const arc_gt_180,
+                           double const x,
+                           double const y)
+{
+    double const cross0 = cos_a0*y - sin_a0*x; // a0 x dirn
+    double const cross1 = x*sin_a1 - y*cos_a1; // dirn x a1
+
+    if(arc_gt_180) {
+        // on the arc unless it's inside the (smaller
+        // than 180 degree) complement of the arc
+        return !(cross0 < 0 && cross1 < 0);
+    }
+    return (cross0 >= 0 && cross1 >= 0);
+}
+
+// Finds the max of c*cos(t) + s*sin(t) over the arc
+// from t0 to t1; arc_gt_180 is set if the arc is longer
+// than 180 degrees. Returns the cos and sin of the t
+// where the max occurs.
+inline double CalcArcMax(double const cos_t0,
+                         double const sin_t0,
+                         double const cos_t1,
+                         double const sin_t1,
+                         bool const arc_gt_180,
+                         double const c,
+                         double const s,
+                         double &cos_t,
+                         double &sin_t)
+{
+    // c*cos(t) + s*sin(t) == |(c,s)|*cos(t-atan2(s,c)),
+    // so the max is |(c,s)| if the direction of (c,s) is
+    // on the arc, otherwise it's at one of the arc ends
+    double const len = sqrt(c*c + s*s);
+    if(len > 0 && CheckDirnOnArc(cos_t0,sin_t0,cos_t1,sin_t1,arc_gt_180,c,s)) {
+        cos_t = c/len;
+        sin_t = s/len;
+        return len;
+    }
+
+    double const f0 = c*cos_t0 + s*sin_t0;
+    double const f1 = c*cos_t1 + s*sin_t1;
+    if(f0 >= f1) {
+        cos_t = cos_t0;
+        sin_t = sin_t0;
+        return f0;
+    }
+    cos_t = cos_t1;
+    sin_t = sin_t1;
+    return f1;
+}
+
+// Calculates the max projection of a sector on the
+// sphere with radius RAD_AV onto proj_axis (must be
+// normalized) in constant time and without any trig.
+//
+// The projection of (lon,lat) is
+//   R*(cos(lat)*a(lon) + n.z*sin(lat))
+//   where a(lon) = n.x*cos(lon) + n.y*sin(lon)
+//
+// cos(lat) is never negative, so for every latitude the
+// max is at the longitude that maximizes a(lon). That
+// leaves two independent one dimensional problems of
+// the same form: find the max of a(lon) over the lon
+// range, then the max over the lat range.
+double CalcSectorProjMax(SectorProjDesc const &sector,
+                         osg::Vec3d const &proj_axis,
+                         osg::Vec3d &ecef_max)
+{
+    bool const lon_gt_180 =
+            (sector.max_lon_degs-sector.min_lon_degs) > 180.0;
+
+    double cos_lon,sin_lon;
+    double const a_max = CalcArcMax(sector.cos_min_lon,
+                                    sector.sin_min_lon,
+                                    sector.cos_max_lon,
+                                    sector.sin_max_lon,
+                                    lon_gt_180,
+                                    proj_axis.x(),
+                                    proj_axis.y(),
+                                    cos_lon,
+                                    sin_lon);
+
+    double cos_lat,sin_lat;
+    double const f_max = CalcArcMax(sector.cos_min_lat,
+                                    sector.sin_min_lat,
+                                    sector.cos_max_lat,
+                                    sector.sin_max_lat,
+                                    false,
+                                    a_max,
+                                    proj_axis.z(),
+                                    cos_lat,
+                                    sin_lat);
+
+    ecef_max = osg::Vec3d(RAD_AV*cos_lat*cos_lon,
+                          RAD_AV*cos_lat*sin_lon,
+                          RAD_AV*sin_lat);
+
+    return RAD_AV*f_max;
+}
+
+// Calculates the interval of a sector projected onto
+// proj_axis (must be normalized); see CalcSectorProjMax
+void CalcSectorProjMinMax(SectorProjDesc const &sector,
+                          osg::Vec3d const &proj_axis,
+                          double &proj_min,
+                          double &proj_max,
+                          osg::Vec3d &ecef_min,
+                          osg::Vec3d &ecef_max)
+{
+    proj_max = CalcSectorProjMax(sector,proj_axis,ecef_max);
+    proj_min = -1.0*CalcSectorProjMax(sector,proj_axis*-1.0,ecef_min);
+}
+
+#endif // SECTOR_UTIL_H
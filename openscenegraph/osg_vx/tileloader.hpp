@@ -0,0 +1,476 @@
+#ifndef TILE_LOADER_H
+#define TILE_LOADER_H
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+#include <condition_variable>
+
+#include <osg/Image>
+#include <osgDB/Registry>
+#include <osgDB/FileNameUtils>
+
+// ============================================================= //
+
+// Lock-free multiple producer, single consumer queue
+// (Vyukov's node based queue). Push can be called from
+// any thread, Pop only from the consumer thread.
+template<typename T>
+class MPSCQueue
+{
+public:
+    MPSCQueue()
+    {
+        Node * stub = new Node;
+        stub->next.store(nullptr,std::memory_order_relaxed);
+        m_head.store(stub,std::memory_order_relaxed);
+        m_tail = stub;
+    }
+
+    ~MPSCQueue()
+    {
+        T value;
+        while(Pop(value)) {
+            // empty
+        }
+        delete m_tail;
+    }
+
+    void Push(T value)
+    {
+        Node * node = new Node;
+        node->value = std::move(value);
+        node->next.store(nullptr,std::memory_order_relaxed);
+
+        // Swing the head to the new node and then link
+        // the previous head to it; the consumer sees the
+        // node once the link is published
+        Node * prev = m_head.exchange(node,std::memory_order_acq_rel);
+        prev->next.store(node,std::memory_order_release);
+    }
+
+    bool Pop(T &value)
+    {
+        Node * tail = m_tail;
+        Node * next = tail->next.load(std::memory_order_acquire);
+        if(next == nullptr) {
+            return false;
+        }
+
+        // next becomes the new stub node
+        value = std::move(next->value);
+        m_tail = next;
+        delete tail;
+
+        return true;
+    }
+
+private:
+    struct Node
+    {
+        std::atomic<Node*> next;
+        T value;
+    };
+
+    std::atomic<Node*> m_head;
+    Node * m_tail;
+};
+
+// ============================================================= //
+
+// Loads tile images in two stages: I/O threads read the
+// raw file data and decode threads turn it into images.
+// Finished images are handed to the render thread through
+// an MPSCQueue and collected with Poll().
+//
+// * Request(), Cancel(), CancelAllExcept() and Poll() must
+//   all be called from the same (render) thread
+// * duplicate requests for a tile that's still being
+//   loaded are ignored
+// * at most max_in_flight requests are between the start
+//   of I/O and Poll() at any time, so a burst of requests
+//   can't build up a backlog of decoded images
+// * canceled requests are skipped by whichever stage
+//   picks them up next
+class TileLoader
+{
+public:
+    struct Options
+    {
+        Options() :
+            num_io_threads(2),
+            num_decode_threads(2),
+            max_in_flight(16)
+        {}
+
+        size_t num_io_threads;
+        size_t num_decode_threads;
+        size_t max_in_flight;
+    };
+
+    struct Result
+    {
+        uint64_t id;
+        osg::ref_ptr<osg::Image> image; // null if loading failed
+        double latency_ms; // from Request() to Poll()
+    };
+
+    struct Stats
+    {
+        Stats() :
+            requested(0),
+            deduplicated(0),
+            canceled(0),
+            completed(0),
+            failed(0),
+            latency_ms_total(0),
+            latency_ms_max(0)
+        {}
+
+        size_t requested;
+        size_t deduplicated;
+        size_t canceled;
+        size_t completed;
+        size_t failed;
+        double latency_ms_total;
+        double latency_ms_max;
+    };
+
+    // get_path returns the image file for a given tile
+    // id; it's called from the I/O threads
+    TileLoader(std::function<std::string(uint64_t)> get_path,
+               Options const &options=Options()) :
+        m_get_path(get_path),
+        m_options(options),
+        m_stop(false),
+        m_num_in_flight(0)
+    {
+        if(m_options.max_in_flight == 0) {
+            m_options.max_in_flight = 1;
+        }
+
+        for(size_t i=0; i < std::max(m_options.num_io_threads,size_t(1)); i++) {
+            m_list_threads.push_back(std::thread(&TileLoader::ioThreadLoop,this));
+        }
+
+        for(size_t i=0; i < std::max(m_options.num_decode_threads,size_t(1)); i++) {
+            m_list_threads.push_back(std::thread(&TileLoader::decodeThreadLoop,this));
+        }
+    }
+
+    ~TileLoader()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_io_waitcond.notify_all();
+        m_decode_waitcond.notify_all();
+
+        for(auto &thread : m_list_threads) {
+            thread.join();
+        }
+    }
+
+    void Request(uint64_t id)
+    {
+        if(m_lkup_jobs.count(id) > 0) {
+            m_stats.deduplicated++;
+            return;
+        }
+
+        auto job = std::make_shared<Job>();
+        job->id = id;
+        job->t_request = std::chrono::steady_clock::now();
+        job->canceled = false;
+        m_lkup_jobs.emplace(id,job);
+        m_stats.requested++;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_queue_io.push_back(job);
+        }
+        m_io_waitcond.notify_one();
+    }
+
+    void Cancel(uint64_t id)
+    {
+        auto it = m_lkup_jobs.find(id);
+        if(it == m_lkup_jobs.end()) {
+            return;
+        }
+
+        it->second->canceled = true;
+        m_lkup_jobs.erase(it);
+        m_stats.canceled++;
+    }
+
+    // Cancels every outstanding request that isn't
+    // in set_ids (ie. tiles that have left the view)
+    void CancelAllExcept(std::unordered_set<uint64_t> const &set_ids)
+    {
+        for(auto it = m_lkup_jobs.begin(); it != m_lkup_jobs.end();) {
+            if(set_ids.count(it->first) == 0) {
+                it->second->canceled = true;
+                it = m_lkup_jobs.erase(it);
+                m_stats.canceled++;
+            }
+            else {
+                ++it;
+            }
+        }
+    }
+
+    // Returns false when there are no more results
+    bool Poll(Result &result)
+    {
+        std::shared_ptr<Job> job;
+        while(m_queue_ready.Pop(job)) {
+            releaseSlot();
+
+            if(job->canceled) {
+                continue;
+            }
+
+            m_lkup_jobs.erase(job->id);
+
+            result.id = job->id;
+            result.image = job->image;
+            result.latency_ms =
+                    std::chrono::duration<double,std::milli>(
+                        std::chrono::steady_clock::now()-job->t_request).count();
+
+            if(result.image.valid()) {
+                m_stats.completed++;
+            }
+            else {
+                m_stats.failed++;
+            }
+            m_stats.latency_ms_total += result.latency_ms;
+            m_stats.latency_ms_max = std::max(m_stats.latency_ms_max,
+                                              result.latency_ms);
+            return true;
+        }
+
+        return false;
+    }
+
+    size_t GetNumPending() const
+    {
+        return m_lkup_jobs.size();
+    }
+
+    Stats const & GetStats() const
+    {
+        return m_stats;
+    }
+
+private:
+    struct Job
+    {
+        uint64_t id;
+        std::chrono::steady_clock::time_point t_request;
+        std::atomic<bool> canceled;
+
+        // set by the I/O and decode stages
+        std::string ext;
+        std::string data;
+        osg::ref_ptr<osg::Image> image;
+    };
+
+    class MemoryStreamBuf : public std::streambuf
+    {
+    public:
+        MemoryStreamBuf(std::string const &data)
+        {
+            char * p = const_cast<char*>(data.data());
+            this->setg(p,p,p+data.size());
+        }
+
+    protected:
+        // some readers seek around in the stream
+        pos_type seekoff(off_type off,
+                         std::ios_base::seekdir dir,
+                         std::ios_base::openmode which)
+        {
+            if(!(which & std::ios_base::in)) {
+                return pos_type(off_type(-1));
+            }
+
+            char * pos = nullptr;
+            if(dir == std::ios_base::beg) {
+                pos = this->eback()+off;
+            }
+            else if(dir == std::ios_base::cur) {
+                pos = this->gptr()+off;
+            }
+            else {
+                pos = this->egptr()+off;
+            }
+
+            if(pos < this->eback() || pos > this->egptr()) {
+                return pos_type(off_type(-1));
+            }
+
+            this->setg(this->eback(),pos,this->egptr());
+            return pos_type(off_type(pos-this->eback()));
+        }
+
+        pos_type seekpos(pos_type pos,
+                         std::ios_base::openmode which)
+        {
+            return seekoff(off_type(pos),std::ios_base::beg,which);
+        }
+    };
+
+    void ioThreadLoop()
+    {
+        while(true) {
+            std::shared_ptr<Job> job;
+            {
+                std::unique_lock<std::mutex> locker(m_mutex);
+                while(true) {
+                    if(m_stop) {
+                        return;
+                    }
+
+                    // drop canceled jobs without using a slot
+                    while(!m_queue_io.empty() && m_queue_io.front()->canceled) {
+                        m_queue_io.pop_front();
+                    }
+
+                    if(!m_queue_io.empty() &&
+                       m_num_in_flight < m_options.max_in_flight) {
+                        break;
+                    }
+                    m_io_waitcond.wait(locker);
+                }
+
+                job = m_queue_io.front();
+                m_queue_io.pop_front();
+                m_num_in_flight++;
+            }
+
+            std::string const path = m_get_path(job->id);
+            job->ext = osgDB::getLowerCaseFileExtension(path);
+
+            std::ifstream ifs(path.c_str(),std::ios::in | std::ios::binary);
+            if(ifs) {
+                job->data.assign(std::istreambuf_iterator<char>(ifs),
+                                 std::istreambuf_iterator<char>());
+            }
+            else {
+                std::cout << "TileLoader: ERROR: Could not open "
+                          << path << std::endl;
+            }
+
+            if(job->canceled) {
+                releaseSlot();
+                continue;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_queue_decode.push_back(job);
+            }
+            m_decode_waitcond.notify_one();
+        }
+    }
+
+    void decodeThreadLoop()
+    {
+        while(true) {
+            std::shared_ptr<Job> job;
+            {
+                std::unique_lock<std::mutex> locker(m_mutex);
+                while(!m_stop && m_queue_decode.empty()) {
+                    m_decode_waitcond.wait(locker);
+                }
+                if(m_stop) {
+                    return;
+                }
+
+                job = m_queue_decode.front();
+                m_queue_decode.pop_front();
+            }
+
+            if(job->canceled) {
+                releaseSlot();
+                continue;
+            }
+
+            if(!job->data.empty()) {
+                osgDB::ReaderWriter * reader =
+                        osgDB::Registry::instance()->
+                        getReaderWriterForExtension(job->ext);
+
+                if(reader) {
+                    MemoryStreamBuf buffer(job->data);
+                    std::istream stream(&buffer);
+
+                    osgDB::ReaderWriter::ReadResult read_result =
+                            reader->readImage(stream);
+
+                    if(read_result.success()) {
+                        job->image = read_result.getImage();
+                    }
+                }
+                else {
+                    std::cout << "TileLoader: ERROR: No reader for "
+                              << job->ext << std::endl;
+                }
+            }
+
+            // the raw data isn't needed anymore
+            std::string().swap(job->data);
+
+            // failed jobs are still passed on so the
+            // render thread knows they're finished
+            m_queue_ready.Push(job);
+        }
+    }
+
+    void releaseSlot()
+    {
+        // lock so an I/O thread can't miss the wake up
+        // between checking the window and waiting
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_num_in_flight--;
+        }
+        m_io_waitcond.notify_one();
+    }
+
+    std::function<std::string(uint64_t)> m_get_path;
+    Options m_options;
+
+    // render thread only
+    std::unordered_map<uint64_t,std::shared_ptr<Job>> m_lkup_jobs;
+    Stats m_stats;
+
+    // shared between stages, guarded by m_mutex
+    std::mutex m_mutex;
+    std::condition_variable m_io_waitcond;
+    std::condition_variable m_decode_waitcond;
+    bool m_stop;
+    size_t m_num_in_flight;
+    std::deque<std::shared_ptr<Job>> m_queue_io;
+    std::deque<std::shared_ptr<Job>> m_queue_decode;
+
+    // decode threads -> render thread
+    MPSCQueue<std::shared_ptr<Job>> m_queue_ready;
+
+    std::vector<std::thread> m_list_threads;
+};
+
+#endif // TILE_LOADER_H
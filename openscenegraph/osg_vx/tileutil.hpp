@@ -1,6 +1,13 @@
 #ifndef TILE_UTIL_H
 #define TILE_UTIL_H
 
+#include <unordered_map>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include <gmutil.hpp>
 #include <osg/ref_ptr>
 #include <osg/Group>
@@ -48,6 +55,110 @@ struct VxTile
     VxTile() : _s(true) {}
 };
 
+// Cache of LLA->ECEF conversions for tile corners and
+// edge midpoints. Neighbouring tiles share edges, and the
+// vx_tilegen demos rebuild the same tree every frame, so
+// most points have already been converted by someone.
+// * points are keyed by their exact lon/lat; tile bounds
+//   come from repeated halving so the same point always
+//   ends up with the same doubles
+// * the cache is simply cleared once it has max_size
+//   points in it
+class VxTileGeometryCache
+{
+public:
+    VxTileGeometryCache(size_t max_size=1 << 18) :
+        m_max_size(max_size),
+        m_num_hits(0),
+        m_num_misses(0)
+    {
+        // empty
+    }
+
+    osg::Vec3d GetECEF(double lon, double lat)
+    {
+        Key const key{lon,lat};
+        auto it = m_lkup_ecef.find(key);
+        if(it != m_lkup_ecef.end()) {
+            m_num_hits++;
+            return it->second;
+        }
+
+        m_num_misses++;
+        if(m_lkup_ecef.size() >= m_max_size) {
+            m_lkup_ecef.clear();
+        }
+
+        osg::Vec3d const ecef = ConvLLAToECEF(PointLLA(lon,lat));
+        m_lkup_ecef.emplace(key,ecef);
+        return ecef;
+    }
+
+    void Clear()
+    {
+        m_lkup_ecef.clear();
+    }
+
+    size_t GetNumHits() const
+    {
+        return m_num_hits;
+    }
+
+    size_t GetNumMisses() const
+    {
+        return m_num_misses;
+    }
+
+private:
+    struct Key
+    {
+        double lon;
+        double lat;
+
+        bool operator == (Key const &other) const
+        {
+            return (lon == other.lon) && (lat == other.lat);
+        }
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(Key const &key) const
+        {
+            uint64_t a,b;
+            memcpy(&a,&key.lon,sizeof(double));
+            memcpy(&b,&key.lat,sizeof(double));
+            return std::hash<uint64_t>()(a ^ (b*0x9E3779B97F4A7C15ULL));
+        }
+    };
+
+    size_t const m_max_size;
+    size_t m_num_hits;
+    size_t m_num_misses;
+    std::unordered_map<Key,osg::Vec3d,KeyHash> m_lkup_ecef;
+};
+
+osg::Vec3d GetTileECEF(VxTileGeometryCache * cache,
+                       double lon,
+                       double lat)
+{
+    return (cache) ? cache->GetECEF(lon,lat) :
+                     ConvLLAToECEF(PointLLA(lon,lat));
+}
+
+// ============================================================= //
+
+void CalcTileOBBFaces(OBB &obb)
+{
+    // Save the unique face planes
+    for(int i=0; i < 3; i++) {
+        Plane &face = obb.faces[i];
+        face.n = obb.ori[i];
+        face.p = (face.n * obb.ext[i]) + obb.center;
+        face.d = face.n * face.p;
+    }
+}
+
 void CalcTileOBB(VxTile * tile)
 {
     // 1. Determine the orthonormal basis
@@ -67,14 +178,7 @@ void CalcTileOBB(VxTile * tile)
     tile->obb.ori[2].normalize();
 
     // Get the bbox min and max
-//    std::vector<osg::Vec3d const *> tile_vx(5);
-//    tile_vx[0] = tile->p_ecef_LT;
-//    tile_vx[1] = tile->p_ecef_LB;
-//    tile_vx[2] = tile->p_ecef_RB;
-//    tile_vx[3] = tile->p_ecef_RT;
-//    tile_vx[4] = &(tile->ecef_MM);
-
-    std::vector<osg::Vec3d const *> tile_vx {
+    osg::Vec3d const * const tile_vx[5] = {
         tile->p_ecef_LT,
         tile->p_ecef_LB,
         tile->p_ecef_RB,
@@ -112,11 +216,228 @@ void CalcTileOBB(VxTile * tile)
     tile->obb.ext = (max_rst-min_rst)*0.5;
 
     // 4. Save the unique face planes
+    CalcTileOBBFaces(tile->obb);
+}
+
+// ============================================================= //
+
+// Four doubles, one lane per tile, so CalcTileOBBx4 can
+// build four OBBs at once (with SSE2 as two registers of
+// two lanes each)
+struct Lanes4d
+{
+#if defined(__SSE2__)
+    __m128d lo;
+    __m128d hi;
+#else
+    double v[4];
+#endif
+};
+
+#if defined(__SSE2__)
+inline Lanes4d L4Set(double a, double b, double c, double d)
+{ return Lanes4d{_mm_set_pd(b,a),_mm_set_pd(d,c)}; }
+
+inline Lanes4d L4Set1(double a)
+{ return Lanes4d{_mm_set1_pd(a),_mm_set1_pd(a)}; }
+
+inline void L4Store(Lanes4d const &a, double * out)
+{ _mm_storeu_pd(out,a.lo); _mm_storeu_pd(out+2,a.hi); }
+
+inline Lanes4d operator + (Lanes4d const &a, Lanes4d const &b)
+{ return Lanes4d{_mm_add_pd(a.lo,b.lo),_mm_add_pd(a.hi,b.hi)}; }
+
+inline Lanes4d operator - (Lanes4d const &a, Lanes4d const &b)
+{ return Lanes4d{_mm_sub_pd(a.lo,b.lo),_mm_sub_pd(a.hi,b.hi)}; }
+
+inline Lanes4d operator * (Lanes4d const &a, Lanes4d const &b)
+{ return Lanes4d{_mm_mul_pd(a.lo,b.lo),_mm_mul_pd(a.hi,b.hi)}; }
+
+inline Lanes4d operator / (Lanes4d const &a, Lanes4d const &b)
+{ return Lanes4d{_mm_div_pd(a.lo,b.lo),_mm_div_pd(a.hi,b.hi)}; }
+
+inline Lanes4d L4Min(Lanes4d const &a, Lanes4d const &b)
+{ return Lanes4d{_mm_min_pd(a.lo,b.lo),_mm_min_pd(a.hi,b.hi)}; }
+
+inline Lanes4d L4Max(Lanes4d const &a, Lanes4d const &b)
+{ return Lanes4d{_mm_max_pd(a.lo,b.lo),_mm_max_pd(a.hi,b.hi)}; }
+
+inline Lanes4d L4Sqrt(Lanes4d const &a)
+{ return Lanes4d{_mm_sqrt_pd(a.lo),_mm_sqrt_pd(a.hi)}; }
+
+// (a > b) ? x : y
+inline Lanes4d L4SelectGreater(Lanes4d const &a, Lanes4d const &b,
+                               Lanes4d const &x, Lanes4d const &y)
+{
+    __m128d const m_lo = _mm_cmpgt_pd(a.lo,b.lo);
+    __m128d const m_hi = _mm_cmpgt_pd(a.hi,b.hi);
+    return Lanes4d{_mm_or_pd(_mm_and_pd(m_lo,x.lo),_mm_andnot_pd(m_lo,y.lo)),
+                   _mm_or_pd(_mm_and_pd(m_hi,x.hi),_mm_andnot_pd(m_hi,y.hi))};
+}
+#else
+inline Lanes4d L4Set(double a, double b, double c, double d)
+{ return Lanes4d{{a,b,c,d}}; }
+
+inline Lanes4d L4Set1(double a)
+{ return Lanes4d{{a,a,a,a}}; }
+
+inline void L4Store(Lanes4d const &a, double * out)
+{ for(int k=0; k < 4; k++) { out[k] = a.v[k]; } }
+
+inline Lanes4d operator + (Lanes4d const &a, Lanes4d const &b)
+{ Lanes4d r; for(int k=0; k < 4; k++) { r.v[k] = a.v[k]+b.v[k]; } return r; }
+
+inline Lanes4d operator - (Lanes4d const &a, Lanes4d const &b)
+{ Lanes4d r; for(int k=0; k < 4; k++) { r.v[k] = a.v[k]-b.v[k]; } return r; }
+
+inline Lanes4d operator * (Lanes4d const &a, Lanes4d const &b)
+{ Lanes4d r; for(int k=0; k < 4; k++) { r.v[k] = a.v[k]*b.v[k]; } return r; }
+
+inline Lanes4d operator / (Lanes4d const &a, Lanes4d const &b)
+{ Lanes4d r; for(int k=0; k < 4; k++) { r.v[k] = a.v[k]/b.v[k]; } return r; }
+
+inline Lanes4d L4Min(Lanes4d const &a, Lanes4d const &b)
+{ Lanes4d r; for(int k=0; k < 4; k++) { r.v[k] = std::min(a.v[k],b.v[k]); } return r; }
+
+inline Lanes4d L4Max(Lanes4d const &a, Lanes4d const &b)
+{ Lanes4d r; for(int k=0; k < 4; k++) { r.v[k] = std::max(a.v[k],b.v[k]); } return r; }
+
+inline Lanes4d L4Sqrt(Lanes4d const &a)
+{ Lanes4d r; for(int k=0; k < 4; k++) { r.v[k] = sqrt(a.v[k]); } return r; }
+
+inline Lanes4d L4SelectGreater(Lanes4d const &a, Lanes4d const &b,
+                               Lanes4d const &x, Lanes4d const &y)
+{ Lanes4d r; for(int k=0; k < 4; k++) { r.v[k] = (a.v[k] > b.v[k]) ? x.v[k] : y.v[k]; } return r; }
+#endif
+
+struct Lanes4Vec3d
+{
+    Lanes4d x;
+    Lanes4d y;
+    Lanes4d z;
+};
+
+inline Lanes4Vec3d L4Gather(osg::Vec3d const &a, osg::Vec3d const &b,
+                            osg::Vec3d const &c, osg::Vec3d const &d)
+{
+    return Lanes4Vec3d{L4Set(a.x(),b.x(),c.x(),d.x()),
+                       L4Set(a.y(),b.y(),c.y(),d.y()),
+                       L4Set(a.z(),b.z(),c.z(),d.z())};
+}
+
+inline Lanes4d L4Dot(Lanes4Vec3d const &a, Lanes4Vec3d const &b)
+{
+    return (a.x*b.x) + (a.y*b.y) + (a.z*b.z);
+}
+
+inline Lanes4Vec3d L4Normalize(Lanes4Vec3d const &a)
+{
+    // same as osg::Vec3d::normalize, zero length
+    // vectors are left alone
+    Lanes4d const zero = L4Set1(0.0);
+    Lanes4d const len = L4Sqrt(L4Dot(a,a));
+    return Lanes4Vec3d{L4SelectGreater(len,zero,a.x/len,a.x),
+                       L4SelectGreater(len,zero,a.y/len,a.y),
+                       L4SelectGreater(len,zero,a.z/len,a.z)};
+}
+
+// Same as CalcTileOBB for four tiles at once (typically
+// the four children of a tile), one tile per lane
+void CalcTileOBBx4(VxTile * const tiles[4])
+{
+    VxTile const * a = tiles[0];
+    VxTile const * b = tiles[1];
+    VxTile const * c = tiles[2];
+    VxTile const * d = tiles[3];
+
+    Lanes4Vec3d const vx[5] = {
+        L4Gather(*(a->p_ecef_LT),*(b->p_ecef_LT),*(c->p_ecef_LT),*(d->p_ecef_LT)),
+        L4Gather(*(a->p_ecef_LB),*(b->p_ecef_LB),*(c->p_ecef_LB),*(d->p_ecef_LB)),
+        L4Gather(*(a->p_ecef_RB),*(b->p_ecef_RB),*(c->p_ecef_RB),*(d->p_ecef_RB)),
+        L4Gather(*(a->p_ecef_RT),*(b->p_ecef_RT),*(c->p_ecef_RT),*(d->p_ecef_RT)),
+        L4Gather(a->ecef_MM,b->ecef_MM,c->ecef_MM,d->ecef_MM)
+    };
+
+    // 1. Determine the orthonormal basis (see CalcTileOBB)
+    Lanes4Vec3d const x_top{vx[0].x-vx[3].x, vx[0].y-vx[3].y, vx[0].z-vx[3].z};
+    Lanes4Vec3d const x_btm{vx[1].x-vx[2].x, vx[1].y-vx[2].y, vx[1].z-vx[2].z};
+
+    Lanes4d const len2_top = L4Dot(x_top,x_top);
+    Lanes4d const len2_btm = L4Dot(x_btm,x_btm);
+
+    Lanes4Vec3d const ori0{L4SelectGreater(len2_top,len2_btm,x_top.x,x_btm.x),
+                           L4SelectGreater(len2_top,len2_btm,x_top.y,x_btm.y),
+                           L4SelectGreater(len2_top,len2_btm,x_top.z,x_btm.z)};
+
+    Lanes4Vec3d const ori2 = vx[4];
+
+    Lanes4Vec3d const ori1{(ori2.y*ori0.z)-(ori2.z*ori0.y),
+                           (ori2.z*ori0.x)-(ori2.x*ori0.z),
+                           (ori2.x*ori0.y)-(ori2.y*ori0.x)};
+
+    Lanes4Vec3d const ori[3] = {
+        L4Normalize(ori0),
+        L4Normalize(ori1),
+        L4Normalize(ori2)
+    };
+
+    // 2. Get the min and max corners
+    Lanes4d min_rst[3];
+    Lanes4d max_rst[3];
     for(int i=0; i < 3; i++) {
-        Plane &face = tile->obb.faces[i];
-        face.n = tile->obb.ori[i];
-        face.p = (face.n * tile->obb.ext[i]) + tile->obb.center;
-        face.d = face.n * face.p;
+        min_rst[i] = L4Dot(ori[i],vx[0]);
+        max_rst[i] = min_rst[i];
+    }
+
+    for(int j=1; j < 5; j++) {
+        for(int i=0; i < 3; i++) {
+            Lanes4d const dist = L4Dot(ori[i],vx[j]);
+            min_rst[i] = L4Min(min_rst[i],dist);
+            max_rst[i] = L4Max(max_rst[i],dist);
+        }
+    }
+
+    // 3. Calc center and extents
+    Lanes4d const half = L4Set1(0.5);
+    Lanes4d mid[3];
+    Lanes4d ext[3];
+    for(int i=0; i < 3; i++) {
+        mid[i] = (min_rst[i]+max_rst[i])*half;
+        ext[i] = (max_rst[i]-min_rst[i])*half;
+    }
+
+    Lanes4Vec3d const center{
+        (ori[0].x*mid[0]) + (ori[1].x*mid[1]) + (ori[2].x*mid[2]),
+        (ori[0].y*mid[0]) + (ori[1].y*mid[1]) + (ori[2].y*mid[2]),
+        (ori[0].z*mid[0]) + (ori[1].z*mid[1]) + (ori[2].z*mid[2])
+    };
+
+    // Scatter back to the tiles
+    double out[3][4];
+    L4Store(center.x,out[0]);
+    L4Store(center.y,out[1]);
+    L4Store(center.z,out[2]);
+    for(int k=0; k < 4; k++) {
+        tiles[k]->obb.center.set(out[0][k],out[1][k],out[2][k]);
+    }
+
+    for(int i=0; i < 3; i++) {
+        L4Store(ori[i].x,out[0]);
+        L4Store(ori[i].y,out[1]);
+        L4Store(ori[i].z,out[2]);
+        for(int k=0; k < 4; k++) {
+            tiles[k]->obb.ori[i].set(out[0][k],out[1][k],out[2][k]);
+        }
+
+        L4Store(ext[i],out[0]);
+        for(int k=0; k < 4; k++) {
+            tiles[k]->obb.ext[i] = out[0][k];
+        }
+    }
+
+    // 4. Save the unique face planes
+    for(int k=0; k < 4; k++) {
+        CalcTileOBBFaces(tiles[k]->obb);
     }
 }
 
@@ -159,12 +480,12 @@ VxTile * BuildRootTile(uint8_t const level,
     return t;
 }
 
-std::unique_ptr<VxTile> BuildChildTile(VxTile * parent,
-                                       uint8_t const quadrant,
-                                       bool calc_obb=true)
+// Sets a child tile's bounds and corners; the corners
+// are shared with the parent
+void InitChildTile(VxTile * parent,
+                   uint8_t const quadrant,
+                   VxTile * t)
 {
-    std::unique_ptr<VxTile> t(new VxTile);
-
     if(quadrant == 0) {
         // LT
         t->minLon = parent->minLon;
@@ -217,12 +538,21 @@ std::unique_ptr<VxTile> BuildChildTile(VxTile * parent,
     t->level = parent->level + 1;
     t->midLon = (t->minLon+t->maxLon)*0.5;
     t->midLat = (t->minLat+t->maxLat)*0.5;
+}
 
-    t->ecef_LM = ConvLLAToECEF(PointLLA(t->minLon,t->midLat));
-    t->ecef_MB = ConvLLAToECEF(PointLLA(t->midLon,t->minLat));
-    t->ecef_RM = ConvLLAToECEF(PointLLA(t->maxLon,t->midLat));
-    t->ecef_MT = ConvLLAToECEF(PointLLA(t->midLon,t->maxLat));
-    t->ecef_MM = ConvLLAToECEF(PointLLA(t->midLon,t->midLat));
+std::unique_ptr<VxTile> BuildChildTile(VxTile * parent,
+                                       uint8_t const quadrant,
+                                       bool calc_obb=true,
+                                       VxTileGeometryCache * cache=nullptr)
+{
+    std::unique_ptr<VxTile> t(new VxTile);
+    InitChildTile(parent,quadrant,t.get());
+
+    t->ecef_LM = GetTileECEF(cache,t->minLon,t->midLat);
+    t->ecef_MB = GetTileECEF(cache,t->midLon,t->minLat);
+    t->ecef_RM = GetTileECEF(cache,t->maxLon,t->midLat);
+    t->ecef_MT = GetTileECEF(cache,t->midLon,t->maxLat);
+    t->ecef_MM = GetTileECEF(cache,t->midLon,t->midLat);
 
     if(calc_obb) {
         CalcTileOBB(t.get());
@@ -231,6 +561,67 @@ std::unique_ptr<VxTile> BuildChildTile(VxTile * parent,
     return t;
 }
 
+// Builds all four children of parent at once. This is
+// faster than calling BuildChildTile four times:
+// * the four edge midpoints that siblings share are
+//   only converted once (16 conversions instead of 20)
+// * the OBBs are built together with CalcTileOBBx4
+// * with a cache, points on the outer edges that
+//   neighbouring tiles already converted are reused
+void BuildChildTiles(VxTile * parent,
+                     bool calc_obb=true,
+                     VxTileGeometryCache * cache=nullptr)
+{
+    parent->tile_LT.reset(new VxTile);
+    parent->tile_LB.reset(new VxTile);
+    parent->tile_RB.reset(new VxTile);
+    parent->tile_RT.reset(new VxTile);
+
+    VxTile * lt = parent->tile_LT.get();
+    VxTile * lb = parent->tile_LB.get();
+    VxTile * rb = parent->tile_RB.get();
+    VxTile * rt = parent->tile_RT.get();
+
+    InitChildTile(parent,0,lt);
+    InitChildTile(parent,1,lb);
+    InitChildTile(parent,2,rb);
+    InitChildTile(parent,3,rt);
+
+    // edge midpoints shared between siblings
+    lb->ecef_RM = GetTileECEF(cache,lb->maxLon,lb->midLat);
+    rb->ecef_LM = lb->ecef_RM;
+
+    lb->ecef_MT = GetTileECEF(cache,lb->midLon,lb->maxLat);
+    lt->ecef_MB = lb->ecef_MT;
+
+    lt->ecef_RM = GetTileECEF(cache,lt->maxLon,lt->midLat);
+    rt->ecef_LM = lt->ecef_RM;
+
+    rb->ecef_MT = GetTileECEF(cache,rb->midLon,rb->maxLat);
+    rt->ecef_MB = rb->ecef_MT;
+
+    // outer edge midpoints
+    lb->ecef_LM = GetTileECEF(cache,lb->minLon,lb->midLat);
+    lb->ecef_MB = GetTileECEF(cache,lb->midLon,lb->minLat);
+    rb->ecef_MB = GetTileECEF(cache,rb->midLon,rb->minLat);
+    rb->ecef_RM = GetTileECEF(cache,rb->maxLon,rb->midLat);
+    lt->ecef_LM = GetTileECEF(cache,lt->minLon,lt->midLat);
+    lt->ecef_MT = GetTileECEF(cache,lt->midLon,lt->maxLat);
+    rt->ecef_MT = GetTileECEF(cache,rt->midLon,rt->maxLat);
+    rt->ecef_RM = GetTileECEF(cache,rt->maxLon,rt->midLat);
+
+    // centers
+    lt->ecef_MM = GetTileECEF(cache,lt->midLon,lt->midLat);
+    lb->ecef_MM = GetTileECEF(cache,lb->midLon,lb->midLat);
+    rb->ecef_MM = GetTileECEF(cache,rb->midLon,rb->midLat);
+    rt->ecef_MM = GetTileECEF(cache,rt->midLon,rt->midLat);
+
+    if(calc_obb) {
+        VxTile * const tiles[4] = {lt,lb,rb,rt};
+        CalcTileOBBx4(tiles);
+    }
+}
+
 std::vector<VxTile*> BuildBaseViewExtents(uint8_t const level)
 {
     std::vector<VxTile*> list_vxtiles;
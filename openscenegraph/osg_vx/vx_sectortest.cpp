@@ -8,9 +8,11 @@
 #include <memory>
 #include <numeric>
 #include <chrono>
+#include <random>
 
 //
 #include <osgnodes.hpp>
+#include <sectorutil.hpp>
 
 osg::Vec4 CalcRainbowGradient(double cVal)
 {
@@ -164,46 +166,6 @@ void CalcCandidatesForSectorLon(osg::Vec3d const &proj_n,
     }
 }
 
-struct SectorProjDesc
-{
-    SectorProjDesc(double min_lon_degs,
-                   double min_lat_degs,
-                   double max_lon_degs,
-                   double max_lat_degs) :
-        min_lon_degs(min_lon_degs),
-        min_lat_degs(min_lat_degs),
-        max_lon_degs(max_lon_degs),
-        max_lat_degs(max_lat_degs),
-        sin_min_lon(sin(min_lon_degs*K_DEG2RAD)),
-        cos_min_lon(cos(min_lon_degs*K_DEG2RAD)),
-        sin_max_lon(sin(max_lon_degs*K_DEG2RAD)),
-        cos_max_lon(cos(max_lon_degs*K_DEG2RAD)),
-        sin_min_lat(sin(min_lat_degs*K_DEG2RAD)),
-        cos_min_lat(cos(min_lat_degs*K_DEG2RAD)),
-        sin_max_lat(sin(max_lat_degs*K_DEG2RAD)),
-        cos_max_lat(cos(max_lat_degs*K_DEG2RAD))
-    {
-
-    }
-
-    double const min_lon_degs;
-    double const min_lat_degs;
-    double const max_lon_degs;
-    double const max_lat_degs;
-
-    double const sin_min_lon;
-    double const cos_min_lon;
-
-    double const sin_max_lon;
-    double const cos_max_lon;
-
-    double const sin_min_lat;
-    double const cos_min_lat;
-
-    double const sin_max_lat;
-    double const cos_max_lat;
-};
-
 void CalcProjMaxForSector(SectorProjDesc const &sector,
                           osg::Vec3d const &proj_axis, // must be normalized
                           osg::Vec3d const &proj_xsec,
@@ -530,9 +492,99 @@ osg::ref_ptr<osg::Group> BuildCamDistLines(osg::Vec3d const &eye,
     return gp;
 }
 
+// Compares CalcSectorProjMinMax against the candidate
+// search in CalcProjMinMaxForSector for random axes and
+// sectors, both from a SectorProjTable and arbitrary
+bool TestSectorProjAccuracy(size_t const num_tests)
+{
+    std::mt19937 rng(1234);
+    std::normal_distribution<double> dist_axis(0.0,1.0);
+    std::uniform_real_distribution<double> dist_unit(0.0,1.0);
+
+    uint8_t const max_level = 12;
+    SectorProjTable table(max_level);
+
+    double max_err = 0;
+    double max_err_pt = 0;
+    double time_brute_ms = 0;
+    double time_closed_ms = 0;
+
+    for(size_t i=0; i < num_tests; i++) {
+        osg::Vec3d axis(dist_axis(rng),dist_axis(rng),dist_axis(rng));
+        axis.normalize();
+
+        std::unique_ptr<SectorProjDesc> sector;
+        if(i%2 == 0) {
+            uint8_t const level = i%(max_level+1);
+            uint32_t const num_tiles_side = uint32_t(1) << level;
+            uint32_t const x = std::min(uint32_t(dist_unit(rng)*num_tiles_side),num_tiles_side-1);
+            uint32_t const y = std::min(uint32_t(dist_unit(rng)*num_tiles_side),num_tiles_side-1);
+            sector.reset(new SectorProjDesc(table.GetSector(level,x,y)));
+        }
+        else {
+            double lon0 = -180.0 + dist_unit(rng)*360.0;
+            double lon1 = -180.0 + dist_unit(rng)*360.0;
+            double lat0 = -90.0 + dist_unit(rng)*180.0;
+            double lat1 = -90.0 + dist_unit(rng)*180.0;
+            sector.reset(new SectorProjDesc(std::min(lon0,lon1),
+                                            std::min(lat0,lat1),
+                                            std::max(lon0,lon1),
+                                            std::max(lat0,lat1)));
+        }
+
+        double brute_min,brute_max;
+        PointLLA lla_min,lla_max;
+        auto t0 = std::chrono::high_resolution_clock::now();
+        if(!CalcProjMinMaxForSector(*sector,axis,brute_min,brute_max,lla_min,lla_max)) {
+            continue;
+        }
+        auto t1 = std::chrono::high_resolution_clock::now();
+
+        double proj_min,proj_max;
+        osg::Vec3d ecef_min,ecef_max;
+        CalcSectorProjMinMax(*sector,axis,proj_min,proj_max,ecef_min,ecef_max);
+        auto t2 = std::chrono::high_resolution_clock::now();
+
+        time_brute_ms += std::chrono::duration<double,std::milli>(t1-t0).count();
+        time_closed_ms += std::chrono::duration<double,std::milli>(t2-t1).count();
+
+        // brute_min is the max along the flipped axis
+        double const err = std::max(fabs(proj_max-brute_max),
+                                    fabs(proj_min+brute_min));
+
+        // the returned points should give the same values
+        double const err_pt = std::max(fabs(ecef_max*axis-proj_max),
+                                       fabs(ecef_min*axis-proj_min));
+
+        if(err > 1E-3) {
+            std::cout << "TestSectorProjAccuracy: ERROR: sector "
+                      << sector->min_lon_degs << "," << sector->min_lat_degs << ","
+                      << sector->max_lon_degs << "," << sector->max_lat_degs
+                      << " axis " << axis << " err " << err << std::endl;
+        }
+
+        max_err = std::max(max_err,err);
+        max_err_pt = std::max(max_err_pt,err_pt);
+    }
+
+    std::cout << "TestSectorProjAccuracy: " << num_tests << " sectors" << std::endl;
+    std::cout << "TestSectorProjAccuracy: max err: " << max_err << "m"
+              << ", max point err: " << max_err_pt << "m" << std::endl;
+    std::cout << "TestSectorProjAccuracy: candidates: " << time_brute_ms << "ms"
+              << ", closed form: " << time_closed_ms << "ms" << std::endl;
+
+    return (max_err < 1E-3) && (max_err_pt < 1E-3);
+}
+
 //
-int main()
+int main(int argc, char **argv)
 {
+    // vx_sectortest -test checks the sector projections
+    // against the candidate search and exits
+    if(argc > 1 && std::string(argv[1]) == "-test") {
+        return TestSectorProjAccuracy(100000) ? 0 : 1;
+    }
+
     Frustum frustum;
     Plane horizon_plane;
 
@@ -638,12 +690,13 @@ int main()
         UpdateProjIntervalSectorMap(gp_sectorprojmap.get(),eye);
 
         {
-            PointLLA lla_min,lla_max;
+            osg::Vec3d ecef_min,ecef_max;
             double proj_min,proj_max;
             osg::Vec3d axis = vpt-eye;
-            CalcProjMinMaxForSector(sector,axis,proj_min,proj_max,lla_min,lla_max);
-            UpdateFacingCircle(ConvLLAToECEF(lla_max),eye.length()/250.0,gp_sectormax);
-            UpdateFacingCircle(ConvLLAToECEF(lla_min),eye.length()/250.0,gp_sectormin);
+            axis.normalize();
+            CalcSectorProjMinMax(sector,axis,proj_min,proj_max,ecef_min,ecef_max);
+            UpdateFacingCircle(ecef_max,eye.length()/250.0,gp_sectormax);
+            UpdateFacingCircle(ecef_min,eye.length()/250.0,gp_sectormin);
         }
 
         // Update gp_root0
@@ -138,10 +138,7 @@ void GenTilesForPoly(std::vector<Edge> const &list_poly_edges,
                 lla.lat > tile->maxLat+K_GT_EPS;
 
         if(!outside) {
-            tile->tile_LT = BuildChildTile(tile,0);
-            tile->tile_LB = BuildChildTile(tile,1);
-            tile->tile_RB = BuildChildTile(tile,2);
-            tile->tile_RT = BuildChildTile(tile,3);
+            BuildChildTiles(tile);
 
             GenTilesForPoly(list_poly_edges,
                             max_level,
@@ -17,6 +17,10 @@
 double const K_GT_NEPS = -1E-6;
 double const K_GT_EPS = 1E-6;
 
+// The quadtree is rebuilt every frame; keep the ECEF
+// tile points around so they aren't converted again
+VxTileGeometryCache g_tile_geometry_cache;
+
 std::vector<Edge> GetListEdgesForPoly(std::vector<osg::Vec3d> const &poly)
 {
     std::vector<Edge> list_poly_edges;
@@ -177,10 +181,7 @@ void GenQuadTreeForGeoBounds(std::vector<std::vector<GeoBounds>> const &list_lod
     // intersects with them, subdivide the tile
     if(CheckTileOverlapsGeoBounds(list_lod_geobb[tile->level+1],tile))
     {
-        tile->tile_LT = BuildChildTile(tile.get(),0,false);
-        tile->tile_LB = BuildChildTile(tile.get(),1,false);
-        tile->tile_RB = BuildChildTile(tile.get(),2,false);
-        tile->tile_RT = BuildChildTile(tile.get(),3,false);
+        BuildChildTiles(tile.get(),false,&g_tile_geometry_cache);
 
         GenQuadTreeForGeoBounds(list_lod_geobb,tile->tile_LT);
         GenQuadTreeForGeoBounds(list_lod_geobb,tile->tile_LB);
@@ -217,10 +218,7 @@ void GenQuadTreeForGeoBounds(std::vector<GeoBounds> const &list_level_geobb,
         // Else subdivide if this tile overlaps with the
         // next level's GeoBounds
         if(CheckTileOverlapsGeoBounds(list_level_geobb[tile->level+1],tile)) {
-            tile->tile_LT = BuildChildTile(tile.get(),0,false);
-            tile->tile_LB = BuildChildTile(tile.get(),1,false);
-            tile->tile_RB = BuildChildTile(tile.get(),2,false);
-            tile->tile_RT = BuildChildTile(tile.get(),3,false);
+            BuildChildTiles(tile.get(),false,&g_tile_geometry_cache);
 
             GenQuadTreeForGeoBounds(list_level_geobb,tile->tile_LT);
             GenQuadTreeForGeoBounds(list_level_geobb,tile->tile_LB);
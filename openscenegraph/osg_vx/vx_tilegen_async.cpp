@@ -1,29 +1,21 @@
 //
 #include <map>
-#include <mutex>
-#include <atomic>
-#include <thread>
-#include <condition_variable>
 #include <chrono>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <unordered_set>
 
 //
 #include <osgnodes.hpp>
 #include <projutil.hpp>
+#include <tileloader.hpp>
 
 //
 #include <osg/Switch>
 #include <osgDB/ReadFile>
 #include <osg/Texture2D>
 
-std::mutex mutex_tile_textures;
-std::set<uint64_t> set_tile_texture_reqs;
-std::map<uint64_t,osg::ref_ptr<osg::Texture2D>> map_tile_texture_ready;
-
-// ttxl = tile texture loader
-std::atomic<bool> ttxl_run;
-std::atomic<bool> ttxl_wake;
-std::condition_variable ttxl_waitcond;
-
 uint64_t K_LIST_TWO_EXP[32] = {
     1,
     2,
@@ -63,11 +55,13 @@ struct TileData
 {
     TileData() :
         in_use(false),
+        tx_failed(false),
         gm(nullptr),
         tx(nullptr)
     {}
 
     bool in_use;
+    bool tx_failed; // cleared when the tile is evicted
     osg::ref_ptr<osg::Switch> gm;
     osg::ref_ptr<osg::Texture2D> tx;
 };
@@ -277,10 +271,77 @@ void GenGmListFromQuadTree(std::unique_ptr<XYTile> &tile,
 
 bool GetOrCreateTileGmAndTex(XYTile * tile);
 void BuildXYTileGeometry(XYTile * tile);
-void TileTextureLoaderThreadLoop();
+std::string GetTileTexturePath(uint64_t id);
+osg::ref_ptr<osg::Texture2D> CreateTileTexture(osg::Image * img);
+void CollectTileTextureReqs(XYTile const * tile,
+                            std::unordered_set<uint64_t> &set_ids);
+
+struct CameraPathPoint
+{
+    osg::Vec3d eye;
+    osg::Vec3d vpt;
+    osg::Vec3d up;
+};
 
-int main()
+// usage:
+// vx_tilegen_async [-record <path>] [-replay <path>]
+//                  [-io <n>] [-decode <n>] [-window <n>]
+// * -record saves view0's camera every frame
+// * -replay drives view0's camera from a recorded path,
+//   exits when the path ends and prints loader stats
+int main(int argc, char * argv[])
 {
+    std::string record_path;
+    std::string replay_path;
+    TileLoader::Options loader_options;
+
+    for(int i=1; i < argc; i++) {
+        if(strcmp(argv[i],"-record")==0 && i+1 < argc) {
+            record_path = argv[++i];
+        }
+        else if(strcmp(argv[i],"-replay")==0 && i+1 < argc) {
+            replay_path = argv[++i];
+        }
+        else if(strcmp(argv[i],"-io")==0 && i+1 < argc) {
+            loader_options.num_io_threads = atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i],"-decode")==0 && i+1 < argc) {
+            loader_options.num_decode_threads = atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i],"-window")==0 && i+1 < argc) {
+            loader_options.max_in_flight = atoi(argv[++i]);
+        }
+        else {
+            std::cout << "Unknown option: " << argv[i] << std::endl;
+            return -1;
+        }
+    }
+
+    // Camera path to replay (one frame per line):
+    // eye.x eye.y eye.z vpt.x vpt.y vpt.z up.x up.y up.z
+    std::vector<CameraPathPoint> list_camera_path;
+    if(!replay_path.empty()) {
+        std::ifstream ifs(replay_path.c_str());
+        CameraPathPoint pt;
+        while(ifs >> pt.eye.x() >> pt.eye.y() >> pt.eye.z()
+                  >> pt.vpt.x() >> pt.vpt.y() >> pt.vpt.z()
+                  >> pt.up.x() >> pt.up.y() >> pt.up.z())
+        {
+            list_camera_path.push_back(pt);
+        }
+
+        if(list_camera_path.empty()) {
+            std::cout << "Error loading camera path: " << replay_path << std::endl;
+            return -1;
+        }
+    }
+
+    std::ofstream ofs_record;
+    if(!record_path.empty()) {
+        ofs_record.open(record_path.c_str());
+        ofs_record.precision(17);
+    }
+
     // Celestial body geometry
     auto gp_celestial = BuildCelestialSurfaceNode();
 
@@ -313,12 +374,14 @@ int main()
         view->setSceneData( gp_root0.get() );
         view->getCamera()->setClearColor(osg::Vec4(0.1,0.1,0.1,1.0));
 
-        osg::ref_ptr<osgGA::TrackballManipulator> view_manip =
-                new osgGA::TrackballManipulator;
-        view_manip->setMinimumDistance(100);
-
-        view->setCameraManipulator(view_manip);
+        // the replayed path sets the camera directly
+        if(list_camera_path.empty()) {
+            osg::ref_ptr<osgGA::TrackballManipulator> view_manip =
+                    new osgGA::TrackballManipulator;
+            view_manip->setMinimumDistance(100);
 
+            view->setCameraManipulator(view_manip);
+        }
     }
 
     // Create view 1 (this view shows View0's frustum)
@@ -353,26 +416,20 @@ int main()
             return -1;
         }
 
-        osg::ref_ptr<osg::Texture2D> root_tx = new osg::Texture2D;
-        root_tx->setImage(root_img);
-        root_tx->setFilter(osg::Texture2D::MIN_FILTER,osg::Texture2D::LINEAR);
-        root_tx->setFilter(osg::Texture2D::MAG_FILTER,osg::Texture2D::LINEAR);
-        root_tx->setWrap(osg::Texture2D::WRAP_S,osg::Texture2D::CLAMP_TO_EDGE);
-        root_tx->setWrap(osg::Texture2D::WRAP_T,osg::Texture2D::CLAMP_TO_EDGE);
-
         auto it = map_tile_cache.find(root_tile->id);
-        it->second.tx = root_tx;
-
-        set_tile_texture_reqs.clear();
+        it->second.tx = CreateTileTexture(root_img);
     }
 
     // prevent root_tile's geometry or texture from
     // being removed from its corresponding cache
     root_tile->lock_in_cache = true;
 
-    ttxl_run = true;
-    std::cout << "###: [starting tile texture loader thread...]" << std::endl;
-    std::thread ttxl_thread(TileTextureLoaderThreadLoop);
+    std::cout << "###: [starting tile texture loader...]" << std::endl;
+    TileLoader tile_loader(GetTileTexturePath,loader_options);
+
+    size_t frame_count=0;
+    double frame_ms_total=0;
+    double frame_ms_max=0;
 
     // geometry
 
@@ -383,11 +440,22 @@ int main()
 
     while(!viewer.done())
     {
+        auto const frame_start = std::chrono::steady_clock::now();
+
         // current camera params
         osg::Camera * camera = viewer.getView(0)->getCamera();
 
         osg::Vec3d eye,vpt,up;
 
+        if(!list_camera_path.empty()) {
+            if(frame_count == list_camera_path.size()) {
+                break;
+            }
+            CameraPathPoint const &pt = list_camera_path[frame_count];
+            camera->setViewMatrixAsLookAt(pt.eye,pt.vpt,pt.up);
+        }
+        frame_count++;
+
 //        //
 //        {
 //            eye = ConvLLAToECEF(PointLLA(-46,30,400));
@@ -398,6 +466,12 @@ int main()
 
         camera->getViewMatrixAsLookAt(eye,vpt,up);
 
+        if(ofs_record.is_open()) {
+            ofs_record << eye.x() << " " << eye.y() << " " << eye.z() << " "
+                       << vpt.x() << " " << vpt.y() << " " << vpt.z() << " "
+                       << up.x() << " " << up.y() << " " << up.z() << "\n";
+        }
+
         double far_dist,near_dist;
         if(!CalcCameraNearFarDist(eye,vpt-eye,20000.0,near_dist,far_dist)) {
             far_dist=0.0;
@@ -435,48 +509,43 @@ int main()
                               list_lod_geobb);
 
 
-        // Copy over any textures that were previously
-        // requested and are now ready
-
-        mutex_tile_textures.lock();
-
-        // Copy over any textures that were previously
-        // requested and are now ready
-        for(auto tx_it = map_tile_texture_ready.begin();
-            tx_it != map_tile_texture_ready.end(); ++tx_it)
-        {
-            // Save ref to new texture
-            {
-                auto it = map_tile_cache.find(tx_it->first);
-                if(it != map_tile_cache.end()) {
-                    it->second.tx = tx_it->second;
-                }
+        // Copy over any textures that have been
+        // loaded since the last frame
+        TileLoader::Result tx_result;
+        while(tile_loader.Poll(tx_result)) {
+            // The tile may have been dropped from the
+            // cache while its texture was loading
+            auto it = map_tile_cache.find(tx_result.id);
+            if(it == map_tile_cache.end()) {
+                continue;
             }
 
-            // Remove corrosponding request
-            {
-                auto it = set_tile_texture_reqs.find(tx_it->first);
-                if(it == set_tile_texture_reqs.end()) {
-                    std::cout << "##: fatal!" << std::endl;
-                    return -1;
-                }
-
-                set_tile_texture_reqs.erase(*it);
+            if(!tx_result.image.valid()) {
+                // Don't request it again until the tile
+                // is evicted and rebuilt
+                std::cout << "Error loading image: "
+                          << GetTileTexturePath(tx_result.id) << std::endl;
+                it->second.tx_failed = true;
+                continue;
             }
+
+            it->second.tx = CreateTileTexture(tx_result.image);
         }
-        map_tile_texture_ready.clear();
 
         // Create the quad tree
         GenQuadTreeForGeoBounds(list_lod_geobb,root_tile);
 
-//        std::cout << "###: tc: " << map_tile_cache.size() << std::endl;
+        // Request textures for the tiles in view that
+        // don't have one yet and cancel requests for
+        // tiles that have left the view
+        {
+            std::unordered_set<uint64_t> set_tx_reqs;
+            CollectTileTextureReqs(root_tile.get(),set_tx_reqs);
 
-        // If there are texture requests pending,
-        // wake the loader thread
-        if(set_tile_texture_reqs.size() > 0) {
-//            std::cout << "// sz: " << set_tile_texture_reqs.size() << std::endl;
-            ttxl_wake = true;
-            ttxl_waitcond.notify_all();
+            for(auto id : set_tx_reqs) {
+                tile_loader.Request(id);
+            }
+            tile_loader.CancelAllExcept(set_tx_reqs);
         }
 
         // Check how many tiles are in use
@@ -488,9 +557,8 @@ int main()
                 in_use++;
             }
         }
-        std::cout << "#: Tiles in use: " << in_use << "/" << map_tile_cache.size() << std::endl;
-
-        mutex_tile_textures.unlock();
+        std::cout << "#: Tiles in use: " << in_use << "/" << map_tile_cache.size()
+                  << ", textures pending: " << tile_loader.GetNumPending() << std::endl;
 
         // ==================================================== //
 
@@ -619,20 +687,33 @@ int main()
             gp_root1->addChild(new_vxtiles);
         }
         viewer.frame();
-    }
 
-    // end loader thread
-    std::cout << "[ending ttxl thread...]" << std::endl;
-    ttxl_run = false;
-    ttxl_wake = true;
-    ttxl_waitcond.notify_all();
+        double const frame_ms =
+                std::chrono::duration<double,std::milli>(
+                    std::chrono::steady_clock::now()-frame_start).count();
+        frame_ms_total += frame_ms;
+        frame_ms_max = std::max(frame_ms_max,frame_ms);
+    }
 
-    ttxl_thread.join();
+    // loader stats
+    TileLoader::Stats const &stats = tile_loader.GetStats();
+    size_t const num_loaded = stats.completed+stats.failed;
+
+    std::cout << "###: frames: " << frame_count
+              << ", avg frame: " << frame_ms_total/std::max(frame_count,size_t(1)) << "ms"
+              << ", max frame: " << frame_ms_max << "ms" << std::endl;
+    std::cout << "###: requests: " << stats.requested
+              << ", duplicates: " << stats.deduplicated
+              << ", canceled: " << stats.canceled
+              << ", loaded: " << stats.completed
+              << ", failed: " << stats.failed << std::endl;
+    std::cout << "###: avg latency: " << stats.latency_ms_total/std::max(num_loaded,size_t(1)) << "ms"
+              << ", max latency: " << stats.latency_ms_max << "ms" << std::endl;
 
     return 0;
 }
 
-osg::ref_ptr<osg::Texture2D> GetTileTextureForId(uint64_t id)
+std::string GetTileTexturePath(uint64_t id)
 {
     // Level from tile id
     uint64_t level = (id & 0xFF000000000000);
@@ -646,13 +727,11 @@ osg::ref_ptr<osg::Texture2D> GetTileTextureForId(uint64_t id)
     str_path += str_level;
     str_path += std::string(".png");
 
-    osg::ref_ptr<osg::Image> img = osgDB::readImageFile(str_path);
-
-    std::cout << "Reading image: " << str_path << std::endl;
-    if(!(img.valid() && img->valid())) {
-        std::cout << "Error loading image: " << str_path << std::endl;
-    }
+    return str_path;
+}
 
+osg::ref_ptr<osg::Texture2D> CreateTileTexture(osg::Image * img)
+{
     osg::ref_ptr<osg::Texture2D> tx = new osg::Texture2D;
     tx->setImage(img);
     tx->setFilter(osg::Texture2D::MIN_FILTER,osg::Texture2D::LINEAR);
@@ -663,76 +742,27 @@ osg::ref_ptr<osg::Texture2D> GetTileTextureForId(uint64_t id)
     return tx;
 }
 
-void TileTextureLoaderThreadLoop()
+void CollectTileTextureReqs(XYTile const * tile,
+                            std::unordered_set<uint64_t> &set_ids)
 {
-    while(ttxl_run)
-    {
-        // acquire lock
-        std::unique_lock<std::mutex> locker(mutex_tile_textures);
-
-        // Wait on ttxl_waitcond
-        while(ttxl_run && (!ttxl_wake)) { // avoid spurious wake-ups
-            ttxl_waitcond.wait(locker);
-        }
-        // wake-up automatically reacquires lock
-
-        std::set<uint64_t> set_reqs = set_tile_texture_reqs;
-        locker.unlock(); // release lock
-
-        std::map<uint64_t,osg::ref_ptr<osg::Texture2D>> map_ready;
-        for(auto it = set_reqs.begin();
-            it != set_reqs.end(); ++it)
-        {
-            std::this_thread::sleep_for(std::chrono::milliseconds(250));
-
-            // Level from tile id
-            uint64_t level = ((*it) & 0xFF000000000000);
-            level = level >> 48;
-
-            std::ostringstream ss;
-            ss << level;
-            std::string str_level = ss.str();
-
-            std::string str_path = "/home/preet/Dev/misc/tile_test/";
-            str_path += str_level;
-            str_path += std::string(".png");
-
-            osg::ref_ptr<osg::Image> img = osgDB::readImageFile(str_path);
-
-//            std::cout << "Reading image: " << str_path << std::endl;
-            if(!(img.valid() && img->valid())) {
-                std::cout << "Error loading image: " << str_path << std::endl;
-                continue;
-            }
-
-            uint64_t x,y,lvl;
-            GetTileLevelXY(*it,x,y,lvl);
-            //std::cout << "load: " << lvl << ", " << x << ", " << y << std::endl;
-
-            osg::ref_ptr<osg::Texture2D> tx = new osg::Texture2D;
-            tx->setImage(img);
-            tx->setFilter(osg::Texture2D::MIN_FILTER,osg::Texture2D::LINEAR);
-            tx->setFilter(osg::Texture2D::MAG_FILTER,osg::Texture2D::LINEAR);
-            tx->setWrap(osg::Texture2D::WRAP_S,osg::Texture2D::CLAMP_TO_EDGE);
-            tx->setWrap(osg::Texture2D::WRAP_T,osg::Texture2D::CLAMP_TO_EDGE);
-
-            std::pair<uint64_t,osg::ref_ptr<osg::Texture2D>> ins_data;
-            ins_data.first = (*it);
-            ins_data.second = tx;
-            map_ready.insert(ins_data);
-        }
+    if(tile == nullptr) {
+        return;
+    }
 
-        // Copy loaded textures back to a list of ready images
-        locker.lock(); // reacquire lock
-        for(auto it = map_ready.begin();
-            it != map_ready.end(); ++it)
+    if(tile->gm != nullptr) {
+        auto it = map_tile_cache.find(tile->id);
+        if(it != map_tile_cache.end() &&
+           it->second.tx == nullptr &&
+           !it->second.tx_failed)
         {
-            map_tile_texture_ready.insert(*it);
+            set_ids.insert(tile->id);
         }
-        locker.unlock(); // release lock
-
-        ttxl_wake = false;
     }
+
+    CollectTileTextureReqs(tile->tile_LT.get(),set_ids);
+    CollectTileTextureReqs(tile->tile_LB.get(),set_ids);
+    CollectTileTextureReqs(tile->tile_RB.get(),set_ids);
+    CollectTileTextureReqs(tile->tile_RT.get(),set_ids);
 }
 
 void CalcGnomonicProjPolys(Plane const &horizon_plane,
@@ -1318,11 +1348,9 @@ bool GetOrCreateTileGmAndTex(XYTile * tile)
         }
         if(map_tile_cache.size() < K_MAX_TILE_CACHE) {
             // Build the tile geometry
+            // (the texture is requested once the tile
+            //  is in the quad tree, see CollectTileTextureReqs)
             BuildXYTileGeometry(tile);
-//            tile->tx = GetTileTextureForId(tile->id);
-
-            // Send a request to load the texture
-            set_tile_texture_reqs.insert(tile->id);
 
             // Save
             std::pair<uint64_t,TileData> ins_data;
@@ -0,0 +1,300 @@
+/*
+   Copyright (C) 2014 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef SCRATCH_GEODESY_HPP
+#define SCRATCH_GEODESY_HPP
+
+#include <cmath>
+#include <cstddef>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Header only LLA <-> ECEF conversions. Angles are in
+// degrees, distances in meters.
+//
+// Every conversion takes the reference ellipsoid as its
+// last parameter (WGS84 by default). Code that models the
+// planet as a sphere passes SPHERE_AV; a sphere is just an
+// ellipsoid with no flattening and takes cheaper paths.
+//
+// The batched conversions take separate pointers for each
+// component along with a stride (in doubles) so they can
+// work directly on arrays of any point type that stores
+// its components as doubles, ie:
+//
+//   std::vector<PointLLA> list_lla;
+//   std::vector<osg::Vec3d> list_ecef(list_lla.size());
+//   geodesy::ConvLLAToECEF(list_lla.size(),
+//                          &(list_lla[0].lon),
+//                          &(list_lla[0].lat),
+//                          &(list_lla[0].alt),
+//                          sizeof(PointLLA)/sizeof(double),
+//                          list_ecef[0].ptr(),
+//                          list_ecef[0].ptr()+1,
+//                          list_ecef[0].ptr()+2,
+//                          3);
+
+namespace geodesy
+{
+    double constexpr PI = 3.14159265358979323846;
+    double constexpr DEG2RAD = PI/180.0;
+    double constexpr RAD2DEG = 180.0/PI;
+
+    struct Ellipsoid
+    {
+        // a: semi-major axis, f: flattening
+        constexpr Ellipsoid(double a, double f) :
+            a(a),
+            f(f),
+            b(a*(1.0-f)),
+            e2(f*(2.0-f)),
+            ep2(f*(2.0-f)/((1.0-f)*(1.0-f))),
+            e4(f*(2.0-f)*f*(2.0-f)),
+            inv_a2(1.0/(a*a))
+        {}
+
+        double const a;
+        double const f;
+        double const b;      // semi-minor axis
+        double const e2;     // first eccentricity squared
+        double const ep2;    // second eccentricity squared
+        double const e4;     // e2 squared
+        double const inv_a2; // 1/(a*a)
+    };
+
+    Ellipsoid constexpr WGS84(6378137.0,1.0/298.257223563);
+
+    // Sphere with the average radius of the Earth
+    Ellipsoid constexpr SPHERE_AV(6371000.0,0.0);
+
+    static_assert(WGS84.e2 > 6.694379990e-3 && WGS84.e2 < 6.694379991e-3,
+                  "geodesy: bad WGS84 eccentricity");
+
+    static_assert(SPHERE_AV.e2 == 0.0 && SPHERE_AV.b == SPHERE_AV.a,
+                  "geodesy: sphere must have no flattening");
+
+    // ============================================================= //
+
+    inline void ConvLLAToECEF(double const lon,
+                              double const lat,
+                              double const alt,
+                              double &x,
+                              double &y,
+                              double &z,
+                              Ellipsoid const &ell=WGS84)
+    {
+        double const sin_lon = sin(lon*DEG2RAD);
+        double const cos_lon = cos(lon*DEG2RAD);
+        double const sin_lat = sin(lat*DEG2RAD);
+        double const cos_lat = cos(lat*DEG2RAD);
+
+        // v = prime vertical radius of curvature
+        double const v = ell.a/sqrt(1.0-(ell.e2*sin_lat*sin_lat));
+        x = (v+alt)*cos_lat*cos_lon;
+        y = (v+alt)*cos_lat*sin_lon;
+        z = ((1.0-ell.e2)*v + alt)*sin_lat;
+    }
+
+    // Closed form ECEF to LLA (no iteration), from:
+    // Vermeille, H. "Direct transformation from geocentric
+    // coordinates to geodetic coordinates" (2002)
+    //
+    // Exact up to rounding for any point further than about
+    // 45km from the center of the Earth
+    inline void ConvECEFToLLA(double const x,
+                              double const y,
+                              double const z,
+                              double &lon,
+                              double &lat,
+                              double &alt,
+                              Ellipsoid const &ell=WGS84)
+    {
+        double const xy2 = x*x + y*y;
+        double const xy = sqrt(xy2);
+
+        lon = atan2(y,x)*RAD2DEG;
+
+        if(ell.e2 == 0.0) {
+            lat = atan2(z,xy)*RAD2DEG;
+            alt = sqrt(xy2 + z*z) - ell.a;
+            return;
+        }
+
+        double const p = xy2*ell.inv_a2;
+        double const q = (1.0-ell.e2)*z*z*ell.inv_a2;
+        double const r = (p+q-ell.e4)/6.0;
+        double const s = ell.e4*p*q/(4.0*r*r*r);
+        double const t = cbrt(1.0 + s + sqrt(s*(2.0+s)));
+        double const u = r*(1.0 + t + 1.0/t);
+        double const v = sqrt(u*u + ell.e4*q);
+        double const w = ell.e2*(u+v-q)/(2.0*v);
+        double const k = sqrt(u+v+w*w)-w;
+        double const d = k*xy/(k+ell.e2);
+        double const dz = sqrt(d*d + z*z);
+
+        lat = 2.0*atan2(z,d+dz)*RAD2DEG;
+        alt = (k+ell.e2-1.0)*dz/k;
+    }
+
+    // ============================================================= //
+
+    namespace detail
+    {
+#if defined(__SSE2__)
+        // sin and cos of two doubles at once, using the
+        // polynomials and range reduction from Cephes
+        // (within an ulp or two of libm for |x| < 1E8)
+        inline void SinCos(__m128d x, __m128d &s, __m128d &c)
+        {
+            __m128d const sign_bit = _mm_set1_pd(-0.0);
+            __m128d const x_sign = _mm_and_pd(x,sign_bit);
+            x = _mm_andnot_pd(sign_bit,x);
+
+            // j: octant of x rounded up to an even number
+            __m128i j = _mm_cvttpd_epi32(_mm_mul_pd(x,_mm_set1_pd(4.0/PI)));
+            j = _mm_and_si128(_mm_add_epi32(j,_mm_set1_epi32(1)),
+                              _mm_set1_epi32(~1));
+            __m128d const y = _mm_cvtepi32_pd(j);
+
+            // z = x - y*(pi/4) in extended precision
+            __m128d z = _mm_sub_pd(x,_mm_mul_pd(y,_mm_set1_pd(7.85398125648498535156E-1)));
+            z = _mm_sub_pd(z,_mm_mul_pd(y,_mm_set1_pd(3.77489470793079817668E-8)));
+            z = _mm_sub_pd(z,_mm_mul_pd(y,_mm_set1_pd(2.69515142907905952645E-15)));
+            __m128d const zz = _mm_mul_pd(z,z);
+
+            // sin(z) for |z| <= pi/4
+            __m128d ps = _mm_set1_pd(1.58962301576546568060E-10);
+            ps = _mm_add_pd(_mm_mul_pd(ps,zz),_mm_set1_pd(-2.50507477628578072866E-8));
+            ps = _mm_add_pd(_mm_mul_pd(ps,zz),_mm_set1_pd(2.75573136213857245213E-6));
+            ps = _mm_add_pd(_mm_mul_pd(ps,zz),_mm_set1_pd(-1.98412698295895385996E-4));
+            ps = _mm_add_pd(_mm_mul_pd(ps,zz),_mm_set1_pd(8.33333333332211858878E-3));
+            ps = _mm_add_pd(_mm_mul_pd(ps,zz),_mm_set1_pd(-1.66666666666666307295E-1));
+            ps = _mm_add_pd(z,_mm_mul_pd(_mm_mul_pd(z,zz),ps));
+
+            // cos(z) for |z| <= pi/4
+            __m128d pc = _mm_set1_pd(-1.13585365213876817300E-11);
+            pc = _mm_add_pd(_mm_mul_pd(pc,zz),_mm_set1_pd(2.08757008419747316778E-9));
+            pc = _mm_add_pd(_mm_mul_pd(pc,zz),_mm_set1_pd(-2.75573141792967388112E-7));
+            pc = _mm_add_pd(_mm_mul_pd(pc,zz),_mm_set1_pd(2.48015872888517045348E-5));
+            pc = _mm_add_pd(_mm_mul_pd(pc,zz),_mm_set1_pd(-1.38888888888730564116E-3));
+            pc = _mm_add_pd(_mm_mul_pd(pc,zz),_mm_set1_pd(4.16666666666665929218E-2));
+            pc = _mm_add_pd(_mm_sub_pd(_mm_set1_pd(1.0),_mm_mul_pd(zz,_mm_set1_pd(0.5))),
+                            _mm_mul_pd(_mm_mul_pd(zz,zz),pc));
+
+            // per lane masks for bits 1 and 2 of j
+            __m128i const jj = _mm_shuffle_epi32(j,_MM_SHUFFLE(1,1,0,0));
+            __m128d const j_bit2 = _mm_castsi128_pd(
+                        _mm_cmpeq_epi32(_mm_and_si128(jj,_mm_set1_epi32(2)),
+                                        _mm_set1_epi32(2)));
+            __m128d const j_bit4 = _mm_castsi128_pd(
+                        _mm_cmpeq_epi32(_mm_and_si128(jj,_mm_set1_epi32(4)),
+                                        _mm_set1_epi32(4)));
+
+            // octants 2 and 6 swap sin and cos
+            s = _mm_or_pd(_mm_and_pd(j_bit2,pc),_mm_andnot_pd(j_bit2,ps));
+            c = _mm_or_pd(_mm_and_pd(j_bit2,ps),_mm_andnot_pd(j_bit2,pc));
+
+            // sin is negative in octants 4 and 6 (and odd),
+            // cos is negative in octants 2 and 4
+            s = _mm_xor_pd(s,_mm_xor_pd(_mm_and_pd(j_bit4,sign_bit),x_sign));
+            c = _mm_xor_pd(c,_mm_and_pd(_mm_xor_pd(j_bit2,j_bit4),sign_bit));
+        }
+#endif
+    }
+
+    // Converts count points; lon/lat/alt are read every
+    // lla_stride doubles and x/y/z are written every
+    // ecef_stride doubles
+    inline void ConvLLAToECEF(size_t const count,
+                              double const * lon,
+                              double const * lat,
+                              double const * alt,
+                              size_t const lla_stride,
+                              double * x,
+                              double * y,
+                              double * z,
+                              size_t const ecef_stride,
+                              Ellipsoid const &ell=WGS84)
+    {
+        size_t i=0;
+
+#if defined(__SSE2__)
+        __m128d const deg2rad = _mm_set1_pd(DEG2RAD);
+        __m128d const one = _mm_set1_pd(1.0);
+        __m128d const ell_a = _mm_set1_pd(ell.a);
+        __m128d const ell_e2 = _mm_set1_pd(ell.e2);
+        __m128d const ell_1_e2 = _mm_set1_pd(1.0-ell.e2);
+
+        for(; i+1 < count; i+=2) {
+            size_t const i0 = i*lla_stride;
+            size_t const i1 = i0+lla_stride;
+
+            __m128d const v_lon = _mm_mul_pd(_mm_set_pd(lon[i1],lon[i0]),deg2rad);
+            __m128d const v_lat = _mm_mul_pd(_mm_set_pd(lat[i1],lat[i0]),deg2rad);
+            __m128d const v_alt = _mm_set_pd(alt[i1],alt[i0]);
+
+            __m128d sin_lon,cos_lon,sin_lat,cos_lat;
+            detail::SinCos(v_lon,sin_lon,cos_lon);
+            detail::SinCos(v_lat,sin_lat,cos_lat);
+
+            __m128d const v = _mm_div_pd(ell_a,_mm_sqrt_pd(
+                _mm_sub_pd(one,_mm_mul_pd(ell_e2,_mm_mul_pd(sin_lat,sin_lat)))));
+
+            __m128d const r = _mm_mul_pd(_mm_add_pd(v,v_alt),cos_lat);
+            __m128d const v_x = _mm_mul_pd(r,cos_lon);
+            __m128d const v_y = _mm_mul_pd(r,sin_lon);
+            __m128d const v_z = _mm_mul_pd(_mm_add_pd(_mm_mul_pd(ell_1_e2,v),v_alt),sin_lat);
+
+            size_t const k0 = i*ecef_stride;
+            size_t const k1 = k0+ecef_stride;
+            _mm_storel_pd(x+k0,v_x); _mm_storeh_pd(x+k1,v_x);
+            _mm_storel_pd(y+k0,v_y); _mm_storeh_pd(y+k1,v_y);
+            _mm_storel_pd(z+k0,v_z); _mm_storeh_pd(z+k1,v_z);
+        }
+#endif
+
+        for(; i < count; i++) {
+            size_t const k = i*ecef_stride;
+            size_t const j = i*lla_stride;
+            ConvLLAToECEF(lon[j],lat[j],alt[j],x[k],y[k],z[k],ell);
+        }
+    }
+
+    // Converts count points; x/y/z are read every
+    // ecef_stride doubles and lon/lat/alt are written
+    // every lla_stride doubles
+    inline void ConvECEFToLLA(size_t const count,
+                              double const * x,
+                              double const * y,
+                              double const * z,
+                              size_t const ecef_stride,
+                              double * lon,
+                              double * lat,
+                              double * alt,
+                              size_t const lla_stride,
+                              Ellipsoid const &ell=WGS84)
+    {
+        for(size_t i=0; i < count; i++) {
+            size_t const k = i*ecef_stride;
+            size_t const j = i*lla_stride;
+            ConvECEFToLLA(x[k],y[k],z[k],lon[j],lat[j],alt[j],ell);
+        }
+    }
+}
+
+#endif // SCRATCH_GEODESY_HPP
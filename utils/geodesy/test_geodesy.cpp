@@ -0,0 +1,202 @@
+/*
+   Copyright (C) 2014 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// stl
+#include <vector>
+#include <random>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+
+// geodesy
+#include <geodesy.hpp>
+
+struct PointLLA
+{
+    double lon;
+    double lat;
+    double alt;
+};
+
+struct PointECEF
+{
+    double x;
+    double y;
+    double z;
+};
+
+// Iterative ECEF to LLA used as the reference for the
+// closed form conversion (converges to rounding error)
+void ConvECEFToLLAIterative(PointECEF const &ecef,
+                            PointLLA &lla,
+                            geodesy::Ellipsoid const &ell)
+{
+    double const p = sqrt(ecef.x*ecef.x + ecef.y*ecef.y);
+    double lat = atan2(ecef.z,p*(1.0-ell.e2));
+    double alt = 0;
+    for(size_t i=0; i < 10; i++) {
+        double const sin_lat = sin(lat);
+        double const v = ell.a/sqrt(1.0-ell.e2*sin_lat*sin_lat);
+        alt = (fabs(lat) < 0.78) ?
+                    (p/cos(lat))-v :
+                    (ecef.z/sin_lat)-(1.0-ell.e2)*v;
+        lat = atan2(ecef.z,p*(1.0-ell.e2*v/(v+alt)));
+    }
+
+    lla.lon = atan2(ecef.y,ecef.x)*geodesy::RAD2DEG;
+    lla.lat = lat*geodesy::RAD2DEG;
+    lla.alt = alt;
+}
+
+std::vector<PointLLA> BuildRandomPoints(size_t count)
+{
+    std::mt19937 rng(4321);
+    std::uniform_real_distribution<double> dist_lon(-180.0,180.0);
+    std::uniform_real_distribution<double> dist_lat(-90.0,90.0);
+    std::uniform_real_distribution<double> dist_alt(-10000.0,100000.0);
+
+    std::vector<PointLLA> list_lla(count);
+    for(auto &lla : list_lla) {
+        lla.lon = dist_lon(rng);
+        lla.lat = dist_lat(rng);
+        lla.alt = dist_alt(rng);
+    }
+
+    // exact edge cases
+    list_lla[0] = PointLLA{0,90,0};
+    list_lla[1] = PointLLA{0,-90,0};
+    list_lla[2] = PointLLA{180,0,0};
+    list_lla[3] = PointLLA{-180,45,0};
+
+    return list_lla;
+}
+
+double Dist(PointECEF const &a, PointECEF const &b)
+{
+    double const dx = a.x-b.x;
+    double const dy = a.y-b.y;
+    double const dz = a.z-b.z;
+    return sqrt(dx*dx + dy*dy + dz*dz);
+}
+
+bool TestEllipsoid(geodesy::Ellipsoid const &ell,
+                   std::string const &name,
+                   std::vector<PointLLA> const &list_lla)
+{
+    size_t const count = list_lla.size();
+
+    // scalar LLA -> ECEF
+    std::vector<PointECEF> list_ecef(count);
+    auto t0 = std::chrono::high_resolution_clock::now();
+    for(size_t i=0; i < count; i++) {
+        geodesy::ConvLLAToECEF(list_lla[i].lon,
+                               list_lla[i].lat,
+                               list_lla[i].alt,
+                               list_ecef[i].x,
+                               list_ecef[i].y,
+                               list_ecef[i].z,
+                               ell);
+    }
+    auto t1 = std::chrono::high_resolution_clock::now();
+
+    // batched LLA -> ECEF
+    std::vector<PointECEF> list_ecef_batch(count);
+    geodesy::ConvLLAToECEF(count,
+                           &(list_lla[0].lon),
+                           &(list_lla[0].lat),
+                           &(list_lla[0].alt),
+                           3,
+                           &(list_ecef_batch[0].x),
+                           &(list_ecef_batch[0].y),
+                           &(list_ecef_batch[0].z),
+                           3,
+                           ell);
+    auto t2 = std::chrono::high_resolution_clock::now();
+
+    // batched ECEF -> LLA
+    std::vector<PointLLA> list_lla_rt(count);
+    geodesy::ConvECEFToLLA(count,
+                           &(list_ecef[0].x),
+                           &(list_ecef[0].y),
+                           &(list_ecef[0].z),
+                           3,
+                           &(list_lla_rt[0].lon),
+                           &(list_lla_rt[0].lat),
+                           &(list_lla_rt[0].alt),
+                           3,
+                           ell);
+    auto t3 = std::chrono::high_resolution_clock::now();
+
+    double max_err_batch = 0;
+    double max_err_lat = 0;
+    double max_err_alt = 0;
+    double max_err_ref_lat = 0;
+    double max_err_ref_alt = 0;
+
+    for(size_t i=0; i < count; i++) {
+        max_err_batch = std::max(max_err_batch,
+                                 Dist(list_ecef[i],list_ecef_batch[i]));
+
+        max_err_lat = std::max(max_err_lat,
+                               fabs(list_lla_rt[i].lat-list_lla[i].lat));
+
+        max_err_alt = std::max(max_err_alt,
+                               fabs(list_lla_rt[i].alt-list_lla[i].alt));
+
+        PointLLA lla_ref;
+        ConvECEFToLLAIterative(list_ecef[i],lla_ref,ell);
+
+        max_err_ref_lat = std::max(max_err_ref_lat,
+                                   fabs(list_lla_rt[i].lat-lla_ref.lat));
+
+        max_err_ref_alt = std::max(max_err_ref_alt,
+                                   fabs(list_lla_rt[i].alt-lla_ref.alt));
+    }
+
+    auto ms = [](std::chrono::high_resolution_clock::time_point a,
+                 std::chrono::high_resolution_clock::time_point b) {
+        return std::chrono::duration<double,std::milli>(b-a).count();
+    };
+
+    std::cout << "#: " << name << ": " << count << " points" << std::endl;
+    std::cout << "#:  lla->ecef: scalar " << ms(t0,t1) << "ms, "
+              << "batched " << ms(t1,t2) << "ms, "
+              << "max diff " << max_err_batch << "m" << std::endl;
+    std::cout << "#:  ecef->lla: batched " << ms(t2,t3) << "ms" << std::endl;
+    std::cout << "#:  round trip: max lat err " << max_err_lat << "deg, "
+              << "max alt err " << max_err_alt << "m" << std::endl;
+    std::cout << "#:  vs iterative: max lat err " << max_err_ref_lat << "deg, "
+              << "max alt err " << max_err_ref_alt << "m" << std::endl;
+
+    // 1E-9 degrees is about 0.1mm on the surface
+    return (max_err_batch < 1E-6) &&
+           (max_err_lat < 1E-9) &&
+           (max_err_alt < 1E-6) &&
+           (max_err_ref_lat < 1E-9) &&
+           (max_err_ref_alt < 1E-6);
+}
+
+int main()
+{
+    std::vector<PointLLA> list_lla = BuildRandomPoints(1000000);
+
+    bool ok = true;
+    ok = TestEllipsoid(geodesy::WGS84,"WGS84",list_lla) && ok;
+    ok = TestEllipsoid(geodesy::SPHERE_AV,"SPHERE_AV",list_lla) && ok;
+
+    std::cout << "#: " << (ok ? "PASS" : "FAIL") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,178 @@
+/*
+   Copyright (C) 2014 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// stl
+#include <vector>
+#include <random>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+
+// vxweld
+#include <vxweld.hpp>
+
+struct Vec2
+{
+    double x;
+    double y;
+};
+
+// Triangle soup over a jittered grid where every grid
+// point is shared by up to six triangles, like the output
+// of a triangulation before its vertices are welded
+std::vector<Vec2> BuildTriangleSoup(size_t grid_size)
+{
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<double> dist(-0.25,0.25);
+
+    std::vector<Vec2> list_grid;
+    for(size_t i=0; i <= grid_size; i++) {
+        for(size_t j=0; j <= grid_size; j++) {
+            list_grid.push_back(Vec2{j+dist(rng),i+dist(rng)});
+        }
+    }
+
+    size_t const row = grid_size+1;
+    std::vector<Vec2> list_soup;
+    for(size_t i=0; i < grid_size; i++) {
+        for(size_t j=0; j < grid_size; j++) {
+            size_t const v = i*row+j;
+            list_soup.push_back(list_grid[v]);
+            list_soup.push_back(list_grid[v+1]);
+            list_soup.push_back(list_grid[v+row+1]);
+
+            list_soup.push_back(list_grid[v]);
+            list_soup.push_back(list_grid[v+row+1]);
+            list_soup.push_back(list_grid[v+row]);
+        }
+    }
+    return list_soup;
+}
+
+// The linear scan vxweld replaces
+void WeldLinear(std::vector<Vec2> const &list_soup,
+                std::vector<Vec2> &list_vx,
+                std::vector<size_t> &list_ix)
+{
+    for(auto const &vx : list_soup) {
+        size_t i=0;
+        for(; i < list_vx.size(); i++) {
+            if(vx.x == list_vx[i].x && vx.y == list_vx[i].y) {
+                break;
+            }
+        }
+        if(i == list_vx.size()) {
+            list_vx.push_back(vx);
+        }
+        list_ix.push_back(i);
+    }
+}
+
+bool TestExact(size_t grid_size)
+{
+    std::vector<Vec2> list_soup = BuildTriangleSoup(grid_size);
+
+    auto t0 = std::chrono::high_resolution_clock::now();
+    std::vector<Vec2> list_vx;
+    std::vector<size_t> list_ix;
+    WeldLinear(list_soup,list_vx,list_ix);
+
+    auto t1 = std::chrono::high_resolution_clock::now();
+    vxweld::Welder<2> welder;
+    welder.Reserve(list_soup.size()/3);
+    std::vector<size_t> list_weld_ix;
+    for(auto const &vx : list_soup) {
+        double const v[2] = {vx.x,vx.y};
+        list_weld_ix.push_back(welder.Add(v));
+    }
+    auto t2 = std::chrono::high_resolution_clock::now();
+
+    // both add vertices in the order they're first seen
+    // so the results should be identical
+    bool ok = (welder.GetNumVertices() == list_vx.size()) &&
+              (list_weld_ix == list_ix);
+
+    for(size_t i=0; ok && i < list_vx.size(); i++) {
+        double const * v = welder.GetVertex(i);
+        ok = (v[0] == list_vx[i].x) && (v[1] == list_vx[i].y);
+    }
+
+    auto ms = [](std::chrono::high_resolution_clock::time_point a,
+                 std::chrono::high_resolution_clock::time_point b) {
+        return std::chrono::duration<double,std::milli>(b-a).count();
+    };
+
+    std::cout << "#: exact: " << list_soup.size() << " -> "
+              << welder.GetNumVertices() << " vertices, "
+              << "linear " << ms(t0,t1) << "ms, "
+              << "hashed " << ms(t1,t2) << "ms" << std::endl;
+
+    return ok;
+}
+
+bool TestEpsilon(size_t count, double epsilon)
+{
+    std::mt19937 rng(4321);
+    std::uniform_real_distribution<double> dist(0.0,1.0);
+
+    std::vector<double> list_pts;
+    for(size_t i=0; i < count*3; i++) {
+        list_pts.push_back(dist(rng));
+    }
+
+    vxweld::Welder<3> welder(epsilon);
+    std::vector<uint32_t> list_ix;
+    for(size_t i=0; i < count; i++) {
+        list_ix.push_back(welder.Add(&(list_pts[i*3])));
+    }
+
+    auto within = [epsilon](double const * a, double const * b) {
+        return (std::fabs(a[0]-b[0]) <= epsilon) &&
+               (std::fabs(a[1]-b[1]) <= epsilon) &&
+               (std::fabs(a[2]-b[2]) <= epsilon);
+    };
+
+    // every point is within epsilon of the vertex it
+    // was welded to
+    bool ok = true;
+    for(size_t i=0; i < count; i++) {
+        ok = ok && within(&(list_pts[i*3]),welder.GetVertex(list_ix[i]));
+    }
+
+    // and no two welded vertices are within epsilon
+    size_t const num_vx = welder.GetNumVertices();
+    for(size_t i=0; ok && i < num_vx; i++) {
+        for(size_t j=i+1; ok && j < num_vx; j++) {
+            ok = !within(welder.GetVertex(i),welder.GetVertex(j));
+        }
+    }
+
+    std::cout << "#: epsilon " << epsilon << ": " << count << " -> "
+              << num_vx << " vertices" << std::endl;
+
+    return ok;
+}
+
+int main()
+{
+    bool ok = true;
+    ok = TestExact(100) && ok;
+    ok = TestEpsilon(20000,0.01) && ok;
+    ok = TestEpsilon(20000,0.05) && ok;
+
+    std::cout << "#: " << (ok ? "PASS" : "FAIL") << std::endl;
+    return ok ? 0 : 1;
+}
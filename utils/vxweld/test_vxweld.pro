@@ -0,0 +1,10 @@
+TEMPLATE    = app
+TARGET      = runme
+CONFIG      -= qt
+
+INCLUDEPATH += $${PWD}
+
+HEADERS += vxweld.hpp
+SOURCES += test_vxweld.cpp
+
+QMAKE_CXXFLAGS += -std=c++11
@@ -0,0 +1,208 @@
+/*
+   Copyright (C) 2014 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef SCRATCH_VXWELD_HPP
+#define SCRATCH_VXWELD_HPP
+
+#include <array>
+#include <cmath>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <unordered_map>
+
+// Header only vertex welding. Vertices are added one at a
+// time and each Add returns the index of the (possibly
+// existing) vertex it was welded to, so an index buffer
+// can be built while the vertices are being generated:
+//
+//   vxweld::Welder<2> welder;
+//   for(auto const &tri_vx : list_tri_vx) {
+//       double const vx[2] = {tri_vx.x,tri_vx.y};
+//       list_ix.push_back(welder.Add(vx));
+//   }
+//   // welder.GetVertices() has the unique vertices
+//
+// Lookups go through a hash map so welding n vertices
+// is O(n), unlike comparing each vertex against the list
+// of vertices seen so far.
+//
+// With an epsilon of zero only vertices that are exactly
+// equal are welded. Otherwise space is split into cells
+// epsilon wide and a vertex is welded to the first vertex
+// found within epsilon (on every axis) in its own cell
+// or the cells around it.
+
+namespace vxweld
+{
+    template<size_t Dims>
+    class Welder
+    {
+    public:
+        Welder(double epsilon=0.0) :
+            m_epsilon(epsilon),
+            m_inv_epsilon((epsilon > 0.0) ? 1.0/epsilon : 0.0)
+        {
+            static_assert(Dims > 0 && Dims <= 3,
+                          "vxweld: Dims must be 1, 2 or 3");
+        }
+
+        void Reserve(size_t num_vx)
+        {
+            m_list_vx.reserve(num_vx*Dims);
+            m_lkup_cells.reserve(num_vx);
+        }
+
+        void Clear()
+        {
+            m_list_vx.clear();
+            m_lkup_cells.clear();
+        }
+
+        // Welds vx (Dims components) and returns the
+        // index of the vertex it was welded to
+        uint32_t Add(double const * vx)
+        {
+            Cell cell;
+            if(m_epsilon > 0.0) {
+                for(size_t i=0; i < Dims; i++) {
+                    cell[i] = static_cast<int64_t>(
+                                std::floor(vx[i]*m_inv_epsilon));
+                }
+
+                // any vertex in the same cell is within
+                // epsilon so only the other cells need
+                // to be checked by distance
+                auto it = m_lkup_cells.find(cell);
+                if(it != m_lkup_cells.end()) {
+                    return it->second;
+                }
+
+                uint32_t idx;
+                if(findNearbyVertex(vx,cell,idx)) {
+                    return idx;
+                }
+            }
+            else {
+                for(size_t i=0; i < Dims; i++) {
+                    // treat -0.0 and 0.0 as the same
+                    double const c = (vx[i] == 0.0) ? 0.0 : vx[i];
+                    std::memcpy(&(cell[i]),&c,sizeof(double));
+                }
+
+                auto it = m_lkup_cells.find(cell);
+                if(it != m_lkup_cells.end()) {
+                    return it->second;
+                }
+            }
+
+            uint32_t const idx = GetNumVertices();
+            m_list_vx.insert(m_list_vx.end(),vx,vx+Dims);
+            m_lkup_cells.emplace(cell,idx);
+            return idx;
+        }
+
+        size_t GetNumVertices() const
+        {
+            return m_list_vx.size()/Dims;
+        }
+
+        double const * GetVertex(size_t idx) const
+        {
+            return &(m_list_vx[idx*Dims]);
+        }
+
+        // The unique vertices, Dims components each
+        std::vector<double> const & GetVertices() const
+        {
+            return m_list_vx;
+        }
+
+    private:
+        typedef std::array<int64_t,Dims> Cell;
+
+        struct CellHash
+        {
+            size_t operator()(Cell const &cell) const
+            {
+                uint64_t h = 0x9E3779B97F4A7C15ull;
+                for(size_t i=0; i < Dims; i++) {
+                    // splitmix64 finalizer per component
+                    uint64_t k = static_cast<uint64_t>(cell[i]) + h;
+                    k = (k ^ (k >> 30)) * 0xBF58476D1CE4E5B9ull;
+                    k = (k ^ (k >> 27)) * 0x94D049BB133111EBull;
+                    h ^= k ^ (k >> 31);
+                }
+                return static_cast<size_t>(h);
+            }
+        };
+
+        bool findNearbyVertex(double const * vx,
+                              Cell const &cell,
+                              uint32_t &idx) const
+        {
+            // walk the 3^Dims block of cells around
+            // cell (the center was already checked)
+            size_t num_cells = 1;
+            for(size_t i=0; i < Dims; i++) {
+                num_cells *= 3;
+            }
+
+            for(size_t n=0; n < num_cells; n++) {
+                Cell nb_cell;
+                size_t m = n;
+                bool center = true;
+                for(size_t i=0; i < Dims; i++) {
+                    int64_t const d = static_cast<int64_t>(m%3)-1;
+                    nb_cell[i] = cell[i]+d;
+                    center = center && (d == 0);
+                    m /= 3;
+                }
+                if(center) {
+                    continue;
+                }
+
+                auto it = m_lkup_cells.find(nb_cell);
+                if(it == m_lkup_cells.end()) {
+                    continue;
+                }
+
+                double const * nb_vx = GetVertex(it->second);
+                bool within = true;
+                for(size_t i=0; i < Dims; i++) {
+                    if(std::fabs(nb_vx[i]-vx[i]) > m_epsilon) {
+                        within = false;
+                        break;
+                    }
+                }
+                if(within) {
+                    idx = it->second;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        double const m_epsilon;
+        double const m_inv_epsilon;
+
+        std::vector<double> m_list_vx;
+        std::unordered_map<Cell,uint32_t,CellHash> m_lkup_cells;
+    };
+}
+
+#endif // SCRATCH_VXWELD_HPP